@@ -509,6 +509,8 @@ int main(int argc, char *argv[]) {
     if (conf->log_time)
         pa_log_set_flags(PA_LOG_PRINT_TIME, PA_LOG_SET);
     pa_log_set_show_backtrace(conf->log_backtrace);
+    if (conf->log_async)
+        pa_log_set_async(true);
 
 #ifdef HAVE_DBUS
     /* conf->system_instance and conf->local_server_type control almost the
@@ -1240,6 +1242,9 @@ finish:
     if (ltdl_init)
         pa_ltdl_done();
 
+    /* Write out whatever is still pending */
+    pa_log_set_async(false);
+
 #ifdef HAVE_DBUS
     dbus_shutdown();
 #endif
@@ -22,6 +22,7 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
 #include <sys/types.h>
 #include <alsa/asoundlib.h>
 #include <math.h>
@@ -44,6 +45,7 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/conf-parser.h>
 #include <pulsecore/strbuf.h>
+#include <pulsecore/idxset.h>
 
 #include "alsa-mixer.h"
 #include "alsa-util.h"
@@ -4336,9 +4338,11 @@ static void profile_set_set_availability_groups(pa_alsa_profile_set *ps) {
     pa_dynarray_free(paths);
 }
 
+/* If the mapping's pcm is not open, which is the case when using cached probe
+ * results, the mixer of alsa_card_index is used. */
 static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
                                 pa_alsa_direction_t direction, pa_hashmap *used_paths,
-                                pa_hashmap *mixers) {
+                                pa_hashmap *mixers, int alsa_card_index) {
 
     pa_alsa_path *p;
     void *state;
@@ -4361,9 +4365,13 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
+    if (pcm_handle)
+        mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    else {
+        pa_assert(alsa_card_index >= 0);
+        mixer_handle = pa_alsa_open_mixer(mixers, alsa_card_index, true);
+    }
 
-    mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
     if (!mixer_handle) {
         /* Cannot open mixer, remove all entries */
         pa_hashmap_remove_all(ps->paths);
@@ -4943,6 +4951,50 @@ static int add_profiles_to_probe(
     return i;
 }
 
+/* The cached probe results assume that all mappings live on the card being
+ * probed, which is normally the case. If a profile set points somewhere
+ * else, the results are not cached. */
+static void mapping_check_card(pa_alsa_profile_set *ps, pa_alsa_mapping *mapping, snd_pcm_t *pcm, int alsa_card_index) {
+    snd_pcm_info_t* pcm_info;
+    snd_pcm_info_alloca(&pcm_info);
+
+    if (!ps->probe_cacheable)
+        return;
+
+    if (snd_pcm_info(pcm, pcm_info) < 0 || snd_pcm_info_get_card(pcm_info) != alsa_card_index) {
+        pa_log_debug("Mapping %s is not on card %i, not caching probe results", mapping->name, alsa_card_index);
+        ps->probe_cacheable = false;
+    }
+}
+
+/* A mapping that could not be opened because its device was in use might
+ * work the next time, so the results are not cached then. The error of the
+ * open is not passed up, so the device is opened once more to find out. */
+static void mapping_check_busy(pa_alsa_profile_set *ps, pa_alsa_mapping *mapping, const char *dev_id, int mode) {
+    snd_pcm_t *pcm;
+    char **i;
+    int err;
+
+    if (ps->probe_busy)
+        return;
+
+    for (i = mapping->device_strings; *i; i++) {
+        char *d;
+
+        d = pa_replace(*i, "%f", dev_id);
+        err = snd_pcm_open(&pcm, d, mode, SND_PCM_NONBLOCK);
+        pa_xfree(d);
+
+        if (err >= 0)
+            snd_pcm_close(pcm);
+        else if (err == -EBUSY || err == -EAGAIN) {
+            pa_log_debug("Mapping %s is busy, not caching probe results", mapping->name);
+            ps->probe_busy = true;
+            return;
+        }
+    }
+}
+
 static void mapping_query_hw_device(pa_alsa_mapping *mapping, snd_pcm_t *pcm) {
     int r;
     snd_pcm_info_t* pcm_info;
@@ -4976,6 +5028,7 @@ void pa_alsa_profile_set_probe(
     pa_alsa_profile **pp, **probe_order;
     pa_alsa_mapping *m;
     pa_hashmap *broken_inputs, *broken_outputs, *used_paths;
+    int alsa_card_index;
 
     pa_assert(ps);
     pa_assert(dev_id);
@@ -4984,6 +5037,10 @@ void pa_alsa_profile_set_probe(
     if (ps->probed)
         return;
 
+    alsa_card_index = snd_card_get_index(dev_id);
+    ps->probe_cacheable = alsa_card_index >= 0;
+    ps->probe_busy = false;
+
     broken_inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     broken_outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
@@ -5046,6 +5103,7 @@ void pa_alsa_profile_set_probe(
                                                            default_n_fragments,
                                                            default_fragment_size_msec))) {
                         p->supported = false;
+                        mapping_check_busy(ps, m, dev_id, SND_PCM_STREAM_PLAYBACK);
                         if (pa_idxset_size(p->output_mappings) == 1 &&
                             ((!p->input_mappings) || pa_idxset_size(p->input_mappings) == 0)) {
                             pa_log_debug("Caching failure to open output:%s", m->name);
@@ -5054,6 +5112,8 @@ void pa_alsa_profile_set_probe(
                         break;
                     }
 
+                    mapping_check_card(ps, m, m->output_pcm, alsa_card_index);
+
                     if (m->hw_device_index < 0)
                         mapping_query_hw_device(m, m->output_pcm);
                 }
@@ -5070,6 +5130,7 @@ void pa_alsa_profile_set_probe(
                                                           default_n_fragments,
                                                           default_fragment_size_msec))) {
                         p->supported = false;
+                        mapping_check_busy(ps, m, dev_id, SND_PCM_STREAM_CAPTURE);
                         if (pa_idxset_size(p->input_mappings) == 1 &&
                             ((!p->output_mappings) || pa_idxset_size(p->output_mappings) == 0)) {
                             pa_log_debug("Caching failure to open input:%s", m->name);
@@ -5078,6 +5139,8 @@ void pa_alsa_profile_set_probe(
                         break;
                     }
 
+                    mapping_check_card(ps, m, m->input_pcm, alsa_card_index);
+
                     if (m->hw_device_index < 0)
                         mapping_query_hw_device(m, m->input_pcm);
                 }
@@ -5094,14 +5157,14 @@ void pa_alsa_profile_set_probe(
             PA_IDXSET_FOREACH(m, p->output_mappings, idx)
                 if (m->output_pcm) {
                     found_output |= !p->fallback_output;
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, -1);
                 }
 
         if (p->input_mappings)
             PA_IDXSET_FOREACH(m, p->input_mappings, idx)
                 if (m->input_pcm) {
                     found_input |= !p->fallback_input;
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, -1);
                 }
     }
 
@@ -5122,6 +5185,241 @@ void pa_alsa_profile_set_probe(
     ps->probed = true;
 }
 
+#define PROBE_CACHE_VERSION 1
+
+char *pa_alsa_profile_set_probe_key(
+        pa_alsa_profile_set *ps,
+        int alsa_card_index,
+        const pa_sample_spec *ss,
+        unsigned default_n_fragments,
+        unsigned default_fragment_size_msec) {
+
+    snd_ctl_t *ctl;
+    snd_ctl_card_info_t *info;
+    snd_ctl_elem_list_t *list;
+    pa_alsa_mapping *m;
+    pa_alsa_profile *p;
+    pa_strbuf *sb;
+    char *dev, *t, *key = NULL;
+    unsigned n_elems, elem_hash, ps_hash, i;
+    void *state;
+    char buf[PA_MAX(PA_CHANNEL_MAP_SNPRINT_MAX, PA_SAMPLE_SPEC_SNPRINT_MAX)];
+    int err;
+
+    pa_assert(ps);
+    pa_assert(ss);
+
+    snd_ctl_card_info_alloca(&info);
+    snd_ctl_elem_list_alloca(&list);
+
+    dev = pa_sprintf_malloc("hw:%i", alsa_card_index);
+    err = snd_ctl_open(&ctl, dev, 0);
+    pa_xfree(dev);
+
+    if (err < 0) {
+        pa_log_debug("Failed to open control device of card %i: %s", alsa_card_index, pa_alsa_strerror(err));
+        return NULL;
+    }
+
+    if ((err = snd_ctl_card_info(ctl, info)) < 0 ||
+        (err = snd_ctl_elem_list(ctl, list)) < 0 ||
+        (err = snd_ctl_elem_list_alloc_space(list, snd_ctl_elem_list_get_count(list))) < 0 ||
+        (err = snd_ctl_elem_list(ctl, list)) < 0) {
+        pa_log_debug("Failed to get control elements of card %i: %s", alsa_card_index, pa_alsa_strerror(err));
+        goto finish;
+    }
+
+    /* Any change in the mixer controls (e.g. a driver or firmware update)
+     * changes the element signature */
+    sb = pa_strbuf_new();
+    n_elems = snd_ctl_elem_list_get_used(list);
+    for (i = 0; i < n_elems; i++)
+        pa_strbuf_printf(sb, "%i:%s:%u;",
+                         (int) snd_ctl_elem_list_get_interface(list, i),
+                         snd_ctl_elem_list_get_name(list, i),
+                         snd_ctl_elem_list_get_index(list, i));
+    t = pa_strbuf_to_string_free(sb);
+    elem_hash = pa_idxset_string_hash_func(t);
+    pa_xfree(t);
+
+    /* And any change in the profile set configuration changes this one */
+    sb = pa_strbuf_new();
+    PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+        char **d;
+
+        pa_strbuf_printf(sb, "m:%s:%i:%i:%s:", m->name, (int) m->direction, (int) m->exact_channels,
+                         pa_channel_map_snprint(buf, sizeof(buf), &m->channel_map));
+        if (m->device_strings)
+            for (d = m->device_strings; *d; d++)
+                pa_strbuf_printf(sb, "%s,", *d);
+        pa_strbuf_puts(sb, ";");
+    }
+    PA_HASHMAP_FOREACH(p, ps->profiles, state)
+        pa_strbuf_printf(sb, "p:%s:%i:%i:%i;", p->name, (int) p->supported, (int) p->fallback_input, (int) p->fallback_output);
+    t = pa_strbuf_to_string_free(sb);
+    ps_hash = pa_idxset_string_hash_func(t);
+    pa_xfree(t);
+
+    key = pa_sprintf_malloc("%s:%s:%s:%u:%08x:%08x:%s:%u:%u",
+                            snd_ctl_card_info_get_driver(info),
+                            snd_ctl_card_info_get_mixername(info),
+                            snd_ctl_card_info_get_components(info),
+                            n_elems, elem_hash, ps_hash,
+                            pa_sample_spec_snprint(buf, sizeof(buf), ss),
+                            default_n_fragments, default_fragment_size_msec);
+
+finish:
+    snd_ctl_elem_list_free_space(list);
+    snd_ctl_close(ctl);
+
+    return key;
+}
+
+pa_tagstruct *pa_alsa_profile_set_probe_save(pa_alsa_profile_set *ps) {
+    pa_tagstruct *t;
+    pa_alsa_mapping *m;
+    pa_alsa_profile *p;
+    void *state;
+
+    pa_assert(ps);
+
+    if (!ps->probed || !ps->probe_cacheable || ps->probe_busy)
+        return NULL;
+
+    /* Only the supported profiles and their mappings are left at this point */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, PROBE_CACHE_VERSION);
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->profiles));
+    PA_HASHMAP_FOREACH(p, ps->profiles, state)
+        pa_tagstruct_puts(t, p->name);
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->mappings));
+    PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+        pa_tagstruct_puts(t, m->name);
+        pa_tagstruct_put_channel_map(t, &m->channel_map);
+        pa_tagstruct_puts64(t, m->hw_device_index);
+        pa_tagstruct_put_boolean(t, !!m->output_path_set);
+        pa_tagstruct_put_boolean(t, !!m->input_path_set);
+    }
+
+    return t;
+}
+
+struct cached_mapping {
+    pa_alsa_mapping *mapping;
+    pa_channel_map channel_map;
+    int64_t hw_device_index;
+    bool output_paths, input_paths;
+};
+
+int pa_alsa_profile_set_probe_cached(pa_alsa_profile_set *ps, pa_hashmap *mixers, int alsa_card_index, const void *data, size_t length) {
+    pa_tagstruct *t;
+    pa_alsa_profile **profiles = NULL, *p;
+    struct cached_mapping *mappings = NULL;
+    pa_hashmap *used_paths;
+    uint32_t n_profiles = 0, n_mappings = 0, i;
+    uint8_t version;
+    uint32_t idx;
+    pa_alsa_mapping *m;
+    int ret = -1;
+
+    pa_assert(ps);
+    pa_assert(data);
+
+    if (ps->probed)
+        return 0;
+
+    /* Read and check everything first, so that nothing is changed if the
+     * data turns out not to fit */
+    t = pa_tagstruct_new_fixed((const uint8_t *) data, length);
+
+    if (pa_tagstruct_getu8(t, &version) < 0 || version != PROBE_CACHE_VERSION ||
+        pa_tagstruct_getu32(t, &n_profiles) < 0 || n_profiles > pa_hashmap_size(ps->profiles))
+        goto finish;
+
+    profiles = pa_xnew0(pa_alsa_profile *, n_profiles);
+    for (i = 0; i < n_profiles; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+            !(profiles[i] = pa_hashmap_get(ps->profiles, name)))
+            goto finish;
+    }
+
+    if (pa_tagstruct_getu32(t, &n_mappings) < 0 || n_mappings > pa_hashmap_size(ps->mappings))
+        goto finish;
+
+    mappings = pa_xnew0(struct cached_mapping, n_mappings);
+    for (i = 0; i < n_mappings; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+            !(mappings[i].mapping = pa_hashmap_get(ps->mappings, name)) ||
+            pa_tagstruct_get_channel_map(t, &mappings[i].channel_map) < 0 ||
+            pa_tagstruct_gets64(t, &mappings[i].hw_device_index) < 0 ||
+            pa_tagstruct_get_boolean(t, &mappings[i].output_paths) < 0 ||
+            pa_tagstruct_get_boolean(t, &mappings[i].input_paths) < 0)
+            goto finish;
+    }
+
+    if (!pa_tagstruct_eof(t))
+        goto finish;
+
+    /* Now do what pa_alsa_profile_set_probe() would have done, minus opening
+     * the pcms */
+    for (i = 0; i < n_profiles; i++) {
+        p = profiles[i];
+
+        /* Already counted in mapping_verify() */
+        if (p->supported)
+            continue;
+
+        p->supported = true;
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+                m->supported++;
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+                m->supported++;
+    }
+
+    used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    for (i = 0; i < n_mappings; i++) {
+        m = mappings[i].mapping;
+
+        m->channel_map = mappings[i].channel_map;
+        m->hw_device_index = (int) mappings[i].hw_device_index;
+
+        if (mappings[i].output_paths)
+            mapping_paths_probe(m, NULL, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, alsa_card_index);
+        if (mappings[i].input_paths)
+            mapping_paths_probe(m, NULL, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, alsa_card_index);
+    }
+
+    pa_alsa_profile_set_drop_unsupported(ps);
+
+    paths_drop_unused(ps->input_paths, used_paths);
+    paths_drop_unused(ps->output_paths, used_paths);
+    pa_hashmap_free(used_paths);
+
+    profile_set_set_availability_groups(ps);
+
+    ps->probed = true;
+    ps->probe_cacheable = true;
+    ret = 0;
+
+finish:
+    pa_tagstruct_free(t);
+    pa_xfree(profiles);
+    pa_xfree(mappings);
+
+    return ret;
+}
+
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *ps) {
     pa_alsa_profile *p;
     pa_alsa_mapping *m;
@@ -30,6 +30,7 @@
 
 #include <pulsecore/llist.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/tagstruct.h>
 
 typedef struct pa_alsa_fdlist pa_alsa_fdlist;
 typedef struct pa_alsa_mixer pa_alsa_mixer;
@@ -369,6 +370,8 @@ struct pa_alsa_profile_set {
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
+    bool probe_cacheable:1;
+    bool probe_busy:1;
 };
 
 void pa_alsa_mapping_dump(pa_alsa_mapping *m);
@@ -378,6 +381,21 @@ pa_alsa_mapping *pa_alsa_mapping_get(pa_alsa_profile_set *ps, const char *name);
 
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus);
 void pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, pa_hashmap *mixers, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+
+/* Probe results can be stored and reused as long as the card and the profile
+ * set stay the same. The key identifies both, it must be computed before
+ * probing. pa_alsa_profile_set_probe_save() returns NULL if the results
+ * cannot be reused. That includes results that may be incomplete because
+ * some device was busy during probing, which sets probe_busy.
+ * pa_alsa_profile_set_probe_cached() returns a negative
+ * value without touching the profile set if the saved data does not fit.
+ * The results are stored in a state database of the following name, keyed
+ * by pa_alsa_profile_set_probe_key(). */
+#define PA_ALSA_PROBE_CACHE_DATABASE "alsa-probe-cache"
+
+char *pa_alsa_profile_set_probe_key(pa_alsa_profile_set *ps, int alsa_card_index, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+pa_tagstruct *pa_alsa_profile_set_probe_save(pa_alsa_profile_set *ps);
+int pa_alsa_profile_set_probe_cached(pa_alsa_profile_set *ps, pa_hashmap *mixers, int alsa_card_index, const void *data, size_t length);
 void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
@@ -52,7 +52,7 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
-#include <pulsecore/time-smoother.h>
+#include <pulsecore/time-smoother_2.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -78,9 +78,6 @@
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms  -- Sleep at least 10ms on each iteration */
 #define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms   -- Wakeup at least this long before the buffer runs empty*/
 
-#define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s   -- smoother windows size */
-#define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s    -- smoother adjust time */
-
 #define SMOOTHER_MIN_INTERVAL (2*PA_USEC_PER_MSEC)                 /* 2ms   -- min smoother update interval */
 #define SMOOTHER_MAX_INTERVAL (200*PA_USEC_PER_MSEC)               /* 200ms -- max smoother update interval */
 
@@ -156,7 +153,7 @@ struct userdata {
 
     pa_rtpoll_item *alsa_rtpoll_item;
 
-    pa_smoother *smoother;
+    pa_smoother_2 *smoother;
     uint64_t write_count;
     uint64_t since_start;
     pa_usec_t smoother_interval;
@@ -480,7 +477,7 @@ static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*p
 /* Reset smoother and counters */
 static void reset_vars(struct userdata *u) {
 
-    pa_smoother_reset(u->smoother, pa_rtclock_now(), true);
+    pa_smoother_2_reset(u->smoother, &u->sink->sample_spec, pa_rtclock_now(), true);
     u->smoother_interval = SMOOTHER_MIN_INTERVAL;
     u->last_smoother_update = 0;
 
@@ -955,7 +952,7 @@ static void update_smoother(struct userdata *u) {
     snd_pcm_sframes_t delay = 0;
     int64_t position;
     int err;
-    pa_usec_t now1 = 0, now2;
+    pa_usec_t now1 = 0;
     snd_pcm_status_t *status;
     snd_htimestamp_t htstamp = { 0, 0 };
 
@@ -988,9 +985,7 @@ static void update_smoother(struct userdata *u) {
     if (PA_UNLIKELY(position < 0))
         position = 0;
 
-    now2 = pa_bytes_to_usec((uint64_t) position, &u->sink->sample_spec);
-
-    pa_smoother_put(u->smoother, now1, now2);
+    pa_smoother_2_put(u->smoother, now1, position);
 
     u->last_smoother_update = now1;
     /* exponentially increase the update interval up to the MAX limit */
@@ -1004,7 +999,7 @@ static int64_t sink_get_latency(struct userdata *u) {
     pa_assert(u);
 
     now1 = pa_rtclock_now();
-    now2 = pa_smoother_get(u->smoother, now1);
+    now2 = pa_smoother_2_get(u->smoother, now1);
 
     delay = (int64_t) pa_bytes_to_usec(u->write_count, &u->sink->sample_spec) - (int64_t) now2;
 
@@ -1036,7 +1031,7 @@ static void suspend(struct userdata *u) {
     if (!u->pcm_handle)
         return;
 
-    pa_smoother_pause(u->smoother, pa_rtclock_now());
+    pa_smoother_2_pause(u->smoother, pa_rtclock_now());
 
     /* Close PCM device */
     close_pcm(u);
@@ -1933,7 +1928,7 @@ static void thread_func(void *userdata) {
                     pa_log_info("Starting playback.");
                     snd_pcm_start(u->pcm_handle);
 
-                    pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+                    pa_smoother_2_resume(u->smoother, pa_rtclock_now());
 
                     u->first = false;
                 }
@@ -1967,7 +1962,7 @@ static void thread_func(void *userdata) {
 
                 /* Convert from the sound card time domain to the
                  * system time domain */
-                cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
+                cusec = pa_smoother_2_translate(u->smoother, sleep_usec);
 
 #ifdef DEBUG_TIMING
                 pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC);
@@ -2380,14 +2375,6 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
-    u->smoother = pa_smoother_new(
-            SMOOTHER_ADJUST_USEC,
-            SMOOTHER_WINDOW_USEC,
-            true,
-            true,
-            5,
-            pa_rtclock_now(),
-            true);
     u->smoother_interval = SMOOTHER_MIN_INTERVAL;
 
     /* use ucm */
@@ -2416,7 +2403,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
      */
 
     if (!card)
-        snd_config_update_free_global();
+        pa_alsa_config_reread();
 
     if (mapping) {
 
@@ -2524,6 +2511,8 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     /* ALSA might tweak the sample spec, so recalculate the frame size */
     frame_size = pa_frame_size(&ss);
 
+    u->smoother = pa_smoother_2_new(&ss, pa_rtclock_now(), true);
+
     pa_sink_new_data_init(&data);
     data.driver = driver;
     data.module = m;
@@ -2802,7 +2791,7 @@ static void userdata_free(struct userdata *u) {
         pa_hashmap_free(u->mixers);
 
     if (u->smoother)
-        pa_smoother_free(u->smoother);
+        pa_smoother_2_free(u->smoother);
 
     if (u->formats)
         pa_idxset_free(u->formats, (pa_free_cb_t) pa_format_info_free);
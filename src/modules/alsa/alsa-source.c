@@ -47,7 +47,7 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
-#include <pulsecore/time-smoother.h>
+#include <pulsecore/time-smoother_2.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -71,9 +71,6 @@
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms */
 #define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms */
 
-#define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s */
-#define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s */
-
 #define SMOOTHER_MIN_INTERVAL (2*PA_USEC_PER_MSEC)                 /* 2ms */
 #define SMOOTHER_MAX_INTERVAL (200*PA_USEC_PER_MSEC)               /* 200ms */
 
@@ -140,7 +137,7 @@ struct userdata {
 
     pa_rtpoll_item *alsa_rtpoll_item;
 
-    pa_smoother *smoother;
+    pa_smoother_2 *smoother;
     uint64_t read_count;
     pa_usec_t smoother_interval;
     pa_usec_t last_smoother_update;
@@ -452,7 +449,7 @@ static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*p
 /* Reset smoother and counters */
 static void reset_vars(struct userdata *u) {
 
-    pa_smoother_reset(u->smoother, pa_rtclock_now(), true);
+    pa_smoother_2_reset(u->smoother, &u->source->sample_spec, pa_rtclock_now(), true);
     u->smoother_interval = SMOOTHER_MIN_INTERVAL;
     u->last_smoother_update = 0;
 
@@ -462,7 +459,7 @@ static void reset_vars(struct userdata *u) {
 
 /* Called from IO context */
 static void close_pcm(struct userdata *u) {
-    pa_smoother_pause(u->smoother, pa_rtclock_now());
+    pa_smoother_2_pause(u->smoother, pa_rtclock_now());
 
     /* Let's suspend */
     snd_pcm_close(u->pcm_handle);
@@ -877,7 +874,7 @@ static void update_smoother(struct userdata *u) {
     snd_pcm_sframes_t delay = 0;
     uint64_t position;
     int err;
-    pa_usec_t now1 = 0, now2;
+    pa_usec_t now1 = 0;
     snd_pcm_status_t *status;
     snd_htimestamp_t htstamp = { 0, 0 };
 
@@ -906,9 +903,8 @@ static void update_smoother(struct userdata *u) {
             return;
 
     position = u->read_count + ((uint64_t) delay * (uint64_t) u->frame_size);
-    now2 = pa_bytes_to_usec(position, &u->source->sample_spec);
 
-    pa_smoother_put(u->smoother, now1, now2);
+    pa_smoother_2_put(u->smoother, now1, (int64_t) position);
 
     u->last_smoother_update = now1;
     /* exponentially increase the update interval up to the MAX limit */
@@ -922,7 +918,7 @@ static int64_t source_get_latency(struct userdata *u) {
     pa_assert(u);
 
     now1 = pa_rtclock_now();
-    now2 = pa_smoother_get(u->smoother, now1);
+    now2 = pa_smoother_2_get(u->smoother, now1);
 
     delay = (int64_t) now2 - (int64_t) pa_bytes_to_usec(u->read_count, &u->source->sample_spec);
 
@@ -1650,7 +1646,7 @@ static void thread_func(void *userdata) {
                 pa_log_info("Starting capture.");
                 snd_pcm_start(u->pcm_handle);
 
-                pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+                pa_smoother_2_resume(u->smoother, pa_rtclock_now());
 
                 u->first = false;
             }
@@ -1678,7 +1674,7 @@ static void thread_func(void *userdata) {
 
                 /* Convert from the sound card time domain to the
                  * system time domain */
-                cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
+                cusec = pa_smoother_2_translate(u->smoother, sleep_usec);
 
 /*                 pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC); */
 
@@ -2077,14 +2073,6 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
         goto fail;
     }
 
-    u->smoother = pa_smoother_new(
-            SMOOTHER_ADJUST_USEC,
-            SMOOTHER_WINDOW_USEC,
-            true,
-            true,
-            5,
-            pa_rtclock_now(),
-            true);
     u->smoother_interval = SMOOTHER_MIN_INTERVAL;
 
     /* use ucm */
@@ -2113,7 +2101,7 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
      */
 
     if (!card)
-        snd_config_update_free_global();
+        pa_alsa_config_reread();
 
     if (mapping) {
 
@@ -2211,6 +2199,8 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     /* ALSA might tweak the sample spec, so recalculate the frame size */
     frame_size = pa_frame_size(&ss);
 
+    u->smoother = pa_smoother_2_new(&ss, pa_rtclock_now(), true);
+
     pa_source_new_data_init(&data);
     data.driver = driver;
     data.module = m;
@@ -2446,7 +2436,7 @@ static void userdata_free(struct userdata *u) {
         pa_hashmap_free(u->mixers);
 
     if (u->smoother)
-        pa_smoother_free(u->smoother);
+        pa_smoother_2_free(u->smoother);
 
     if (u->supported_formats)
         pa_xfree(u->supported_formats);
@@ -755,6 +755,32 @@ static void append_lost_relationship(pa_alsa_ucm_device *dev) {
     }
 }
 
+bool pa_alsa_ucm_available(int card_index) {
+    snd_use_case_mgr_t *ucm_mgr;
+    char *card_name;
+    int err;
+
+    /* Same lookup as pa_alsa_ucm_query_profiles(), without parsing the verbs */
+    card_name = pa_sprintf_malloc("hw:%i", card_index);
+    err = snd_use_case_mgr_open(&ucm_mgr, card_name);
+    pa_xfree(card_name);
+
+    if (err < 0) {
+        if (snd_card_get_name(card_index, &card_name) < 0)
+            return false;
+
+        err = snd_use_case_mgr_open(&ucm_mgr, card_name);
+        pa_xfree(card_name);
+
+        if (err < 0)
+            return false;
+    }
+
+    snd_use_case_mgr_close(ucm_mgr);
+
+    return true;
+}
+
 int pa_alsa_ucm_query_profiles(pa_alsa_ucm_config *ucm, int card_index) {
     char *card_name;
     const char **verb_list, *value;
@@ -2341,6 +2367,10 @@ static void ucm_port_update_available(pa_alsa_ucm_port_data *port) {
 
 /* Dummy functions for systems without UCM support */
 
+bool pa_alsa_ucm_available(int card_index) {
+    return false;
+}
+
 int pa_alsa_ucm_query_profiles(pa_alsa_ucm_config *ucm, int card_index) {
         pa_log_info("UCM not available.");
         return -1;
@@ -902,6 +902,32 @@ void pa_alsa_refcnt_dec(void) {
     }
 }
 
+static unsigned n_config_holds = 0;
+static bool config_reread_pending = false;
+
+void pa_alsa_config_reread(void) {
+    if (n_config_holds > 0) {
+        config_reread_pending = true;
+        return;
+    }
+
+    snd_config_update_free_global();
+}
+
+void pa_alsa_config_hold(void) {
+    n_config_holds++;
+}
+
+void pa_alsa_config_release(void) {
+    pa_assert(n_config_holds > 0);
+
+    if (--n_config_holds > 0 || !config_reread_pending)
+        return;
+
+    config_reread_pending = false;
+    snd_config_update_free_global();
+}
+
 bool pa_alsa_init_description(pa_proplist *p, pa_card *card) {
     const char *d, *k;
     pa_assert(p);
@@ -119,6 +119,13 @@ void pa_alsa_dump_status(snd_pcm_t *pcm);
 void pa_alsa_refcnt_inc(void);
 void pa_alsa_refcnt_dec(void);
 
+/* Makes ALSA reread its configuration, so that hot-plugged devices show up.
+ * While a thread holds the configuration, this is put off until the last hold
+ * is released. Called from main context. */
+void pa_alsa_config_reread(void);
+void pa_alsa_config_hold(void);
+void pa_alsa_config_release(void);
+
 void pa_alsa_init_proplist_pcm_info(pa_core *c, pa_proplist *p, snd_pcm_info_t *pcm_info);
 void pa_alsa_init_proplist_card(pa_core *c, pa_proplist *p, int card);
 void pa_alsa_init_proplist_pcm(pa_core *c, pa_proplist *p, snd_pcm_t *pcm);
@@ -21,12 +21,18 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
+
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-error.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/queue.h>
+#include <pulsecore/thread.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -70,6 +76,7 @@ PA_MODULE_USAGE(
         "use_ucm=<load use case manager> "
         "avoid_resampling=<use stream original sample rate if possible?> "
         "control=<name of mixer control> "
+        "probe_cache=<reuse probing results from earlier runs?> "
 );
 
 static const char* const valid_modargs[] = {
@@ -99,10 +106,18 @@ static const char* const valid_modargs[] = {
     "use_ucm",
     "avoid_resampling",
     "control",
+    "probe_cache",
     NULL
 };
 
 #define DEFAULT_DEVICE_ID "0"
+#define DEFAULT_PROBE_CACHE true
+
+/* When the profile set was set up from cached probe results, the card is
+ * probed again in the background once it has been idle for this long, so
+ * that changes that the card's identity doesn't show make it into the cache */
+#define PROBE_REVALIDATE_DELAY_USEC (30 * PA_USEC_PER_SEC)
+#define PROBE_REVALIDATE_POLL_USEC (50 * PA_USEC_PER_MSEC)
 
 struct userdata {
     pa_core *core;
@@ -120,6 +135,18 @@ struct userdata {
 
     pa_alsa_profile_set *profile_set;
 
+    /* Set if the profile set was set up from cached probe results */
+    char *probe_cache_key;
+    void *probe_cache_data;
+    size_t probe_cache_length;
+
+    /* Probing again in the background, see probe_revalidate_cb() */
+    pa_time_event *probe_revalidate_event;
+    pa_thread *probe_revalidate_thread;
+    pa_alsa_profile_set *probe_revalidate_set;
+    pa_tagstruct *probe_revalidate_result;
+    pa_atomic_t probe_revalidate_done;
+
     /* ucm stuffs */
     bool use_ucm;
     pa_alsa_ucm_config ucm;
@@ -193,6 +220,291 @@ static void add_disabled_profile(pa_hashmap *profiles) {
     pa_hashmap_put(profiles, p->name, p);
 }
 
+static pa_database *probe_cache_open(void) {
+    pa_database *database;
+    char *fname;
+
+    if (!(fname = pa_state_path(PA_ALSA_PROBE_CACHE_DATABASE, true)))
+        return NULL;
+
+    if (!(database = pa_database_open(fname, true)))
+        pa_log_debug("Failed to open probe cache '%s': %s", fname, pa_cstrerror(errno));
+
+    pa_xfree(fname);
+
+    return database;
+}
+
+/* The cached results are only checked against the card's identity, so
+ * whether they are still right shows when the mappings are actually used, or
+ * when the card is probed again in the background. If opening one of them
+ * fails, the results are dropped and the card is probed again the next time
+ * it shows up. */
+static void probe_cache_invalidate(struct userdata *u) {
+    pa_database *database;
+    pa_datum key;
+
+    if (!u->probe_cache_key)
+        return;
+
+    /* Opening a mapping may fail because the card is being probed in the
+     * background, the outcome of that decides then */
+    if (u->probe_revalidate_thread)
+        return;
+
+    pa_log_info("Dropping cached probe results for card %s.", u->device_id);
+
+    if ((database = probe_cache_open())) {
+        key.data = u->probe_cache_key;
+        key.size = strlen(u->probe_cache_key);
+
+        pa_database_unset(database, &key);
+        pa_database_sync(database);
+        pa_database_close(database);
+    }
+
+    pa_xfree(u->probe_cache_key);
+    u->probe_cache_key = NULL;
+    pa_xfree(u->probe_cache_data);
+    u->probe_cache_data = NULL;
+
+    if (u->probe_revalidate_event) {
+        u->core->mainloop->time_free(u->probe_revalidate_event);
+        u->probe_revalidate_event = NULL;
+    }
+}
+
+static void probe_profile_set(struct userdata *u, bool use_cache) {
+    pa_core *c = u->core;
+    pa_database *database = NULL;
+    pa_datum key, data;
+    pa_tagstruct *t;
+    char *k = NULL;
+    bool cached = false;
+    pa_usec_t start;
+
+    start = pa_rtclock_now();
+
+    if (use_cache && !u->profile_set->probed &&
+        (k = pa_alsa_profile_set_probe_key(u->profile_set, u->alsa_card_index, &c->default_sample_spec,
+                                           c->default_n_fragments, c->default_fragment_size_msec)))
+        database = probe_cache_open();
+
+    if (database) {
+        key.data = k;
+        key.size = strlen(k);
+
+        if (pa_database_get(database, &key, &data)) {
+            cached = pa_alsa_profile_set_probe_cached(u->profile_set, u->mixers, u->alsa_card_index, data.data, data.size) >= 0;
+
+            if (cached) {
+                u->probe_cache_data = pa_xmemdup(data.data, data.size);
+                u->probe_cache_length = data.size;
+            }
+
+            pa_datum_free(&data);
+
+            if (!cached) {
+                pa_log_info("Cached probe results for card %s do not fit, probing again.", u->device_id);
+                pa_database_unset(database, &key);
+            }
+        }
+    }
+
+    if (!cached) {
+        pa_alsa_profile_set_probe(u->profile_set, u->mixers, u->device_id, &c->default_sample_spec,
+                                  c->default_n_fragments, c->default_fragment_size_msec);
+
+        if (database && (t = pa_alsa_profile_set_probe_save(u->profile_set))) {
+            size_t size;
+
+            data.data = (void *) pa_tagstruct_data(t, &size);
+            data.size = size;
+
+            pa_database_set(database, &key, &data, true);
+            pa_tagstruct_free(t);
+        }
+    }
+
+    if (database) {
+        pa_database_sync(database);
+        pa_database_close(database);
+    }
+
+    pa_log_info("Probing card %s took %0.1f ms%s.", u->device_id,
+                (double) (pa_rtclock_now() - start) / PA_USEC_PER_MSEC, cached ? " (cached)" : "");
+
+    if (cached)
+        u->probe_cache_key = k;
+    else
+        pa_xfree(k);
+}
+
+/* Called from the revalidation thread */
+static void probe_revalidate_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+    pa_hashmap *mixers;
+
+    mixers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                 pa_xfree, (pa_free_cb_t) pa_alsa_mixer_free);
+
+    pa_alsa_profile_set_probe(u->probe_revalidate_set, mixers, u->device_id, &u->core->default_sample_spec,
+                              u->core->default_n_fragments, u->core->default_fragment_size_msec);
+    u->probe_revalidate_result = pa_alsa_profile_set_probe_save(u->probe_revalidate_set);
+
+    pa_hashmap_free(mixers);
+
+    pa_atomic_store(&u->probe_revalidate_done, 1);
+}
+
+/* Keeps the card's devices closed while the card is being probed. They are
+ * only touched when they are suspended already, so nothing is interrupted. */
+static bool card_suspend_for_probe(struct userdata *u, bool suspend) {
+    pa_sink *sink;
+    pa_source *source;
+    uint32_t idx;
+
+    if (suspend) {
+        PA_IDXSET_FOREACH(sink, u->card->sinks, idx)
+            if (sink->state != PA_SINK_SUSPENDED)
+                return false;
+
+        PA_IDXSET_FOREACH(source, u->card->sources, idx)
+            if (source->state != PA_SOURCE_SUSPENDED)
+                return false;
+    }
+
+    PA_IDXSET_FOREACH(sink, u->card->sinks, idx)
+        pa_sink_suspend(sink, suspend, PA_SUSPEND_INTERNAL);
+
+    PA_IDXSET_FOREACH(source, u->card->sources, idx)
+        pa_source_suspend(source, suspend, PA_SUSPEND_INTERNAL);
+
+    return true;
+}
+
+static void probe_revalidate_finish(struct userdata *u) {
+    pa_database *database;
+    pa_datum key, data;
+    pa_tagstruct *t;
+    bool busy;
+
+    pa_thread_free(u->probe_revalidate_thread);
+    u->probe_revalidate_thread = NULL;
+
+    pa_alsa_config_release();
+    card_suspend_for_probe(u, false);
+
+    busy = u->probe_revalidate_set->probe_busy;
+    t = u->probe_revalidate_result;
+    u->probe_revalidate_result = NULL;
+    pa_alsa_profile_set_free(u->probe_revalidate_set);
+    u->probe_revalidate_set = NULL;
+
+    /* Something else had the card open, try again later */
+    if (!t && busy) {
+        pa_log_debug("Card %s was busy, checking the cached probe results later.", u->device_id);
+        pa_core_rttime_restart(u->core, u->probe_revalidate_event, pa_rtclock_now() + PROBE_REVALIDATE_DELAY_USEC);
+        return;
+    }
+
+    u->core->mainloop->time_free(u->probe_revalidate_event);
+    u->probe_revalidate_event = NULL;
+
+    if (!t) {
+        probe_cache_invalidate(u);
+        return;
+    }
+
+    data.data = (void *) pa_tagstruct_data(t, &data.size);
+
+    if (data.size == u->probe_cache_length && memcmp(data.data, u->probe_cache_data, data.size) == 0)
+        pa_log_debug("Cached probe results for card %s are still valid.", u->device_id);
+    else if ((database = probe_cache_open())) {
+        pa_log_info("Cached probe results for card %s are out of date, updating them.", u->device_id);
+
+        key.data = u->probe_cache_key;
+        key.size = strlen(u->probe_cache_key);
+
+        pa_database_set(database, &key, &data, true);
+        pa_database_sync(database);
+        pa_database_close(database);
+    }
+
+    pa_tagstruct_free(t);
+}
+
+static char *get_profile_set_fname(struct userdata *u) {
+    char *fn = NULL;
+
+#ifdef HAVE_UDEV
+    fn = pa_udev_get_property(u->alsa_card_index, "PULSE_PROFILE_SET");
+#endif
+
+    if (pa_modargs_get_value(u->modargs, "profile_set", NULL)) {
+        pa_xfree(fn);
+        fn = pa_xstrdup(pa_modargs_get_value(u->modargs, "profile_set", NULL));
+    }
+
+    return fn;
+}
+
+/* The cached probe results are checked against a fresh probe of the card,
+ * which runs in a thread of its own. The entry is updated if the results
+ * have changed, and dropped if they cannot be cached anymore. The profile
+ * set in use is left alone, the new results are used the next time the card
+ * shows up. */
+static void probe_revalidate_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+    char *fn;
+
+    pa_assert(u);
+    pa_assert(u->probe_cache_key);
+
+    if (u->probe_revalidate_thread) {
+        if (pa_atomic_load(&u->probe_revalidate_done))
+            probe_revalidate_finish(u);
+        else
+            pa_core_rttime_restart(u->core, e, pa_rtclock_now() + PROBE_REVALIDATE_POLL_USEC);
+
+        return;
+    }
+
+    if (!card_suspend_for_probe(u, true)) {
+        pa_core_rttime_restart(u->core, e, pa_rtclock_now() + PROBE_REVALIDATE_DELAY_USEC);
+        return;
+    }
+
+    fn = get_profile_set_fname(u);
+    u->probe_revalidate_set = pa_alsa_profile_set_new(fn, &u->core->default_channel_map);
+    pa_xfree(fn);
+
+    if (!u->probe_revalidate_set) {
+        card_suspend_for_probe(u, false);
+        u->core->mainloop->time_free(e);
+        u->probe_revalidate_event = NULL;
+        return;
+    }
+
+    u->probe_revalidate_set->ignore_dB = u->profile_set->ignore_dB;
+
+    pa_atomic_store(&u->probe_revalidate_done, 0);
+    pa_alsa_config_hold();
+
+    if (!(u->probe_revalidate_thread = pa_thread_new("alsa-probe", probe_revalidate_thread_func, u))) {
+        pa_log_warn("Failed to create probe thread for card %s.", u->device_id);
+        pa_alsa_config_release();
+        card_suspend_for_probe(u, false);
+        pa_alsa_profile_set_free(u->probe_revalidate_set);
+        u->probe_revalidate_set = NULL;
+        u->core->mainloop->time_free(e);
+        u->probe_revalidate_event = NULL;
+        return;
+    }
+
+    pa_core_rttime_restart(u->core, e, pa_rtclock_now() + PROBE_REVALIDATE_POLL_USEC);
+}
+
 static int card_set_profile(pa_card *c, pa_card_profile *new_profile) {
     struct userdata *u;
     struct profile_data *nd, *od;
@@ -251,7 +563,8 @@ static int card_set_profile(pa_card *c, pa_card_profile *new_profile) {
         PA_IDXSET_FOREACH(am, nd->profile->output_mappings, idx) {
 
             if (!am->sink)
-                am->sink = pa_alsa_sink_new(c->module, u->modargs, __FILE__, c, am);
+                if (!(am->sink = pa_alsa_sink_new(c->module, u->modargs, __FILE__, c, am)))
+                    probe_cache_invalidate(u);
 
             if (sink_inputs && am->sink) {
                 pa_sink_move_all_finish(am->sink, sink_inputs, false);
@@ -263,7 +576,8 @@ static int card_set_profile(pa_card *c, pa_card_profile *new_profile) {
         PA_IDXSET_FOREACH(am, nd->profile->input_mappings, idx) {
 
             if (!am->source)
-                am->source = pa_alsa_source_new(c->module, u->modargs, __FILE__, c, am);
+                if (!(am->source = pa_alsa_source_new(c->module, u->modargs, __FILE__, c, am)))
+                    probe_cache_invalidate(u);
 
             if (source_outputs && am->source) {
                 pa_source_move_all_finish(am->source, source_outputs, false);
@@ -301,11 +615,13 @@ static void init_profile(struct userdata *u) {
 
     if (d->profile && d->profile->output_mappings)
         PA_IDXSET_FOREACH(am, d->profile->output_mappings, idx)
-            am->sink = pa_alsa_sink_new(u->module, u->modargs, __FILE__, u->card, am);
+            if (!(am->sink = pa_alsa_sink_new(u->module, u->modargs, __FILE__, u->card, am)))
+                probe_cache_invalidate(u);
 
     if (d->profile && d->profile->input_mappings)
         PA_IDXSET_FOREACH(am, d->profile->input_mappings, idx)
-            am->source = pa_alsa_source_new(u->module, u->modargs, __FILE__, u->card, am);
+            if (!(am->source = pa_alsa_source_new(u->module, u->modargs, __FILE__, u->card, am)))
+                probe_cache_invalidate(u);
 }
 
 static pa_available_t calc_port_state(pa_device_port *p, struct userdata *u) {
@@ -785,6 +1101,7 @@ int pa__init(pa_module *m) {
     const char *profile_str = NULL;
     char *fn = NULL;
     bool namereg_fail = false;
+    bool probe_cache = DEFAULT_PROBE_CACHE;
     int err = -PA_MODULE_ERR_UNSPECIFIED, rval;
 
     pa_alsa_refcnt_inc();
@@ -835,12 +1152,17 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(u->modargs, "probe_cache", &probe_cache) < 0) {
+        pa_log("Failed to parse probe_cache argument.");
+        goto fail;
+    }
+
     /* Force ALSA to reread its configuration. This matters if our device
      * was hot-plugged after ALSA has already read its configuration - see
      * https://bugs.freedesktop.org/show_bug.cgi?id=54029
      */
 
-    snd_config_update_free_global();
+    pa_alsa_config_reread();
 
     rval = u->use_ucm ? pa_alsa_ucm_query_profiles(&u->ucm, u->alsa_card_index) : -1;
     if (rval == -PA_ALSA_ERR_UCM_LINKED) {
@@ -868,15 +1190,7 @@ int pa__init(pa_module *m) {
     }
     else {
         u->use_ucm = false;
-#ifdef HAVE_UDEV
-        fn = pa_udev_get_property(u->alsa_card_index, "PULSE_PROFILE_SET");
-#endif
-
-        if (pa_modargs_get_value(u->modargs, "profile_set", NULL)) {
-            pa_xfree(fn);
-            fn = pa_xstrdup(pa_modargs_get_value(u->modargs, "profile_set", NULL));
-        }
-
+        fn = get_profile_set_fname(u);
         u->profile_set = pa_alsa_profile_set_new(fn, &u->core->default_channel_map);
         pa_xfree(fn);
     }
@@ -886,7 +1200,7 @@ int pa__init(pa_module *m) {
 
     u->profile_set->ignore_dB = ignore_dB;
 
-    pa_alsa_profile_set_probe(u->profile_set, u->mixers, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
+    probe_profile_set(u, probe_cache);
     pa_alsa_profile_set_dump(u->profile_set);
 
     pa_card_new_data_init(&data);
@@ -999,6 +1313,12 @@ int pa__init(pa_module *m) {
     if (reserve)
         pa_reserve_wrapper_unref(reserve);
 
+    /* UCM profile sets are made up from the UCM configuration, they are not
+     * probed again in the background */
+    if (u->probe_cache_key && !u->use_ucm)
+        u->probe_revalidate_event = pa_core_rttime_new(m->core, pa_rtclock_now() + PROBE_REVALIDATE_DELAY_USEC,
+                                                       probe_revalidate_cb, u);
+
     if (!pa_hashmap_isempty(u->profile_set->decibel_fixes))
         pa_log_warn("Card %s uses decibel fixes (i.e. overrides the decibel information for some alsa volume elements). "
                     "Please note that this feature is meant just as a help for figuring out the correct decibel values. "
@@ -1046,6 +1366,20 @@ void pa__done(pa_module*m) {
     if (!(u = m->userdata))
         goto finish;
 
+    if (u->probe_revalidate_thread) {
+        pa_thread_free(u->probe_revalidate_thread);
+        pa_alsa_config_release();
+    }
+
+    if (u->probe_revalidate_event)
+        u->core->mainloop->time_free(u->probe_revalidate_event);
+
+    if (u->probe_revalidate_result)
+        pa_tagstruct_free(u->probe_revalidate_result);
+
+    if (u->probe_revalidate_set)
+        pa_alsa_profile_set_free(u->probe_revalidate_set);
+
     if (u->mixers)
         pa_hashmap_free(u->mixers);
     if (u->jacks)
@@ -1068,6 +1402,8 @@ void pa__done(pa_module*m) {
 
     pa_alsa_ucm_free(&u->ucm);
 
+    pa_xfree(u->probe_cache_key);
+    pa_xfree(u->probe_cache_data);
     pa_xfree(u->device_id);
     pa_xfree(u);
 
@@ -0,0 +1,168 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+
+#include "a2dp-bitrate-control.h"
+
+/* The bitrate goes down when the send buffer is filled above the high
+ * watermark on average, and up again when it has stayed below the low
+ * watermark for a while. Between the two nothing changes. */
+#define HIGH_WATERMARK 0.75
+#define LOW_WATERMARK 0.25
+#define AVERAGE_WEIGHT 0.125
+
+/* One burst of congestion costs one step only. After that, the bitrate
+ * goes down further only if the send buffer doesn't drain. */
+#define DECREASE_HOLDOFF_USEC (500 * PA_USEC_PER_MSEC)
+#define DRAIN_THRESHOLD 0.05
+
+/* How long the buffer has to stay below the low watermark before the
+ * bitrate goes up. This doubles whenever an increase is soon followed by a
+ * decrease, so the bitrate doesn't keep oscillating around the capacity of
+ * the link. Once an increase beyond the bitrate that failed works out, the
+ * link has improved, and the bitrate may go up quickly again. */
+#define MIN_INCREASE_HOLDOFF_USEC (2 * PA_USEC_PER_SEC)
+#define MAX_INCREASE_HOLDOFF_USEC (16 * PA_USEC_PER_SEC)
+
+/* Everything a step changes, so that it can be undone */
+struct steps {
+    /* Steps taken, relative to the start */
+    int level;
+
+    bool decreased;
+    pa_usec_t last_decrease;
+    double decrease_fill;           /* Average fill level at the last decrease */
+    bool increased;
+    pa_usec_t last_increase;
+
+    bool failed;
+    int failed_level;               /* Level of the last failed increase */
+
+    pa_usec_t increase_holdoff;
+};
+
+struct pa_a2dp_bitrate_control {
+    double fill;                    /* Average fill level of the send buffer */
+
+    bool good;                      /* Below the low watermark since good_since */
+    pa_usec_t good_since;
+
+    struct steps steps;
+    struct steps before_last_step;
+};
+
+pa_a2dp_bitrate_control *pa_a2dp_bitrate_control_new(void) {
+    pa_a2dp_bitrate_control *c;
+
+    c = pa_xnew0(pa_a2dp_bitrate_control, 1);
+    c->steps.increase_holdoff = MIN_INCREASE_HOLDOFF_USEC;
+
+    return c;
+}
+
+void pa_a2dp_bitrate_control_free(pa_a2dp_bitrate_control *c) {
+    pa_assert(c);
+
+    pa_xfree(c);
+}
+
+/* True if no decrease happened since the last increase */
+static bool last_increase_held(pa_a2dp_bitrate_control *c) {
+    return c->steps.increased && (!c->steps.decreased || c->steps.last_increase > c->steps.last_decrease);
+}
+
+static pa_a2dp_bitrate_step_t decrease(pa_a2dp_bitrate_control *c, pa_usec_t now) {
+    c->good = false;
+
+    if (c->steps.decreased && (now - c->steps.last_decrease < DECREASE_HOLDOFF_USEC ||
+                               c->fill < c->steps.decrease_fill - DRAIN_THRESHOLD))
+        return PA_A2DP_BITRATE_KEEP;
+
+    c->before_last_step = c->steps;
+
+    /* The last increase was too much for the link */
+    if (last_increase_held(c) && now - c->steps.last_increase < c->steps.increase_holdoff) {
+        c->steps.failed = true;
+        c->steps.failed_level = c->steps.level;
+        c->steps.increase_holdoff = PA_MIN(2 * c->steps.increase_holdoff, MAX_INCREASE_HOLDOFF_USEC);
+        pa_log_debug("Bitrate increase failed, next one after %0.1f s.", (double) c->steps.increase_holdoff / PA_USEC_PER_SEC);
+    }
+
+    c->steps.decreased = true;
+    c->steps.last_decrease = now;
+    c->steps.decrease_fill = c->fill;
+    c->steps.level--;
+
+    return PA_A2DP_BITRATE_DECREASE;
+}
+
+static pa_a2dp_bitrate_step_t increase(pa_a2dp_bitrate_control *c, pa_usec_t now) {
+    if (!c->good) {
+        c->good = true;
+        c->good_since = now;
+    }
+
+    if (now - c->good_since < c->steps.increase_holdoff)
+        return PA_A2DP_BITRATE_KEEP;
+
+    c->before_last_step = c->steps;
+
+    if (last_increase_held(c) && (!c->steps.failed || c->steps.level >= c->steps.failed_level)) {
+        c->steps.failed = false;
+        c->steps.increase_holdoff = MIN_INCREASE_HOLDOFF_USEC;
+    }
+
+    c->good_since = now;
+    c->steps.increased = true;
+    c->steps.last_increase = now;
+    c->steps.level++;
+
+    return PA_A2DP_BITRATE_INCREASE;
+}
+
+pa_a2dp_bitrate_step_t pa_a2dp_bitrate_control_update(pa_a2dp_bitrate_control *c, pa_usec_t now, size_t queued, size_t capacity, bool congested) {
+    double level;
+
+    pa_assert(c);
+
+    level = capacity > 0 ? PA_MIN((double) queued / (double) capacity, 1.0) : 0.0;
+    c->fill += (level - c->fill) * AVERAGE_WEIGHT;
+
+    if (congested || c->fill > HIGH_WATERMARK)
+        return decrease(c, now);
+
+    if (c->fill < LOW_WATERMARK)
+        return increase(c, now);
+
+    c->good = false;
+
+    return PA_A2DP_BITRATE_KEEP;
+}
+
+void pa_a2dp_bitrate_control_reject(pa_a2dp_bitrate_control *c) {
+    pa_assert(c);
+
+    c->steps = c->before_last_step;
+}
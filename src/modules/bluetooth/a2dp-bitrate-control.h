@@ -0,0 +1,48 @@
+#ifndef fooa2dpbitratecontrolhfoo
+#define fooa2dpbitratecontrolhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+#include <pulsecore/macro.h>
+
+typedef struct pa_a2dp_bitrate_control pa_a2dp_bitrate_control;
+
+typedef enum pa_a2dp_bitrate_step {
+    PA_A2DP_BITRATE_KEEP,
+    PA_A2DP_BITRATE_DECREASE,
+    PA_A2DP_BITRATE_INCREASE,
+} pa_a2dp_bitrate_step_t;
+
+/* Decides when the encoder bitrate should change, based on how full the
+ * send buffer of the socket gets */
+pa_a2dp_bitrate_control *pa_a2dp_bitrate_control_new(void);
+void pa_a2dp_bitrate_control_free(pa_a2dp_bitrate_control *c);
+
+/* Called after every packet that was written or failed to be written, with
+ * the number of bytes waiting in the send buffer and the size of the buffer.
+ * congested is true if the socket did not take the packet, or if audio had
+ * to be skipped because the socket did not take the packets in time. */
+pa_a2dp_bitrate_step_t pa_a2dp_bitrate_control_update(pa_a2dp_bitrate_control *c, pa_usec_t now, size_t queued, size_t capacity, bool congested);
+
+/* Undoes the step that was returned last, for when the encoder is already
+ * at its highest or lowest bitrate and could not take it. Otherwise the
+ * controller would count steps that never happened. */
+void pa_a2dp_bitrate_control_reject(pa_a2dp_bitrate_control *c);
+
+#endif
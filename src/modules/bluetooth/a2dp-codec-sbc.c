@@ -38,6 +38,7 @@
 
 #define SBC_BITPOOL_DEC_LIMIT 32
 #define SBC_BITPOOL_DEC_STEP 5
+#define SBC_BITPOOL_INC_STEP 5
 
 struct sbc_info {
     sbc_t sbc;                           /* Codec data */
@@ -515,6 +516,29 @@ static size_t reduce_encoder_bitrate(void *codec_info, size_t write_link_mtu) {
     return get_block_size(codec_info, write_link_mtu);
 }
 
+static size_t increase_encoder_bitrate(void *codec_info, size_t write_link_mtu) {
+    struct sbc_info *sbc_info = (struct sbc_info *) codec_info;
+
+    /* Check if bitpool is already at its limit */
+    if (sbc_info->sbc.bitpool >= sbc_info->max_bitpool)
+        return 0;
+
+    /* set_bitpool() clamps this to max_bitpool */
+    set_bitpool(sbc_info, sbc_info->sbc.bitpool + SBC_BITPOOL_INC_STEP);
+    return get_block_size(codec_info, write_link_mtu);
+}
+
+static uint32_t get_encoder_bitrate(void *codec_info) {
+    static const uint32_t rates[] = { 16000, 32000, 44100, 48000 };
+    struct sbc_info *sbc_info = (struct sbc_info *) codec_info;
+    uint32_t samples;
+
+    /* Number of samples per channel in one frame */
+    samples = (sbc_info->sbc.subbands ? 8 : 4) * (sbc_info->sbc.blocks + 1) * 4;
+
+    return (uint32_t) ((uint64_t) sbc_info->frame_length * 8 * rates[sbc_info->sbc.frequency] / samples);
+}
+
 static size_t encode_buffer(void *codec_info, uint32_t timestamp, const uint8_t *input_buffer, size_t input_size, uint8_t *output_buffer, size_t output_size, size_t *processed) {
     struct sbc_info *sbc_info = (struct sbc_info *) codec_info;
     struct rtp_header *header;
@@ -677,6 +701,8 @@ const pa_a2dp_codec pa_a2dp_codec_sbc = {
     .get_read_block_size = get_block_size,
     .get_write_block_size = get_block_size,
     .reduce_encoder_bitrate = reduce_encoder_bitrate,
+    .increase_encoder_bitrate = increase_encoder_bitrate,
+    .get_encoder_bitrate = get_encoder_bitrate,
     .encode_buffer = encode_buffer,
     .decode_buffer = decode_buffer,
 };
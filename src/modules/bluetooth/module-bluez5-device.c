@@ -26,6 +26,8 @@
 #include <errno.h>
 
 #include <arpa/inet.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -40,12 +42,14 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/poll.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/semaphore.h>
 #include <pulsecore/shared.h>
 #include <pulsecore/socket-util.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/time-smoother.h>
 
+#include "a2dp-bitrate-control.h"
 #include "a2dp-codecs.h"
 #include "a2dp-codec-util.h"
 #include "bluez5-util.h"
@@ -64,6 +68,9 @@ PA_MODULE_USAGE("path=<device object path>"
 
 #define HSP_MAX_GAIN 15
 
+/* Number of A2DP packets in flight between the IO and the encoder thread */
+#define A2DP_ENCODER_PACKETS 2
+
 static const char* const valid_modargs[] = {
     "path",
     "autodetect_mtu",
@@ -74,6 +81,7 @@ enum {
     BLUETOOTH_MESSAGE_IO_THREAD_FAILED,
     BLUETOOTH_MESSAGE_STREAM_FD_HUP,
     BLUETOOTH_MESSAGE_SET_TRANSPORT_PLAYING,
+    BLUETOOTH_MESSAGE_SET_BITRATE,
     BLUETOOTH_MESSAGE_MAX
 };
 
@@ -92,6 +100,14 @@ typedef struct bluetooth_msg {
 PA_DEFINE_PRIVATE_CLASS(bluetooth_msg, pa_msgobject);
 #define BLUETOOTH_MSG(o) (bluetooth_msg_cast(o))
 
+struct a2dp_packet {
+    pa_memchunk memchunk;                        /* Rendered audio */
+    uint64_t index;                              /* Stream position of the audio, in bytes */
+    void *buffer;                                /* Encoded packet */
+    size_t length;                               /* Size of the encoded packet */
+    bool failed;
+};
+
 struct userdata {
     pa_module *module;
     pa_core *core;
@@ -126,18 +142,40 @@ struct userdata {
     size_t write_link_mtu;
     size_t read_block_size;
     size_t write_block_size;
+    size_t write_buffer_size;                    /* Send buffer size of the socket */
     uint64_t read_index;
     uint64_t write_index;
     pa_usec_t started_at;
     pa_smoother *read_smoother;
-    pa_memchunk write_memchunk;
 
     const pa_a2dp_codec *a2dp_codec;
 
     void *encoder_info;
     pa_sample_spec encoder_sample_spec;
-    void *encoder_buffer;                        /* Codec transfer buffer */
-    size_t encoder_buffer_size;                  /* Size of the buffer */
+    size_t encoder_buffer_size;                  /* Size of the packet buffers */
+
+    /* A2DP encoding runs in a thread of its own. The IO thread renders
+     * audio into the packet ring and writes the packets to the socket
+     * once the encoder thread is done with them. */
+    pa_thread *encoder_thread;
+    pa_semaphore *encoder_semaphore;
+    pa_fdsem *encoder_fdsem;
+    pa_rtpoll_item *encoder_rtpoll_item;
+    struct a2dp_packet encoder_packets[A2DP_ENCODER_PACKETS];
+    pa_atomic_t encoder_submitted;               /* Packets rendered */
+    pa_atomic_t encoder_encoded;                 /* Packets encoded */
+    unsigned encoder_written;                    /* Packets written or discarded */
+    pa_atomic_t encoder_quit;
+
+    /* Statistics, logged when the stream is torn down */
+    unsigned n_socket_full;
+    unsigned n_encoded;
+    pa_usec_t encode_usec;
+    pa_usec_t encode_usec_max;
+
+    pa_a2dp_bitrate_control *bitrate_control;
+    pa_a2dp_bitrate_step_t bitrate_step;         /* Pending bitrate change */
+    bool bitrate_at_max;
 
     void *decoder_info;
     pa_sample_spec decoder_sample_spec;
@@ -410,18 +448,169 @@ static int sco_process_push(struct userdata *u) {
     return l;
 }
 
+/* Run from encoder thread */
+static void a2dp_encode_packet(struct userdata *u, struct a2dp_packet *p) {
+    const uint8_t *ptr;
+    size_t processed;
+    pa_usec_t start, elapsed;
+
+    start = pa_rtclock_now();
+
+    /* Try to create a packet of the full MTU */
+    ptr = (const uint8_t *) pa_memblock_acquire_chunk(&p->memchunk);
+
+    p->length = u->a2dp_codec->encode_buffer(u->encoder_info, p->index / pa_frame_size(&u->encoder_sample_spec), ptr, p->memchunk.length, p->buffer, u->encoder_buffer_size, &processed);
+
+    pa_memblock_release(p->memchunk.memblock);
+
+    p->failed = processed != p->memchunk.length;
+
+    elapsed = pa_rtclock_now() - start;
+    u->n_encoded++;
+    u->encode_usec += elapsed;
+    u->encode_usec_max = PA_MAX(u->encode_usec_max, elapsed);
+}
+
+/* Encoder thread function */
+static void encoder_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    if (u->core->realtime_scheduling)
+        pa_thread_make_realtime(u->core->realtime_priority);
+
+    for (;;) {
+        pa_semaphore_wait(u->encoder_semaphore);
+
+        /* Everything that was submitted is encoded before quitting, the IO
+         * thread may still want to write it */
+        while (pa_atomic_load(&u->encoder_encoded) != pa_atomic_load(&u->encoder_submitted)) {
+            unsigned i = (unsigned) pa_atomic_load(&u->encoder_encoded);
+
+            a2dp_encode_packet(u, &u->encoder_packets[i % A2DP_ENCODER_PACKETS]);
+
+            pa_atomic_inc(&u->encoder_encoded);
+            pa_fdsem_post(u->encoder_fdsem);
+        }
+
+        if (pa_atomic_load(&u->encoder_quit))
+            break;
+    }
+}
+
 /* Run from IO thread */
-static void a2dp_prepare_encoder_buffer(struct userdata *u) {
+static void a2dp_encoder_stop(struct userdata *u) {
     pa_assert(u);
 
-    if (u->encoder_buffer_size < u->write_link_mtu) {
-        pa_xfree(u->encoder_buffer);
-        u->encoder_buffer = pa_xmalloc(u->write_link_mtu);
+    if (u->encoder_thread) {
+        pa_atomic_store(&u->encoder_quit, 1);
+        pa_semaphore_post(u->encoder_semaphore);
+        pa_thread_free(u->encoder_thread);
+        u->encoder_thread = NULL;
+    }
+
+    if (u->encoder_rtpoll_item) {
+        pa_rtpoll_item_free(u->encoder_rtpoll_item);
+        u->encoder_rtpoll_item = NULL;
+    }
+
+    if (u->encoder_fdsem) {
+        pa_fdsem_free(u->encoder_fdsem);
+        u->encoder_fdsem = NULL;
     }
 
+    if (u->encoder_semaphore) {
+        pa_semaphore_free(u->encoder_semaphore);
+        u->encoder_semaphore = NULL;
+    }
+}
+
+/* Run from IO thread */
+static int a2dp_encoder_start(struct userdata *u) {
+    unsigned i;
+
+    pa_assert(u);
+    pa_assert(!u->encoder_thread);
+
     /* Encoder buffer cannot be larger then link MTU, otherwise
      * encode method would produce larger packets then link MTU */
-    u->encoder_buffer_size = u->write_link_mtu;
+    if (u->encoder_buffer_size != u->write_link_mtu) {
+        for (i = 0; i < A2DP_ENCODER_PACKETS; i++) {
+            pa_assert(!u->encoder_packets[i].memchunk.memblock);
+            pa_xfree(u->encoder_packets[i].buffer);
+            u->encoder_packets[i].buffer = pa_xmalloc(u->write_link_mtu);
+        }
+
+        u->encoder_buffer_size = u->write_link_mtu;
+    }
+
+    if (!(u->encoder_fdsem = pa_fdsem_new())) {
+        pa_log_error("Failed to create encoder fdsem");
+        return -1;
+    }
+
+    u->encoder_semaphore = pa_semaphore_new(0);
+    u->encoder_rtpoll_item = pa_rtpoll_item_new_fdsem(u->rtpoll, PA_RTPOLL_NORMAL, u->encoder_fdsem);
+    pa_atomic_store(&u->encoder_quit, 0);
+
+    if (!(u->encoder_thread = pa_thread_new("bluetooth-enc", encoder_thread_func, u))) {
+        pa_log_error("Failed to create encoder thread");
+        a2dp_encoder_stop(u);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Run from IO thread, returns the number of bytes of audio that were
+ * rendered but not written yet */
+static size_t a2dp_encoder_queued(struct userdata *u) {
+    unsigned i, submitted = (unsigned) pa_atomic_load(&u->encoder_submitted);
+    size_t length = 0;
+
+    for (i = u->encoder_written; i != submitted; i++)
+        length += u->encoder_packets[i % A2DP_ENCODER_PACKETS].memchunk.length;
+
+    return length;
+}
+
+/* Run from IO thread. Renders audio into the free slots of the ring and
+ * returns true while the next packet is still being encoded. */
+static bool a2dp_encoder_busy(struct userdata *u) {
+    unsigned submitted = (unsigned) pa_atomic_load(&u->encoder_submitted);
+
+    pa_assert(u->encoder_thread);
+
+    while (submitted - u->encoder_written < A2DP_ENCODER_PACKETS) {
+        struct a2dp_packet *p = &u->encoder_packets[submitted % A2DP_ENCODER_PACKETS];
+
+        p->index = u->write_index + a2dp_encoder_queued(u);
+        pa_sink_render_full(u->sink, u->write_block_size, &p->memchunk);
+
+        submitted = (unsigned) pa_atomic_inc(&u->encoder_submitted) + 1;
+        pa_semaphore_post(u->encoder_semaphore);
+    }
+
+    return (unsigned) pa_atomic_load(&u->encoder_encoded) == u->encoder_written;
+}
+
+/* Run from IO thread, after the encoder thread has stopped */
+static void a2dp_encoder_drop(struct userdata *u) {
+    unsigned submitted = (unsigned) pa_atomic_load(&u->encoder_submitted);
+
+    pa_assert(!u->encoder_thread);
+
+    for (; u->encoder_written != submitted; u->encoder_written++) {
+        struct a2dp_packet *p = &u->encoder_packets[u->encoder_written % A2DP_ENCODER_PACKETS];
+
+        pa_memblock_unref(p->memchunk.memblock);
+        pa_memchunk_reset(&p->memchunk);
+    }
+
+    pa_atomic_store(&u->encoder_submitted, 0);
+    pa_atomic_store(&u->encoder_encoded, 0);
+    u->encoder_written = 0;
 }
 
 /* Run from IO thread */
@@ -439,24 +628,61 @@ static void a2dp_prepare_decoder_buffer(struct userdata *u) {
 }
 
 /* Run from IO thread */
-static int a2dp_write_buffer(struct userdata *u, size_t nbytes) {
+static void post_bitrate(struct userdata *u) {
+    uint32_t bitrate = u->a2dp_codec->get_encoder_bitrate(u->encoder_info);
+
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->msg), BLUETOOTH_MESSAGE_SET_BITRATE, NULL, bitrate, NULL, NULL);
+}
+
+/* Run from IO thread */
+static void update_bitrate_control(struct userdata *u, bool congested) {
+    int free_space;
+    size_t queued = 0;
+    pa_a2dp_bitrate_step_t step;
+
+    pa_assert(u->bitrate_control);
+
+    /* On Bluetooth sockets SIOCOUTQ reports the free space in the send
+     * buffer, not the number of bytes queued */
+    if (ioctl(u->stream_fd, SIOCOUTQ, &free_space) >= 0 && free_space >= 0 && (size_t) free_space < u->write_buffer_size)
+        queued = u->write_buffer_size - (size_t) free_space;
+
+    step = pa_a2dp_bitrate_control_update(u->bitrate_control, pa_rtclock_now(), queued, u->write_buffer_size, congested);
+
+    if (step == PA_A2DP_BITRATE_INCREASE && u->bitrate_at_max) {
+        pa_a2dp_bitrate_control_reject(u->bitrate_control);
+        return;
+    }
+
+    if (step != PA_A2DP_BITRATE_KEEP)
+        u->bitrate_step = step;
+}
+
+/* Run from IO thread */
+static void a2dp_packet_done(struct userdata *u, struct a2dp_packet *p) {
+    u->write_index += (uint64_t) p->memchunk.length;
+    pa_memblock_unref(p->memchunk.memblock);
+    pa_memchunk_reset(&p->memchunk);
+    u->encoder_written++;
+}
+
+/* Run from IO thread */
+static int a2dp_write_buffer(struct userdata *u, struct a2dp_packet *p) {
     int ret = 0;
 
     /* Encoder function of A2DP codec may provide empty buffer, in this case do
      * not post any empty buffer via A2DP socket. It may be because of codec
      * internal state, e.g. encoder is waiting for more samples so it can
      * provide encoded data. */
-    if (PA_UNLIKELY(!nbytes)) {
-        u->write_index += (uint64_t) u->write_memchunk.length;
-        pa_memblock_unref(u->write_memchunk.memblock);
-        pa_memchunk_reset(&u->write_memchunk);
+    if (PA_UNLIKELY(!p->length)) {
+        a2dp_packet_done(u, p);
         return 0;
     }
 
     for (;;) {
         ssize_t l;
 
-        l = pa_write(u->stream_fd, u->encoder_buffer, nbytes, &u->stream_write_type);
+        l = pa_write(u->stream_fd, p->buffer, p->length, &u->stream_write_type);
 
         pa_assert(l != 0);
 
@@ -468,7 +694,9 @@ static int a2dp_write_buffer(struct userdata *u, size_t nbytes) {
 
             else if (errno == EAGAIN) {
                 /* Hmm, apparently the socket was not writable, give up for now */
-                pa_log_debug("Got EAGAIN on write() after POLLOUT, probably there is a temporary connection loss.");
+                pa_log_debug("Got EAGAIN on write(), the socket is full. Probably there is a temporary connection loss.");
+                u->n_socket_full++;
+                update_bitrate_control(u, true);
                 break;
             }
 
@@ -477,19 +705,18 @@ static int a2dp_write_buffer(struct userdata *u, size_t nbytes) {
             break;
         }
 
-        pa_assert((size_t) l <= nbytes);
+        pa_assert((size_t) l <= p->length);
 
-        if ((size_t) l != nbytes) {
+        if ((size_t) l != p->length) {
             pa_log_warn("Wrote memory block to socket only partially! %llu written, wanted to write %llu.",
                         (unsigned long long) l,
-                        (unsigned long long) nbytes);
+                        (unsigned long long) p->length);
             ret = -1;
             break;
         }
 
-        u->write_index += (uint64_t) u->write_memchunk.length;
-        pa_memblock_unref(u->write_memchunk.memblock);
-        pa_memchunk_reset(&u->write_memchunk);
+        a2dp_packet_done(u, p);
+        update_bitrate_control(u, false);
 
         ret = 1;
 
@@ -501,36 +728,25 @@ static int a2dp_write_buffer(struct userdata *u, size_t nbytes) {
 
 /* Run from IO thread */
 static int a2dp_process_render(struct userdata *u) {
-    const uint8_t *ptr;
-    size_t processed;
-    size_t length;
+    struct a2dp_packet *p;
 
     pa_assert(u);
     pa_assert(u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK);
     pa_assert(u->sink);
     pa_assert(u->a2dp_codec);
 
-    /* First, render some data */
-    if (!u->write_memchunk.memblock)
-        pa_sink_render_full(u->sink, u->write_block_size, &u->write_memchunk);
-
-    pa_assert(u->write_memchunk.length == u->write_block_size);
-
-    a2dp_prepare_encoder_buffer(u);
-
-    /* Try to create a packet of the full MTU */
-    ptr = (const uint8_t *) pa_memblock_acquire_chunk(&u->write_memchunk);
-
-    length = u->a2dp_codec->encode_buffer(u->encoder_info, u->write_index / pa_frame_size(&u->encoder_sample_spec), ptr, u->write_memchunk.length, u->encoder_buffer, u->encoder_buffer_size, &processed);
+    /* The encoder thread wakes us up once the packet is ready */
+    if (a2dp_encoder_busy(u))
+        return 0;
 
-    pa_memblock_release(u->write_memchunk.memblock);
+    p = &u->encoder_packets[u->encoder_written % A2DP_ENCODER_PACKETS];
 
-    if (processed != u->write_memchunk.length) {
+    if (p->failed) {
         pa_log_error("Encoding error");
         return -1;
     }
 
-    return a2dp_write_buffer(u, length);
+    return a2dp_write_buffer(u, p);
 }
 
 /* Run from IO thread */
@@ -643,7 +859,7 @@ static int a2dp_process_push(struct userdata *u) {
 }
 
 static void update_sink_buffer_size(struct userdata *u) {
-    int old_bufsize;
+    int old_bufsize, bufsize;
     socklen_t len = sizeof(int);
     int ret;
 
@@ -672,6 +888,14 @@ static void update_sink_buffer_size(struct userdata *u) {
                 pa_log_info("Changing bluetooth buffer size: Changed from %d to %d", old_bufsize / 2, new_bufsize);
         }
     }
+
+    /* The bitrate control needs the actual size, which includes the overhead
+     * that the kernel added */
+    len = sizeof(int);
+    if (getsockopt(u->stream_fd, SOL_SOCKET, SO_SNDBUF, &bufsize, &len) >= 0)
+        u->write_buffer_size = (size_t) bufsize;
+    else
+        u->write_buffer_size = 0;
 }
 
 static void teardown_stream(struct userdata *u) {
@@ -690,11 +914,24 @@ static void teardown_stream(struct userdata *u) {
         u->read_smoother = NULL;
     }
 
-    if (u->write_memchunk.memblock) {
-        pa_memblock_unref(u->write_memchunk.memblock);
-        pa_memchunk_reset(&u->write_memchunk);
+    a2dp_encoder_stop(u);
+    a2dp_encoder_drop(u);
+
+    if (u->bitrate_control) {
+        pa_a2dp_bitrate_control_free(u->bitrate_control);
+        u->bitrate_control = NULL;
     }
 
+    if (u->n_encoded > 0)
+        pa_log_debug("Encoded %u packets, %0.2f ms on average, %0.2f ms at most. The socket was full %u times.",
+                     u->n_encoded,
+                     (double) u->encode_usec / u->n_encoded / PA_USEC_PER_MSEC,
+                     (double) u->encode_usec_max / PA_USEC_PER_MSEC,
+                     u->n_socket_full);
+
+    u->n_encoded = u->n_socket_full = 0;
+    u->encode_usec = u->encode_usec_max = 0;
+
     pa_log_debug("Audio stream torn down");
     u->stream_setup_done = false;
 }
@@ -755,13 +992,6 @@ static void handle_sink_block_size_change(struct userdata *u) {
                                              FIXED_LATENCY_PLAYBACK_A2DP : FIXED_LATENCY_PLAYBACK_SCO) +
                                             pa_bytes_to_usec(u->write_block_size, &u->encoder_sample_spec));
 
-    /* If there is still data in the memchunk, we have to discard it
-     * because the write_block_size may have changed. */
-    if (u->write_memchunk.memblock) {
-        pa_memblock_unref(u->write_memchunk.memblock);
-        pa_memchunk_reset(&u->write_memchunk);
-    }
-
     update_sink_buffer_size(u);
 }
 
@@ -824,6 +1054,16 @@ static int setup_stream(struct userdata *u) {
 
     transport_config_mtu(u);
 
+    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
+        if (a2dp_encoder_start(u) < 0)
+            return -1;
+
+        u->bitrate_control = pa_a2dp_bitrate_control_new();
+        u->bitrate_step = PA_A2DP_BITRATE_KEEP;
+        u->bitrate_at_max = false;
+        post_bitrate(u);
+    }
+
     pa_make_fd_nonblock(u->stream_fd);
     pa_make_socket_low_delay(u->stream_fd);
 
@@ -1067,7 +1307,7 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                 wi = pa_bytes_to_usec(u->write_index + u->write_block_size, &u->encoder_sample_spec);
             } else if (u->started_at) {
                 ri = pa_rtclock_now() - u->started_at;
-                wi = pa_bytes_to_usec(u->write_index, &u->encoder_sample_spec);
+                wi = pa_bytes_to_usec(u->write_index + a2dp_encoder_queued(u), &u->encoder_sample_spec);
             }
 
             *((int64_t*) data) = u->sink->thread_info.fixed_latency + wi - ri;
@@ -1336,6 +1576,38 @@ static int init_profile(struct userdata *u) {
     return r;
 }
 
+/* Run from IO thread. The encoder state must not change under the encoder
+ * thread, so the step waits until the thread has encoded everything that
+ * was submitted. It posts the fdsem when done, which brings us back here.
+ * Packets that are already queued keep their size. */
+static void apply_bitrate_step(struct userdata *u) {
+    size_t new_write_block_size;
+
+    if (u->encoder_thread && pa_atomic_load(&u->encoder_encoded) != pa_atomic_load(&u->encoder_submitted))
+        return;
+
+    if (u->bitrate_step == PA_A2DP_BITRATE_DECREASE) {
+        new_write_block_size = u->a2dp_codec->reduce_encoder_bitrate(u->encoder_info, u->write_link_mtu);
+        if (new_write_block_size)
+            u->bitrate_at_max = false;
+    } else {
+        new_write_block_size = u->a2dp_codec->increase_encoder_bitrate(u->encoder_info, u->write_link_mtu);
+        if (!new_write_block_size)
+            u->bitrate_at_max = true;
+    }
+
+    u->bitrate_step = PA_A2DP_BITRATE_KEEP;
+
+    if (!new_write_block_size) {
+        pa_a2dp_bitrate_control_reject(u->bitrate_control);
+        return;
+    }
+
+    u->write_block_size = new_write_block_size;
+    handle_sink_block_size_change(u);
+    post_bitrate(u);
+}
+
 static int write_block(struct userdata *u) {
     int n_written;
 
@@ -1473,6 +1745,7 @@ static void thread_func(void *userdata) {
                 /* There is no source, we have to use the system clock for timing */
                 } else {
                     bool have_written = false;
+                    bool waiting_for_encoder = false;
                     pa_usec_t time_passed = 0;
                     pa_usec_t audio_sent = 0;
 
@@ -1498,6 +1771,9 @@ static void thread_func(void *userdata) {
                             skip_bytes = bytes_to_send - 2 * u->write_block_size;
                             skip_usec = pa_bytes_to_usec(skip_bytes, &u->encoder_sample_spec);
 
+                            /* Only what is left after the skip is still due */
+                            bytes_to_send -= skip_bytes;
+
                             pa_log_debug("Skipping %llu us (= %llu bytes) in audio stream",
                                         (unsigned long long) skip_usec,
                                         (unsigned long long) skip_bytes);
@@ -1516,35 +1792,47 @@ static void thread_func(void *userdata) {
                                 skip_bytes -= bytes_to_render;
                             }
 
-                            if (u->write_index > 0 && u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
-                                size_t new_write_block_size = u->a2dp_codec->reduce_encoder_bitrate(u->encoder_info, u->write_link_mtu);
-                                if (new_write_block_size) {
-                                    u->write_block_size = new_write_block_size;
-                                    handle_sink_block_size_change(u);
-                                }
-                            }
+                            if (u->write_index > 0 && u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
+                                update_bitrate_control(u, true);
                         }
 
-                        blocks_to_write = 1;
+                        /* Every block that is due goes out right away */
+                        blocks_to_write = bytes_to_send / u->write_block_size + 1;
                     }
 
-                    /* If the stream is writable, send some data if necessary */
-                    if (writable && blocks_to_write > 0) {
+                    if (u->bitrate_step != PA_A2DP_BITRATE_KEEP)
+                        apply_bitrate_step(u);
+
+                    /* If the stream is writable, send some data if necessary. Blocks that
+                     * are due are written back to back until the socket is full. */
+                    while (writable && blocks_to_write > 0) {
                         int result;
 
+                        if (u->encoder_thread && a2dp_encoder_busy(u)) {
+                            waiting_for_encoder = true;
+                            break;
+                        }
+
                         if ((result = write_block(u)) < 0)
                             goto fail;
 
+                        if (result == 0) {
+                            writable = false;
+                            break;
+                        }
+
                         blocks_to_write -= result;
-                        writable = false;
-                        if (result)
-                            have_written = true;
+                        have_written = true;
                     }
 
+                    if (have_written)
+                        writable = false;
+
                     /* If nothing was written during this iteration, either the stream
                      * is not writable or there was no write pending. Set up a timer that
-                     * will wake up the thread when the next data needs to be written. */
-                    if (!have_written) {
+                     * will wake up the thread when the next data needs to be written.
+                     * If the encoder thread is still busy, it will wake us up itself. */
+                    if (!have_written && !waiting_for_encoder) {
                         pa_usec_t sleep_for;
                         pa_usec_t next_write_at;
 
@@ -1670,6 +1958,8 @@ static void stop_thread(struct userdata *u) {
         u->rtpoll_item = NULL;
     }
 
+    a2dp_encoder_stop(u);
+
     if (u->rtpoll) {
         pa_rtpoll_free(u->rtpoll);
         u->rtpoll = NULL;
@@ -2262,6 +2552,16 @@ static int device_process_msg(pa_msgobject *obj, int code, void *data, int64_t o
             if (u->transport_acquired)
                 pa_bluetooth_transport_set_state(u->transport, PA_BLUETOOTH_TRANSPORT_STATE_PLAYING);
             break;
+        case BLUETOOTH_MESSAGE_SET_BITRATE:
+            /* The profile may have changed since the message was posted */
+            if (u->sink && u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
+                pa_proplist *p = pa_proplist_new();
+
+                pa_proplist_setf(p, "bluetooth.bitrate", "%u", (unsigned) offset);
+                pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, p);
+                pa_proplist_free(p);
+            }
+            break;
     }
 
     return 0;
@@ -2366,6 +2666,7 @@ fail:
 
 void pa__done(pa_module *m) {
     struct userdata *u;
+    unsigned i;
 
     pa_assert(m);
 
@@ -2386,8 +2687,8 @@ void pa__done(pa_module *m) {
     if (u->transport_microphone_gain_changed_slot)
         pa_hook_slot_free(u->transport_microphone_gain_changed_slot);
 
-    if (u->encoder_buffer)
-        pa_xfree(u->encoder_buffer);
+    for (i = 0; i < A2DP_ENCODER_PACKETS; i++)
+        pa_xfree(u->encoder_packets[i].buffer);
 
     if (u->decoder_buffer)
         pa_xfree(u->decoder_buffer);
@@ -47,6 +47,9 @@ struct pa_echo_canceller_params {
         struct {
             pa_sample_spec out_ss;
         } null;
+        struct {
+            struct pbfdaf *aec;
+        } pbfdaf;
 #ifdef HAVE_SPEEX
         struct {
             SpeexEchoState *state;
@@ -148,6 +151,15 @@ bool pa_null_ec_init(pa_core *c, pa_echo_canceller *ec,
 void pa_null_ec_run(pa_echo_canceller *ec, const uint8_t *rec, const uint8_t *play, uint8_t *out);
 void pa_null_ec_done(pa_echo_canceller *ec);
 
+/* Partitioned block frequency domain adaptive filter */
+bool pa_pbfdaf_ec_init(pa_core *c, pa_echo_canceller *ec,
+                       pa_sample_spec *rec_ss, pa_channel_map *rec_map,
+                       pa_sample_spec *play_ss, pa_channel_map *play_map,
+                       pa_sample_spec *out_ss, pa_channel_map *out_map,
+                       uint32_t *nframes, const char *args);
+void pa_pbfdaf_ec_run(pa_echo_canceller *ec, const uint8_t *rec, const uint8_t *play, uint8_t *out);
+void pa_pbfdaf_ec_done(pa_echo_canceller *ec);
+
 #ifdef HAVE_SPEEX
 /* Speex canceller functions */
 bool pa_speex_ec_init(pa_core *c, pa_echo_canceller *ec,
@@ -29,6 +29,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "echo-cancel.h"
@@ -36,9 +37,11 @@
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
 #include <pulse/rtclock.h>
+#include <pulse/util.h>
 
 #include <pulsecore/i18n.h>
 #include <pulsecore/atomic.h>
+#include <pulsecore/asyncq.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sink.h>
@@ -47,10 +50,20 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
+#include <pulsecore/poll.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/ltdl-helper.h>
 
+#ifdef ECHO_CANCEL_TEST
+#include <errno.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/sconv.h>
+#include <pulsecore/sndfile-util.h>
+#endif
+
 PA_MODULE_AUTHOR("Wim Taymans");
 PA_MODULE_DESCRIPTION("Echo Cancellation");
 PA_MODULE_VERSION(PACKAGE_VERSION);
@@ -74,12 +87,14 @@ PA_MODULE_USAGE(
           "autoloaded=<set if this module is being loaded automatically> "
           "use_volume_sharing=<yes or no> "
           "use_master_format=<yes or no> "
+          "use_thread=<run the canceller on its own thread> "
         ));
 
 /* NOTE: Make sure the enum and ec_table are maintained in the correct order */
 typedef enum {
     PA_ECHO_CANCELLER_INVALID = -1,
     PA_ECHO_CANCELLER_NULL,
+    PA_ECHO_CANCELLER_PBFDAF,
 #ifdef HAVE_SPEEX
     PA_ECHO_CANCELLER_SPEEX,
 #endif
@@ -104,6 +119,12 @@ static const pa_echo_canceller ec_table[] = {
         .run                    = pa_null_ec_run,
         .done                   = pa_null_ec_done,
     },
+    {
+        /* Built-in partitioned block frequency domain adaptive filter */
+        .init                   = pa_pbfdaf_ec_init,
+        .run                    = pa_pbfdaf_ec_run,
+        .done                   = pa_pbfdaf_ec_done,
+    },
 #ifdef HAVE_SPEEX
     {
         /* Speex */
@@ -140,11 +161,15 @@ static const pa_echo_canceller ec_table[] = {
 #define DEFAULT_SAVE_AEC false
 #define DEFAULT_AUTOLOADED false
 #define DEFAULT_USE_MASTER_FORMAT false
+#define DEFAULT_USE_THREAD false
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
 #define MAX_LATENCY_BLOCKS 10
 
+/* How many blocks may be queued up for the canceller thread */
+#define EC_THREAD_MAX_JOBS 32
+
 /* Can only be used in main context */
 #define IS_ACTIVE(u) (((u)->source->state == PA_SOURCE_RUNNING) && \
                       ((u)->sink->state == PA_SINK_RUNNING))
@@ -176,6 +201,14 @@ static const pa_echo_canceller ec_table[] = {
  *    be before capture and the difference should not be bigger than one frame
  *    size. We would ideally like to resample the sink_input but most driver
  *    don't give enough accuracy to be able to do that right now.
+ *
+ * With use_thread=true the canceller itself is run on a thread of its own,
+ * so that a heavy canceller does not hold up the master source's I/O thread
+ * (and with it every other source output of that source). The I/O thread
+ * still does all the bookkeeping above, but instead of running the canceller
+ * it hands the blocks over to the canceller thread through a lock-free queue
+ * and posts the canceled blocks when they come back through a second one.
+ * This adds one block of latency when the canceller keeps up.
  */
 
 struct userdata;
@@ -189,6 +222,27 @@ struct pa_echo_canceller_msg {
 PA_DEFINE_PRIVATE_CLASS(pa_echo_canceller_msg, pa_msgobject);
 #define PA_ECHO_CANCELLER_MSG(o) (pa_echo_canceller_msg_cast(o))
 
+/* Processing stages we keep timing statistics for. These are published as
+ * source properties so the cost of each stage can be inspected at run time. */
+enum {
+    EC_TIMING_RESYNC,
+    EC_TIMING_DRIFT_COMP,
+    EC_TIMING_CANCELLER,
+    EC_TIMING_MAX
+};
+
+static const char* const ec_timing_names[EC_TIMING_MAX] = {
+    [EC_TIMING_RESYNC] = "resync",
+    [EC_TIMING_DRIFT_COMP] = "drift_compensation",
+    [EC_TIMING_CANCELLER] = "canceller",
+};
+
+struct ec_timing {
+    uint64_t count;
+    pa_usec_t total;
+    pa_usec_t max;
+};
+
 struct snapshot {
     pa_usec_t sink_now;
     pa_usec_t sink_latency;
@@ -201,6 +255,14 @@ struct snapshot {
     int64_t recv_counter;
     size_t rlen;
     size_t plen;
+
+    struct ec_timing timing[EC_TIMING_MAX];
+};
+
+/* A block handed to the canceller thread */
+struct ec_job {
+    pa_memchunk rchunk, pchunk, cchunk;
+    pa_usec_t elapsed;
 };
 
 struct userdata {
@@ -252,8 +314,29 @@ struct userdata {
 
     bool use_volume_sharing;
 
+    /* Canceller thread, see use_thread */
+    pa_thread *ec_thread;
+    pa_asyncq *ec_jobs;         /* source I/O thread -> canceller thread */
+    pa_asyncq *ec_results;      /* canceller thread -> source I/O thread */
+    pa_rtpoll_item *rtpoll_item_results;
+    struct ec_job ec_job_pool[EC_THREAD_MAX_JOBS];
+
+    /* Last timing statistics, shown as source properties */
+    struct ec_timing timing[EC_TIMING_MAX];
+
     struct {
-        pa_cvolume current_volume;
+        /* The average of the source volume. Read by the canceller, which
+         * may run on its own thread, so only the average is kept. */
+        pa_atomic_t current_volume;
+        struct ec_timing timing[EC_TIMING_MAX];
+
+        /* Used by the canceller thread to post volume changes */
+        pa_asyncmsgq *outq;
+
+        /* Blocks that have been handed to the canceller thread and not
+         * posted yet */
+        unsigned ec_jobs_submitted, ec_jobs_completed;
+        size_t ec_pending_rlen, ec_pending_plen;
     } thread_info;
 };
 
@@ -278,6 +361,7 @@ static const char* const valid_modargs[] = {
     "autoloaded",
     "use_volume_sharing",
     "use_master_format",
+    "use_thread",
     NULL
 };
 
@@ -334,6 +418,46 @@ static int64_t calc_diff(struct userdata *u, struct snapshot *snapshot) {
     return diff_time;
 }
 
+/* Called from source I/O thread context. */
+static void add_timing(struct userdata *u, unsigned stage, pa_usec_t elapsed) {
+    struct ec_timing *t = &u->thread_info.timing[stage];
+
+    t->count++;
+    t->total += elapsed;
+    if (elapsed > t->max)
+        t->max = elapsed;
+}
+
+/* Called from source I/O thread context. */
+static pa_usec_t account_timing(struct userdata *u, unsigned stage, pa_usec_t start) {
+    pa_usec_t elapsed = pa_rtclock_now() - start;
+
+    add_timing(u, stage, elapsed);
+
+    return elapsed;
+}
+
+/* Called from main context. The statistics change all the time, so they
+ * are only put into the proplist when it is shown. */
+static void source_update_stats_cb(pa_source *s) {
+    struct userdata *u;
+    unsigned i;
+
+    pa_source_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    for (i = 0; i < EC_TIMING_MAX; i++) {
+        char key[64];
+
+        pa_snprintf(key, sizeof(key), "echo_cancel.%s.count", ec_timing_names[i]);
+        pa_proplist_setf(s->proplist, key, "%llu", (unsigned long long) u->timing[i].count);
+        pa_snprintf(key, sizeof(key), "echo_cancel.%s.total_usec", ec_timing_names[i]);
+        pa_proplist_setf(s->proplist, key, "%llu", (unsigned long long) u->timing[i].total);
+        pa_snprintf(key, sizeof(key), "echo_cancel.%s.max_usec", ec_timing_names[i]);
+        pa_proplist_setf(s->proplist, key, "%llu", (unsigned long long) u->timing[i].max);
+    }
+}
+
 /* Called from main context */
 static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
     struct userdata *u = userdata;
@@ -354,6 +478,8 @@ static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct tim
     pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
     pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
 
+    memcpy(u->timing, latency_snapshot.timing, sizeof(u->timing));
+
     /* calculate drift between capture and playback */
     diff_time = calc_diff(u, &latency_snapshot);
 
@@ -420,12 +546,14 @@ static int source_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t
                 /* Add the latency internal to our source output on top */
                 pa_bytes_to_usec(pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq), &u->source_output->source->sample_spec) +
                 /* and the buffering we do on the source */
-                pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec);
+                pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec) +
+                /* and whatever the canceller thread has not given back yet */
+                pa_bytes_to_usec(u->thread_info.ec_pending_rlen, &u->source_output->source->sample_spec);
 
             return 0;
 
         case PA_SOURCE_MESSAGE_SET_VOLUME_SYNCED:
-            u->thread_info.current_volume = u->source->reference_volume;
+            pa_atomic_store(&u->thread_info.current_volume, (int) pa_cvolume_avg(&u->source->reference_volume));
             break;
     }
 
@@ -701,9 +829,12 @@ static void apply_diff_time(struct userdata *u, int64_t diff_time) {
 static void do_resync(struct userdata *u) {
     int64_t diff_time;
     struct snapshot latency_snapshot;
+    pa_usec_t start;
 
     pa_log("Doing resync");
 
+    start = pa_rtclock_now();
+
     /* update our snapshot */
     /* 1. Get sink input latency snapshot, might cause buffers to be sent to source thread */
     pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
@@ -718,6 +849,8 @@ static void do_resync(struct userdata *u) {
 
     /* and adjust for the drift */
     apply_diff_time(u, diff_time);
+
+    account_timing(u, EC_TIMING_RESYNC, start);
 }
 
 /* 1. Calculate drift at this point, pass to canceller
@@ -733,8 +866,11 @@ static void do_push_drift_comp(struct userdata *u) {
     pa_memchunk rchunk, pchunk, cchunk;
     uint8_t *rdata, *pdata, *cdata;
     float drift;
+    pa_usec_t start, ec_start, ec_time = 0;
     int unused PA_GCC_UNUSED;
 
+    start = pa_rtclock_now();
+
     rlen = pa_memblockq_get_length(u->source_memblockq);
     plen = pa_memblockq_get_length(u->sink_memblockq);
 
@@ -763,7 +899,9 @@ static void do_push_drift_comp(struct userdata *u) {
         pdata = pa_memblock_acquire(pchunk.memblock);
         pdata += pchunk.index;
 
+        ec_start = pa_rtclock_now();
         u->ec->play(u->ec, pdata);
+        ec_time += account_timing(u, EC_TIMING_CANCELLER, ec_start);
 
         if (u->save_aec) {
             if (u->drift_file)
@@ -791,8 +929,10 @@ static void do_push_drift_comp(struct userdata *u) {
         cchunk.memblock = pa_memblock_new(u->source->core->mempool, cchunk.length);
         cdata = pa_memblock_acquire(cchunk.memblock);
 
+        ec_start = pa_rtclock_now();
         u->ec->set_drift(u->ec, drift);
         u->ec->record(u->ec, rdata, cdata);
+        ec_time += account_timing(u, EC_TIMING_CANCELLER, ec_start);
 
         if (u->save_aec) {
             if (u->drift_file)
@@ -814,6 +954,10 @@ static void do_push_drift_comp(struct userdata *u) {
         pa_memblockq_drop(u->source_memblockq, u->source_output_blocksize);
         rlen -= u->source_output_blocksize;
     }
+
+    /* Only account for the bookkeeping around the canceller here, the
+     * canceller itself has its own counter */
+    account_timing(u, EC_TIMING_DRIFT_COMP, start + ec_time);
 }
 
 /* This one's simpler than the drift compensation case -- we just iterate over
@@ -825,6 +969,7 @@ static void do_push(struct userdata *u) {
     size_t rlen, plen;
     pa_memchunk rchunk, pchunk, cchunk;
     uint8_t *rdata, *pdata, *cdata;
+    pa_usec_t start;
     int unused PA_GCC_UNUSED;
 
     rlen = pa_memblockq_get_length(u->source_memblockq);
@@ -858,7 +1003,9 @@ static void do_push(struct userdata *u) {
         }
 
         /* perform echo cancellation */
+        start = pa_rtclock_now();
         u->ec->run(u->ec, rdata, pdata, cdata);
+        account_timing(u, EC_TIMING_CANCELLER, start);
 
         if (u->save_aec) {
             if (u->canceled_file)
@@ -889,6 +1036,172 @@ static void do_push(struct userdata *u) {
     }
 }
 
+static struct ec_job ec_thread_quit;
+
+/* Called from canceller thread context. */
+static void ec_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+    struct ec_job *job;
+
+    pa_log_debug("Canceller thread starting up");
+
+    if (u->core->realtime_scheduling)
+        pa_thread_make_realtime(u->core->realtime_priority);
+
+    while ((job = pa_asyncq_pop(u->ec_jobs, true)) != &ec_thread_quit) {
+        uint8_t *rdata, *pdata, *cdata;
+        pa_usec_t start;
+
+        rdata = (uint8_t *) pa_memblock_acquire(job->rchunk.memblock) + job->rchunk.index;
+        pdata = (uint8_t *) pa_memblock_acquire(job->pchunk.memblock) + job->pchunk.index;
+        cdata = pa_memblock_acquire(job->cchunk.memblock);
+
+        start = pa_rtclock_now();
+        u->ec->run(u->ec, rdata, pdata, cdata);
+        job->elapsed = pa_rtclock_now() - start;
+
+        pa_memblock_release(job->cchunk.memblock);
+        pa_memblock_release(job->pchunk.memblock);
+        pa_memblock_release(job->rchunk.memblock);
+
+        /* There are never more jobs in flight than the queue can hold */
+        pa_assert_se(pa_asyncq_push(u->ec_results, job, false) == 0);
+    }
+
+    pa_log_debug("Canceller thread shutting down");
+}
+
+/* Called from source I/O thread context. */
+static void ec_thread_finish_job(struct userdata *u, struct ec_job *job) {
+    int unused PA_GCC_UNUSED;
+
+    pa_assert(job == &u->ec_job_pool[u->thread_info.ec_jobs_completed % EC_THREAD_MAX_JOBS]);
+
+    if (u->save_aec) {
+        uint8_t *data;
+
+        if (u->captured_file) {
+            data = pa_memblock_acquire_chunk(&job->rchunk);
+            unused = fwrite(data, 1, job->rchunk.length, u->captured_file);
+            pa_memblock_release(job->rchunk.memblock);
+        }
+        if (u->played_file) {
+            data = pa_memblock_acquire_chunk(&job->pchunk);
+            unused = fwrite(data, 1, job->pchunk.length, u->played_file);
+            pa_memblock_release(job->pchunk.memblock);
+        }
+        if (u->canceled_file) {
+            data = pa_memblock_acquire_chunk(&job->cchunk);
+            unused = fwrite(data, 1, job->cchunk.length, u->canceled_file);
+            pa_memblock_release(job->cchunk.memblock);
+        }
+    }
+
+    add_timing(u, EC_TIMING_CANCELLER, job->elapsed);
+
+    if (PA_SOURCE_IS_LINKED(u->source->thread_info.state))
+        pa_source_post(u->source, &job->cchunk);
+
+    u->thread_info.ec_pending_rlen -= job->rchunk.length;
+    u->thread_info.ec_pending_plen -= job->pchunk.length;
+    u->thread_info.ec_jobs_completed++;
+
+    pa_memblock_unref(job->rchunk.memblock);
+    pa_memblock_unref(job->pchunk.memblock);
+    pa_memblock_unref(job->cchunk.memblock);
+    pa_memchunk_reset(&job->rchunk);
+    pa_memchunk_reset(&job->pchunk);
+    pa_memchunk_reset(&job->cchunk);
+}
+
+/* Waits until the canceller thread has given back all blocks we handed to it.
+ *
+ * Called from source I/O thread context. */
+static void ec_thread_flush(struct userdata *u) {
+    while (u->thread_info.ec_jobs_completed != u->thread_info.ec_jobs_submitted)
+        ec_thread_finish_job(u, pa_asyncq_pop(u->ec_results, true));
+}
+
+/* Called from source I/O thread context. */
+static int ec_results_before(pa_rtpoll_item *i) {
+    struct userdata *u = pa_rtpoll_item_get_work_userdata(i);
+
+    if (pa_asyncq_read_before_poll(u->ec_results) < 0)
+        return 1; /* there is something to pick up already */
+
+    return 0;
+}
+
+/* Called from source I/O thread context. */
+static void ec_results_after(pa_rtpoll_item *i) {
+    struct userdata *u = pa_rtpoll_item_get_work_userdata(i);
+
+    pa_asyncq_read_after_poll(u->ec_results);
+}
+
+/* Called from source I/O thread context. */
+static int ec_results_work(pa_rtpoll_item *i) {
+    struct userdata *u = pa_rtpoll_item_get_work_userdata(i);
+    struct ec_job *job;
+
+    while ((job = pa_asyncq_pop(u->ec_results, false)))
+        ec_thread_finish_job(u, job);
+
+    return 0;
+}
+
+/* Like do_push(), but hands the blocks to the canceller thread instead of
+ * running the canceller here. The canceled blocks are posted to the source
+ * once they come back, see ec_results_work().
+ *
+ * Called from source I/O thread context. */
+static void do_push_thread(struct userdata *u) {
+    size_t rlen, plen;
+    struct ec_job *job;
+
+    rlen = pa_memblockq_get_length(u->source_memblockq);
+    plen = pa_memblockq_get_length(u->sink_memblockq);
+
+    while (rlen >= u->source_output_blocksize) {
+
+        /* If the canceller does not keep up, there is nothing better to do
+         * than to wait for it */
+        if (u->thread_info.ec_jobs_submitted - u->thread_info.ec_jobs_completed == EC_THREAD_MAX_JOBS) {
+            pa_log_debug("Canceller thread is falling behind");
+            ec_thread_finish_job(u, pa_asyncq_pop(u->ec_results, true));
+        }
+
+        job = &u->ec_job_pool[u->thread_info.ec_jobs_submitted % EC_THREAD_MAX_JOBS];
+
+        pa_memblockq_peek_fixed_size(u->source_memblockq, u->source_output_blocksize, &job->rchunk);
+        pa_memblockq_peek_fixed_size(u->sink_memblockq, u->sink_blocksize, &job->pchunk);
+
+        /* we ran out of played data and pchunk has been filled with silence bytes */
+        if (plen < u->sink_blocksize)
+            pa_memblockq_seek(u->sink_memblockq, u->sink_blocksize - plen, PA_SEEK_RELATIVE, true);
+
+        job->cchunk.index = 0;
+        job->cchunk.length = u->source_blocksize;
+        job->cchunk.memblock = pa_memblock_new(u->source->core->mempool, job->cchunk.length);
+
+        u->thread_info.ec_pending_rlen += u->source_output_blocksize;
+        u->thread_info.ec_pending_plen += u->sink_blocksize;
+        u->thread_info.ec_jobs_submitted++;
+
+        pa_assert_se(pa_asyncq_push(u->ec_jobs, job, false) == 0);
+
+        pa_memblockq_drop(u->source_memblockq, u->source_output_blocksize);
+        rlen -= u->source_output_blocksize;
+
+        pa_memblockq_drop(u->sink_memblockq, u->sink_blocksize);
+
+        if (plen >= u->sink_blocksize)
+            plen -= u->sink_blocksize;
+        else
+            plen = 0;
+    }
+}
+
 /* Called from source I/O thread context. */
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
     struct userdata *u;
@@ -966,6 +1279,8 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     /* process and push out samples */
     if (u->ec->params.drift_compensation)
         do_push_drift_comp(u);
+    else if (u->ec_thread)
+        do_push_thread(u);
     else
         do_push(u);
 }
@@ -1053,8 +1368,8 @@ static void source_output_snapshot_within_thread(struct userdata *u, struct snap
     delay = pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq);
 
     delay = (u->source_output->thread_info.resampler ? pa_resampler_request(u->source_output->thread_info.resampler, delay) : delay);
-    rlen = pa_memblockq_get_length(u->source_memblockq);
-    plen = pa_memblockq_get_length(u->sink_memblockq);
+    rlen = pa_memblockq_get_length(u->source_memblockq) + u->thread_info.ec_pending_rlen;
+    plen = pa_memblockq_get_length(u->sink_memblockq) + u->thread_info.ec_pending_plen;
 
     snapshot->source_now = now;
     snapshot->source_latency = latency;
@@ -1062,6 +1377,8 @@ static void source_output_snapshot_within_thread(struct userdata *u, struct snap
     snapshot->recv_counter = u->recv_counter;
     snapshot->rlen = rlen + u->sink_skip;
     snapshot->plen = plen + u->source_skip;
+
+    memcpy(snapshot->timing, u->thread_info.timing, sizeof(snapshot->timing));
 }
 
 /* Called from source I/O thread context. */
@@ -1285,6 +1602,22 @@ static void source_output_attach_cb(pa_source_output *o) {
             o->source->thread_info.rtpoll,
             PA_RTPOLL_LATE,
             u->asyncmsgq);
+
+    u->thread_info.outq = pa_thread_mq_get()->outq;
+
+    if (u->ec_thread) {
+        struct pollfd *pollfd;
+
+        u->rtpoll_item_results = pa_rtpoll_item_new(o->source->thread_info.rtpoll, PA_RTPOLL_LATE, 1);
+
+        pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item_results, NULL);
+        pollfd->fd = pa_asyncq_read_fd(u->ec_results);
+        pollfd->events = POLLIN;
+
+        pa_rtpoll_item_set_before_callback(u->rtpoll_item_results, ec_results_before, u);
+        pa_rtpoll_item_set_after_callback(u->rtpoll_item_results, ec_results_after, u);
+        pa_rtpoll_item_set_work_callback(u->rtpoll_item_results, ec_results_work, u);
+    }
 }
 
 /* Called from sink I/O thread context. */
@@ -1329,6 +1662,11 @@ static void source_output_detach_cb(pa_source_output *o) {
     pa_source_output_assert_io_context(o);
     pa_assert_se(u = o->userdata);
 
+    /* Get everything back from the canceller thread before we lose the
+     * source */
+    if (u->ec_thread)
+        ec_thread_flush(u);
+
     if (PA_SOURCE_IS_LINKED(u->source->thread_info.state))
         pa_source_detach_within_thread(u->source);
     pa_source_set_rtpoll(u->source, NULL);
@@ -1339,6 +1677,11 @@ static void source_output_detach_cb(pa_source_output *o) {
         pa_rtpoll_item_free(u->rtpoll_item_read);
         u->rtpoll_item_read = NULL;
     }
+
+    if (u->rtpoll_item_results) {
+        pa_rtpoll_item_free(u->rtpoll_item_results);
+        u->rtpoll_item_results = NULL;
+    }
 }
 
 /* Called from sink I/O thread context. */
@@ -1604,20 +1947,22 @@ static int canceller_process_msg_cb(pa_msgobject *o, int code, void *userdata, i
     return 0;
 }
 
-/* Called by the canceller, so source I/O thread context. */
+/* Called by the canceller, so source I/O or canceller thread context. */
 pa_volume_t pa_echo_canceller_get_capture_volume(pa_echo_canceller *ec) {
 #ifndef ECHO_CANCEL_TEST
-    return pa_cvolume_avg(&ec->msg->userdata->thread_info.current_volume);
+    return (pa_volume_t) pa_atomic_load(&ec->msg->userdata->thread_info.current_volume);
 #else
     return PA_VOLUME_NORM;
 #endif
 }
 
-/* Called by the canceller, so source I/O thread context. */
+/* Called by the canceller, so source I/O or canceller thread context. */
 void pa_echo_canceller_set_capture_volume(pa_echo_canceller *ec, pa_volume_t v) {
 #ifndef ECHO_CANCEL_TEST
-    if (pa_cvolume_avg(&ec->msg->userdata->thread_info.current_volume) != v) {
-        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(ec->msg), ECHO_CANCELLER_MESSAGE_SET_VOLUME, PA_UINT_TO_PTR(v),
+    if ((pa_volume_t) pa_atomic_load(&ec->msg->userdata->thread_info.current_volume) != v) {
+        /* Not pa_thread_mq_get(), this may be called from the canceller
+         * thread */
+        pa_asyncmsgq_post(ec->msg->userdata->thread_info.outq, PA_MSGOBJECT(ec->msg), ECHO_CANCELLER_MESSAGE_SET_VOLUME, PA_UINT_TO_PTR(v),
                 0, NULL, NULL);
     }
 #endif
@@ -1641,6 +1986,8 @@ uint32_t pa_echo_canceller_blocksize_power2(unsigned rate, unsigned ms) {
 static pa_echo_canceller_method_t get_ec_method_from_string(const char *method) {
     if (pa_streq(method, "null"))
         return PA_ECHO_CANCELLER_NULL;
+    if (pa_streq(method, "pbfdaf"))
+        return PA_ECHO_CANCELLER_PBFDAF;
 #ifdef HAVE_SPEEX
     if (pa_streq(method, "speex"))
         return PA_ECHO_CANCELLER_SPEEX;
@@ -1713,6 +2060,7 @@ int pa__init(pa_module*m) {
     uint32_t temp;
     uint32_t nframes = 0;
     bool use_master_format;
+    bool use_thread;
     pa_usec_t blocksize_usec;
 
     pa_assert(m);
@@ -1814,6 +2162,12 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    use_thread = DEFAULT_USE_THREAD;
+    if (pa_modargs_get_value_boolean(ma, "use_thread", &use_thread) < 0) {
+        pa_log("Failed to parse use_thread value");
+        goto fail;
+    }
+
     if (init_common(ma, u, &source_ss, &source_map) < 0)
         goto fail;
 
@@ -1849,6 +2203,23 @@ int pa__init(pa_module*m) {
     if (u->ec->params.drift_compensation)
         pa_assert(u->ec->set_drift);
 
+    if (use_thread && u->ec->params.drift_compensation) {
+        /* The drift compensating cancellers get playback and capture data
+         * separately, which the canceller thread does not support */
+        pa_log_warn("Drift compensation is enabled, not using a canceller thread");
+        use_thread = false;
+    }
+
+    if (use_thread) {
+        u->ec_jobs = pa_asyncq_new(EC_THREAD_MAX_JOBS);
+        u->ec_results = pa_asyncq_new(EC_THREAD_MAX_JOBS);
+
+        if (!(u->ec_thread = pa_thread_new("echo-cancel", ec_thread_func, u))) {
+            pa_log("Failed to create canceller thread.");
+            goto fail;
+        }
+    }
+
     /* Create source */
     pa_source_new_data_init(&source_data);
     source_data.driver = __FILE__;
@@ -1889,6 +2260,7 @@ int pa__init(pa_module*m) {
     u->source->parent.process_msg = source_process_msg_cb;
     u->source->set_state_in_main_thread = source_set_state_in_main_thread_cb;
     u->source->update_requested_latency = source_update_requested_latency_cb;
+    u->source->update_stats = source_update_stats_cb;
     pa_source_set_set_mute_callback(u->source, source_set_mute_cb);
     if (!u->use_volume_sharing) {
         pa_source_set_get_volume_callback(u->source, source_get_volume_cb);
@@ -2076,7 +2448,7 @@ int pa__init(pa_module*m) {
     u->ec->msg->parent.process_msg = canceller_process_msg_cb;
     u->ec->msg->userdata = u;
 
-    u->thread_info.current_volume = u->source->reference_volume;
+    pa_atomic_store(&u->thread_info.current_volume, (int) pa_cvolume_avg(&u->source->reference_volume));
 
     /* We don't want to deal with too many chunks at a time */
     blocksize_usec = pa_bytes_to_usec(u->source_blocksize, &u->source->sample_spec);
@@ -2171,6 +2543,16 @@ void pa__done(pa_module*m) {
     if (u->sink_memblockq)
         pa_memblockq_free(u->sink_memblockq);
 
+    if (u->ec_thread) {
+        pa_assert_se(pa_asyncq_push(u->ec_jobs, &ec_thread_quit, true) == 0);
+        pa_thread_free(u->ec_thread);
+    }
+
+    if (u->ec_jobs)
+        pa_asyncq_free(u->ec_jobs, NULL);
+    if (u->ec_results)
+        pa_asyncq_free(u->ec_results, NULL);
+
     if (u->ec) {
         if (u->ec->done)
             u->ec->done(u->ec);
@@ -2203,44 +2585,164 @@ void pa__done(pa_module*m) {
 #ifdef ECHO_CANCEL_TEST
 /*
  * Stand-alone test program for running in the canceller on pre-recorded files.
+ *
+ * Files are read and written as raw samples in the canceller's format, unless
+ * their name ends in ".wav", in which case the format is taken care of by
+ * libsndfile. The rate and channel count of WAV input must match what the
+ * canceller was configured with. At the end the time spent in the canceller
+ * and the echo return loss enhancement (ERLE, the ratio of captured to
+ * canceled signal energy) are reported, so different backends can be
+ * compared on the same recordings.
  */
+
+struct test_file {
+    FILE *file;
+    SNDFILE *sndfile;
+    pa_sample_spec ss;
+};
+
+static int test_file_open_read(struct test_file *f, const char *fn, const pa_sample_spec *ss) {
+    SF_INFO sfi;
+    pa_sample_spec file_ss;
+
+    f->ss = *ss;
+
+    if (!pa_endswith(fn, ".wav")) {
+        if (!(f->file = fopen(fn, "rb"))) {
+            pa_log("Could not open %s: %s", fn, pa_cstrerror(errno));
+            return -1;
+        }
+
+        return 0;
+    }
+
+    pa_zero(sfi);
+    if (!(f->sndfile = sf_open(fn, SFM_READ, &sfi))) {
+        pa_log("Could not open %s: %s", fn, sf_strerror(NULL));
+        return -1;
+    }
+
+    if (pa_sndfile_read_sample_spec(f->sndfile, &file_ss) < 0) {
+        pa_log("Failed to determine the sample format of %s", fn);
+        return -1;
+    }
+
+    if (file_ss.rate != ss->rate || file_ss.channels != ss->channels) {
+        pa_log("%s has %u channels at %u Hz, the canceller expects %u channels at %u Hz", fn,
+               file_ss.channels, file_ss.rate, ss->channels, ss->rate);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_file_open_write(struct test_file *f, const char *fn, const pa_sample_spec *ss) {
+    SF_INFO sfi;
+
+    f->ss = *ss;
+
+    if (!pa_endswith(fn, ".wav")) {
+        if (!(f->file = fopen(fn, "wb"))) {
+            pa_log("Could not open %s: %s", fn, pa_cstrerror(errno));
+            return -1;
+        }
+
+        return 0;
+    }
+
+    pa_zero(sfi);
+    if (pa_sndfile_write_sample_spec(&sfi, &f->ss) < 0) {
+        pa_log("Cannot write %s samples to %s", pa_sample_format_to_string(ss->format), fn);
+        return -1;
+    }
+    sfi.format |= SF_FORMAT_WAV;
+
+    if (!(f->sndfile = sf_open(fn, SFM_WRITE, &sfi))) {
+        pa_log("Could not open %s: %s", fn, sf_strerror(NULL));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void test_file_close(struct test_file *f) {
+    if (f->file)
+        fclose(f->file);
+    if (f->sndfile)
+        sf_close(f->sndfile);
+}
+
+static bool test_file_read(struct test_file *f, void *data, size_t length) {
+    pa_sndfile_readf_t readf;
+    sf_count_t frames;
+
+    if (f->file)
+        return fread(data, length, 1, f->file) > 0;
+
+    frames = length / pa_frame_size(&f->ss);
+
+    if ((readf = pa_sndfile_readf_function(&f->ss)))
+        return readf(f->sndfile, data, frames) == frames;
+    else
+        return sf_read_raw(f->sndfile, data, length) == (sf_count_t) length;
+}
+
+static void test_file_write(struct test_file *f, const void *data, size_t length) {
+    pa_sndfile_writef_t writef;
+    int unused PA_GCC_UNUSED;
+
+    if (f->file) {
+        unused = fwrite(data, length, 1, f->file);
+        return;
+    }
+
+    if ((writef = pa_sndfile_writef_function(&f->ss)))
+        writef(f->sndfile, data, length / pa_frame_size(&f->ss));
+    else
+        sf_write_raw(f->sndfile, data, length);
+}
+
+/* Adds up the energy of a block of samples, for the ERLE calculation */
+static double test_energy(const pa_sample_spec *ss, const void *data, size_t length, float *buf) {
+    unsigned n = length / pa_sample_size(ss), i;
+    double sum = 0.0;
+
+    pa_get_convert_to_float32ne_function(ss->format)(n, data, buf);
+
+    for (i = 0; i < n; i++)
+        sum += (double) buf[i] * buf[i];
+
+    return sum;
+}
+
 int main(int argc, char* argv[]) {
     struct userdata u;
+    struct test_file play_file, rec_file, out_file;
     pa_sample_spec source_output_ss, source_ss, sink_ss;
     pa_channel_map source_output_map, source_map, sink_map;
     pa_modargs *ma = NULL;
     uint8_t *rdata = NULL, *pdata = NULL, *cdata = NULL;
-    int unused PA_GCC_UNUSED;
+    float *fbuf = NULL;
     int ret = 0, i;
     char c;
     float drift;
     uint32_t nframes;
+    pa_usec_t start, ec_time = 0;
+    uint64_t rec_bytes = 0;
+    double rec_energy = 0.0, out_energy = 0.0, duration;
 
     if (!getenv("MAKE_CHECK"))
         pa_log_set_level(PA_LOG_DEBUG);
 
     pa_memzero(&u, sizeof(u));
+    pa_zero(play_file);
+    pa_zero(rec_file);
+    pa_zero(out_file);
 
     if (argc < 4 || argc > 7) {
         goto usage;
     }
 
-    u.captured_file = fopen(argv[2], "rb");
-    if (u.captured_file == NULL) {
-        perror ("Could not open capture file");
-        goto fail;
-    }
-    u.played_file = fopen(argv[1], "rb");
-    if (u.played_file == NULL) {
-        perror ("Could not open play file");
-        goto fail;
-    }
-    u.canceled_file = fopen(argv[3], "wb");
-    if (u.canceled_file == NULL) {
-        perror ("Could not open canceled file");
-        goto fail;
-    }
-
     u.core = pa_xnew0(pa_core, 1);
     u.core->cpu_info.cpu_type = PA_CPU_X86;
     u.core->cpu_info.flags.x86 |= PA_CPU_X86_SSE;
@@ -2275,6 +2777,13 @@ int main(int argc, char* argv[]) {
     u.source_blocksize = nframes * pa_frame_size(&source_ss);
     u.sink_blocksize = nframes * pa_frame_size(&sink_ss);
 
+    /* The files can only be opened now that the canceller has settled on
+     * its sample specs */
+    if (test_file_open_read(&play_file, argv[1], &sink_ss) < 0 ||
+        test_file_open_read(&rec_file, argv[2], &source_output_ss) < 0 ||
+        test_file_open_write(&out_file, argv[3], &source_ss) < 0)
+        goto fail;
+
     if (u.ec->params.drift_compensation) {
         if (argc < 6) {
             pa_log("Drift compensation enabled but drift file not specified");
@@ -2292,17 +2801,24 @@ int main(int argc, char* argv[]) {
     rdata = pa_xmalloc(u.source_output_blocksize);
     pdata = pa_xmalloc(u.sink_blocksize);
     cdata = pa_xmalloc(u.source_blocksize);
+    fbuf = pa_xnew(float, u.source_output_blocksize / pa_sample_size(&source_output_ss));
 
     if (!u.ec->params.drift_compensation) {
-        while (fread(rdata, u.source_output_blocksize, 1, u.captured_file) > 0) {
-            if (fread(pdata, u.sink_blocksize, 1, u.played_file) == 0) {
-                perror("Played file ended before captured file");
+        while (test_file_read(&rec_file, rdata, u.source_output_blocksize)) {
+            if (!test_file_read(&play_file, pdata, u.sink_blocksize)) {
+                pa_log("Played file ended before captured file");
                 goto fail;
             }
 
+            start = pa_rtclock_now();
             u.ec->run(u.ec, rdata, pdata, cdata);
+            ec_time += pa_rtclock_now() - start;
+
+            rec_bytes += u.source_output_blocksize;
+            rec_energy += test_energy(&source_output_ss, rdata, u.source_output_blocksize, fbuf);
+            out_energy += test_energy(&source_ss, cdata, u.source_blocksize, fbuf);
 
-            unused = fwrite(cdata, u.source_blocksize, 1, u.canceled_file);
+            test_file_write(&out_file, cdata, u.source_blocksize);
         }
     } else {
         while (fscanf(u.drift_file, "%c", &c) > 0) {
@@ -2323,14 +2839,20 @@ int main(int argc, char* argv[]) {
                         goto fail;
                     }
 
-                    if (fread(rdata, i, 1, u.captured_file) <= 0) {
-                        perror("Captured file ended prematurely");
+                    if (!test_file_read(&rec_file, rdata, i)) {
+                        pa_log("Captured file ended prematurely");
                         goto fail;
                     }
 
+                    start = pa_rtclock_now();
                     u.ec->record(u.ec, rdata, cdata);
+                    ec_time += pa_rtclock_now() - start;
 
-                    unused = fwrite(cdata, i, 1, u.canceled_file);
+                    rec_bytes += i;
+                    rec_energy += test_energy(&source_output_ss, rdata, i, fbuf);
+                    out_energy += test_energy(&source_ss, cdata, i, fbuf);
+
+                    test_file_write(&out_file, cdata, i);
 
                     break;
 
@@ -2340,40 +2862,48 @@ int main(int argc, char* argv[]) {
                         goto fail;
                     }
 
-                    if (fread(pdata, i, 1, u.played_file) <= 0) {
-                        perror("Played file ended prematurely");
+                    if (!test_file_read(&play_file, pdata, i)) {
+                        pa_log("Played file ended prematurely");
                         goto fail;
                     }
 
+                    start = pa_rtclock_now();
                     u.ec->play(u.ec, pdata);
+                    ec_time += pa_rtclock_now() - start;
 
                     break;
             }
         }
 
-        if (fread(rdata, i, 1, u.captured_file) > 0)
+        if (test_file_read(&rec_file, rdata, i))
             pa_log("All capture data was not consumed");
-        if (fread(pdata, i, 1, u.played_file) > 0)
+        if (test_file_read(&play_file, pdata, i))
             pa_log("All playback data was not consumed");
     }
 
+    duration = (double) rec_bytes / pa_bytes_per_second(&source_output_ss);
+    pa_log_notice("Processed %0.2f s of audio in %0.3f s (%0.2f%% of real time)",
+                  duration, (double) ec_time / PA_USEC_PER_SEC,
+                  duration > 0 ? 100.0 * ec_time / PA_USEC_PER_SEC / duration : 0.0);
+    if (out_energy > 0.0)
+        pa_log_notice("ERLE: %0.2f dB", 10.0 * log10(rec_energy / out_energy));
+
     u.ec->done(u.ec);
     u.ec->msg->dead = true;
     pa_echo_canceller_msg_unref(u.ec->msg);
 
 out:
-    if (u.captured_file)
-        fclose(u.captured_file);
-    if (u.played_file)
-        fclose(u.played_file);
-    if (u.canceled_file)
-        fclose(u.canceled_file);
+    test_file_close(&play_file);
+    test_file_close(&rec_file);
+    test_file_close(&out_file);
+
     if (u.drift_file)
         fclose(u.drift_file);
 
     pa_xfree(rdata);
     pa_xfree(pdata);
     pa_xfree(cdata);
+    pa_xfree(fbuf);
 
     pa_xfree(u.ec);
     pa_xfree(u.core);
@@ -0,0 +1,475 @@
+/***
+    This file is part of PulseAudio.
+
+    PulseAudio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of the License,
+    or (at your option) any later version.
+
+    PulseAudio is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/modargs.h>
+
+#include "echo-cancel.h"
+
+/* A partitioned block frequency domain adaptive filter (PBFDAF).
+ *
+ * The echo path is modelled by an FIR filter of filter_size_ms, split into P
+ * partitions of one block each. Every block, the playback signal is
+ * transformed (overlap-save, FFT size 2N), pushed into a frequency domain
+ * delay line and convolved with the partitions. The estimate is subtracted
+ * from the recorded signal and the error is used to update all partitions
+ * with a per-bin power normalised step. The gradient constraint (which keeps
+ * the partitions from wrapping around) is applied to one partition per
+ * block in turn, which converges almost as well as constraining all of them
+ * at a fraction of the cost.
+ *
+ * All spectra are stored as separate real and imaginary arrays, so that the
+ * per-bin work vectorises trivially. */
+
+/* should be between 5-20 ms */
+#define DEFAULT_FRAME_SIZE_MS 10
+/* should be between 50-500 ms */
+#define DEFAULT_FILTER_SIZE_MS 128
+#define DEFAULT_MU 0.5
+
+/* smoothing of the playback power estimate */
+#define POWER_SMOOTHING 0.9f
+/* regularisation of the step size, roughly -60 dBFS */
+#define POWER_FLOOR 1e-6f
+/* the filter is reset after this many blocks in a row with twice as much
+ * energy in the output as in the recording */
+#define DIVERGED_BLOCKS 20
+
+static const char* const valid_modargs[] = {
+    "frame_size_ms",
+    "filter_size_ms",
+    "mu",
+    NULL
+};
+
+typedef void (*pbfdaf_mac_func_t)(float *yr, float *yi, const float *xr, const float *xi,
+                                  const float *wr, const float *wi, unsigned n);
+typedef void (*pbfdaf_update_func_t)(float *wr, float *wi, const float *xr, const float *xi,
+                                     const float *gr, const float *gi, unsigned n);
+
+struct pbfdaf {
+    unsigned n;                 /* block size in frames */
+    unsigned parts;             /* number of partitions */
+    unsigned stride;            /* n + 1 bins, rounded up to the vector size */
+    float mu;
+
+    /* complex fft of size n, used for real transforms of size 2n */
+    unsigned *rev;
+    float *cos_table, *sin_table;   /* exp(-2 pi i k / n), k < n / 2 */
+    float *rcos_table, *rsin_table; /* exp(-pi i k / n), k <= n */
+    float *zr, *zi;
+
+    float *time;                /* 2n samples of scratch */
+    float *x_old;               /* previous playback block */
+    float *xr, *xi;             /* frequency domain delay line, parts * stride */
+    unsigned pos;               /* newest entry in the delay line */
+    float *wr, *wi;             /* filter partitions, parts * stride */
+    float *yr, *yi;             /* echo estimate, later the step */
+    float *power;
+    unsigned constrain;         /* next partition to constrain */
+    unsigned diverged;          /* blocks in a row that made things worse */
+
+    pbfdaf_mac_func_t mac;
+    pbfdaf_update_func_t update;
+};
+
+/* y += x * w */
+static void mac_c(float *yr, float *yi, const float *xr, const float *xi,
+                  const float *wr, const float *wi, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        yr[i] += xr[i] * wr[i] - xi[i] * wi[i];
+        yi[i] += xr[i] * wi[i] + xi[i] * wr[i];
+    }
+}
+
+/* w += conj(x) * g */
+static void update_c(float *wr, float *wi, const float *xr, const float *xi,
+                     const float *gr, const float *gi, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        wr[i] += xr[i] * gr[i] + xi[i] * gi[i];
+        wi[i] += xr[i] * gi[i] - xi[i] * gr[i];
+    }
+}
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <xmmintrin.h>
+
+/* n is always a multiple of 4, see stride */
+__attribute__ ((target ("sse")))
+static void mac_sse(float *yr, float *yi, const float *xr, const float *xi,
+                    const float *wr, const float *wi, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i += 4) {
+        __m128 a = _mm_loadu_ps(xr + i), b = _mm_loadu_ps(xi + i);
+        __m128 c = _mm_loadu_ps(wr + i), d = _mm_loadu_ps(wi + i);
+
+        _mm_storeu_ps(yr + i, _mm_add_ps(_mm_loadu_ps(yr + i), _mm_sub_ps(_mm_mul_ps(a, c), _mm_mul_ps(b, d))));
+        _mm_storeu_ps(yi + i, _mm_add_ps(_mm_loadu_ps(yi + i), _mm_add_ps(_mm_mul_ps(a, d), _mm_mul_ps(b, c))));
+    }
+}
+
+__attribute__ ((target ("sse")))
+static void update_sse(float *wr, float *wi, const float *xr, const float *xi,
+                       const float *gr, const float *gi, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i += 4) {
+        __m128 a = _mm_loadu_ps(xr + i), b = _mm_loadu_ps(xi + i);
+        __m128 c = _mm_loadu_ps(gr + i), d = _mm_loadu_ps(gi + i);
+
+        _mm_storeu_ps(wr + i, _mm_add_ps(_mm_loadu_ps(wr + i), _mm_add_ps(_mm_mul_ps(a, c), _mm_mul_ps(b, d))));
+        _mm_storeu_ps(wi + i, _mm_add_ps(_mm_loadu_ps(wi + i), _mm_sub_ps(_mm_mul_ps(a, d), _mm_mul_ps(b, c))));
+    }
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+/* In-place radix-2 complex fft of size n. The inverse is not normalised. */
+static void fft_complex(struct pbfdaf *f, float *re, float *im, bool inverse) {
+    const float sign = inverse ? -1.0f : 1.0f;
+    unsigned i, j, k, len;
+
+    for (i = 0; i < f->n; i++) {
+        j = f->rev[i];
+        if (i < j) {
+            float t;
+
+            t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    for (len = 2; len <= f->n; len <<= 1) {
+        unsigned half = len / 2, step = f->n / len;
+
+        for (i = 0; i < f->n; i += len) {
+            for (k = 0; k < half; k++) {
+                float c = f->cos_table[k * step], s = sign * f->sin_table[k * step];
+                unsigned a = i + k, b = i + k + half;
+                /* (re[b] + i im[b]) * (c + i s), with s = -sin for the forward fft */
+                float tr = re[b] * c - im[b] * s;
+                float ti = re[b] * s + im[b] * c;
+
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+/* Real forward fft of 2n samples to n + 1 bins, computed with a complex fft
+ * of size n on the interleaved even and odd samples. */
+static void fft_forward(struct pbfdaf *f, const float *x, float *Xr, float *Xi) {
+    unsigned k;
+
+    for (k = 0; k < f->n; k++) {
+        f->zr[k] = x[2 * k];
+        f->zi[k] = x[2 * k + 1];
+    }
+
+    fft_complex(f, f->zr, f->zi, false);
+
+    for (k = 0; k <= f->n; k++) {
+        unsigned a = k % f->n, b = (f->n - k) % f->n;
+        /* even and odd half spectra */
+        float er = (f->zr[a] + f->zr[b]) * 0.5f, ei = (f->zi[a] - f->zi[b]) * 0.5f;
+        float or = (f->zi[a] + f->zi[b]) * 0.5f, oi = (f->zr[b] - f->zr[a]) * 0.5f;
+        float c = f->rcos_table[k], s = f->rsin_table[k];
+
+        Xr[k] = er + or * c - oi * s;
+        Xi[k] = ei + or * s + oi * c;
+    }
+}
+
+/* Inverse of fft_forward(), normalised. */
+static void fft_inverse(struct pbfdaf *f, const float *Xr, const float *Xi, float *x) {
+    const float scale = 1.0f / f->n;
+    unsigned k;
+
+    for (k = 0; k < f->n; k++) {
+        unsigned b = f->n - k;
+        float er = (Xr[k] + Xr[b]) * 0.5f, ei = (Xi[k] - Xi[b]) * 0.5f;
+        float dr = (Xr[k] - Xr[b]) * 0.5f, di = (Xi[k] + Xi[b]) * 0.5f;
+        /* odd part, multiplied by the conjugate twiddle */
+        float c = f->rcos_table[k], s = -f->rsin_table[k];
+        float or = dr * c - di * s, oi = dr * s + di * c;
+
+        f->zr[k] = er - oi;
+        f->zi[k] = ei + or;
+    }
+
+    fft_complex(f, f->zr, f->zi, true);
+
+    for (k = 0; k < f->n; k++) {
+        x[2 * k] = f->zr[k] * scale;
+        x[2 * k + 1] = f->zi[k] * scale;
+    }
+}
+
+static struct pbfdaf *pbfdaf_new(unsigned n, unsigned parts, float mu, bool have_sse) {
+    struct pbfdaf *f;
+    unsigned i, bits;
+
+    f = pa_xnew0(struct pbfdaf, 1);
+    f->n = n;
+    f->parts = parts;
+    f->stride = PA_ROUND_UP(n + 1, 4);
+    f->mu = mu;
+
+    f->rev = pa_xnew(unsigned, n);
+    for (bits = 0; (1U << bits) < n; bits++)
+        ;
+    for (i = 0; i < n; i++) {
+        unsigned j, r = 0;
+
+        for (j = 0; j < bits; j++)
+            r |= ((i >> j) & 1) << (bits - 1 - j);
+        f->rev[i] = r;
+    }
+
+    f->cos_table = pa_xnew(float, n / 2);
+    f->sin_table = pa_xnew(float, n / 2);
+    for (i = 0; i < n / 2; i++) {
+        f->cos_table[i] = cos(2 * M_PI * i / n);
+        f->sin_table[i] = -sin(2 * M_PI * i / n);
+    }
+
+    f->rcos_table = pa_xnew(float, n + 1);
+    f->rsin_table = pa_xnew(float, n + 1);
+    for (i = 0; i <= n; i++) {
+        f->rcos_table[i] = cos(M_PI * i / n);
+        f->rsin_table[i] = -sin(M_PI * i / n);
+    }
+
+    f->zr = pa_xnew0(float, n);
+    f->zi = pa_xnew0(float, n);
+    f->time = pa_xnew0(float, 2 * n);
+    f->x_old = pa_xnew0(float, n);
+    f->xr = pa_xnew0(float, parts * f->stride);
+    f->xi = pa_xnew0(float, parts * f->stride);
+    f->wr = pa_xnew0(float, parts * f->stride);
+    f->wi = pa_xnew0(float, parts * f->stride);
+    f->yr = pa_xnew0(float, f->stride);
+    f->yi = pa_xnew0(float, f->stride);
+    f->power = pa_xnew0(float, f->stride);
+
+    f->mac = mac_c;
+    f->update = update_c;
+#if defined (__i386__) || defined (__amd64__)
+    if (have_sse) {
+        f->mac = mac_sse;
+        f->update = update_sse;
+    }
+#endif
+
+    return f;
+}
+
+static void pbfdaf_free(struct pbfdaf *f) {
+    pa_xfree(f->rev);
+    pa_xfree(f->cos_table);
+    pa_xfree(f->sin_table);
+    pa_xfree(f->rcos_table);
+    pa_xfree(f->rsin_table);
+    pa_xfree(f->zr);
+    pa_xfree(f->zi);
+    pa_xfree(f->time);
+    pa_xfree(f->x_old);
+    pa_xfree(f->xr);
+    pa_xfree(f->xi);
+    pa_xfree(f->wr);
+    pa_xfree(f->wi);
+    pa_xfree(f->yr);
+    pa_xfree(f->yi);
+    pa_xfree(f->power);
+    pa_xfree(f);
+}
+
+static void pbfdaf_process(struct pbfdaf *f, const float *rec, const float *play, float *out) {
+    const unsigned n = f->n, stride = f->stride;
+    float *Xr, *Xi, *Wr, *Wi;
+    float rec_energy = 0, out_energy = 0;
+    unsigned i, p;
+
+    /* Transform the last two playback blocks into the delay line */
+    f->pos = (f->pos + 1) % f->parts;
+    Xr = f->xr + f->pos * stride;
+    Xi = f->xi + f->pos * stride;
+
+    memcpy(f->time, f->x_old, n * sizeof(float));
+    memcpy(f->time + n, play, n * sizeof(float));
+    memcpy(f->x_old, play, n * sizeof(float));
+    fft_forward(f, f->time, Xr, Xi);
+
+    for (i = 0; i <= n; i++)
+        f->power[i] = POWER_SMOOTHING * f->power[i] +
+            (1.0f - POWER_SMOOTHING) * (Xr[i] * Xr[i] + Xi[i] * Xi[i]);
+
+    /* Echo estimate */
+    memset(f->yr, 0, stride * sizeof(float));
+    memset(f->yi, 0, stride * sizeof(float));
+    for (p = 0; p < f->parts; p++) {
+        unsigned q = (f->pos + f->parts - p) % f->parts;
+
+        f->mac(f->yr, f->yi, f->xr + q * stride, f->xi + q * stride, f->wr + p * stride, f->wi + p * stride, stride);
+    }
+    fft_inverse(f, f->yr, f->yi, f->time);
+
+    /* The error is our output, and drives the adaptation */
+    for (i = 0; i < n; i++) {
+        out[i] = rec[i] - f->time[n + i];
+        rec_energy += rec[i] * rec[i];
+        out_energy += out[i] * out[i];
+    }
+
+    memset(f->time, 0, n * sizeof(float));
+    memcpy(f->time + n, out, n * sizeof(float));
+    fft_forward(f, f->time, f->yr, f->yi);
+
+    for (i = 0; i <= n; i++) {
+        float step = f->mu / (f->parts * (f->power[i] + 2 * n * POWER_FLOOR));
+
+        f->yr[i] *= step;
+        f->yi[i] *= step;
+    }
+
+    for (p = 0; p < f->parts; p++) {
+        unsigned q = (f->pos + f->parts - p) % f->parts;
+
+        f->update(f->wr + p * stride, f->wi + p * stride, f->xr + q * stride, f->xi + q * stride, f->yr, f->yi, stride);
+    }
+
+    /* Constrain one partition to a linear (not circular) convolution */
+    Wr = f->wr + f->constrain * stride;
+    Wi = f->wi + f->constrain * stride;
+    fft_inverse(f, Wr, Wi, f->time);
+    memset(f->time + n, 0, n * sizeof(float));
+    fft_forward(f, f->time, Wr, Wi);
+    f->constrain = (f->constrain + 1) % f->parts;
+
+    /* A filter that keeps adding more than it removes has diverged, start
+     * over. Single bad blocks, e.g. at the start of double-talk, are left to
+     * the adaptation. */
+    if (out_energy > 2 * rec_energy + n * POWER_FLOOR)
+        f->diverged++;
+    else
+        f->diverged = 0;
+
+    if (f->diverged >= DIVERGED_BLOCKS) {
+        pa_log_debug("Filter diverged, resetting it");
+        memset(f->wr, 0, f->parts * stride * sizeof(float));
+        memset(f->wi, 0, f->parts * stride * sizeof(float));
+        f->diverged = 0;
+    }
+}
+
+static void pa_pbfdaf_ec_fixate_spec(pa_sample_spec *rec_ss, pa_channel_map *rec_map,
+                                     pa_sample_spec *play_ss, pa_channel_map *play_map,
+                                     pa_sample_spec *out_ss, pa_channel_map *out_map) {
+    out_ss->format = PA_SAMPLE_FLOAT32NE;
+    out_ss->channels = 1;
+    pa_channel_map_init_mono(out_map);
+
+    *play_ss = *out_ss;
+    *play_map = *out_map;
+    *rec_ss = *out_ss;
+    *rec_map = *out_map;
+}
+
+bool pa_pbfdaf_ec_init(pa_core *c, pa_echo_canceller *ec,
+                       pa_sample_spec *rec_ss, pa_channel_map *rec_map,
+                       pa_sample_spec *play_ss, pa_channel_map *play_map,
+                       pa_sample_spec *out_ss, pa_channel_map *out_map,
+                       uint32_t *nframes, const char *args) {
+    uint32_t frame_size_ms, filter_size_ms, parts;
+    double mu;
+    bool have_sse = false;
+    pa_modargs *ma;
+
+    if (!(ma = pa_modargs_new(args, valid_modargs))) {
+        pa_log("Failed to parse submodule arguments.");
+        goto fail;
+    }
+
+    frame_size_ms = DEFAULT_FRAME_SIZE_MS;
+    if (pa_modargs_get_value_u32(ma, "frame_size_ms", &frame_size_ms) < 0 || frame_size_ms < 1 || frame_size_ms > 200) {
+        pa_log("Invalid frame_size_ms specification");
+        goto fail;
+    }
+
+    filter_size_ms = DEFAULT_FILTER_SIZE_MS;
+    if (pa_modargs_get_value_u32(ma, "filter_size_ms", &filter_size_ms) < 0 || filter_size_ms < 1 || filter_size_ms > 2000) {
+        pa_log("Invalid filter_size_ms specification");
+        goto fail;
+    }
+
+    mu = DEFAULT_MU;
+    if (pa_modargs_get_value_double(ma, "mu", &mu) < 0 || mu <= 0 || mu > 1) {
+        pa_log("Invalid mu specification, must be in (0, 1]");
+        goto fail;
+    }
+
+    pa_pbfdaf_ec_fixate_spec(rec_ss, rec_map, play_ss, play_map, out_ss, out_map);
+
+    /* The fft needs a power of two */
+    *nframes = pa_echo_canceller_blocksize_power2(out_ss->rate, frame_size_ms);
+    parts = PA_MAX(1U, (out_ss->rate * filter_size_ms / 1000 + *nframes - 1) / *nframes);
+
+    if (c->cpu_info.cpu_type == PA_CPU_X86 && (c->cpu_info.flags.x86 & PA_CPU_X86_SSE))
+        have_sse = true;
+
+    pa_log_debug("Using nframes %d, %u partitions, mu %0.3f, rate %d%s", *nframes, parts, mu, out_ss->rate,
+                 have_sse ? ", SSE" : "");
+
+    ec->params.pbfdaf.aec = pbfdaf_new(*nframes, parts, mu, have_sse);
+
+    pa_modargs_free(ma);
+    return true;
+
+fail:
+    if (ma)
+        pa_modargs_free(ma);
+    return false;
+}
+
+void pa_pbfdaf_ec_run(pa_echo_canceller *ec, const uint8_t *rec, const uint8_t *play, uint8_t *out) {
+    /* We know it's FLOAT32NE mono data */
+    pbfdaf_process(ec->params.pbfdaf.aec, (const float *) rec, (const float *) play, (float *) out);
+}
+
+void pa_pbfdaf_ec_done(pa_echo_canceller *ec) {
+    if (ec->params.pbfdaf.aec) {
+        pbfdaf_free(ec->params.pbfdaf.aec);
+        ec->params.pbfdaf.aec = NULL;
+    }
+}
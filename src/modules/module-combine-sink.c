@@ -54,7 +54,7 @@ PA_MODULE_USAGE(
         "sink_name=<name for the sink> "
         "sink_properties=<properties for the sink> "
         "slaves=<slave sinks> "
-        "adjust_time=<how often to readjust rates in s> "
+        "adjust_time=<how fast to correct latency differences between outputs in s, 0 to disable> "
         "resample_method=<method> "
         "format=<sample format> "
         "rate=<sample rate> "
@@ -69,6 +69,22 @@ PA_MODULE_USAGE(
 
 #define BLOCK_USEC (PA_USEC_PER_MSEC * 200)
 
+/* How often the output threads recalculate their rates */
+#define RATE_UPDATE_INTERVAL_USEC (100*PA_USEC_PER_MSEC)
+
+/* The queue length jumps by a block whenever new data comes in, so the
+ * latency difference is averaged over this time */
+#define LATENCY_AVERAGING_USEC (PA_USEC_PER_SEC)
+
+/* 2‰ can be considered inaudible, so the rate doesn't change by more
+ * than that at once */
+#define MAX_RATE_STEP 0.002
+
+/* An output that would have to be resampled further away from the
+ * nominal rate most likely has broken timing, and is not adjusted */
+#define MIN_RATE_RATIO 0.8
+#define MAX_RATE_RATIO 1.25
+
 static const char* const valid_modargs[] = {
     "sink_name",
     "sink_properties",
@@ -92,12 +108,15 @@ struct output {
     /* This message queue is only for POST messages, i.e. the messages that
      * carry audio data from the sink thread to the output thread. The POST
      * messages need to be handled in a separate queue, because the queue is
-     * processed not only in the output thread mainloop, but also inside the
-     * sink input pop() callback. Processing other messages (such as
-     * SET_REQUESTED_LATENCY) is not safe inside the pop() callback; at least
-     * one reason why it's not safe is that messages that generate rewind
-     * requests (such as SET_REQUESTED_LATENCY) cause crashes when processed
-     * in the pop() callback. */
+     * processed inside the sink input pop() callback. Processing other
+     * messages (such as SET_REQUESTED_LATENCY) is not safe inside the pop()
+     * callback; at least one reason why it's not safe is that messages that
+     * generate rewind requests (such as SET_REQUESTED_LATENCY) cause crashes
+     * when processed in the pop() callback.
+     *
+     * The output thread doesn't poll this queue: the data is only needed
+     * when the output renders, so posting a block to all outputs doesn't
+     * wake each of their threads up. */
     pa_asyncmsgq *audio_inq;
 
     /* This message queue is for all other messages than POST from the sink
@@ -108,20 +127,34 @@ struct output {
     /* Message queue from the output thread to the sink thread. */
     pa_asyncmsgq *outq;
 
-    pa_rtpoll_item *audio_inq_rtpoll_item_read, *audio_inq_rtpoll_item_write;
+    pa_rtpoll_item *audio_inq_rtpoll_item_write;
     pa_rtpoll_item *control_inq_rtpoll_item_read, *control_inq_rtpoll_item_write;
     pa_rtpoll_item *outq_rtpoll_item_read, *outq_rtpoll_item_write;
 
     pa_memblockq *memblockq;
 
-    /* For communication of the stream latencies to the main thread */
-    pa_usec_t total_latency;
+    /* For communication of the stream latencies to the sink thread */
+    pa_atomic_t total_latency;
+    pa_atomic_t sink_latency;
+
+    /* Set while the output's sink is suspended and doesn't take any data */
+    pa_atomic_t suspended;
 
     /* For communication of the stream parameters to the sink thread */
     pa_atomic_t max_request;
     pa_atomic_t max_latency;
     pa_atomic_t min_latency;
 
+    struct {
+        pa_usec_t last_rate_update;
+        double latency_error;
+
+        /* The accumulated latency error, which makes up for the clock
+         * drift of the output's sink. Relative to the nominal rate, and
+         * kept while the sink is suspended. */
+        double rate_offset;
+    } thread_info; /* managed in the output's IO thread context */
+
     PA_LLIST_FIELDS(struct output);
 };
 
@@ -134,7 +167,6 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
-    pa_time_event *time_event;
     pa_usec_t adjust_time;
 
     bool automatic;
@@ -159,6 +191,7 @@ struct userdata {
         bool in_null_mode;
         pa_smoother *smoother;
         uint64_t counter;
+        pa_atomic_t target_latency; /* read by the output threads, 0 while unknown */
     } thread_info;
 };
 
@@ -166,7 +199,6 @@ enum {
     SINK_MESSAGE_ADD_OUTPUT = PA_SINK_MESSAGE_MAX,
     SINK_MESSAGE_REMOVE_OUTPUT,
     SINK_MESSAGE_NEED,
-    SINK_MESSAGE_UPDATE_LATENCY,
     SINK_MESSAGE_UPDATE_MAX_REQUEST,
     SINK_MESSAGE_UPDATE_LATENCY_RANGE
 };
@@ -181,105 +213,6 @@ static void output_enable(struct output *o);
 static void output_free(struct output *o);
 static int output_create_sink_input(struct output *o);
 
-static void adjust_rates(struct userdata *u) {
-    struct output *o;
-    pa_usec_t max_sink_latency = 0, min_total_latency = (pa_usec_t) -1, target_latency, avg_total_latency = 0;
-    uint32_t base_rate;
-    uint32_t idx;
-    unsigned n = 0;
-
-    pa_assert(u);
-    pa_sink_assert_ref(u->sink);
-
-    if (pa_idxset_size(u->outputs) <= 0)
-        return;
-
-    if (!PA_SINK_IS_OPENED(u->sink->state))
-        return;
-
-    PA_IDXSET_FOREACH(o, u->outputs, idx) {
-        pa_usec_t sink_latency;
-
-        if (!o->sink_input || !PA_SINK_IS_OPENED(o->sink->state))
-            continue;
-
-        o->total_latency = pa_sink_input_get_latency(o->sink_input, &sink_latency);
-        o->total_latency += sink_latency;
-
-        if (sink_latency > max_sink_latency)
-            max_sink_latency = sink_latency;
-
-        if (min_total_latency == (pa_usec_t) -1 || o->total_latency < min_total_latency)
-            min_total_latency = o->total_latency;
-
-        avg_total_latency += o->total_latency;
-        n++;
-
-        pa_log_debug("[%s] total=%0.2fms sink=%0.2fms ", o->sink->name, (double) o->total_latency / PA_USEC_PER_MSEC, (double) sink_latency / PA_USEC_PER_MSEC);
-
-        if (o->total_latency > 10*PA_USEC_PER_SEC)
-            pa_log_warn("[%s] Total latency of output is very high (%0.2fms), most likely the audio timing in one of your drivers is broken.", o->sink->name, (double) o->total_latency / PA_USEC_PER_MSEC);
-    }
-
-    if (min_total_latency == (pa_usec_t) -1)
-        return;
-
-    avg_total_latency /= n;
-
-    target_latency = PA_MAX(max_sink_latency, min_total_latency);
-
-    pa_log_info("[%s] avg total latency is %0.2f msec.", u->sink->name, (double) avg_total_latency / PA_USEC_PER_MSEC);
-    pa_log_info("[%s] target latency is %0.2f msec.", u->sink->name, (double) target_latency / PA_USEC_PER_MSEC);
-
-    base_rate = u->sink->sample_spec.rate;
-
-    PA_IDXSET_FOREACH(o, u->outputs, idx) {
-        uint32_t new_rate = base_rate;
-        uint32_t current_rate;
-
-        if (!o->sink_input || !PA_SINK_IS_OPENED(o->sink->state))
-            continue;
-
-        current_rate = o->sink_input->sample_spec.rate;
-
-        if (o->total_latency != target_latency)
-            new_rate += (uint32_t) (((double) o->total_latency - (double) target_latency) / (double) u->adjust_time * (double) new_rate);
-
-        if (new_rate < (uint32_t) (base_rate*0.8) || new_rate > (uint32_t) (base_rate*1.25)) {
-            pa_log_warn("[%s] sample rates too different, not adjusting (%u vs. %u).", o->sink_input->sink->name, base_rate, new_rate);
-            new_rate = base_rate;
-        } else {
-            if (base_rate < new_rate + 20 && new_rate < base_rate + 20)
-              new_rate = base_rate;
-            /* Do the adjustment in small steps; 2‰ can be considered inaudible */
-            if (new_rate < (uint32_t) (current_rate*0.998) || new_rate > (uint32_t) (current_rate*1.002)) {
-                pa_log_info("[%s] new rate of %u Hz not within 2‰ of %u Hz, forcing smaller adjustment", o->sink_input->sink->name, new_rate, current_rate);
-                new_rate = PA_CLAMP(new_rate, (uint32_t) (current_rate*0.998), (uint32_t) (current_rate*1.002));
-            }
-            pa_log_info("[%s] new rate is %u Hz; ratio is %0.3f; latency is %0.2f msec.", o->sink_input->sink->name, new_rate, (double) new_rate / base_rate, (double) o->total_latency / PA_USEC_PER_MSEC);
-        }
-        pa_sink_input_set_rate(o->sink_input, new_rate);
-    }
-
-    pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_UPDATE_LATENCY, NULL, (int64_t) avg_total_latency, NULL);
-}
-
-static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
-    struct userdata *u = userdata;
-
-    pa_assert(u);
-    pa_assert(a);
-    pa_assert(u->time_event == e);
-
-    adjust_rates(u);
-
-    if (u->sink->state == PA_SINK_SUSPENDED) {
-        u->core->mainloop->time_free(e);
-        u->time_event = NULL;
-    } else
-        pa_core_rttime_restart(u->core, e, pa_rtclock_now() + u->adjust_time);
-}
-
 static void process_render_null(struct userdata *u, pa_usec_t now) {
     size_t ate = 0;
 
@@ -369,6 +302,60 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* Called from combine sink I/O thread context */
+static void update_target_latency(struct userdata *u) {
+    pa_usec_t max_sink_latency = 0, min_total_latency = (pa_usec_t) -1, avg_total_latency = 0, target_latency, x, y;
+    struct output *o;
+    unsigned n = 0;
+
+    pa_assert(u);
+
+    /* The outputs publish their latencies as they render. Aim at the
+     * latency of the slowest output, but never below the largest sink
+     * latency, since no output can play data before its sink does. */
+    PA_LLIST_FOREACH(o, u->thread_info.active_outputs) {
+        pa_usec_t total_latency, sink_latency;
+
+        if (pa_atomic_load(&o->suspended))
+            continue;
+
+        if (!(total_latency = (pa_usec_t) pa_atomic_load(&o->total_latency)))
+            continue;
+
+        sink_latency = (pa_usec_t) pa_atomic_load(&o->sink_latency);
+
+        if (sink_latency > max_sink_latency)
+            max_sink_latency = sink_latency;
+
+        if (total_latency < min_total_latency)
+            min_total_latency = total_latency;
+
+        avg_total_latency += total_latency;
+        n++;
+
+        if (total_latency > 10*PA_USEC_PER_SEC && pa_log_ratelimit(PA_LOG_WARN))
+            pa_log_warn("[%s] Total latency of output is very high (%0.2fms), most likely the audio timing in one of your drivers is broken.", o->sink->name, (double) total_latency / PA_USEC_PER_MSEC);
+    }
+
+    if (n == 0)
+        return;
+
+    avg_total_latency /= n;
+
+    target_latency = PA_MAX(max_sink_latency, min_total_latency);
+    pa_atomic_store(&u->thread_info.target_latency, (int) target_latency);
+
+    x = pa_rtclock_now();
+    y = pa_bytes_to_usec(u->thread_info.counter, &u->sink->sample_spec);
+
+    if (y > avg_total_latency)
+        y -= avg_total_latency;
+    else
+        y = 0;
+
+    pa_smoother_put(u->thread_info.smoother, x, y);
+}
+
 /* Called from combine sink I/O thread context */
 static void render_memblock(struct userdata *u, struct output *o, size_t length) {
     pa_assert(u);
@@ -387,6 +374,11 @@ static void render_memblock(struct userdata *u, struct output *o, size_t length)
     while (pa_asyncmsgq_process_one(o->audio_inq) > 0)
         ;
 
+    if (pa_memblockq_is_readable(o->memblockq))
+        return;
+
+    update_target_latency(u);
+
     /* Ok, now let's prepare some data if we really have to */
     while (!pa_memblockq_is_readable(o->memblockq)) {
         struct output *j;
@@ -397,11 +389,16 @@ static void render_memblock(struct userdata *u, struct output *o, size_t length)
 
         u->thread_info.counter += chunk.length;
 
-        /* OK, let's send this data to the other threads */
+        /* OK, let's send this data to the other threads. Only a reference
+         * to the block is passed, the data itself is shared. */
         PA_LLIST_FOREACH(j, u->thread_info.active_outputs) {
             if (j == o)
                 continue;
 
+            /* A suspended sink doesn't read its queue */
+            if (pa_atomic_load(&j->suspended))
+                continue;
+
             pa_asyncmsgq_post(j->audio_inq, PA_MSGOBJECT(j->sink_input), SINK_INPUT_MESSAGE_POST, NULL, 0, &chunk, NULL);
         }
 
@@ -432,6 +429,80 @@ static void request_memblock(struct output *o, size_t length) {
         pa_asyncmsgq_send(o->outq, PA_MSGOBJECT(o->userdata->sink), SINK_MESSAGE_NEED, o, (int64_t) length, NULL);
 }
 
+/* Called from I/O thread context */
+static void update_rate(struct output *o) {
+    struct userdata *u = o->userdata;
+    pa_sink_input *i = o->sink_input;
+    pa_usec_t now, sink_latency, total_latency, target_latency, dt;
+    double base_rate, current_rate, rate, wanted_rate, weight, integral_step;
+    uint32_t new_rate;
+
+    now = pa_rtclock_now();
+
+    if (o->thread_info.last_rate_update > 0 && now < o->thread_info.last_rate_update + RATE_UPDATE_INTERVAL_USEC)
+        return;
+
+    dt = o->thread_info.last_rate_update > 0 ? now - o->thread_info.last_rate_update : RATE_UPDATE_INTERVAL_USEC;
+    o->thread_info.last_rate_update = now;
+
+    /* Everything that is queued between the combine sink and the
+     * speaker of this output */
+    sink_latency = (pa_usec_t) pa_sink_get_latency_within_thread(i->sink, false);
+    total_latency = pa_bytes_to_usec(pa_memblockq_get_length(o->memblockq), &u->sink->sample_spec) +
+        pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec) +
+        sink_latency;
+
+    pa_atomic_store(&o->sink_latency, (int) sink_latency);
+    pa_atomic_store(&o->total_latency, (int) PA_MAX(total_latency, 1U));
+
+    if (u->adjust_time <= 0)
+        return;
+
+    if (!(target_latency = (pa_usec_t) pa_atomic_load(&u->thread_info.target_latency)))
+        return;
+
+    weight = PA_MIN((double) dt / LATENCY_AVERAGING_USEC, 1.0);
+    o->thread_info.latency_error += ((double) total_latency - (double) target_latency - o->thread_info.latency_error) * weight;
+
+    /* Play faster while we are behind the other outputs, so that the
+     * difference is gone after adjust_time. The clock drift of the
+     * output is made up for by the integral of the difference, otherwise
+     * the output would have to stay behind to play fast enough. With the
+     * integral time at four times adjust_time the control loop is
+     * critically damped. */
+    integral_step = o->thread_info.latency_error * (double) dt / (4.0 * (double) u->adjust_time * (double) u->adjust_time);
+    o->thread_info.rate_offset += integral_step;
+
+    base_rate = u->sink->sample_spec.rate;
+    current_rate = i->thread_info.sample_spec.rate;
+    rate = wanted_rate = base_rate * (1.0 + o->thread_info.latency_error / (double) u->adjust_time + o->thread_info.rate_offset);
+
+    if (rate < base_rate * MIN_RATE_RATIO || rate > base_rate * MAX_RATE_RATIO) {
+        if (pa_log_ratelimit(PA_LOG_WARN))
+            pa_log_warn("[%s] sample rates too different, not adjusting (%u vs. %u).", i->sink->name,
+                        (uint32_t) base_rate, (uint32_t) (rate + 0.5));
+        rate = base_rate;
+    }
+
+    /* Large corrections are spread over several updates */
+    rate = PA_CLAMP(rate, current_rate * (1.0 - MAX_RATE_STEP), current_rate * (1.0 + MAX_RATE_STEP));
+    new_rate = (uint32_t) (rate + 0.5);
+
+    /* Don't accumulate what can't be applied yet, or the output would
+     * overshoot once the limits are out of the way */
+    if (rate != wanted_rate)
+        o->thread_info.rate_offset -= integral_step;
+
+    if (new_rate == i->thread_info.sample_spec.rate)
+        return;
+
+    if (pa_log_ratelimit(PA_LOG_DEBUG))
+        pa_log_debug("[%s] new rate is %u Hz; latency is %0.2f msec, target %0.2f msec.", i->sink->name, new_rate,
+                     (double) total_latency / PA_USEC_PER_MSEC, (double) target_latency / PA_USEC_PER_MSEC);
+
+    pa_sink_input_set_rate_within_thread(i, new_rate);
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct output *o;
@@ -454,6 +525,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     pa_memblockq_drop(o->memblockq, chunk->length);
 
+    update_rate(o);
+
     return 0;
 }
 
@@ -531,15 +604,9 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_assert_se(o = i->userdata);
 
     /* Set up the queue from the sink thread to us */
-    pa_assert(!o->audio_inq_rtpoll_item_read);
     pa_assert(!o->control_inq_rtpoll_item_read);
     pa_assert(!o->outq_rtpoll_item_write);
 
-    o->audio_inq_rtpoll_item_read = pa_rtpoll_item_new_asyncmsgq_read(
-            i->sink->thread_info.rtpoll,
-            PA_RTPOLL_LATE,  /* This one is not that important, since we check for data in _peek() anyway. */
-            o->audio_inq);
-
     o->control_inq_rtpoll_item_read = pa_rtpoll_item_new_asyncmsgq_read(
             i->sink->thread_info.rtpoll,
             PA_RTPOLL_NORMAL,
@@ -567,6 +634,13 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_atomic_store(&o->max_latency, (int) max);
     pa_log_debug("attach latency range %lu %lu", (unsigned long) min, (unsigned long) max);
 
+    pa_atomic_store(&o->total_latency, 0);
+    pa_atomic_store(&o->sink_latency, 0);
+    pa_atomic_store(&o->suspended, i->sink->thread_info.state == PA_SINK_SUSPENDED);
+    o->thread_info.last_rate_update = 0;
+    o->thread_info.latency_error = 0;
+    o->thread_info.rate_offset = 0;
+
     /* We register the output. That means that the sink will start to pass data to
      * this output. */
     pa_asyncmsgq_send(o->userdata->sink->asyncmsgq, PA_MSGOBJECT(o->userdata->sink), SINK_MESSAGE_ADD_OUTPUT, o, 0, NULL);
@@ -583,11 +657,6 @@ static void sink_input_detach_cb(pa_sink_input *i) {
      * pass any further data to this output */
     pa_asyncmsgq_send(o->userdata->sink->asyncmsgq, PA_MSGOBJECT(o->userdata->sink), SINK_MESSAGE_REMOVE_OUTPUT, o, 0, NULL);
 
-    if (o->audio_inq_rtpoll_item_read) {
-        pa_rtpoll_item_free(o->audio_inq_rtpoll_item_read);
-        o->audio_inq_rtpoll_item_read = NULL;
-    }
-
     if (o->control_inq_rtpoll_item_read) {
         pa_rtpoll_item_free(o->control_inq_rtpoll_item_read);
         o->control_inq_rtpoll_item_read = NULL;
@@ -600,6 +669,21 @@ static void sink_input_detach_cb(pa_sink_input *i) {
 
 }
 
+/* Called from I/O thread context */
+static void sink_input_suspend_within_thread_cb(pa_sink_input *i, bool b) {
+    struct output *o;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(o = i->userdata);
+
+    pa_atomic_store(&o->suspended, b);
+
+    /* The sink's latency starts over after resuming */
+    pa_atomic_store(&o->total_latency, 0);
+    o->thread_info.last_rate_update = 0;
+    o->thread_info.latency_error = 0;
+}
+
 /* Called from main context */
 static void sink_input_kill_cb(pa_sink_input *i) {
     struct output *o;
@@ -674,9 +758,6 @@ static void unsuspend(struct userdata *u) {
     PA_IDXSET_FOREACH(o, u->outputs, idx)
         output_enable(o);
 
-    if (!u->time_event && u->adjust_time > 0)
-        u->time_event = pa_core_rttime_new(u->core, pa_rtclock_now() + u->adjust_time, time_callback, u);
-
     pa_log_info("Resumed successfully...");
 }
 
@@ -914,21 +995,6 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             render_memblock(u, (struct output*) data, (size_t) offset);
             return 0;
 
-        case SINK_MESSAGE_UPDATE_LATENCY: {
-            pa_usec_t x, y, latency = (pa_usec_t) offset;
-
-            x = pa_rtclock_now();
-            y = pa_bytes_to_usec(u->thread_info.counter, &u->sink->sample_spec);
-
-            if (y > latency)
-                y -= latency;
-            else
-                y = 0;
-
-            pa_smoother_put(u->thread_info.smoother, x, y);
-            return 0;
-        }
-
         case SINK_MESSAGE_UPDATE_MAX_REQUEST:
             update_max_request(u);
             break;
@@ -1014,6 +1080,7 @@ static int output_create_sink_input(struct output *o) {
     o->sink_input->update_sink_latency_range = sink_input_update_sink_latency_range_cb;
     o->sink_input->attach = sink_input_attach_cb;
     o->sink_input->detach = sink_input_detach_cb;
+    o->sink_input->suspend_within_thread = sink_input_suspend_within_thread_cb;
     o->sink_input->kill = sink_input_kill_cb;
     o->sink_input->userdata = o;
 
@@ -1081,8 +1148,6 @@ static void output_free(struct output *o) {
     output_disable(o);
     update_description(o->userdata);
 
-    if (o->audio_inq_rtpoll_item_read)
-        pa_rtpoll_item_free(o->audio_inq_rtpoll_item_read);
     if (o->audio_inq_rtpoll_item_write)
         pa_rtpoll_item_free(o->audio_inq_rtpoll_item_write);
 
@@ -1516,9 +1581,6 @@ int pa__init(pa_module*m) {
     PA_IDXSET_FOREACH(o, u->outputs, idx)
         output_verify(o);
 
-    if (u->adjust_time > 0)
-        u->time_event = pa_core_rttime_new(m->core, pa_rtclock_now() + u->adjust_time, time_callback, u);
-
     pa_modargs_free(ma);
 
     return 0;
@@ -1571,9 +1633,6 @@ void pa__done(pa_module*m) {
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
-    if (u->time_event)
-        u->core->mainloop->time_free(u->time_event);
-
     if (u->thread_info.smoother)
         pa_smoother_free(u->thread_info.smoother);
 
@@ -45,10 +45,12 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
+#include <pulse/rtclock.h>
 
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/aupdate.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/module.h>
@@ -57,6 +59,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/thread-mq.h>
 #include <pulsecore/shared.h>
 #include <pulsecore/idxset.h>
 #include <pulsecore/strlist.h>
@@ -78,10 +81,54 @@ PA_MODULE_USAGE(
           "channel_map=<channel map> "
           "autoloaded=<set if this module is being loaded automatically> "
           "use_volume_sharing=<yes or no> "
+          "low_latency=<use partitioned convolution instead of overlap-add> "
+          "partition_size=<head partition size in samples for low_latency mode> "
          ));
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 #define DEFAULT_AUTOLOADED false
+#define DEFAULT_PARTITION_SIZE 64
+/* tail partitions are this many times larger than the head partitions */
+#define PCONV_TAIL_RATIO 16
+#define CPU_LOG_INTERVAL (10 * PA_USEC_PER_SEC)
+
+/* One stage of a uniformly partitioned overlap-save convolution. The low
+ * latency mode uses a head stage with small partitions for the start of the
+ * impulse response and a tail stage with large partitions for the rest. */
+struct pconv_stage {
+    size_t block;/* partition size, the FFTs are twice as long */
+    size_t n_parts;
+    size_t offset;/* first sample of the impulse response covered */
+    fftwf_plan forward, inverse;
+    size_t fill;/* input samples gathered for the current block */
+    size_t fdl_pos;/* newest entry in the frequency domain delay line */
+    bool fading;/* crossfade from the old filter on the next block */
+    /* per channel */
+    float **input;/* previous and current input block */
+    fftwf_complex **fdl;/* spectra of the last n_parts input blocks */
+    float **out;/* output of the last completed block */
+};
+
+/* complex spectra are kept 32 byte aligned so FFTW can use them directly */
+#define PCONV_STRIDE(s) PA_ROUND_UP((s)->block + 1, 4)
+
+/* The partition spectra of all channels, built in the main thread and
+ * handed to the IO thread as a whole */
+struct pconv_filter {
+    fftwf_complex *head, *tail;
+};
+
+typedef struct eq_msg eq_msg;
+
+struct eq_msg {
+    pa_msgobject parent;
+};
+
+PA_DEFINE_PRIVATE_CLASS(eq_msg, pa_msgobject);
+
+enum {
+    EQ_MESSAGE_FREE_FILTER
+};
 
 struct userdata {
     pa_module *module;
@@ -127,6 +174,24 @@ struct userdata {
     char **base_profiles;
 
     bool automatic_description;
+
+    /* low latency mode, see pconv_process() */
+    bool low_latency;
+    size_t ir_length;
+    struct pconv_stage head, tail;
+    size_t tail_pos;/* read position in the tail output */
+    float *pc_time, *pc_time_old;
+    float *pc_discard;/* output while rebuilding the state after a rewind */
+    fftwf_complex *pc_accum;
+    struct pconv_filter *pc_filter, *pc_old_filter;
+    pa_atomic_ptr_t pc_pending;
+    struct pconv_filter *pc_design;/* partitions of all channels, main thread only */
+    float *design_ir, *design_time;
+    fftwf_complex *design_spec;
+    eq_msg *msg;
+
+    pa_usec_t busy_usec;
+    size_t busy_frames;
 };
 
 static const char* const valid_modargs[] = {
@@ -139,6 +204,8 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "autoloaded",
     "use_volume_sharing",
+    "low_latency",
+    "partition_size",
     NULL
 };
 
@@ -262,7 +329,10 @@ static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t of
                 /* Add the latency internal to our sink input on top */
                 pa_bytes_to_usec(pa_memblockq_get_length(u->output_q) +
                                  pa_memblockq_get_length(u->input_q), &u->sink_input->sink->sample_spec) +
-                pa_bytes_to_usec(pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq), &u->sink_input->sink->sample_spec);
+                pa_bytes_to_usec(pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq), &u->sink_input->sink->sample_spec) +
+
+                /* The partitioned convolution delays by one head block */
+                (u->low_latency ? pa_bytes_to_usec(u->head.block * pa_frame_size(&u->sink->sample_spec), &u->sink->sample_spec) : 0);
             //    pa_bytes_to_usec(u->samples_gathered * fs, &u->sink->sample_spec);
             //+ pa_bytes_to_usec(u->latency * fs, ss)
             return 0;
@@ -603,6 +673,457 @@ static void input_buffer(struct userdata *u, pa_memchunk *in) {
     pa_memblock_release(in->memblock);
 }
 
+/* Called from I/O thread context. Logs the CPU time spent filtering, per
+ * channel and relative to the duration of the audio produced, so the two
+ * modes can be compared. */
+static void account_cpu(struct userdata *u, pa_usec_t busy, size_t frames) {
+    pa_usec_t duration;
+
+    u->busy_usec += busy;
+    u->busy_frames += frames;
+
+    duration = (pa_usec_t) u->busy_frames * PA_USEC_PER_SEC / u->sink->sample_spec.rate;
+    if (duration < CPU_LOG_INTERVAL)
+        return;
+
+    pa_log_debug("%s: %0.3f%% CPU per channel",
+                 u->low_latency ? "Partitioned convolution" : "Overlap-add",
+                 100.0 * u->busy_usec / duration / u->channels);
+
+    u->busy_usec = 0;
+    u->busy_frames = 0;
+}
+
+static void pconv_stage_init(struct pconv_stage *s, size_t channels, size_t block, size_t n_parts, size_t offset) {
+    float *t;
+    fftwf_complex *X;
+
+    s->block = block;
+    s->n_parts = n_parts;
+    s->offset = offset;
+
+    s->input = pa_xnew0(float *, channels);
+    s->fdl = pa_xnew0(fftwf_complex *, channels);
+    s->out = pa_xnew0(float *, channels);
+    for (size_t c = 0; c < channels; ++c) {
+        s->input[c] = alloc(2 * block, sizeof(float));
+        s->fdl[c] = alloc(n_parts * PCONV_STRIDE(s), sizeof(fftwf_complex));
+        s->out[c] = alloc(block, sizeof(float));
+    }
+
+    /* The plans are only ever used with fftwf_execute_dft_*(), so the
+     * arrays they were made with can go away again */
+    t = alloc(2 * block, sizeof(float));
+    X = alloc(PCONV_STRIDE(s), sizeof(fftwf_complex));
+    s->forward = fftwf_plan_dft_r2c_1d(2 * block, t, X, FFTW_ESTIMATE);
+    s->inverse = fftwf_plan_dft_c2r_1d(2 * block, X, t, FFTW_ESTIMATE);
+    fftwf_free(t);
+    fftwf_free(X);
+}
+
+static void pconv_stage_done(struct pconv_stage *s, size_t channels) {
+    if (!s->input)
+        return;
+
+    for (size_t c = 0; c < channels; ++c) {
+        fftwf_free(s->input[c]);
+        fftwf_free(s->fdl[c]);
+        fftwf_free(s->out[c]);
+    }
+    pa_xfree(s->input);
+    pa_xfree(s->fdl);
+    pa_xfree(s->out);
+
+    fftwf_destroy_plan(s->forward);
+    fftwf_destroy_plan(s->inverse);
+}
+
+static void pconv_filter_free(struct pconv_filter *f) {
+    if (!f)
+        return;
+
+    fftwf_free(f->head);
+    if (f->tail)
+        fftwf_free(f->tail);
+    pa_xfree(f);
+}
+
+/* Called from main context. Turns the magnitude response of a channel into a
+ * minimum phase impulse response of ir_length samples using the real
+ * cepstrum, so that the filter itself adds as little delay as possible. */
+static void design_min_phase(struct userdata *u, size_t channel) {
+    const size_t n = u->fft_size, fade = u->ir_length / 8;
+    float *t = u->design_time, *ir = u->design_ir;
+    fftwf_complex *spec = u->design_spec;
+    const float *H;
+    unsigned a_i;
+    float X;
+
+    a_i = pa_aupdate_read_begin(u->a_H[channel]);
+    X = u->Xs[channel][a_i];
+    H = u->Hs[channel][a_i];
+    for (size_t i = 0; i < FILTER_SIZE(u); ++i) {
+        /* undo fix_filter(), the inverse fft below divides by n anyway */
+        spec[i][0] = logf(PA_MAX(X * H[i] * n, 1e-7f));
+        spec[i][1] = 0;
+    }
+    pa_aupdate_read_end(u->a_H[channel]);
+
+    /* keep the causal part of the cepstrum only */
+    fftwf_execute_dft_c2r(u->inverse_plan, spec, t);
+    t[0] /= n;
+    for (size_t i = 1; i < n / 2; ++i)
+        t[i] *= 2.0f / n;
+    t[n / 2] /= n;
+    memset(t + n / 2 + 1, 0, (n / 2 - 1) * sizeof(float));
+
+    fftwf_execute_dft_r2c(u->forward_plan, t, spec);
+    for (size_t i = 0; i < FILTER_SIZE(u); ++i) {
+        float mag = expf(spec[i][0]), phase = spec[i][1];
+
+        spec[i][0] = mag * cosf(phase);
+        spec[i][1] = mag * sinf(phase);
+    }
+    fftwf_execute_dft_c2r(u->inverse_plan, spec, t);
+
+    for (size_t i = 0; i < u->ir_length; ++i)
+        ir[i] = t[i] / n;
+
+    /* fade out where the impulse response is cut off */
+    for (size_t i = 0; i < fade; ++i)
+        ir[u->ir_length - fade + i] *= (float) .5 * (1 + cos(M_PI * (i + 1) / fade));
+}
+
+/* Called from main context */
+static void pconv_partition(struct userdata *u, const struct pconv_stage *s, fftwf_complex *P) {
+    float *t = u->design_time;
+
+    for (size_t p = 0; p < s->n_parts; ++p) {
+        const float *h = u->design_ir + s->offset + p * s->block;
+
+        /* overlap-save: block taps zero padded to the fft size, with the
+         * 1/N of the inverse fft folded in */
+        for (size_t i = 0; i < s->block; ++i)
+            t[i] = h[i] / (2 * s->block);
+        memset(t + s->block, 0, s->block * sizeof(float));
+
+        fftwf_execute_dft_r2c(s->forward, t, P + p * PCONV_STRIDE(s));
+    }
+}
+
+/* Called from main context. Designs the partitions of one channel into
+ * pc_design. */
+static void pconv_design_channel(struct userdata *u, size_t c) {
+    const size_t head_size = u->head.n_parts * PCONV_STRIDE(&u->head);
+    const size_t tail_size = u->tail.n_parts * PCONV_STRIDE(&u->tail);
+
+    design_min_phase(u, c);
+    pconv_partition(u, &u->head, u->pc_design->head + c * head_size);
+    if (u->pc_design->tail)
+        pconv_partition(u, &u->tail, u->pc_design->tail + c * tail_size);
+}
+
+/* Called from main context. Publishes a copy of pc_design to the IO
+ * thread, which crossfades to it on its own. Nothing here blocks the IO
+ * thread. */
+static void pconv_publish_filter(struct userdata *u) {
+    struct pconv_filter *f, *old;
+    const size_t head_size = u->head.n_parts * PCONV_STRIDE(&u->head);
+    const size_t tail_size = u->tail.n_parts * PCONV_STRIDE(&u->tail);
+
+    f = pa_xnew0(struct pconv_filter, 1);
+    f->head = alloc(u->channels * head_size, sizeof(fftwf_complex));
+    memcpy(f->head, u->pc_design->head, u->channels * head_size * sizeof(fftwf_complex));
+    if (u->pc_design->tail) {
+        f->tail = alloc(u->channels * tail_size, sizeof(fftwf_complex));
+        memcpy(f->tail, u->pc_design->tail, u->channels * tail_size * sizeof(fftwf_complex));
+    }
+
+    /* If the IO thread did not pick up the previous filter yet it never
+     * will, so we can free it right here */
+    do {
+        old = pa_atomic_ptr_load(&u->pc_pending);
+    } while (!pa_atomic_ptr_cmpxchg(&u->pc_pending, old, f));
+
+    pconv_filter_free(old);
+}
+
+/* Called from main context, after the magnitude response of a channel
+ * changed. channel == u->channels means that all channels were set to
+ * the same response, which then only needs to be designed once. */
+static void pconv_update_filter(struct userdata *u, size_t channel) {
+    const size_t head_size = u->head.n_parts * PCONV_STRIDE(&u->head);
+    const size_t tail_size = u->tail.n_parts * PCONV_STRIDE(&u->tail);
+
+    if (!u->low_latency)
+        return;
+
+    if (channel < u->channels)
+        pconv_design_channel(u, channel);
+    else {
+        pconv_design_channel(u, 0);
+        for (size_t c = 1; c < u->channels; ++c) {
+            memcpy(u->pc_design->head + c * head_size, u->pc_design->head, head_size * sizeof(fftwf_complex));
+            if (u->pc_design->tail)
+                memcpy(u->pc_design->tail + c * tail_size, u->pc_design->tail, tail_size * sizeof(fftwf_complex));
+        }
+    }
+
+    pconv_publish_filter(u);
+}
+
+/* Called from main context */
+static int eq_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    pa_assert(o);
+    pa_assert_ctl_context();
+
+    switch (code) {
+        case EQ_MESSAGE_FREE_FILTER:
+            pconv_filter_free(data);
+            break;
+    }
+
+    return 0;
+}
+
+/* Called from I/O thread context */
+static void pconv_accumulate(const struct pconv_stage *s, size_t c, const fftwf_complex *P, fftwf_complex *accum) {
+    const size_t stride = PCONV_STRIDE(s);
+
+    memset(accum, 0, (s->block + 1) * sizeof(fftwf_complex));
+
+    for (size_t p = 0; p < s->n_parts; ++p) {
+        const fftwf_complex *X = s->fdl[c] + ((s->fdl_pos + s->n_parts - p) % s->n_parts) * stride;
+        const fftwf_complex *H = P + p * stride;
+
+        for (size_t j = 0; j <= s->block; ++j) {
+            accum[j][0] += X[j][0] * H[j][0] - X[j][1] * H[j][1];
+            accum[j][1] += X[j][0] * H[j][1] + X[j][1] * H[j][0];
+        }
+    }
+}
+
+/* Called from I/O thread context. Runs one block of channel c through the
+ * stage. P are the channel's partitions of the current filter, P_old those
+ * of the filter to crossfade from, if any. */
+static void pconv_stage_run(struct userdata *u, struct pconv_stage *s, size_t c,
+                            const fftwf_complex *P, const fftwf_complex *P_old) {
+    float *t = u->pc_time + s->block, *t_old = u->pc_time_old + s->block;
+
+    fftwf_execute_dft_r2c(s->forward, s->input[c], s->fdl[c] + s->fdl_pos * PCONV_STRIDE(s));
+    /* the current block is the first half of the next window */
+    memcpy(s->input[c], s->input[c] + s->block, s->block * sizeof(float));
+
+    if (!P) {
+        pa_memzero(s->out[c], s->block * sizeof(float));
+        return;
+    }
+
+    pconv_accumulate(s, c, P, u->pc_accum);
+    fftwf_execute_dft_c2r(s->inverse, u->pc_accum, u->pc_time);
+
+    if (!P_old) {
+        memcpy(s->out[c], t, s->block * sizeof(float));
+        return;
+    }
+
+    pconv_accumulate(s, c, P_old, u->pc_accum);
+    fftwf_execute_dft_c2r(s->inverse, u->pc_accum, u->pc_time_old);
+
+    for (size_t i = 0; i < s->block; ++i) {
+        float g = (float) (i + 1) / s->block;
+
+        s->out[c][i] = g * t[i] + (1 - g) * t_old[i];
+    }
+}
+
+/* Called from I/O thread context. Processes the head block that was just
+ * completed and, every PCONV_TAIL_RATIO head blocks, a tail block. */
+static void pconv_block(struct userdata *u) {
+    const size_t head_size = u->head.n_parts * PCONV_STRIDE(&u->head);
+    const size_t tail_size = u->tail.n_parts * PCONV_STRIDE(&u->tail);
+    struct pconv_filter *f, *old;
+    bool run_tail;
+
+    /* Pick up a new filter, unless we are still fading to the last one */
+    if (!u->pc_old_filter && (f = pa_atomic_ptr_load(&u->pc_pending)) &&
+        pa_atomic_ptr_cmpxchg(&u->pc_pending, f, NULL)) {
+
+        if (u->pc_filter) {
+            u->pc_old_filter = u->pc_filter;
+            u->head.fading = true;
+            u->tail.fading = u->tail.n_parts > 0;
+        }
+
+        u->pc_filter = f;
+    }
+
+    f = u->pc_filter;
+    old = u->pc_old_filter;
+
+    u->head.fdl_pos = (u->head.fdl_pos + 1) % u->head.n_parts;
+    run_tail = u->tail.n_parts > 0 && u->tail.fill + u->head.block == u->tail.block;
+    if (run_tail)
+        u->tail.fdl_pos = (u->tail.fdl_pos + 1) % u->tail.n_parts;
+
+    for (size_t c = 0; c < u->channels; ++c) {
+        pconv_stage_run(u, &u->head, c,
+                        f ? f->head + c * head_size : NULL,
+                        u->head.fading ? old->head + c * head_size : NULL);
+
+        if (u->tail.n_parts == 0)
+            continue;
+
+        /* The tail output lines up with the head output, as the tail starts
+         * exactly one tail block into the impulse response */
+        for (size_t i = 0; i < u->head.block; ++i)
+            u->head.out[c][i] += u->tail.out[c][u->tail_pos + i];
+
+        memcpy(u->tail.input[c] + u->tail.block + u->tail.fill, u->head.input[c], u->head.block * sizeof(float));
+
+        if (run_tail)
+            pconv_stage_run(u, &u->tail, c,
+                            f ? f->tail + c * tail_size : NULL,
+                            u->tail.fading ? old->tail + c * tail_size : NULL);
+    }
+
+    u->head.fading = false;
+    if (run_tail) {
+        u->tail.fading = false;
+        u->tail.fill = 0;
+        u->tail_pos = 0;
+    } else if (u->tail.n_parts > 0) {
+        u->tail.fill += u->head.block;
+        u->tail_pos += u->head.block;
+    }
+
+    /* Hand the old filter back to the main thread for freeing */
+    if (old && !u->head.fading && !u->tail.fading) {
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->msg), EQ_MESSAGE_FREE_FILTER, old, 0, NULL, NULL);
+        u->pc_old_filter = NULL;
+    }
+}
+
+/* Called from I/O thread context. The low latency mode filters with a
+ * minimum phase version of the equalizer curve, using a non-uniformly
+ * partitioned convolution: small head partitions keep the latency at one
+ * head block, large tail partitions keep the cost of the long impulse
+ * response down. */
+static void pconv_process(struct userdata *u, const float *src, float *dst, size_t n) {
+    const size_t block = u->head.block;
+
+    while (n > 0) {
+        size_t k = PA_MIN(n, block - u->head.fill);
+
+        for (size_t c = 0; c < u->channels; ++c) {
+            float *in = u->head.input[c] + block + u->head.fill;
+            const float *out = u->head.out[c] + u->head.fill;
+
+            for (size_t i = 0; i < k; ++i) {
+                in[i] = src[i * u->channels + c];
+                dst[i * u->channels + c] = PA_CLAMP_UNLIKELY(out[i], -1.0f, 1.0f);
+            }
+        }
+
+        src += k * u->channels;
+        dst += k * u->channels;
+        n -= k;
+
+        u->head.fill += k;
+        if (u->head.fill == block) {
+            pconv_block(u);
+            u->head.fill = 0;
+        }
+    }
+}
+
+static void pconv_stage_clear(struct pconv_stage *s, size_t channels) {
+    for (size_t c = 0; c < channels; ++c) {
+        pa_memzero(s->input[c], 2 * s->block * sizeof(float));
+        pa_memzero(s->fdl[c], s->n_parts * PCONV_STRIDE(s) * sizeof(fftwf_complex));
+        pa_memzero(s->out[c], s->block * sizeof(float));
+    }
+
+    s->fill = 0;
+    s->fdl_pos = 0;
+}
+
+/* Every output sample depends on at most this many frames of input */
+static size_t pconv_history(struct userdata *u) {
+    return u->ir_length + u->head.block + u->tail.block;
+}
+
+/* Called from I/O thread context. The convolution has already seen the input
+ * that was just rewound, and would run it twice. So its state is cleared and
+ * rebuilt from the input before the new read position, which input_q keeps
+ * around for this, see sink_input_update_max_rewind_cb(). */
+static void pconv_rewind(struct userdata *u) {
+    size_t fs = pa_frame_size(&u->sink->sample_spec);
+    size_t n = pconv_history(u);
+
+    pconv_stage_clear(&u->head, u->channels);
+    if (u->tail.n_parts > 0)
+        pconv_stage_clear(&u->tail, u->channels);
+    u->tail_pos = 0;
+
+    pa_memblockq_rewind(u->input_q, n * fs);
+
+    while (n > 0) {
+        pa_memchunk tchunk;
+        size_t k;
+        float *src;
+
+        pa_assert_se(pa_memblockq_peek(u->input_q, &tchunk) >= 0);
+        pa_assert(tchunk.memblock);
+
+        k = PA_MIN(PA_MIN(tchunk.length / fs, n), u->head.block);
+
+        src = pa_memblock_acquire_chunk(&tchunk);
+        pconv_process(u, src, u->pc_discard, k);
+        pa_memblock_release(tchunk.memblock);
+        pa_memblock_unref(tchunk.memblock);
+
+        pa_memblockq_drop(u->input_q, k * fs);
+        n -= k;
+    }
+}
+
+/* Called from I/O thread context */
+static void pconv_pop(struct userdata *u, size_t nbytes, pa_memchunk *chunk) {
+    size_t fs = pa_frame_size(&u->sink->sample_spec);
+    pa_memchunk tchunk;
+    pa_usec_t start;
+    float *src, *dst;
+
+    /* Hmm, process any rewind request that might be queued up */
+    pa_sink_process_rewind(u->sink, 0);
+
+    while (pa_memblockq_peek(u->input_q, &tchunk) < 0) {
+        pa_sink_render(u->sink, nbytes, &tchunk);
+        pa_memblockq_push(u->input_q, &tchunk);
+        pa_memblock_unref(tchunk.memblock);
+    }
+    pa_assert(tchunk.memblock);
+
+    tchunk.length = PA_MIN(nbytes, tchunk.length);
+    pa_memblockq_drop(u->input_q, tchunk.length);
+
+    chunk->index = 0;
+    chunk->length = tchunk.length;
+    chunk->memblock = pa_memblock_new(u->sink->core->mempool, chunk->length);
+
+    src = pa_memblock_acquire_chunk(&tchunk);
+    dst = pa_memblock_acquire(chunk->memblock);
+
+    start = pa_rtclock_now();
+    pconv_process(u, src, dst, chunk->length / fs);
+    account_cpu(u, pa_rtclock_now() - start, chunk->length / fs);
+
+    pa_memblock_release(chunk->memblock);
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_unref(tchunk.memblock);
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
@@ -610,6 +1131,7 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     size_t mbs;
     //struct timeval start, end;
     pa_memchunk tchunk;
+    pa_usec_t start;
 
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
@@ -619,6 +1141,11 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     if (!PA_SINK_IS_LINKED(u->sink->thread_info.state))
         return -1;
 
+    if (u->low_latency) {
+        pconv_pop(u, nbytes, chunk);
+        return 0;
+    }
+
     /* FIXME: Please clean this up. I see more commented code lines
      * than uncommented code lines. I am sorry, but I am too dumb to
      * understand this. */
@@ -684,7 +1211,9 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     pa_assert(u->R < u->window_size);
     //pa_rtclock_get(&start);
     /* process a block */
+    start = pa_rtclock_now();
     process_samples(u);
+    account_cpu(u, pa_rtclock_now() - start, u->output_buffer_length / fs);
     //pa_rtclock_get(&end);
     //pa_log_debug("Took %0.6f seconds to process", (double) pa_timeval_diff(&end, &start) / PA_USEC_PER_SEC);
 END:
@@ -767,6 +1296,9 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
 
     pa_sink_process_rewind(u->sink, amount);
     pa_memblockq_rewind(u->input_q, nbytes);
+
+    if (u->low_latency && nbytes > 0)
+        pconv_rewind(u);
 }
 
 /* Called from I/O thread context */
@@ -778,8 +1310,13 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
 
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
-    pa_memblockq_set_maxrewind(u->input_q, nbytes);
     pa_sink_set_max_rewind_within_thread(u->sink, nbytes);
+
+    /* pconv_rewind() needs the input before the rewound part, too */
+    if (u->low_latency)
+        nbytes += pconv_history(u) * pa_frame_size(&u->sink->sample_spec);
+
+    pa_memblockq_set_maxrewind(u->input_q, nbytes);
 }
 
 /* Called from I/O thread context */
@@ -791,7 +1328,9 @@ static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
     pa_assert_se(u = i->userdata);
 
     fs = pa_frame_size(&u->sink_input->sample_spec);
-    pa_sink_set_max_request_within_thread(u->sink, PA_ROUND_UP(nbytes / fs, u->R) * fs);
+    if (!u->low_latency)
+        nbytes = PA_ROUND_UP(nbytes / fs, u->R) * fs;
+    pa_sink_set_max_request_within_thread(u->sink, nbytes);
 }
 
 /* Called from I/O thread context */
@@ -840,9 +1379,13 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
 
     fs = pa_frame_size(&u->sink_input->sample_spec);
-    /* set buffer size to max request, no overlap copy */
-    max_request = PA_ROUND_UP(pa_sink_input_get_max_request(u->sink_input) / fs, u->R);
-    max_request = PA_MAX(max_request, u->window_size);
+    if (u->low_latency)
+        max_request = pa_sink_input_get_max_request(u->sink_input) / fs;
+    else {
+        /* set buffer size to max request, no overlap copy */
+        max_request = PA_ROUND_UP(pa_sink_input_get_max_request(u->sink_input) / fs, u->R);
+        max_request = PA_MAX(max_request, u->window_size);
+    }
 
     pa_sink_set_max_request_within_thread(u->sink, max_request * fs);
 
@@ -1113,6 +1656,8 @@ int pa__init(pa_module*m) {
     float *H;
     unsigned a_i;
     bool use_volume_sharing = true;
+    bool low_latency = false;
+    uint32_t partition_size = DEFAULT_PARTITION_SIZE;
 
     pa_assert(m);
 
@@ -1145,9 +1690,21 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "low_latency", &low_latency) < 0) {
+        pa_log("low_latency= expects a boolean argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "partition_size", &partition_size) < 0 ||
+        !pa_is_power_of_two(partition_size) || partition_size < 16 || partition_size > 1024) {
+        pa_log("partition_size= expects a power of two between 16 and 1024");
+        goto fail;
+    }
+
     u = pa_xnew0(struct userdata, 1);
     u->module = m;
     m->userdata = u;
+    u->low_latency = low_latency;
 
     u->channels = ss.channels;
     u->fft_size = pow(2, ceil(log(ss.rate) / log(2)));//probably unstable near corner cases of powers of 2
@@ -1187,6 +1744,40 @@ int pa__init(pa_module*m) {
     hanning_window(u->W, u->window_size);
     u->first_iteration = true;
 
+    if (u->low_latency) {
+        /* A quarter of the fft size still resolves the curve to a few Hz */
+        u->ir_length = u->fft_size / 4;
+        partition_size = PA_MIN(partition_size, u->ir_length / 2);
+
+        if (partition_size * PCONV_TAIL_RATIO * 2 <= u->ir_length) {
+            pconv_stage_init(&u->head, u->channels, partition_size, PCONV_TAIL_RATIO, 0);
+            pconv_stage_init(&u->tail, u->channels, partition_size * PCONV_TAIL_RATIO,
+                             u->ir_length / (partition_size * PCONV_TAIL_RATIO) - 1, partition_size * PCONV_TAIL_RATIO);
+        } else
+            pconv_stage_init(&u->head, u->channels, partition_size, u->ir_length / partition_size, 0);
+
+        pa_log_debug("Partitioned convolution: %zu head partitions of %zu, %zu tail partitions of %zu samples",
+                     u->head.n_parts, u->head.block, u->tail.n_parts, u->tail.block);
+
+        u->pc_time = alloc(2 * PA_MAX(u->head.block, u->tail.block), sizeof(float));
+        u->pc_time_old = alloc(2 * PA_MAX(u->head.block, u->tail.block), sizeof(float));
+        u->pc_discard = alloc(u->channels * u->head.block, sizeof(float));
+        u->pc_accum = alloc(PA_MAX(u->head.block, u->tail.block) + 1, sizeof(fftwf_complex));
+        pa_atomic_ptr_store(&u->pc_pending, NULL);
+
+        u->design_ir = alloc(u->ir_length, sizeof(float));
+        u->design_time = alloc(u->fft_size, sizeof(float));
+        u->design_spec = alloc(FILTER_SIZE(u), sizeof(fftwf_complex));
+
+        u->pc_design = pa_xnew0(struct pconv_filter, 1);
+        u->pc_design->head = alloc(u->channels * u->head.n_parts * PCONV_STRIDE(&u->head), sizeof(fftwf_complex));
+        if (u->tail.n_parts > 0)
+            u->pc_design->tail = alloc(u->channels * u->tail.n_parts * PCONV_STRIDE(&u->tail), sizeof(fftwf_complex));
+
+        u->msg = pa_msgobject_new(eq_msg);
+        u->msg->parent.process_msg = eq_process_msg_cb;
+    }
+
     u->base_profiles = pa_xnew0(char *, u->channels);
     for (c = 0; c < u->channels; ++c)
         u->base_profiles[c] = pa_xstrdup("default");
@@ -1307,6 +1898,11 @@ int pa__init(pa_module*m) {
 
     /* load old parameters */
     load_state(u);
+    if (u->low_latency) {
+        for (c = 0; c < u->channels; ++c)
+            pconv_design_channel(u, c);
+        pconv_publish_filter(u);
+    }
 
     /* The order here is important. The input must be put first,
      * otherwise streams might attach to the sink before the sink
@@ -1375,6 +1971,24 @@ void pa__done(pa_module*m) {
     pa_memblockq_free(u->output_q);
     pa_memblockq_free(u->input_q);
 
+    pconv_stage_done(&u->head, u->channels);
+    pconv_stage_done(&u->tail, u->channels);
+    if (u->low_latency) {
+        fftwf_free(u->pc_time);
+        fftwf_free(u->pc_time_old);
+        fftwf_free(u->pc_discard);
+        fftwf_free(u->pc_accum);
+        pconv_filter_free(u->pc_filter);
+        pconv_filter_free(u->pc_old_filter);
+        pconv_filter_free(pa_atomic_ptr_load(&u->pc_pending));
+        pconv_filter_free(u->pc_design);
+        fftwf_free(u->design_ir);
+        fftwf_free(u->design_time);
+        fftwf_free(u->design_spec);
+    }
+    if (u->msg)
+        eq_msg_unref(u->msg);
+
     fftwf_destroy_plan(u->inverse_plan);
     fftwf_destroy_plan(u->forward_plan);
     fftwf_free(u->output_window);
@@ -1891,6 +2505,7 @@ void equalizer_handle_seed_filter(DBusConnection *conn, DBusMessage *msg, void *
     }
     pa_aupdate_write_end(u->a_H[r_channel]);
     pa_xfree(ys);
+    pconv_update_filter(u, channel);
 
     pa_dbus_send_empty_reply(conn, msg);
 
@@ -2040,6 +2655,7 @@ static void set_filter(struct userdata *u, size_t channel, double *H_, double pr
         }
     }
     pa_aupdate_write_end(u->a_H[r_channel]);
+    pconv_update_filter(u, channel);
 }
 
 void equalizer_handle_set_filter(DBusConnection *conn, DBusMessage *msg, void *_u) {
@@ -2153,6 +2769,7 @@ void equalizer_handle_load_profile(DBusConnection *conn, DBusMessage *msg, void
             load_profile(u, c, name);
         }
     }
+    pconv_update_filter(u, channel);
     pa_dbus_send_empty_reply(conn, msg);
 
     pa_assert_se((message = dbus_message_new_signal(u->dbus_path, EQUALIZER_IFACE, equalizer_signals[EQUALIZER_SIGNAL_FILTER_CHANGED].name)));
@@ -26,6 +26,7 @@
 
 #include <math.h>
 
+#include <pulse/util.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/i18n.h>
@@ -38,6 +39,8 @@
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/ltdl-helper.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/semaphore.h>
 
 #ifdef HAVE_DBUS
 #include <pulsecore/protocol-dbus.h>
@@ -65,6 +68,7 @@ PA_MODULE_USAGE(
       "control=<comma separated list of input control values> "
       "input_ladspaport_map=<comma separated list of input LADSPA port names> "
       "output_ladspaport_map=<comma separated list of output LADSPA port names> "
+      "threads=<number of worker threads running plugin instances> "
       "autoloaded=<set if this module is being loaded automatically> "));
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
@@ -73,6 +77,19 @@ PA_MODULE_USAGE(
 /* PLEASE NOTICE: The PortAudio ports and the LADSPA ports are two different concepts.
 They are not related and where possible the names of the LADSPA port variables contains "ladspa" to avoid confusion */
 
+struct userdata;
+
+/* When more than one plugin instance is needed to cover all channels, the
+ * instances can be run in parallel by a small pool of worker threads. The IO
+ * thread hands out one block at a time, runs its own share of the instances
+ * and then waits until all workers have finished theirs. */
+struct worker {
+    struct userdata *u;
+    pa_thread *thread;
+    pa_semaphore *start;
+    unsigned index;
+};
+
 struct userdata {
     pa_module *module;
 
@@ -82,14 +99,26 @@ struct userdata {
     const LADSPA_Descriptor *descriptor;
     LADSPA_Handle handle[PA_CHANNELS_MAX];
     unsigned long max_ladspaport_count, input_count, output_count, channels;
-    LADSPA_Data **input, **output;
+    /* Every plugin instance has its own set of buffers, so that the instances
+     * can be run concurrently. */
+    LADSPA_Data **input[PA_CHANNELS_MAX], **output[PA_CHANNELS_MAX];
     size_t block_size;
     LADSPA_Data *control;
     long unsigned n_control;
 
-    /* This is a dummy buffer. Every port must be connected, but we don't care
-    about control out ports. We connect them all to this single buffer. */
-    LADSPA_Data control_out;
+    /* These are dummy buffers. Every port must be connected, but we don't care
+    about control out ports. We connect them all to a single buffer per
+    plugin instance. */
+    LADSPA_Data control_out[PA_CHANNELS_MAX];
+
+    struct worker *workers;
+    unsigned n_workers;
+    pa_semaphore *workers_done;
+    bool workers_quit;
+
+    /* The block currently being processed, handed over to the workers */
+    float *block_src, *block_dst;
+    unsigned block_n;
 
     pa_memblockq *memblockq;
 
@@ -120,6 +149,7 @@ static const char* const valid_modargs[] = {
     "control",
     "input_ladspaport_map",
     "output_ladspaport_map",
+    "threads",
     "autoloaded",
     NULL
 };
@@ -459,12 +489,96 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
+/* Called from I/O thread context or from a worker thread */
+static void run_instance(struct userdata *u, unsigned h, float *src, float *dst, unsigned n) {
+    unsigned c;
+
+    for (c = 0; c < u->input_count; c++)
+        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[h][c], sizeof(float), src + h*u->max_ladspaport_count + c, u->channels*sizeof(float), n);
+    u->descriptor->run(u->handle[h], n);
+    for (c = 0; c < u->output_count; c++)
+        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[h][c], sizeof(float), n);
+}
+
+/* Called from worker thread context */
+static void worker_thread_func(void *userdata) {
+    struct worker *w = userdata;
+    struct userdata *u = w->u;
+
+    if (u->module->core->realtime_scheduling)
+        pa_thread_make_realtime(u->module->core->realtime_priority);
+
+    for (;;) {
+        unsigned h;
+
+        pa_semaphore_wait(w->start);
+
+        if (u->workers_quit)
+            break;
+
+        for (h = w->index + 1; h < (u->channels / u->max_ladspaport_count); h += u->n_workers + 1)
+            run_instance(u, h, u->block_src, u->block_dst, u->block_n);
+
+        pa_semaphore_post(u->workers_done);
+    }
+}
+
+static int start_workers(struct userdata *u, unsigned n_workers) {
+    unsigned w;
+
+    u->workers_done = pa_semaphore_new(0);
+    u->workers = pa_xnew0(struct worker, n_workers);
+
+    for (w = 0; w < n_workers; w++) {
+        char *name;
+
+        u->workers[w].u = u;
+        u->workers[w].index = w;
+        u->workers[w].start = pa_semaphore_new(0);
+
+        name = pa_sprintf_malloc("ladspa-worker%u", w);
+        u->workers[w].thread = pa_thread_new(name, worker_thread_func, &u->workers[w]);
+        pa_xfree(name);
+
+        if (!u->workers[w].thread) {
+            pa_log("Failed to create worker thread.");
+            pa_semaphore_free(u->workers[w].start);
+            return -1;
+        }
+
+        u->n_workers++;
+    }
+
+    return 0;
+}
+
+static void stop_workers(struct userdata *u) {
+    unsigned w;
+
+    u->workers_quit = true;
+
+    for (w = 0; w < u->n_workers; w++) {
+        pa_semaphore_post(u->workers[w].start);
+        pa_thread_free(u->workers[w].thread);
+        pa_semaphore_free(u->workers[w].start);
+    }
+
+    pa_xfree(u->workers);
+    u->workers = NULL;
+    u->n_workers = 0;
+
+    if (u->workers_done) {
+        pa_semaphore_free(u->workers_done);
+        u->workers_done = NULL;
+    }
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
     float *src, *dst;
     size_t fs;
-    unsigned n, h, c;
+    unsigned n, h, w;
     pa_memchunk tchunk;
 
     pa_sink_input_assert_ref(i);
@@ -502,12 +616,23 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     src = pa_memblock_acquire_chunk(&tchunk);
     dst = pa_memblock_acquire(chunk->memblock);
 
-    for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
-        for (c = 0; c < u->input_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c], sizeof(float), src+ h*u->max_ladspaport_count + c, u->channels*sizeof(float), n);
-        u->descriptor->run(u->handle[h], n);
-        for (c = 0; c < u->output_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[c], sizeof(float), n);
+    if (u->n_workers > 0) {
+        u->block_src = src;
+        u->block_dst = dst;
+        u->block_n = n;
+
+        for (w = 0; w < u->n_workers; w++)
+            pa_semaphore_post(u->workers[w].start);
+
+        /* The IO thread takes the first share of the instances itself */
+        for (h = 0; h < (u->channels / u->max_ladspaport_count); h += u->n_workers + 1)
+            run_instance(u, h, src, dst, n);
+
+        for (w = 0; w < u->n_workers; w++)
+            pa_semaphore_wait(u->workers_done);
+    } else {
+        for (h = 0; h < (u->channels / u->max_ladspaport_count); h++)
+            run_instance(u, h, src, dst, n);
     }
 
     pa_memblock_release(tchunk.memblock);
@@ -798,7 +923,7 @@ static void connect_control_ports(struct userdata *u) {
 
         if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
             for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                d->connect_port(u->handle[c], p, &u->control_out);
+                d->connect_port(u->handle[c], p, &u->control_out[c]);
             continue;
         }
 
@@ -901,7 +1026,7 @@ static int write_control_parameters(struct userdata *u, double *control_values,
 
         if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
             for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                d->connect_port(u->handle[c], p, &u->control_out);
+                d->connect_port(u->handle[c], p, &u->control_out[c]);
             continue;
         }
 
@@ -1002,6 +1127,7 @@ int pa__init(pa_module*m) {
     const char *e, *cdata;
     const LADSPA_Descriptor *d;
     unsigned long p, h, j, n_control, c;
+    uint32_t n_threads = 0;
     pa_memchunk silence;
 
     pa_assert(m);
@@ -1058,13 +1184,16 @@ int pa__init(pa_module*m) {
 
     cdata = pa_modargs_get_value(ma, "control", NULL);
 
+    if (pa_modargs_get_value_u32(ma, "threads", &n_threads) < 0) {
+        pa_log("Invalid number of threads");
+        goto fail;
+    }
+
     u = pa_xnew0(struct userdata, 1);
     u->module = m;
     m->userdata = u;
     u->max_ladspaport_count = 1; /*to avoid division by zero etc. in pa__done when failing before this value has been set*/
     u->channels = 0;
-    u->input = NULL;
-    u->output = NULL;
     u->ss = ss;
 
     if (!(e = getenv("LADSPA_PATH")))
@@ -1208,31 +1337,45 @@ int pa__init(pa_module*m) {
 
     u->block_size = pa_frame_align(pa_mempool_block_size_max(m->core->mempool), &ss);
 
-    /* Create buffers */
-    if (LADSPA_IS_INPLACE_BROKEN(d->Properties)) {
-        u->input = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->input_count);
-        for (c = 0; c < u->input_count; c++)
-            u->input[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-        u->output = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->output_count);
-        for (c = 0; c < u->output_count; c++)
-            u->output[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-    } else {
-        u->input = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->max_ladspaport_count);
-        for (c = 0; c < u->max_ladspaport_count; c++)
-            u->input[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-        u->output = u->input;
-    }
-    /* Initialize plugin instances */
+    /* Create buffers and initialize plugin instances */
     for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
+        if (LADSPA_IS_INPLACE_BROKEN(d->Properties)) {
+            u->input[h] = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->input_count);
+            for (c = 0; c < u->input_count; c++)
+                u->input[h][c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
+            u->output[h] = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->output_count);
+            for (c = 0; c < u->output_count; c++)
+                u->output[h][c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
+        } else {
+            u->input[h] = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->max_ladspaport_count);
+            for (c = 0; c < u->max_ladspaport_count; c++)
+                u->input[h][c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
+            u->output[h] = u->input[h];
+        }
+
         if (!(u->handle[h] = d->instantiate(d, ss.rate))) {
             pa_log("Failed to instantiate plugin %s with label %s", plugin, d->Label);
             goto fail;
         }
 
         for (c = 0; c < u->input_count; c++)
-            d->connect_port(u->handle[h], input_ladspaport[c], u->input[c]);
+            d->connect_port(u->handle[h], input_ladspaport[c], u->input[h][c]);
         for (c = 0; c < u->output_count; c++)
-            d->connect_port(u->handle[h], output_ladspaport[c], u->output[c]);
+            d->connect_port(u->handle[h], output_ladspaport[c], u->output[h][c]);
+    }
+
+    /* There is no point in having more workers than instances besides the
+     * one run by the IO thread itself. */
+    if (n_threads > (u->channels / u->max_ladspaport_count) - 1) {
+        n_threads = (uint32_t) (u->channels / u->max_ladspaport_count) - 1;
+        pa_log_info("Limiting number of worker threads to %u", n_threads);
+    }
+
+    if (n_threads > 0) {
+        if (start_workers(u, n_threads) < 0)
+            goto fail;
+
+        pa_log_debug("Running plugin instances on %u worker threads", n_threads);
     }
 
     u->n_control = n_control;
@@ -1403,7 +1546,7 @@ int pa__get_n_used(pa_module *m) {
 
 void pa__done(pa_module*m) {
     struct userdata *u;
-    unsigned c;
+    unsigned h, c;
 
     pa_assert(m);
 
@@ -1431,30 +1574,33 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
-    for (c = 0; c < (u->channels / u->max_ladspaport_count); c++) {
-        if (u->handle[c]) {
+    if (u->workers)
+        stop_workers(u);
+
+    for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
+        if (u->handle[h]) {
             if (u->descriptor->deactivate)
-                u->descriptor->deactivate(u->handle[c]);
-            u->descriptor->cleanup(u->handle[c]);
+                u->descriptor->deactivate(u->handle[h]);
+            u->descriptor->cleanup(u->handle[h]);
         }
-    }
 
-    if (u->output == u->input) {
-        if (u->input != NULL) {
-            for (c = 0; c < u->max_ladspaport_count; c++)
-                pa_xfree(u->input[c]);
-            pa_xfree(u->input);
-        }
-    } else {
-        if (u->input != NULL) {
-            for (c = 0; c < u->input_count; c++)
-                pa_xfree(u->input[c]);
-            pa_xfree(u->input);
-        }
-        if (u->output != NULL) {
-            for (c = 0; c < u->output_count; c++)
-                pa_xfree(u->output[c]);
-            pa_xfree(u->output);
+        if (u->output[h] == u->input[h]) {
+            if (u->input[h] != NULL) {
+                for (c = 0; c < u->max_ladspaport_count; c++)
+                    pa_xfree(u->input[h][c]);
+                pa_xfree(u->input[h]);
+            }
+        } else {
+            if (u->input[h] != NULL) {
+                for (c = 0; c < u->input_count; c++)
+                    pa_xfree(u->input[h][c]);
+                pa_xfree(u->input[h]);
+            }
+            if (u->output[h] != NULL) {
+                for (c = 0; c < u->output_count; c++)
+                    pa_xfree(u->output[h][c]);
+                pa_xfree(u->output[h]);
+            }
         }
     }
 
@@ -47,6 +47,7 @@ PA_MODULE_USAGE(
         "latency_msec=<latency in ms> "
         "max_latency_msec=<maximum latency in ms> "
         "fast_adjust_threshold_msec=<threshold for fast adjust in ms> "
+        "io_adjust=<adjust the rate continuously from the sink's IO thread?> "
         "format=<sample format> "
         "rate=<sample rate> "
         "channels=<number of channels> "
@@ -65,6 +66,12 @@ PA_MODULE_USAGE(
 
 #define DEFAULT_ADJUST_TIME_USEC (10*PA_USEC_PER_SEC)
 
+/* With io_adjust, the rate is recalculated at most this often */
+#define IO_ADJUST_INTERVAL_USEC (20*PA_USEC_PER_MSEC)
+
+/* Maximum deviation from the base rate */
+#define MAX_RATE_DEVIATION 0.01
+
 typedef struct loopback_msg loopback_msg;
 
 struct userdata {
@@ -94,6 +101,7 @@ struct userdata {
     pa_usec_t max_latency;
     pa_usec_t adjust_time;
     pa_usec_t fast_adjust_threshold;
+    bool io_adjust;
 
     /* Latency boundaries and current values */
     pa_usec_t min_source_latency;
@@ -140,6 +148,13 @@ struct userdata {
         /* Copied from main thread */
         pa_usec_t minimum_latency;
 
+        /* Rate controller for io_adjust. The source latency is the one
+         * reported with the last push, without the pushed chunk. */
+        int64_t source_latency;
+        pa_usec_t source_timestamp;
+        pa_usec_t last_adjust;
+        double latency_integral;
+
         /* Various booleans */
         bool in_pop;
         bool pop_called;
@@ -164,6 +179,7 @@ static const char* const valid_modargs[] = {
     "latency_msec",
     "max_latency_msec",
     "fast_adjust_threshold_msec",
+    "io_adjust",
     "format",
     "rate",
     "channels",
@@ -355,6 +371,10 @@ static void adjust_rates(struct userdata *u) {
         pa_log_info("Underrun counter: %u", u->underrun_counter);
     }
 
+    /* The output thread takes care of the rate itself */
+    if (u->io_adjust)
+        return;
+
     /* Calculate real adjust time if source or sink did not change and if the system has
      * not been suspended. If the time between two calls is more than 5% longer than the
      * configured adjust time, we assume that the system has been sleeping and skip the
@@ -432,8 +452,10 @@ static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct tim
     pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
 
     /* Get sink and source latency snapshot */
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL);
-    pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL);
+    if (!u->io_adjust) {
+        pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL);
+        pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL);
+    }
 
     adjust_rates(u);
 }
@@ -550,6 +572,77 @@ static void memblockq_adjust(struct userdata *u, int64_t latency_offset_usec, bo
     }
 }
 
+/* Called from output thread context */
+static void reset_rate_within_thread(struct userdata *u) {
+    u->output_thread_info.last_adjust = 0;
+    u->output_thread_info.latency_integral = 0;
+
+    pa_sink_input_set_rate_within_thread(u->sink_input, u->sink_input->sample_spec.rate);
+}
+
+/* Called from output thread context
+ * Rate controller for io_adjust. Source and sink latencies are known here
+ * whenever the sink renders, so the rate can be corrected in small steps
+ * instead of once per adjust_time. This is a PI controller with critical
+ * damping and a time constant of adjust_time; the integral part removes the
+ * latency offset that the clock drift would otherwise leave. The sink is
+ * rendering when this is called, so popped_length bytes have already left
+ * the queue, but are not yet part of the sink latency. */
+static void adjust_rate_within_thread(struct userdata *u, size_t popped_length) {
+    pa_sink_input *i = u->sink_input;
+    pa_usec_t now, time_passed, final_latency;
+    int64_t source_latency, sink_latency, latency_difference;
+    double time_constant, correction, max_integral;
+    uint32_t base_rate;
+
+    if (!u->adjust_time)
+        return;
+
+    /* Wait until the initial latency adjustment is done */
+    if (!u->output_thread_info.pop_called || !u->output_thread_info.push_called || u->output_thread_info.pop_adjust)
+        return;
+
+    now = pa_rtclock_now();
+    if (u->output_thread_info.last_adjust > 0 && now < u->output_thread_info.last_adjust + IO_ADJUST_INTERVAL_USEC)
+        return;
+
+    time_passed = u->output_thread_info.last_adjust > 0 ? now - u->output_thread_info.last_adjust : IO_ADJUST_INTERVAL_USEC;
+    u->output_thread_info.last_adjust = now;
+
+    /* The source has been recording since the last push */
+    source_latency = u->output_thread_info.source_latency + (int64_t) (now - u->output_thread_info.source_timestamp);
+    sink_latency = pa_sink_get_latency_within_thread(i->sink, true) +
+                   pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec) +
+                   pa_bytes_to_usec(popped_length, &i->sample_spec);
+
+    /* The queue is in the source's time domain, so this is the latency at base rate */
+    final_latency = PA_MAX(u->latency, u->output_thread_info.minimum_latency);
+    latency_difference = source_latency + sink_latency +
+                         (int64_t) pa_bytes_to_usec(pa_memblockq_get_length(u->memblockq), &i->sample_spec) -
+                         (int64_t) final_latency;
+
+    if (u->fast_adjust_threshold > 0 && (pa_usec_t) llabs(latency_difference) > u->fast_adjust_threshold) {
+        pa_log_debug("Latency difference larger than %" PRIu64 " msec, skipping or inserting samples.", u->fast_adjust_threshold / PA_USEC_PER_MSEC);
+
+        memblockq_adjust(u, source_latency + sink_latency, true);
+        reset_rate_within_thread(u);
+        return;
+    }
+
+    time_constant = (double) u->adjust_time;
+    max_integral = MAX_RATE_DEVIATION * 4 * time_constant * time_constant;
+
+    u->output_thread_info.latency_integral += (double) latency_difference * time_passed;
+    u->output_thread_info.latency_integral = PA_CLAMP(u->output_thread_info.latency_integral, -max_integral, max_integral);
+
+    correction = (double) latency_difference / time_constant +
+                 u->output_thread_info.latency_integral / (4 * time_constant * time_constant);
+    correction = PA_CLAMP(correction, -MAX_RATE_DEVIATION, MAX_RATE_DEVIATION);
+
+    base_rate = i->sample_spec.rate;
+    pa_sink_input_set_rate_within_thread(i, (uint32_t) (base_rate * (1.0 + correction) + 0.5));
+}
+
 /* Called from input thread context */
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
     struct userdata *u;
@@ -844,6 +937,9 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     if (!u->output_thread_info.push_called)
         memblockq_adjust(u, 0, true);
 
+    if (u->io_adjust)
+        adjust_rate_within_thread(u, chunk->length);
+
     return 0;
 }
 
@@ -880,6 +976,11 @@ static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, in
 
             pa_memblockq_push_align(u->memblockq, chunk);
 
+            if (u->io_adjust) {
+                u->output_thread_info.source_latency = PA_PTR_TO_INT(data) - (int64_t) pa_bytes_to_usec(chunk->length, &u->sink_input->sample_spec);
+                u->output_thread_info.source_timestamp = (pa_usec_t) offset;
+            }
+
             /* If push has not been called yet, latency adjustments in sink_input_pop_cb()
              * are enabled. Disable them on first push and correct the memblockq. If pop
              * has not been called yet, wait until the pop_cb() requests the adjustment */
@@ -919,6 +1020,9 @@ static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, in
                  * might lead to a gap in the stream */
                 memblockq_adjust(u, time_delta, true);
 
+                if (u->io_adjust)
+                    reset_rate_within_thread(u);
+
                 u->output_thread_info.pop_adjust = false;
                 u->output_thread_info.push_called = true;
             }
@@ -1423,6 +1527,12 @@ int pa__init(pa_module *m) {
     u->adjust_counter = 0;
     u->fast_adjust_threshold = fast_adjust_threshold * PA_USEC_PER_MSEC;
 
+    u->io_adjust = false;
+    if (pa_modargs_get_value_boolean(ma, "io_adjust", &u->io_adjust) < 0) {
+        pa_log("Invalid boolean io_adjust parameter");
+        goto fail;
+    }
+
     adjust_time_sec = DEFAULT_ADJUST_TIME_USEC / PA_USEC_PER_SEC;
     if (pa_modargs_get_value_u32(ma, "adjust_time", &adjust_time_sec) < 0) {
         pa_log("Failed to parse adjust_time value");
@@ -1550,6 +1550,16 @@ static void create_stream_callback(pa_pdispatch *pd, uint32_t command,  uint32_t
         pa_format_info_free(format);
     }
 
+#ifdef TUNNEL_SINK
+    if (u->version >= 35) {
+        uint32_t timing_index;
+
+        /* We don't use the srbchannel */
+        if (pa_tagstruct_getu32(t, &timing_index) < 0)
+            goto parse_error;
+    }
+#endif
+
     if (!pa_tagstruct_eof(t))
         goto parse_error;
 
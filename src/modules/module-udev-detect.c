@@ -36,6 +36,21 @@
 #include <pulsecore/ratelimit.h>
 #include <pulsecore/strbuf.h>
 
+#ifdef HAVE_ALSA
+#include <pulse/rtclock.h>
+
+#include <pulsecore/database.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/semaphore.h>
+#include <pulsecore/tagstruct.h>
+#include <pulsecore/thread.h>
+
+#include "alsa/alsa-mixer.h"
+#include "alsa/alsa-ucm.h"
+#include "alsa/alsa-util.h"
+#include "udev-util.h"
+#endif
+
 PA_MODULE_AUTHOR("Lennart Poettering");
 PA_MODULE_DESCRIPTION("Detect available audio hardware and load matching drivers");
 PA_MODULE_VERSION(PACKAGE_VERSION);
@@ -47,7 +62,8 @@ PA_MODULE_USAGE(
         "ignore_dB=<ignore dB information from the device?> "
         "deferred_volume=<syncronize sw and hw volume changes in IO-thread?> "
         "use_ucm=<use ALSA UCM for card configuration?> "
-        "avoid_resampling=<use stream original sample rate if possible?>");
+        "avoid_resampling=<use stream original sample rate if possible?> "
+        "parallel_probe=<probe the cards found at startup concurrently?>");
 
 struct device {
     char *path;
@@ -57,8 +73,27 @@ struct device {
     char *args;
     uint32_t module;
     pa_ratelimit ratelimit;
+    bool probed;
 };
 
+#ifdef HAVE_ALSA
+/* A card found at startup that is probed in a thread of its own. The results
+ * end up in the probe cache of module-alsa-card, which then only needs to
+ * verify them when it is loaded on the main thread. */
+struct probe {
+    struct userdata *userdata;
+    struct device *device;
+    int alsa_card_index;
+    char *key;
+    pa_alsa_profile_set *profile_set;
+    pa_tagstruct *result;
+    pa_usec_t time;
+    pa_thread *thread;
+
+    PA_LLIST_FIELDS(struct probe);
+};
+#endif
+
 struct userdata {
     pa_core *core;
     pa_hashmap *devices;
@@ -70,6 +105,7 @@ struct userdata {
     bool deferred_volume:1;
     bool use_ucm:1;
     bool avoid_resampling:1;
+    bool parallel_probe:1;
 
     uint32_t tsched_buffer_size;
 
@@ -79,6 +115,12 @@ struct userdata {
 
     int inotify_fd;
     pa_io_event *inotify_io;
+
+#ifdef HAVE_ALSA
+    /* Only set while the cards found at startup are being probed */
+    pa_semaphore *probe_semaphore;
+    PA_LLIST_HEAD(struct probe, probes);
+#endif
 };
 
 static const char* const valid_modargs[] = {
@@ -89,10 +131,14 @@ static const char* const valid_modargs[] = {
     "deferred_volume",
     "use_ucm",
     "avoid_resampling",
+    "parallel_probe",
     NULL
 };
 
+#define DEFAULT_PARALLEL_PROBE true
+
 static int setup_inotify(struct userdata *u);
+static bool probe_start(struct userdata *u, struct device *d);
 
 static void device_free(struct device *d) {
     pa_assert(d);
@@ -314,7 +360,9 @@ static void verify_access(struct userdata *u, struct device *d) {
             busy = is_card_busy(path_get_card_id(d->path));
             pa_log_debug("%s is busy: %s", d->path, pa_yes_no(busy));
 
-            if (!busy) {
+            if (!busy && probe_start(u, d))
+                pa_log_debug("Deferring loading of %s until probing has finished.", d->path);
+            else if (!busy) {
 
                 /* So, why do we rate limit here? It's certainly ugly,
                  * but there seems to be no other way. Problem is
@@ -689,6 +737,236 @@ static int setup_inotify(struct userdata *u) {
     return 0;
 }
 
+#ifdef HAVE_ALSA
+
+static pa_database *probe_cache_open(void) {
+    pa_database *database;
+    char *fname;
+
+    if (!(fname = pa_state_path(PA_ALSA_PROBE_CACHE_DATABASE, true)))
+        return NULL;
+
+    if (!(database = pa_database_open(fname, true)))
+        pa_log_debug("Failed to open probe cache '%s': %s", fname, pa_cstrerror(errno));
+
+    pa_xfree(fname);
+
+    return database;
+}
+
+static void probe_free(struct probe *p) {
+    pa_assert(p);
+    pa_assert(!p->thread);
+
+    if (p->profile_set)
+        pa_alsa_profile_set_free(p->profile_set);
+
+    if (p->result)
+        pa_tagstruct_free(p->result);
+
+    pa_xfree(p->key);
+    pa_xfree(p);
+}
+
+/* Called from probe thread context */
+static void probe_thread_func(void *userdata) {
+    struct probe *p = userdata;
+    struct userdata *u = p->userdata;
+    pa_hashmap *mixers;
+    char *dev_id;
+    pa_usec_t start;
+
+    pa_log_debug("Probe thread for card %i starting up.", p->alsa_card_index);
+
+    start = pa_rtclock_now();
+
+    /* module-alsa-card doesn't use the profile set for UCM cards, so
+     * there is nothing to probe in advance for them */
+    if (!u->use_ucm || !pa_alsa_ucm_available(p->alsa_card_index)) {
+        mixers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                     pa_xfree, (pa_free_cb_t) pa_alsa_mixer_free);
+        dev_id = pa_sprintf_malloc("%i", p->alsa_card_index);
+
+        pa_alsa_profile_set_probe(p->profile_set, mixers, dev_id, &u->core->default_sample_spec,
+                                  u->core->default_n_fragments, u->core->default_fragment_size_msec);
+        p->result = pa_alsa_profile_set_probe_save(p->profile_set);
+
+        pa_xfree(dev_id);
+        pa_hashmap_free(mixers);
+    }
+
+    p->time = pa_rtclock_now() - start;
+
+    pa_semaphore_post(u->probe_semaphore);
+}
+
+/* Returns true if loading the card module has been deferred until the cards
+ * found at startup have been probed. While the probe threads are running,
+ * this happens for every card: loading module-alsa-card makes ALSA reread its
+ * configuration, which would pull it away from under the probe threads. A
+ * thread is only started for the cards that module-alsa-card has no usable
+ * cached results for. */
+static bool probe_start(struct userdata *u, struct device *d) {
+    struct probe *p;
+    pa_database *database;
+    pa_datum key, data;
+    char *fn;
+    bool cached = false;
+
+    pa_assert(u);
+    pa_assert(d);
+
+    if (!u->probe_semaphore || d->probed)
+        return false;
+
+    d->probed = true;
+
+    p = pa_xnew0(struct probe, 1);
+    p->userdata = u;
+    p->device = d;
+
+    PA_LLIST_PREPEND(struct probe, u->probes, p);
+
+    if (pa_atoi(path_get_card_id(d->path), &p->alsa_card_index) < 0)
+        return true;
+
+    /* Set up the profile set just like module-alsa-card does, so that the
+     * cache key matches */
+    fn = pa_udev_get_property(p->alsa_card_index, "PULSE_PROFILE_SET");
+    p->profile_set = pa_alsa_profile_set_new(fn, &u->core->default_channel_map);
+    pa_xfree(fn);
+
+    if (!p->profile_set)
+        return true;
+
+    p->profile_set->ignore_dB = u->ignore_dB;
+
+    if (!(p->key = pa_alsa_profile_set_probe_key(p->profile_set, p->alsa_card_index, &u->core->default_sample_spec,
+                                                 u->core->default_n_fragments, u->core->default_fragment_size_msec)))
+        return true;
+
+    if (!(database = probe_cache_open()))
+        return true;
+
+    key.data = p->key;
+    key.size = strlen(p->key);
+
+    if (pa_database_get(database, &key, &data)) {
+        pa_datum_free(&data);
+        cached = true;
+    }
+
+    pa_database_close(database);
+
+    if (cached)
+        return true;
+
+    if (!(p->thread = pa_thread_new("udev-probe", probe_thread_func, p)))
+        pa_log_warn("Failed to create probe thread for %s.", d->path);
+
+    return true;
+}
+
+static void probe_commit(struct userdata *u, struct probe *p) {
+    pa_database *database;
+    pa_datum key, data;
+    size_t size;
+
+    pa_assert(u);
+    pa_assert(p);
+
+    PA_LLIST_REMOVE(struct probe, u->probes, p);
+
+    /* The database is not kept open, as module-alsa-card opens it for
+     * writing too */
+    if (p->result && (database = probe_cache_open())) {
+        key.data = p->key;
+        key.size = strlen(p->key);
+        data.data = (void *) pa_tagstruct_data(p->result, &size);
+        data.size = size;
+
+        pa_database_set(database, &key, &data, true);
+        pa_database_sync(database);
+        pa_database_close(database);
+    }
+
+    verify_access(u, p->device);
+
+    probe_free(p);
+}
+
+static void probe_begin(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(!u->probe_semaphore);
+
+    /* Keep the ALSA configuration around while the probe threads are
+     * running, even if a card module fails to load and drops its
+     * reference */
+    pa_alsa_refcnt_inc();
+
+    u->probe_semaphore = pa_semaphore_new(0);
+}
+
+/* Waits for all probe threads, then loads the card modules that have been
+ * deferred, in the order in which the cards were found. */
+static void probe_end(struct userdata *u) {
+    struct probe *p, *prev;
+    unsigned n_probed = 0, i;
+    pa_usec_t start;
+
+    pa_assert(u);
+
+    if (!u->probe_semaphore)
+        return;
+
+    start = pa_rtclock_now();
+
+    PA_LLIST_FOREACH(p, u->probes)
+        if (p->thread)
+            n_probed++;
+
+    /* Every probe thread posts the semaphore once */
+    for (i = 0; i < n_probed; i++)
+        pa_semaphore_wait(u->probe_semaphore);
+
+    PA_LLIST_FOREACH(p, u->probes) {
+        if (!p->thread)
+            continue;
+
+        pa_thread_free(p->thread);
+        p->thread = NULL;
+
+        pa_log_info("Probing card %s (%s) took %0.1f ms.", p->device->path, p->device->card_name,
+                    (double) p->time / PA_USEC_PER_MSEC);
+    }
+
+    /* The list is in reverse order */
+    for (p = u->probes; p && p->next; p = p->next)
+        ;
+
+    for (; p; p = prev) {
+        prev = p->prev;
+        probe_commit(u, p);
+    }
+
+    if (n_probed > 0)
+        pa_log_info("Probed %u cards concurrently, waited %0.1f ms.", n_probed,
+                    (double) (pa_rtclock_now() - start) / PA_USEC_PER_MSEC);
+
+    pa_semaphore_free(u->probe_semaphore);
+    u->probe_semaphore = NULL;
+
+    pa_alsa_refcnt_dec();
+}
+
+#else
+
+static bool probe_start(struct userdata *u, struct device *d) {
+    return false;
+}
+
+#endif /* HAVE_ALSA */
+
 int pa__init(pa_module *m) {
     struct userdata *u = NULL;
     pa_modargs *ma;
@@ -698,6 +976,7 @@ int pa__init(pa_module *m) {
     bool use_tsched = true, fixed_latency_range = false, ignore_dB = false, deferred_volume = m->core->deferred_volume;
     bool use_ucm = true;
     bool avoid_resampling;
+    bool parallel_probe = DEFAULT_PARALLEL_PROBE;
 
     pa_assert(m);
 
@@ -757,6 +1036,12 @@ int pa__init(pa_module *m) {
     }
     u->avoid_resampling = avoid_resampling;
 
+    if (pa_modargs_get_value_boolean(ma, "parallel_probe", &parallel_probe) < 0) {
+        pa_log("Failed to parse parallel_probe= argument.");
+        goto fail;
+    }
+    u->parallel_probe = parallel_probe;
+
     if (!(u->udev = udev_new())) {
         pa_log("Failed to initialize udev library.");
         goto fail;
@@ -807,10 +1092,19 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+#ifdef HAVE_ALSA
+    if (u->parallel_probe)
+        probe_begin(u);
+#endif
+
     first = udev_enumerate_get_list_entry(enumerate);
     udev_list_entry_foreach(item, first)
         process_path(u, udev_list_entry_get_name(item));
 
+#ifdef HAVE_ALSA
+    probe_end(u);
+#endif
+
     udev_enumerate_unref(enumerate);
 
     pa_log_info("Found %u cards.", pa_hashmap_size(u->devices));
@@ -309,11 +309,13 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
         for(ch=0;ch<o->sample_spec.channels;ch++)
             streams[0].volume.values[ch] = PA_VOLUME_NORM; /* FIXME */
         streams[0].volume.channels = o->sample_spec.channels;
+        streams[0].ramp_length = 0;
 
         streams[1].chunk = tchunk;
         for(ch=0;ch<o->sample_spec.channels;ch++)
             streams[1].volume.values[ch] = PA_VOLUME_NORM; /* FIXME */
         streams[1].volume.channels = o->sample_spec.channels;
+        streams[1].ramp_length = 0;
 
         /* do mixing */
         pa_mix(streams,                /* 2 streams to be mixed */
@@ -555,7 +555,8 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
     if (s->intended_latency < s->sink_latency*2)
         s->intended_latency = s->sink_latency*2;
 
-    s->memblockq = pa_memblockq_new(
+    /* One memblock per packet would make for a long list */
+    s->memblockq = pa_memblockq_new_ring(
             "module-rtp-recv memblockq",
             0,
             MEMBLOCKQ_MAXLENGTH,
@@ -564,7 +565,8 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
             pa_usec_to_bytes(s->intended_latency - s->sink_latency, &s->sink_input->sample_spec),
             0,
             0,
-            &silence);
+            &silence,
+            u->module->core->mempool);
 
     pa_memblock_unref(silence.memblock);
 
@@ -193,6 +193,9 @@ static inline void apply_interaction_to_sink(struct userdata *u, pa_sink *s, con
     pa_assert(u);
     pa_sink_assert_ref(s);
 
+    /* Pass the volume changes of all the streams to the IO thread at once */
+    pa_sink_begin_input_volume_batch(s);
+
     PA_IDXSET_FOREACH(j, s->inputs, idx) {
         bool corked, interaction_applied;
         const char *role;
@@ -233,6 +236,8 @@ static inline void apply_interaction_to_sink(struct userdata *u, pa_sink *s, con
             uncork_or_unduck(u, j, role, corked, g);
         }
     }
+
+    pa_sink_end_input_volume_batch(s);
 }
 
 static void apply_interaction_global(struct userdata *u, const char *trigger_role, pa_sink_input *ignore_stream, bool new_stream, struct group *g) {
@@ -253,6 +258,7 @@ static void remove_interactions(struct userdata *u, struct group *g) {
     const char *role;
 
     PA_IDXSET_FOREACH(s, u->core->sinks, idx) {
+        pa_sink_begin_input_volume_batch(s);
         PA_IDXSET_FOREACH(j, s->inputs, idx_input) {
             if(!!pa_hashmap_get(g->interaction_state, j)) {
                 corked = (j->state == PA_SINK_INPUT_CORKED);
@@ -261,6 +267,7 @@ static void remove_interactions(struct userdata *u, struct group *g) {
                 uncork_or_unduck(u, j, role, corked, g);
             }
         }
+        pa_sink_end_input_volume_batch(s);
     }
 }
 
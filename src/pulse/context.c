@@ -125,6 +125,13 @@ static void reset_callbacks(pa_context *c) {
     c->ext_stream_restore.userdata = NULL;
 }
 
+static void buffer_free(pa_memblock *b) {
+    pa_assert(b);
+
+    pa_memblock_release(b);
+    pa_memblock_unref(b);
+}
+
 pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *name, const pa_proplist *p) {
     pa_context *c;
     pa_mem_type_t type;
@@ -153,6 +160,7 @@ pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *
     c->mainloop = mainloop;
     c->playback_streams = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     c->record_streams = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    c->buffers = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, (pa_free_cb_t) buffer_free);
     c->client_index = PA_INVALID_INDEX;
     c->use_rtclock = pa_mainloop_is_our_api(mainloop);
 
@@ -225,6 +233,8 @@ static void context_unlink(pa_context *c) {
         c->pstream = NULL;
     }
 
+    c->srbchannel = NULL;
+
     if (c->srb_template.memblock) {
         pa_memblock_unref(c->srb_template.memblock);
         c->srb_template.memblock = NULL;
@@ -262,6 +272,9 @@ static void context_free(pa_context *c) {
     if (c->playback_streams)
         pa_hashmap_free(c->playback_streams);
 
+    if (c->buffers)
+        pa_hashmap_free(c->buffers);
+
     if (c->mempool)
         pa_mempool_unref(c->mempool);
 
@@ -395,6 +408,7 @@ static void handle_srbchannel_memblock(pa_context *c, pa_memblock *memblock) {
 
     /* ...and switch over */
     pa_pstream_set_srbchannel(c->pstream, sr);
+    c->srbchannel = sr;
 }
 
 static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
@@ -1519,6 +1533,7 @@ fail:
 static void pa_command_disable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_context *c = userdata;
     pa_tagstruct *t2;
+    pa_stream *s;
 
     pa_assert(pd);
     pa_assert(command == PA_COMMAND_DISABLE_SRBCHANNEL);
@@ -1526,7 +1541,12 @@ static void pa_command_disable_srbchannel(pa_pdispatch *pd, uint32_t command, ui
     pa_assert(c);
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
 
+    /* The streams need to ask for their timing again */
+    PA_LLIST_FOREACH(s, c->streams)
+        s->timing_slot = NULL;
+
     pa_pstream_set_srbchannel(c->pstream, NULL);
+    c->srbchannel = NULL;
 
     c->srb_template.readfd = -1;
     c->srb_template.writefd = -1;
@@ -1648,3 +1668,41 @@ int pa_context_load_cookie_from_file(pa_context *c, const char *cookie_file_path
 
     return 0;
 }
+
+int pa_context_alloc_buffer(pa_context *c, void **data, size_t *nbytes) {
+    pa_memblock *b;
+    size_t m;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(c, data, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(c, nbytes && *nbytes != 0, PA_ERR_INVALID);
+
+    /* Larger blocks wouldn't come from the pool */
+    m = pa_context_get_tile_size(c, NULL);
+    if (*nbytes > m)
+        *nbytes = m;
+
+    b = pa_memblock_new(c->mempool, *nbytes);
+
+    *data = pa_memblock_acquire(b);
+    *nbytes = pa_memblock_get_length(b);
+
+    pa_assert_se(pa_hashmap_put(c->buffers, *data, b) == 0);
+
+    return 0;
+}
+
+int pa_context_free_buffer(pa_context *c, void *data) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(c, data && pa_hashmap_get(c->buffers, data), PA_ERR_INVALID);
+
+    pa_hashmap_remove_and_free(c->buffers, data);
+
+    return 0;
+}
@@ -290,6 +290,26 @@ size_t pa_context_get_tile_size(const pa_context *c, const pa_sample_spec *ss);
  * location, feel free to use this function. \since 5.0 */
 int pa_context_load_cookie_from_file(pa_context *c, const char *cookie_file_path);
 
+/** Allocate a buffer for audio data from the memory pool of the
+ * context. Unlike pa_stream_begin_write() this is not tied to a
+ * stream, and any number of buffers may be allocated and filled ahead
+ * of time. On input *nbytes should be the number of bytes to
+ * allocate, or (size_t) -1 to let the library choose. It is capped at
+ * pa_context_get_tile_size(c, NULL), and on return *nbytes contains
+ * the actual size. If the connection to the server uses shared
+ * memory, a buffer that is passed as-is to pa_stream_write() is handed
+ * to the server without copying it. The data pointer must then be
+ * passed to pa_stream_write() unchanged and free_cb must be NULL; the
+ * write takes over the buffer, and it must not be accessed or freed
+ * anymore afterwards. Buffers that are not written must be freed with
+ * pa_context_free_buffer(). Returns a negative error value on failure.
+ * \since 15.0 */
+int pa_context_alloc_buffer(pa_context *c, void **data, size_t *nbytes);
+
+/** Free a buffer allocated with pa_context_alloc_buffer() that has not
+ * been written to a stream. \since 15.0 */
+int pa_context_free_buffer(pa_context *c, void *data);
+
 PA_C_DECL_END
 
 #endif
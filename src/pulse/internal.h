@@ -76,6 +76,8 @@ struct pa_context {
 
     pa_srbchannel_template srb_template;
     uint32_t srb_setup_tag;
+    /* Owned by the pstream */
+    pa_srbchannel *srbchannel;
 
     pa_hashmap *record_streams, *playback_streams;
     PA_LLIST_HEAD(pa_stream, streams);
@@ -95,6 +97,8 @@ struct pa_context {
     void *event_userdata;
 
     pa_mempool *mempool;
+    /* Buffers from pa_context_alloc_buffer(), data pointer -> pa_memblock */
+    pa_hashmap *buffers;
 
     bool is_local:1;
     bool do_shm:1;
@@ -208,6 +212,13 @@ struct pa_stream {
     pa_time_event *auto_timing_update_event;
     pa_usec_t auto_timing_interval_usec;
 
+    /* Timing snapshots the server publishes in the srbchannel, and what
+     * we need to bring their write index up to date */
+    pa_srbchannel_timing *timing_slot;
+    unsigned timing_seq;
+    uint64_t timing_sent;
+    uint32_t timing_seeks;
+
     pa_smoother *smoother;
 
     /* Callbacks */
@@ -193,6 +193,11 @@ static pa_stream *pa_stream_new_with_proplist_internal(
     s->auto_timing_update_requested = false;
     s->auto_timing_interval_usec = AUTO_TIMING_INTERVAL_START_USEC;
 
+    s->timing_slot = NULL;
+    s->timing_seq = 0;
+    s->timing_sent = 0;
+    s->timing_seeks = 0;
+
     reset_callbacks(s);
 
     s->smoother = NULL;
@@ -268,6 +273,7 @@ static void stream_unlink(pa_stream *s) {
     pa_stream_unref(s);
 
     s->context = NULL;
+    s->timing_slot = NULL;
 
     if (s->auto_timing_update_event) {
         pa_assert(s->mainloop);
@@ -375,6 +381,8 @@ void pa_stream_set_state(pa_stream *s, pa_stream_state_t st) {
     pa_stream_unref(s);
 }
 
+static int read_shared_timing(pa_stream *s);
+
 static void request_auto_timing_update(pa_stream *s, bool force) {
     pa_assert(s);
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
@@ -382,7 +390,11 @@ static void request_auto_timing_update(pa_stream *s, bool force) {
     if (!(s->flags & PA_STREAM_AUTO_TIMING_UPDATE))
         return;
 
-    if (s->state == PA_STREAM_READY &&
+    if (s->state == PA_STREAM_READY && s->timing_slot && read_shared_timing(s) >= 0) {
+        /* The server published the timing to the srbchannel, no need to
+         * ask for it */
+
+    } else if (s->state == PA_STREAM_READY &&
         (force || !s->auto_timing_update_requested)) {
         pa_operation *o;
 
@@ -955,6 +967,12 @@ static void auto_timing_update_callback(pa_mainloop_api *m, pa_time_event *e, co
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
 
     pa_stream_ref(s);
+
+    /* Without a request there's no reply to tell about the update */
+    if (s->state == PA_STREAM_READY && s->timing_slot && read_shared_timing(s) > 0)
+        if (s->latency_update_callback)
+            s->latency_update_callback(s, s->latency_update_userdata);
+
     request_auto_timing_update(s, false);
     pa_stream_unref(s);
 }
@@ -1150,6 +1168,18 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
             s->format = f;
     }
 
+    if (s->context->version >= 35 && s->direction == PA_STREAM_PLAYBACK) {
+        uint32_t timing_index;
+
+        if (pa_tagstruct_getu32(t, &timing_index) < 0) {
+            pa_context_fail(s->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        if (timing_index != PA_INVALID_INDEX && s->context->srbchannel)
+            s->timing_slot = pa_srbchannel_get_timing(s->context->srbchannel, timing_index);
+    }
+
     if (!pa_tagstruct_eof(t)) {
         pa_context_fail(s->context, PA_ERR_PROTOCOL);
         goto finish;
@@ -1480,6 +1510,8 @@ int pa_stream_write_ext_free(
         int64_t offset,
         pa_seek_mode_t seek) {
 
+    pa_memblock *b;
+
     pa_assert(s);
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
     pa_assert(data);
@@ -1498,7 +1530,27 @@ int pa_stream_write_ext_free(
     PA_CHECK_VALIDITY(s->context, length % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
     PA_CHECK_VALIDITY(s->context, !free_cb || !s->write_memblock, PA_ERR_INVALID);
 
-    if (s->write_memblock) {
+    if (!s->write_memblock && (b = pa_hashmap_get(s->context->buffers, data))) {
+        pa_memchunk chunk;
+
+        /* The buffer is from pa_context_alloc_buffer() */
+
+        PA_CHECK_VALIDITY(s->context, !free_cb, PA_ERR_INVALID);
+        PA_CHECK_VALIDITY(s->context, length <= pa_memblock_get_length(b), PA_ERR_INVALID);
+
+        pa_assert_se(pa_hashmap_remove(s->context->buffers, data) == b);
+        pa_memblock_release(b);
+
+        chunk.memblock = b;
+        chunk.index = 0;
+        chunk.length = length;
+
+        if (length > 0)
+            pa_pstream_send_memblock(s->context->pstream, s->channel, offset, seek, &chunk);
+
+        pa_memblock_unref(b);
+
+    } else if (s->write_memblock) {
         pa_memchunk chunk;
 
         /* pa_stream_write_begin() was called before */
@@ -1571,6 +1623,14 @@ int pa_stream_write_ext_free(
 
     if (s->direction == PA_STREAM_PLAYBACK) {
 
+        /* The server accounts for the same in the timing it publishes */
+        if (seek == PA_SEEK_RELATIVE)
+            s->timing_sent += (uint64_t) (offset + (int64_t) length);
+        else {
+            s->timing_sent += length;
+            s->timing_seeks++;
+        }
+
         /* Update latency request correction */
         if (s->write_index_corrections[s->current_write_index_correction].valid) {
 
@@ -1792,6 +1852,97 @@ static pa_usec_t calc_time(const pa_stream *s, bool ignore_transport) {
     return usec;
 }
 
+static void update_smoother(pa_stream *s) {
+    pa_timing_info *i = &s->timing_info;
+    pa_usec_t u, x;
+
+    /* Update smoother if we're not corked */
+    if (!s->smoother || s->corked)
+        return;
+
+    u = x = pa_rtclock_now() - i->transport_usec;
+
+    if (s->direction == PA_STREAM_PLAYBACK && s->context->version >= 13) {
+        pa_usec_t su;
+
+        /* If we weren't playing then it will take some time
+         * until the audio will actually come out through the
+         * speakers. Since we follow that timing here, we need
+         * to try to fix this up */
+
+        su = pa_bytes_to_usec((uint64_t) i->since_underrun, &s->sample_spec);
+
+        if (su < i->sink_usec)
+            x += i->sink_usec - su;
+    }
+
+    if (!i->playing)
+        pa_smoother_pause(s->smoother, x);
+
+    /* Update the smoother */
+    if ((s->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
+        (s->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
+        pa_smoother_put(s->smoother, u, calc_time(s, true));
+
+    if (i->playing)
+        pa_smoother_resume(s->smoother, x, true);
+}
+
+/* Takes the timing from the snapshot the server published to the
+ * srbchannel. Returns -1 if there is none or it is older than the auto
+ * timing update interval, 0 if it didn't change since the last call and
+ * 1 if the timing info was updated. The server doesn't publish
+ * regularly while nothing is rendered, so for an old snapshot the timing
+ * has to be asked for. */
+static int read_shared_timing(pa_stream *s) {
+    pa_timing_info *i = &s->timing_info;
+    pa_srbchannel_timing_info info;
+    unsigned seq;
+    pa_usec_t now;
+    bool stale;
+
+    pa_assert(s->timing_slot);
+    pa_assert(s->direction == PA_STREAM_PLAYBACK);
+
+    if (!pa_srbchannel_timing_read(s->timing_slot, &info, &seq) || seq == 0)
+        return -1;
+
+    now = pa_rtclock_now();
+    stale = now > info.timestamp + s->auto_timing_interval_usec;
+
+    if (seq == s->timing_seq)
+        return stale ? -1 : 0;
+
+    s->timing_seq = seq;
+
+    i->sink_usec = info.sink_usec;
+    i->source_usec = 0;
+    i->playing = !!info.playing;
+    i->since_underrun = (int64_t) (info.playing ? info.playing_for : info.underrun_for);
+
+    /* We are on the same machine, so the clocks are the same too */
+    i->transport_usec = now > info.timestamp ? now - info.timestamp : 0;
+    i->synchronized_clocks = true;
+    pa_timeval_sub(pa_gettimeofday(&i->timestamp), i->transport_usec);
+
+    i->read_index = info.read_index;
+    i->read_index_corrupt = false;
+
+    /* Add what is still on the way to the server, unless there is a seek
+     * we can't account for */
+    if (info.seeks == s->timing_seeks) {
+        i->write_index = info.write_index + (int64_t) (s->timing_sent - info.received);
+        i->write_index_corrupt = false;
+    } else
+        i->write_index_corrupt = true;
+
+    s->timing_info_valid = true;
+
+    update_smoother(s);
+
+    return stale ? -1 : 1;
+}
+
 static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     struct timeval local, remote, now;
@@ -1929,37 +2080,7 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
                 i->read_index -= (int64_t) pa_memblockq_get_length(o->stream->record_memblockq);
         }
 
-        /* Update smoother if we're not corked */
-        if (o->stream->smoother && !o->stream->corked) {
-            pa_usec_t u, x;
-
-            u = x = pa_rtclock_now() - i->transport_usec;
-
-            if (o->stream->direction == PA_STREAM_PLAYBACK && o->context->version >= 13) {
-                pa_usec_t su;
-
-                /* If we weren't playing then it will take some time
-                 * until the audio will actually come out through the
-                 * speakers. Since we follow that timing here, we need
-                 * to try to fix this up */
-
-                su = pa_bytes_to_usec((uint64_t) i->since_underrun, &o->stream->sample_spec);
-
-                if (su < i->sink_usec)
-                    x += i->sink_usec - su;
-            }
-
-            if (!i->playing)
-                pa_smoother_pause(o->stream->smoother, x);
-
-            /* Update the smoother */
-            if ((o->stream->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
-                (o->stream->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
-                pa_smoother_put(o->stream->smoother, u, calc_time(o->stream, true));
-
-            if (i->playing)
-                pa_smoother_resume(o->stream->smoother, x, true);
-        }
+        update_smoother(o->stream);
     }
 
     o->stream->auto_timing_update_requested = false;
@@ -2346,6 +2467,8 @@ pa_operation* pa_stream_flush(pa_stream *s, pa_stream_success_cb_t cb, void *use
         if (s->write_index_corrections[s->current_write_index_correction].valid)
             s->write_index_corrections[s->current_write_index_correction].corrupt = true;
 
+        s->timing_seeks++;
+
         if (s->buffer_attr.prebuf > 0)
             check_smoother_status(s, false, false, true);
 
@@ -2462,6 +2585,10 @@ int pa_stream_get_time(pa_stream *s, pa_usec_t *r_usec) {
     PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
     PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+
+    if (s->timing_slot)
+        read_shared_timing(s);
+
     PA_CHECK_VALIDITY(s->context, s->timing_info_valid, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_PLAYBACK || !s->timing_info.read_index_corrupt, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_RECORD || !s->timing_info.write_index_corrupt, PA_ERR_NODATA);
@@ -2515,6 +2642,10 @@ int pa_stream_get_latency(pa_stream *s, pa_usec_t *r_usec, int *negative) {
     PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
     PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+
+    if (s->timing_slot)
+        read_shared_timing(s);
+
     PA_CHECK_VALIDITY(s->context, s->timing_info_valid, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_PLAYBACK || !s->timing_info.write_index_corrupt, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_RECORD || !s->timing_info.read_index_corrupt, PA_ERR_NODATA);
@@ -2547,6 +2678,10 @@ const pa_timing_info* pa_stream_get_timing_info(pa_stream *s) {
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, !pa_detect_fork(), PA_ERR_FORKED);
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->direction != PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+
+    if (s->timing_slot)
+        read_shared_timing(s);
+
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->timing_info_valid, PA_ERR_NODATA);
 
     return &s->timing_info;
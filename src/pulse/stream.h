@@ -509,6 +509,14 @@ int pa_stream_cancel_write(
  * bytes both at the end and at the beginning of the reserved memory
  * area.
  *
+ * Since 15.0, buffers allocated with pa_context_alloc_buffer() are
+ * written without copying them as well. Pass the pointer returned by that call and a
+ * NULL \a free_cb; the data has to start at the beginning of the
+ * buffer, but may end before its end. Like with
+ * pa_stream_begin_write() the buffer may no longer be accessed after
+ * this call. Several such buffers may be filled ahead of time and
+ * written to different streams of the same context.
+ *
  * Returns zero on success. */
 int pa_stream_write(
         pa_stream *p             /**< The stream to use */,
@@ -23,6 +23,7 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
 
 #include <pulse/xmalloc.h>
 
@@ -35,8 +36,11 @@
 
 #include "asyncmsgq.h"
 
+static void batch_destroy(void *p);
+
 PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, pa_xfree);
 PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
+PA_STATIC_FLIST_DECLARE(batches, 0, batch_destroy);
 
 struct asyncmsgq_item {
     int code;
@@ -47,6 +51,13 @@ struct asyncmsgq_item {
     pa_memchunk memchunk;
     pa_semaphore *semaphore;
     int ret;
+    pa_asyncmsgq_batch *batch; /* set if this item carries a batch */
+};
+
+struct pa_asyncmsgq_batch {
+    struct asyncmsgq_item head; /* what is actually pushed into the queue */
+    struct asyncmsgq_item *items;
+    unsigned n_items, n_allocated;
 };
 
 struct pa_asyncmsgq {
@@ -55,8 +66,23 @@ struct pa_asyncmsgq {
     pa_mutex *mutex; /* only for the writer side */
 
     struct asyncmsgq_item *current;
+
+    /* The batch we are handing out messages from, for the reader side */
+    pa_asyncmsgq_batch *batch;
+    unsigned batch_idx;
 };
 
+static void item_release(struct asyncmsgq_item *i) {
+    if (i->free_cb)
+        i->free_cb(i->userdata);
+
+    if (i->object)
+        pa_msgobject_unref(i->object);
+
+    if (i->memchunk.memblock)
+        pa_memblock_unref(i->memchunk.memblock);
+}
+
 pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     pa_asyncq *asyncq;
     pa_asyncmsgq *a;
@@ -71,6 +97,8 @@ pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     a->asyncq = asyncq;
     pa_assert_se(a->mutex = pa_mutex_new(false, true));
     a->current = NULL;
+    a->batch = NULL;
+    a->batch_idx = 0;
 
     return a;
 }
@@ -79,18 +107,21 @@ static void asyncmsgq_free(pa_asyncmsgq *a) {
     struct asyncmsgq_item *i;
     pa_assert(a);
 
+    if (a->batch) {
+        pa_assert(!a->batch->head.semaphore);
+        pa_asyncmsgq_batch_free(a->batch);
+    }
+
     while ((i = pa_asyncq_pop(a->asyncq, false))) {
 
         pa_assert(!i->semaphore);
 
-        if (i->object)
-            pa_msgobject_unref(i->object);
-
-        if (i->memchunk.memblock)
-            pa_memblock_unref(i->memchunk.memblock);
+        if (i->batch) {
+            pa_asyncmsgq_batch_free(i->batch);
+            continue;
+        }
 
-        if (i->free_cb)
-            i->free_cb(i->userdata);
+        item_release(i);
 
         if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
             pa_xfree(i);
@@ -134,6 +165,7 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
     } else
         pa_memchunk_reset(&i->memchunk);
     i->semaphore = NULL;
+    i->batch = NULL;
 
     /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
     pa_mutex_lock(a->mutex);
@@ -156,6 +188,7 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
         i.memchunk = *chunk;
     } else
         pa_memchunk_reset(&i.memchunk);
+    i.batch = NULL;
 
     if (!(i.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
         i.semaphore = pa_semaphore_new(0);
@@ -177,9 +210,21 @@ int pa_asyncmsgq_get(pa_asyncmsgq *a, pa_msgobject **object, int *code, void **u
     pa_assert(PA_REFCNT_VALUE(a) > 0);
     pa_assert(!a->current);
 
-    if (!(a->current = pa_asyncq_pop(a->asyncq, wait_op))) {
-/*         pa_log("failure"); */
-        return -1;
+    if (a->batch)
+        a->current = &a->batch->items[a->batch_idx];
+    else {
+        if (!(a->current = pa_asyncq_pop(a->asyncq, wait_op))) {
+/*             pa_log("failure"); */
+            return -1;
+        }
+
+        if (a->current->batch) {
+            /* Hand out the messages of the batch one by one, as if they
+             * had been queued separately */
+            a->batch = a->current->batch;
+            a->batch_idx = 0;
+            a->current = &a->batch->items[0];
+        }
     }
 
 /*     pa_log("success"); */
@@ -213,19 +258,35 @@ void pa_asyncmsgq_done(pa_asyncmsgq *a, int ret) {
     pa_assert(a);
     pa_assert(a->current);
 
-    if (a->current->semaphore) {
+    if (a->batch) {
+        pa_asyncmsgq_batch *b = a->batch;
+
         a->current->ret = ret;
-        pa_semaphore_post(a->current->semaphore);
-    } else {
+        if (ret < 0 && b->head.ret >= 0)
+            b->head.ret = ret;
+
+        a->current = NULL;
+
+        if (++a->batch_idx < b->n_items)
+            return;
+
+        /* That was the last one, reply once for the whole batch */
+        a->batch = NULL;
+        a->batch_idx = 0;
 
-        if (a->current->free_cb)
-            a->current->free_cb(a->current->userdata);
+        if (b->head.semaphore)
+            pa_semaphore_post(b->head.semaphore);
+        else
+            pa_asyncmsgq_batch_free(b);
 
-        if (a->current->object)
-            pa_msgobject_unref(a->current->object);
+        return;
+    }
 
-        if (a->current->memchunk.memblock)
-            pa_memblock_unref(a->current->memchunk.memblock);
+    if (a->current->semaphore) {
+        a->current->ret = ret;
+        pa_semaphore_post(a->current->semaphore);
+    } else {
+        item_release(a->current);
 
         if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), a->current) < 0)
             pa_xfree(a->current);
@@ -290,6 +351,10 @@ int pa_asyncmsgq_read_fd(pa_asyncmsgq *a) {
 int pa_asyncmsgq_read_before_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
+    /* The rest of a batch is still waiting to be handed out */
+    if (a->batch)
+        return -1;
+
     return pa_asyncq_read_before_poll(a->asyncq);
 }
 
@@ -356,3 +421,144 @@ bool pa_asyncmsgq_dispatching(pa_asyncmsgq *a) {
 
     return !!a->current;
 }
+
+static void batch_destroy(void *p) {
+    pa_asyncmsgq_batch *b = p;
+
+    pa_xfree(b->items);
+    pa_xfree(b);
+}
+
+pa_asyncmsgq_batch *pa_asyncmsgq_batch_new(void) {
+    pa_asyncmsgq_batch *b;
+
+    /* Batches are recycled together with their item array, so that
+     * finishing a posted batch doesn't free memory in the reading
+     * thread */
+    if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(batches)))) {
+        b = pa_xnew0(pa_asyncmsgq_batch, 1);
+        b->head.batch = b;
+        pa_memchunk_reset(&b->head.memchunk);
+    }
+
+    return b;
+}
+
+void pa_asyncmsgq_batch_free(pa_asyncmsgq_batch *b) {
+    unsigned k;
+
+    pa_assert(b);
+
+    for (k = 0; k < b->n_items; k++)
+        item_release(&b->items[k]);
+
+    b->n_items = 0;
+    b->head.semaphore = NULL;
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(batches), b) < 0)
+        batch_destroy(b);
+}
+
+void pa_asyncmsgq_batch_add(pa_asyncmsgq_batch *b, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+    struct asyncmsgq_item *i;
+
+    pa_assert(b);
+
+    if (b->n_items >= b->n_allocated) {
+        b->n_allocated = PA_MAX(2 * b->n_allocated, 8U);
+        b->items = pa_xrealloc(b->items, sizeof(struct asyncmsgq_item) * b->n_allocated);
+    }
+
+    i = &b->items[b->n_items++];
+
+    i->code = code;
+    i->object = object ? pa_msgobject_ref(object) : NULL;
+    i->userdata = (void*) userdata;
+    i->free_cb = free_cb;
+    i->offset = offset;
+    if (chunk) {
+        pa_assert(chunk->memblock);
+        i->memchunk = *chunk;
+        pa_memblock_ref(i->memchunk.memblock);
+    } else
+        pa_memchunk_reset(&i->memchunk);
+    i->semaphore = NULL;
+    i->ret = -1;
+    i->batch = NULL;
+}
+
+void pa_asyncmsgq_batch_add_coalesced(pa_asyncmsgq_batch *b, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+    unsigned k;
+
+    pa_assert(b);
+
+    for (k = 0; k < b->n_items;) {
+        struct asyncmsgq_item *i = &b->items[k];
+
+        if (i->object != object || i->code != code) {
+            k++;
+            continue;
+        }
+
+        item_release(i);
+        memmove(i, i + 1, sizeof(struct asyncmsgq_item) * (b->n_items - k - 1));
+        b->n_items--;
+    }
+
+    pa_asyncmsgq_batch_add(b, object, code, userdata, offset, chunk, free_cb);
+}
+
+unsigned pa_asyncmsgq_batch_size(pa_asyncmsgq_batch *b) {
+    pa_assert(b);
+
+    return b->n_items;
+}
+
+void pa_asyncmsgq_batch_post(pa_asyncmsgq *a, pa_asyncmsgq_batch *b) {
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+    pa_assert(b);
+
+    if (b->n_items <= 0) {
+        pa_asyncmsgq_batch_free(b);
+        return;
+    }
+
+    b->head.semaphore = NULL;
+    b->head.ret = 0;
+
+    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
+    pa_mutex_lock(a->mutex);
+    pa_asyncq_post(a->asyncq, &b->head);
+    pa_mutex_unlock(a->mutex);
+}
+
+int pa_asyncmsgq_batch_send(pa_asyncmsgq *a, pa_asyncmsgq_batch *b) {
+    int ret;
+
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+    pa_assert(b);
+
+    if (b->n_items <= 0) {
+        pa_asyncmsgq_batch_free(b);
+        return 0;
+    }
+
+    b->head.ret = 0;
+    if (!(b->head.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
+        b->head.semaphore = pa_semaphore_new(0);
+
+    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
+    pa_mutex_lock(a->mutex);
+    pa_assert_se(pa_asyncq_push(a->asyncq, &b->head, true) == 0);
+    pa_mutex_unlock(a->mutex);
+
+    pa_semaphore_wait(b->head.semaphore);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(semaphores), b->head.semaphore) < 0)
+        pa_semaphore_free(b->head.semaphore);
+
+    ret = b->head.ret;
+    pa_asyncmsgq_batch_free(b);
+
+    return ret;
+}
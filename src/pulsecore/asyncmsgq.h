@@ -42,13 +42,20 @@
  *
  * There are two functions for submitting messages: _post and
  * _send. The former just enqueues the message asynchronously, the
- * latter waits for completion, synchronously. */
+ * latter waits for completion, synchronously.
+ *
+ * Several messages for the same queue can be collected in a batch,
+ * which is then submitted with a single _batch_post or _batch_send,
+ * so that a _batch_send costs only one round trip to the reading
+ * thread. The reading side does not need to know about batches, the
+ * messages are handed out by _get one after the other. */
 
 enum {
     PA_MESSAGE_SHUTDOWN = -1/* A generic message to inform the handler of this queue to quit */
 };
 
 typedef struct pa_asyncmsgq pa_asyncmsgq;
+typedef struct pa_asyncmsgq_batch pa_asyncmsgq_batch;
 
 pa_asyncmsgq* pa_asyncmsgq_new(unsigned size);
 pa_asyncmsgq* pa_asyncmsgq_ref(pa_asyncmsgq *q);
@@ -78,4 +85,28 @@ void pa_asyncmsgq_write_after_poll(pa_asyncmsgq *a);
 
 bool pa_asyncmsgq_dispatching(pa_asyncmsgq *a);
 
+/* For batches of messages, on the writer side. Messages are
+ * dispatched in the order they were added. Object and memchunk are
+ * referenced, and userdata is freed with free_cb once the batch is
+ * done, for sent batches too. Finished batches are kept in a free
+ * list, so that the reading thread doesn't free a posted batch. */
+pa_asyncmsgq_batch *pa_asyncmsgq_batch_new(void);
+void pa_asyncmsgq_batch_free(pa_asyncmsgq_batch *b);
+
+void pa_asyncmsgq_batch_add(pa_asyncmsgq_batch *b, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk, pa_free_cb_t userdata_free_cb);
+
+/* Like pa_asyncmsgq_batch_add(), but drops an earlier message for the
+ * same object and code from the batch. The new message takes the place
+ * at the end. Only for messages where dispatching the last one has the
+ * same effect as dispatching all of them, like syncing a value to the
+ * thread_info struct. */
+void pa_asyncmsgq_batch_add_coalesced(pa_asyncmsgq_batch *b, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk, pa_free_cb_t userdata_free_cb);
+
+unsigned pa_asyncmsgq_batch_size(pa_asyncmsgq_batch *b);
+
+/* Both take ownership of the batch. _batch_send returns 0 if all
+ * messages returned >= 0, otherwise the first negative return value. */
+void pa_asyncmsgq_batch_post(pa_asyncmsgq *q, pa_asyncmsgq_batch *b);
+int pa_asyncmsgq_batch_send(pa_asyncmsgq *q, pa_asyncmsgq_batch *b);
+
 #endif
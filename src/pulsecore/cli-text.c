@@ -282,6 +282,7 @@ char *pa_sink_list_to_string(pa_core *c) {
         if (sink->module)
             pa_strbuf_printf(s, "\tmodule: %u\n", sink->module->index);
 
+        pa_sink_update_stats(sink);
         t = pa_proplist_to_string_sep(sink->proplist, "\n\t\t");
         pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
         pa_xfree(t);
@@ -393,6 +394,7 @@ char *pa_source_list_to_string(pa_core *c) {
         if (source->module)
             pa_strbuf_printf(s, "\tmodule: %u\n", source->module->index);
 
+        pa_source_update_stats(source);
         t = pa_proplist_to_string_sep(source->proplist, "\n\t\t");
         pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
         pa_xfree(t);
@@ -498,6 +500,7 @@ char *pa_source_output_list_to_string(pa_core *c) {
         if (o->direct_on_input)
             pa_strbuf_printf(s, "\tdirect on input: %u\n", o->direct_on_input->index);
 
+        pa_source_output_update_stats(o);
         t = pa_proplist_to_string_sep(o->proplist, "\n\t\t");
         pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
         pa_xfree(t);
@@ -593,6 +596,7 @@ char *pa_sink_input_list_to_string(pa_core *c) {
         if (i->client)
             pa_strbuf_printf(s, "\tclient: %u <%s>\n", i->client->index, pa_strnull(pa_proplist_gets(i->client->proplist, PA_PROP_APPLICATION_NAME)));
 
+        pa_sink_input_update_stats(i);
         t = pa_proplist_to_string_sep(i->proplist, "\n\t\t");
         pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
         pa_xfree(t);
@@ -155,6 +155,7 @@ bool pa_cpu_init_arm(pa_cpu_arm_flag_t *flags) {
         pa_convert_func_init_neon(*flags);
         pa_mix_func_init_neon(*flags);
         pa_remap_func_init_neon(*flags);
+        pa_biquad_func_init_neon(*flags);
     }
 #endif
 
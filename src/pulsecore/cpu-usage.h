@@ -0,0 +1,113 @@
+#ifndef foopulsecorecpuusagehfoo
+#define foopulsecorecpuusagehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <limits.h>
+
+#include <pulse/proplist.h>
+#include <pulse/sample.h>
+#include <pulse/timeval.h>
+
+#include <pulsecore/macro.h>
+
+/* Accounts the time an IO thread spends on behalf of an object, like
+ * rendering a sink or peeking from a sink input. Besides the total, the
+ * time per second and the longest single call are kept for one second
+ * windows, and the values of the last complete window are the ones to
+ * report. Only to be used from the IO thread. */
+
+typedef struct pa_cpu_usage {
+    pa_usec_t usec;
+    uint64_t n_missed; /* calls that took longer than their deadline */
+
+    /* The current window, which starts with the first call accounted */
+    pa_usec_t window_start;
+    pa_usec_t window_usec, window_peak_usec;
+    unsigned window_peak_percent;
+
+    /* The last complete window */
+    pa_usec_t usec_per_sec, peak_usec;
+    unsigned peak_percent; /* of the deadline */
+} pa_cpu_usage;
+
+/* Starts a new window if the current one is at least a second old. Also
+ * to be called before reading the values, so that they don't get stale
+ * while nothing is accounted. */
+static inline void pa_cpu_usage_roll(pa_cpu_usage *u, pa_usec_t now) {
+    pa_usec_t elapsed;
+
+    if (u->window_start == 0)
+        return;
+
+    elapsed = now - u->window_start;
+
+    if (elapsed < PA_USEC_PER_SEC)
+        return;
+
+    u->usec_per_sec = u->window_usec * PA_USEC_PER_SEC / elapsed;
+    u->peak_usec = u->window_peak_usec;
+    u->peak_percent = u->window_peak_percent;
+
+    u->window_start = now;
+    u->window_usec = u->window_peak_usec = 0;
+    u->window_peak_percent = 0;
+}
+
+/* Accounts a call that ran from start to end. If deadline is not 0,
+ * the call should have finished within that time. */
+static inline void pa_cpu_usage_add(pa_cpu_usage *u, pa_usec_t start, pa_usec_t end, pa_usec_t deadline) {
+    pa_usec_t d = end - start;
+
+    if (u->window_start == 0)
+        u->window_start = start;
+
+    pa_cpu_usage_roll(u, end);
+
+    u->usec += d;
+    u->window_usec += d;
+
+    if (d > u->window_peak_usec)
+        u->window_peak_usec = d;
+
+    if (deadline > 0) {
+        unsigned percent = (unsigned) PA_MIN(d * 100 / deadline, (pa_usec_t) UINT_MAX);
+
+        if (percent > u->window_peak_percent)
+            u->window_peak_percent = percent;
+
+        if (d > deadline)
+            u->n_missed++;
+    }
+}
+
+/* Sets the "cpu.*" properties. The deadline related ones only if
+ * with_deadline is true. */
+static inline void pa_cpu_usage_to_proplist(const pa_cpu_usage *u, pa_proplist *p, bool with_deadline) {
+    pa_proplist_setf(p, "cpu.usec", "%llu", (unsigned long long) u->usec);
+    pa_proplist_setf(p, "cpu.usec_per_sec", "%llu", (unsigned long long) u->usec_per_sec);
+    pa_proplist_setf(p, "cpu.peak_usec", "%llu", (unsigned long long) u->peak_usec);
+
+    if (!with_deadline)
+        return;
+
+    pa_proplist_setf(p, "cpu.peak_deadline_percent", "%u", u->peak_percent);
+    pa_proplist_setf(p, "cpu.missed_deadlines", "%llu", (unsigned long long) u->n_missed);
+}
+
+#endif
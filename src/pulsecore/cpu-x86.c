@@ -123,6 +123,8 @@ bool pa_cpu_init_x86(pa_cpu_x86_flag_t *flags) {
         pa_volume_func_init_sse(*flags);
         pa_remap_func_init_sse(*flags);
         pa_convert_func_init_sse(*flags);
+        pa_mix_func_init_sse(*flags);
+        pa_biquad_func_init_sse(*flags);
     }
 
     return true;
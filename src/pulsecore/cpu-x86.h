@@ -56,4 +56,8 @@ void pa_remap_func_init_sse(pa_cpu_x86_flag_t flags);
 
 void pa_convert_func_init_sse (pa_cpu_x86_flag_t flags);
 
+void pa_mix_func_init_sse(pa_cpu_x86_flag_t flags);
+
+void pa_biquad_func_init_sse(pa_cpu_x86_flag_t flags);
+
 #endif /* foocpux86hfoo */
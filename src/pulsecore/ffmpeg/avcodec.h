@@ -68,6 +68,7 @@ struct AVResampleContext;
 struct AVResampleContext *av_resample_init(int out_rate, int in_rate, int filter_length, int log2_phase_count, int linear, double cutoff);
 int av_resample(struct AVResampleContext *c, short *dst, short *src, int *consumed, int src_size, int dst_size, int update_ctx);
 void av_resample_compensate(struct AVResampleContext *c, int sample_delta, int compensation_distance);
+void av_resample_reset(struct AVResampleContext *c);
 void av_resample_close(struct AVResampleContext *c);
 void av_build_filter(int16_t *filter, double factor, int tap_count, int phase_count, int scale, int type);
 
@@ -196,6 +196,14 @@ AVResampleContext *av_resample_init(int out_rate, int in_rate, int filter_size,
     return c;
 }
 
+/* Forgets the position in the input, as if the context was new */
+void av_resample_reset(AVResampleContext *c){
+    c->dst_incr= c->ideal_dst_incr;
+    c->compensation_distance= 0;
+    c->frac= 0;
+    c->index= -(1<<c->phase_shift)*((c->filter_length-1)/2);
+}
+
 void av_resample_close(AVResampleContext *c){
     av_freep(&c->filter_bank);
     av_freep(&c);
@@ -103,9 +103,236 @@ static void biquad_highpass(struct biquad *bq, double cutoff)
 	}
 }
 
+static void biquad_peaking(struct biquad *bq, double freq, double Q,
+			   double db_gain)
+{
+	double A;
+
+	/* Clip frequencies to between 0 and 1, inclusive. */
+	freq = PA_MAX(0.0, PA_MIN(freq, 1.0));
+
+	/* Don't let Q go negative, which causes an unstable filter. */
+	Q = PA_MAX(0.0, Q);
+
+	A = pow(10.0, db_gain / 40);
+
+	if (freq > 0 && freq < 1) {
+		if (Q > 0) {
+			double w0 = M_PI * freq;
+			double alpha = sin(w0) / (2 * Q);
+			double k = cos(w0);
+
+			double b0 = 1 + alpha * A;
+			double b1 = -2 * k;
+			double b2 = 1 - alpha * A;
+			double a0 = 1 + alpha / A;
+			double a1 = -2 * k;
+			double a2 = 1 - alpha / A;
+
+			set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+		} else {
+			/* When Q = 0, the above formulas have problems. If we
+			 * look at the z-transform, we can see that the limit
+			 * as Q->0 is A^2, so set the filter that way.
+			 */
+			set_coefficient(bq, A * A, 0, 0, 1, 0, 0);
+		}
+	} else {
+		/* When frequency is 0 or 1, the z-transform is 1. */
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+	}
+}
+
+static void biquad_lowshelf(struct biquad *bq, double freq, double db_gain)
+{
+	double A;
+
+	/* Clip frequencies to between 0 and 1, inclusive. */
+	freq = PA_MAX(0.0, PA_MIN(freq, 1.0));
+
+	A = pow(10.0, db_gain / 40);
+
+	if (freq == 1) {
+		/* The z-transform is a constant gain. */
+		set_coefficient(bq, A * A, 0, 0, 1, 0, 0);
+	} else if (freq > 0) {
+		double w0 = M_PI * freq;
+		double S = 1; /* filter slope (1 is max value) */
+		double alpha = 0.5 * sin(w0) *
+			sqrt((A + 1 / A) * (1 / S - 1) + 2);
+		double k = cos(w0);
+		double k2 = 2 * sqrt(A) * alpha;
+		double a_plus_one = A + 1;
+		double a_minus_one = A - 1;
+
+		double b0 = A * (a_plus_one - a_minus_one * k + k2);
+		double b1 = 2 * A * (a_minus_one - a_plus_one * k);
+		double b2 = A * (a_plus_one - a_minus_one * k - k2);
+		double a0 = a_plus_one + a_minus_one * k + k2;
+		double a1 = -2 * (a_minus_one + a_plus_one * k);
+		double a2 = a_plus_one + a_minus_one * k - k2;
+
+		set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+	} else {
+		/* When frequency is 0, the z-transform is 1. */
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+	}
+}
+
+static void biquad_highshelf(struct biquad *bq, double freq, double db_gain)
+{
+	double A;
+
+	/* Clip frequencies to between 0 and 1, inclusive. */
+	freq = PA_MAX(0.0, PA_MIN(freq, 1.0));
+
+	A = pow(10.0, db_gain / 40);
+
+	if (freq == 1) {
+		/* The z-transform is 1. */
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+	} else if (freq > 0) {
+		double w0 = M_PI * freq;
+		double S = 1; /* filter slope (1 is maximum value) */
+		double alpha = 0.5 * sin(w0) *
+			sqrt((A + 1 / A) * (1 / S - 1) + 2);
+		double k = cos(w0);
+		double k2 = 2 * sqrt(A) * alpha;
+		double a_plus_one = A + 1;
+		double a_minus_one = A - 1;
+
+		double b0 = A * (a_plus_one + a_minus_one * k + k2);
+		double b1 = -2 * A * (a_minus_one + a_plus_one * k);
+		double b2 = A * (a_plus_one + a_minus_one * k - k2);
+		double a0 = a_plus_one - a_minus_one * k + k2;
+		double a1 = 2 * (a_minus_one - a_plus_one * k);
+		double a2 = a_plus_one - a_minus_one * k - k2;
+
+		set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+	} else {
+		/* When frequency = 0, the filter is just a gain, A^2. */
+		set_coefficient(bq, A * A, 0, 0, 1, 0, 0);
+	}
+}
+
+static void biquad_bandpass(struct biquad *bq, double freq, double Q)
+{
+	/* No negative frequencies allowed. */
+	freq = PA_MAX(0.0, freq);
+
+	/* Don't let Q go negative, which causes an unstable filter. */
+	Q = PA_MAX(0.0, Q);
+
+	if (freq > 0 && freq < 1) {
+		double w0 = M_PI * freq;
+		if (Q > 0) {
+			double alpha = sin(w0) / (2 * Q);
+			double k = cos(w0);
+
+			double b0 = alpha;
+			double b1 = 0;
+			double b2 = -alpha;
+			double a0 = 1 + alpha;
+			double a1 = -2 * k;
+			double a2 = 1 - alpha;
+
+			set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+		} else {
+			/* When Q = 0, the above formulas have problems. If we
+			 * look at the z-transform, we can see that the limit
+			 * as Q->0 is 1, so set the filter that way.
+			 */
+			set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+		}
+	} else {
+		/* When the cutoff is zero, the z-transform approaches 0, if Q
+		 * > 0. When both Q and cutoff are zero, the z-transform is
+		 * pretty much undefined. What should we do in this case?
+		 * For now, just make the filter 0. When the cutoff is 1, the
+		 * z-transform also approaches 0.
+		 */
+		set_coefficient(bq, 0, 0, 0, 1, 0, 0);
+	}
+}
+
+static void biquad_notch(struct biquad *bq, double freq, double Q)
+{
+	/* Clip frequencies to between 0 and 1, inclusive. */
+	freq = PA_MAX(0.0, PA_MIN(freq, 1.0));
+
+	/* Don't let Q go negative, which causes an unstable filter. */
+	Q = PA_MAX(0.0, Q);
+
+	if (freq > 0 && freq < 1) {
+		if (Q > 0) {
+			double w0 = M_PI * freq;
+			double alpha = sin(w0) / (2 * Q);
+			double k = cos(w0);
+
+			double b0 = 1;
+			double b1 = -2 * k;
+			double b2 = 1;
+			double a0 = 1 + alpha;
+			double a1 = -2 * k;
+			double a2 = 1 - alpha;
+
+			set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+		} else {
+			/* When Q = 0, the above formulas have problems. If we
+			 * look at the z-transform, we can see that the limit
+			 * as Q->0 is 0, so set the filter that way.
+			 */
+			set_coefficient(bq, 0, 0, 0, 1, 0, 0);
+		}
+	} else {
+		/* When frequency is 0 or 1, the z-transform is 1. */
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+	}
+}
+
+static void biquad_allpass(struct biquad *bq, double freq, double Q)
+{
+	/* Clip frequencies to between 0 and 1, inclusive. */
+	freq = PA_MAX(0.0, PA_MIN(freq, 1.0));
+
+	/* Don't let Q go negative, which causes an unstable filter. */
+	Q = PA_MAX(0.0, Q);
+
+	if (freq > 0 && freq < 1) {
+		if (Q > 0) {
+			double w0 = M_PI * freq;
+			double alpha = sin(w0) / (2 * Q);
+			double k = cos(w0);
+
+			double b0 = 1 - alpha;
+			double b1 = -2 * k;
+			double b2 = 1 + alpha;
+			double a0 = 1 + alpha;
+			double a1 = -2 * k;
+			double a2 = 1 - alpha;
+
+			set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+		} else {
+			/* When Q = 0, the above formulas have problems. If we
+			 * look at the z-transform, we can see that the limit
+			 * as Q->0 is -1, so set the filter that way.
+			 */
+			set_coefficient(bq, -1, 0, 0, 1, 0, 0);
+		}
+	} else {
+		/* When frequency is 0 or 1, the z-transform is 1. */
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+	}
+}
+
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq)
 {
+	biquad_set_params(bq, type, freq, 0, 0);
+}
 
+void biquad_set_params(struct biquad *bq, enum biquad_type type, double freq,
+		       double Q, double gain)
+{
 	switch (type) {
 	case BQ_LOWPASS:
 		biquad_lowpass(bq, freq);
@@ -113,5 +340,89 @@ void biquad_set(struct biquad *bq, enum biquad_type type, double freq)
 	case BQ_HIGHPASS:
 		biquad_highpass(bq, freq);
 		break;
+	case BQ_BANDPASS:
+		biquad_bandpass(bq, freq, Q);
+		break;
+	case BQ_LOWSHELF:
+		biquad_lowshelf(bq, freq, gain);
+		break;
+	case BQ_HIGHSHELF:
+		biquad_highshelf(bq, freq, gain);
+		break;
+	case BQ_PEAKING:
+		biquad_peaking(bq, freq, Q, gain);
+		break;
+	case BQ_NOTCH:
+		biquad_notch(bq, freq, Q);
+		break;
+	case BQ_ALLPASS:
+		biquad_allpass(bq, freq, Q);
+		break;
+	case BQ_NONE:
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+		break;
 	}
 }
+
+void biquad_state_reset(struct biquad_state *state)
+{
+	state->x1 = 0;
+	state->x2 = 0;
+	state->y1 = 0;
+	state->y2 = 0;
+}
+
+static void biquad_process_float32_c(const struct biquad *bq,
+				     struct biquad_state *state, int samples,
+				     int channels, const float *src,
+				     float *dest)
+{
+	int c, i;
+
+	for (c = 0; c < channels; c++) {
+		float lx1 = state[c].x1;
+		float lx2 = state[c].x2;
+		float ly1 = state[c].y1;
+		float ly2 = state[c].y2;
+		float lb0 = bq[c].b0;
+		float lb1 = bq[c].b1;
+		float lb2 = bq[c].b2;
+		float la1 = bq[c].a1;
+		float la2 = bq[c].a2;
+
+		for (i = c; i < samples * channels; i += channels) {
+			float x, y;
+			x = src[i];
+			y = lb0*x + lb1*lx1 + lb2*lx2 - la1*ly1 - la2*ly2;
+			lx2 = lx1;
+			lx1 = x;
+			ly2 = ly1;
+			ly1 = y;
+			dest[i] = y;
+		}
+
+		state[c].x1 = lx1;
+		state[c].x2 = lx2;
+		state[c].y1 = ly1;
+		state[c].y2 = ly2;
+	}
+}
+
+static biquad_process_float32_func_t process_float32_func = biquad_process_float32_c;
+
+void biquad_process_float32(const struct biquad *bq, struct biquad_state *state,
+			    int samples, int channels, const float *src,
+			    float *dest)
+{
+	process_float32_func(bq, state, samples, channels, src, dest);
+}
+
+biquad_process_float32_func_t biquad_get_process_float32_func(void)
+{
+	return process_float32_func;
+}
+
+void biquad_set_process_float32_func(biquad_process_float32_func_t func)
+{
+	process_float32_func = func;
+}
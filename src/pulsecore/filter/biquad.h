@@ -23,10 +23,26 @@ struct biquad {
 	float a1, a2;
 };
 
+/* The filter history of one biquad, kept separately from the coefficients so
+ * that a bank of filters (one per channel, or one per band of an equalizer)
+ * can share the same processing code.
+ */
+struct biquad_state {
+	float x1, x2;
+	float y1, y2;
+};
+
 /* The type of the biquad filters */
 enum biquad_type {
 	BQ_LOWPASS,
 	BQ_HIGHPASS,
+	BQ_BANDPASS,
+	BQ_LOWSHELF,
+	BQ_HIGHSHELF,
+	BQ_PEAKING,
+	BQ_NOTCH,
+	BQ_ALLPASS,
+	BQ_NONE,
 };
 
 /* Initialize a biquad filter parameters from its type and parameters.
@@ -38,6 +54,36 @@ enum biquad_type {
  */
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq);
 
+/* Like biquad_set(), but also takes the parameters needed by the parametric
+ * filter types.
+ * Args:
+ *    Q - Quality factor, used by the bandpass, peaking, notch and allpass
+ *        filters.
+ *    gain - Gain in dB, used by the shelving and peaking filters.
+ */
+void biquad_set_params(struct biquad *bq, enum biquad_type type, double freq,
+		       double Q, double gain);
+
+void biquad_state_reset(struct biquad_state *state);
+
+/* Run a bank of biquad filters over interleaved samples. bq and state contain
+ * one entry per channel, so each channel can have its own coefficients. src
+ * and dest may be the same buffer. Cascades (e.g. the bands of a parametric
+ * equalizer) are built by calling this once per stage.
+ */
+typedef void (*biquad_process_float32_func_t)(const struct biquad *bq,
+					      struct biquad_state *state,
+					      int samples, int channels,
+					      const float *src, float *dest);
+
+void biquad_process_float32(const struct biquad *bq, struct biquad_state *state,
+			    int samples, int channels, const float *src,
+			    float *dest);
+
+/* The implementation is picked by the cpu init code */
+biquad_process_float32_func_t biquad_get_process_float32_func(void);
+void biquad_set_process_float32_func(biquad_process_float32_func_t func);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,192 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+#include <pulsecore/cpu-arm.h>
+
+#include "biquad.h"
+#include "crossover.h"
+
+#include <arm_neon.h>
+
+/* Same lane layout as the SSE version: four channels per vector, each with
+ * its own coefficients. NEON on ARMv7 flushes denormals to zero, so the
+ * output may differ slightly from the scalar code on decaying signals. */
+
+#define LOAD4(p, field) ({                                                      \
+    float32x4_t _v = vdupq_n_f32((p)[0].field);                                 \
+    _v = vsetq_lane_f32((p)[1].field, _v, 1);                                   \
+    _v = vsetq_lane_f32((p)[2].field, _v, 2);                                   \
+    _v = vsetq_lane_f32((p)[3].field, _v, 3);                                   \
+    _v; })
+
+#define STORE4(p, field, v)                                                     \
+    do {                                                                        \
+        (p)[0].field = vgetq_lane_f32((v), 0);                                  \
+        (p)[1].field = vgetq_lane_f32((v), 1);                                  \
+        (p)[2].field = vgetq_lane_f32((v), 2);                                  \
+        (p)[3].field = vgetq_lane_f32((v), 3);                                  \
+    } while (0)
+
+/* b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2 */
+#define BIQUAD4(x, x1, x2, y1, y2)                                              \
+    vsubq_f32(vsubq_f32(vaddq_f32(vaddq_f32(vmulq_f32(b0, (x)),                 \
+                                            vmulq_f32(b1, (x1))),               \
+                                  vmulq_f32(b2, (x2))),                         \
+                        vmulq_f32(a1, (y1))),                                   \
+              vmulq_f32(a2, (y2)))
+
+static void biquad_process_float32_neon(const struct biquad *bq, struct biquad_state *state, int samples, int channels,
+                                        const float *src, float *dest) {
+    int c, i;
+
+    for (c = 0; c + 4 <= channels; c += 4) {
+        const float32x4_t b0 = LOAD4(bq + c, b0), b1 = LOAD4(bq + c, b1), b2 = LOAD4(bq + c, b2);
+        const float32x4_t a1 = LOAD4(bq + c, a1), a2 = LOAD4(bq + c, a2);
+        float32x4_t x1 = LOAD4(state + c, x1), x2 = LOAD4(state + c, x2);
+        float32x4_t y1 = LOAD4(state + c, y1), y2 = LOAD4(state + c, y2);
+
+        for (i = 0; i < samples; i++) {
+            float32x4_t x, y;
+
+            x = vld1q_f32(src + i * channels + c);
+            y = BIQUAD4(x, x1, x2, y1, y2);
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            vst1q_f32(dest + i * channels + c, y);
+        }
+
+        STORE4(state + c, x1, x1);
+        STORE4(state + c, x2, x2);
+        STORE4(state + c, y1, y1);
+        STORE4(state + c, y2, y2);
+    }
+
+    /* The state is kept in locals, as dest could alias it */
+    for (; c < channels; c++) {
+        const struct biquad *q = &bq[c];
+        float x1 = state[c].x1, x2 = state[c].x2;
+        float y1 = state[c].y1, y2 = state[c].y2;
+
+        for (i = c; i < samples * channels; i += channels) {
+            float x = src[i], y;
+
+            y = q->b0*x + q->b1*x1 + q->b2*x2 - q->a1*y1 - q->a2*y2;
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            dest[i] = y;
+        }
+
+        state[c].x1 = x1;
+        state[c].x2 = x2;
+        state[c].y1 = y1;
+        state[c].y2 = y2;
+    }
+}
+
+static void lr4_process_mc_float32_neon(struct lr4 *lr4, int samples, int channels, float *src, float *dest) {
+    int c, i;
+
+    for (c = 0; c + 4 <= channels; c += 4) {
+        const float32x4_t b0 = LOAD4(lr4 + c, bq.b0), b1 = LOAD4(lr4 + c, bq.b1), b2 = LOAD4(lr4 + c, bq.b2);
+        const float32x4_t a1 = LOAD4(lr4 + c, bq.a1), a2 = LOAD4(lr4 + c, bq.a2);
+        float32x4_t x1 = LOAD4(lr4 + c, x1), x2 = LOAD4(lr4 + c, x2);
+        float32x4_t y1 = LOAD4(lr4 + c, y1), y2 = LOAD4(lr4 + c, y2);
+        float32x4_t z1 = LOAD4(lr4 + c, z1), z2 = LOAD4(lr4 + c, z2);
+
+        for (i = 0; i < samples; i++) {
+            float32x4_t x, y, z;
+
+            x = vld1q_f32(src + i * channels + c);
+            y = BIQUAD4(x, x1, x2, y1, y2);
+            z = BIQUAD4(y, y1, y2, z1, z2);
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            z2 = z1;
+            z1 = z;
+            vst1q_f32(dest + i * channels + c, z);
+        }
+
+        STORE4(lr4 + c, x1, x1);
+        STORE4(lr4 + c, x2, x2);
+        STORE4(lr4 + c, y1, y1);
+        STORE4(lr4 + c, y2, y2);
+        STORE4(lr4 + c, z1, z1);
+        STORE4(lr4 + c, z2, z2);
+    }
+
+    for (; c < channels; c++)
+        lr4_process_float32(&lr4[c], samples, channels, &src[c], &dest[c]);
+}
+
+static void lr4_process_mc_s16_neon(struct lr4 *lr4, int samples, int channels, short *src, short *dest) {
+    int c, i;
+
+    for (c = 0; c + 4 <= channels; c += 4) {
+        const float32x4_t b0 = LOAD4(lr4 + c, bq.b0), b1 = LOAD4(lr4 + c, bq.b1), b2 = LOAD4(lr4 + c, bq.b2);
+        const float32x4_t a1 = LOAD4(lr4 + c, bq.a1), a2 = LOAD4(lr4 + c, bq.a2);
+        float32x4_t x1 = LOAD4(lr4 + c, x1), x2 = LOAD4(lr4 + c, x2);
+        float32x4_t y1 = LOAD4(lr4 + c, y1), y2 = LOAD4(lr4 + c, y2);
+        float32x4_t z1 = LOAD4(lr4 + c, z1), z2 = LOAD4(lr4 + c, z2);
+
+        for (i = 0; i < samples; i++) {
+            float32x4_t x, y, z;
+
+            x = vcvtq_f32_s32(vmovl_s16(vld1_s16(src + i * channels + c)));
+            y = BIQUAD4(x, x1, x2, y1, y2);
+            z = BIQUAD4(y, y1, y2, z1, z2);
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            z2 = z1;
+            z1 = z;
+
+            /* vcvtq_s32_f32 truncates like the scalar code does */
+            vst1_s16(dest + i * channels + c, vqmovn_s32(vcvtq_s32_f32(z)));
+        }
+
+        STORE4(lr4 + c, x1, x1);
+        STORE4(lr4 + c, x2, x2);
+        STORE4(lr4 + c, y1, y1);
+        STORE4(lr4 + c, y2, y2);
+        STORE4(lr4 + c, z1, z1);
+        STORE4(lr4 + c, z2, z2);
+    }
+
+    for (; c < channels; c++)
+        lr4_process_s16(&lr4[c], samples, channels, &src[c], &dest[c]);
+}
+
+void pa_biquad_func_init_neon(pa_cpu_arm_flag_t flags) {
+    pa_log_info("Initialising ARM NEON optimized biquad filters.");
+
+    biquad_set_process_float32_func(biquad_process_float32_neon);
+    lr4_set_process_mc_float32_func(lr4_process_mc_float32_neon);
+    lr4_set_process_mc_s16_func(lr4_process_mc_s16_neon);
+}
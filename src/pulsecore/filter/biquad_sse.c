@@ -0,0 +1,216 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+#include <pulsecore/cpu-x86.h>
+
+#include "biquad.h"
+#include "crossover.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+/* The filters below work on four channels at a time, one channel per SIMD
+ * lane. Every lane has its own coefficients, so e.g. the LFE channel can be
+ * lowpassed while the others are highpassed. The arithmetic is done in the
+ * same order as the scalar code, but the results are not guaranteed to be
+ * bit-identical, as the compiler may fuse the multiply-adds of the scalar
+ * code. Channels that do not fill a complete vector are handed to the scalar
+ * code. */
+
+#define LOAD4(p, field) _mm_setr_ps((p)[0].field, (p)[1].field, (p)[2].field, (p)[3].field)
+
+#define STORE4(p, field, v)                         \
+    do {                                            \
+        PA_DECLARE_ALIGNED(16, float, _t[4]);       \
+        _mm_store_ps(_t, (v));                      \
+        (p)[0].field = _t[0];                       \
+        (p)[1].field = _t[1];                       \
+        (p)[2].field = _t[2];                       \
+        (p)[3].field = _t[3];                       \
+    } while (0)
+
+/* b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2 */
+#define BIQUAD4(x, x1, x2, y1, y2)                                      \
+    _mm_sub_ps(_mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, (x)),    \
+                                                _mm_mul_ps(b1, (x1))),  \
+                                     _mm_mul_ps(b2, (x2))),             \
+                          _mm_mul_ps(a1, (y1))),                        \
+               _mm_mul_ps(a2, (y2)))
+
+__attribute__ ((target ("sse")))
+static void biquad_process_float32_sse(const struct biquad *bq, struct biquad_state *state, int samples, int channels,
+                                       const float *src, float *dest) {
+    int c, i;
+
+    for (c = 0; c + 4 <= channels; c += 4) {
+        const __m128 b0 = LOAD4(bq + c, b0), b1 = LOAD4(bq + c, b1), b2 = LOAD4(bq + c, b2);
+        const __m128 a1 = LOAD4(bq + c, a1), a2 = LOAD4(bq + c, a2);
+        __m128 x1 = LOAD4(state + c, x1), x2 = LOAD4(state + c, x2);
+        __m128 y1 = LOAD4(state + c, y1), y2 = LOAD4(state + c, y2);
+
+        for (i = 0; i < samples; i++) {
+            __m128 x, y;
+
+            x = _mm_loadu_ps(src + i * channels + c);
+            y = BIQUAD4(x, x1, x2, y1, y2);
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            _mm_storeu_ps(dest + i * channels + c, y);
+        }
+
+        STORE4(state + c, x1, x1);
+        STORE4(state + c, x2, x2);
+        STORE4(state + c, y1, y1);
+        STORE4(state + c, y2, y2);
+    }
+
+    /* The state is kept in locals, as dest could alias it */
+    for (; c < channels; c++) {
+        const struct biquad *q = &bq[c];
+        float x1 = state[c].x1, x2 = state[c].x2;
+        float y1 = state[c].y1, y2 = state[c].y2;
+
+        for (i = c; i < samples * channels; i += channels) {
+            float x = src[i], y;
+
+            y = q->b0*x + q->b1*x1 + q->b2*x2 - q->a1*y1 - q->a2*y2;
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            dest[i] = y;
+        }
+
+        state[c].x1 = x1;
+        state[c].x2 = x2;
+        state[c].y1 = y1;
+        state[c].y2 = y2;
+    }
+}
+
+__attribute__ ((target ("sse")))
+static void lr4_process_mc_float32_sse(struct lr4 *lr4, int samples, int channels, float *src, float *dest) {
+    int c, i;
+
+    for (c = 0; c + 4 <= channels; c += 4) {
+        const __m128 b0 = LOAD4(lr4 + c, bq.b0), b1 = LOAD4(lr4 + c, bq.b1), b2 = LOAD4(lr4 + c, bq.b2);
+        const __m128 a1 = LOAD4(lr4 + c, bq.a1), a2 = LOAD4(lr4 + c, bq.a2);
+        __m128 x1 = LOAD4(lr4 + c, x1), x2 = LOAD4(lr4 + c, x2);
+        __m128 y1 = LOAD4(lr4 + c, y1), y2 = LOAD4(lr4 + c, y2);
+        __m128 z1 = LOAD4(lr4 + c, z1), z2 = LOAD4(lr4 + c, z2);
+
+        for (i = 0; i < samples; i++) {
+            __m128 x, y, z;
+
+            x = _mm_loadu_ps(src + i * channels + c);
+            y = BIQUAD4(x, x1, x2, y1, y2);
+            z = BIQUAD4(y, y1, y2, z1, z2);
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            z2 = z1;
+            z1 = z;
+            _mm_storeu_ps(dest + i * channels + c, z);
+        }
+
+        STORE4(lr4 + c, x1, x1);
+        STORE4(lr4 + c, x2, x2);
+        STORE4(lr4 + c, y1, y1);
+        STORE4(lr4 + c, y2, y2);
+        STORE4(lr4 + c, z1, z1);
+        STORE4(lr4 + c, z2, z2);
+    }
+
+    for (; c < channels; c++)
+        lr4_process_float32(&lr4[c], samples, channels, &src[c], &dest[c]);
+}
+
+/* Needs SSE2 for the integer conversions */
+__attribute__ ((target ("sse2")))
+static void lr4_process_mc_s16_sse2(struct lr4 *lr4, int samples, int channels, short *src, short *dest) {
+    int c, i;
+
+    for (c = 0; c + 4 <= channels; c += 4) {
+        const __m128 b0 = LOAD4(lr4 + c, bq.b0), b1 = LOAD4(lr4 + c, bq.b1), b2 = LOAD4(lr4 + c, bq.b2);
+        const __m128 a1 = LOAD4(lr4 + c, bq.a1), a2 = LOAD4(lr4 + c, bq.a2);
+        __m128 x1 = LOAD4(lr4 + c, x1), x2 = LOAD4(lr4 + c, x2);
+        __m128 y1 = LOAD4(lr4 + c, y1), y2 = LOAD4(lr4 + c, y2);
+        __m128 z1 = LOAD4(lr4 + c, z1), z2 = LOAD4(lr4 + c, z2);
+
+        for (i = 0; i < samples; i++) {
+            __m128i xi;
+            __m128 x, y, z;
+
+            /* Load four samples and sign extend them to 32 bit */
+            xi = _mm_loadl_epi64((const __m128i *) (src + i * channels + c));
+            xi = _mm_srai_epi32(_mm_unpacklo_epi16(xi, xi), 16);
+            x = _mm_cvtepi32_ps(xi);
+
+            y = BIQUAD4(x, x1, x2, y1, y2);
+            z = BIQUAD4(y, y1, y2, z1, z2);
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            z2 = z1;
+            z1 = z;
+
+            /* Truncate like the scalar code does, then saturate to 16 bit */
+            xi = _mm_cvttps_epi32(z);
+            xi = _mm_packs_epi32(xi, xi);
+            _mm_storel_epi64((__m128i *) (dest + i * channels + c), xi);
+        }
+
+        STORE4(lr4 + c, x1, x1);
+        STORE4(lr4 + c, x2, x2);
+        STORE4(lr4 + c, y1, y1);
+        STORE4(lr4 + c, y2, y2);
+        STORE4(lr4 + c, z1, z1);
+        STORE4(lr4 + c, z2, z2);
+    }
+
+    for (; c < channels; c++)
+        lr4_process_s16(&lr4[c], samples, channels, &src[c], &dest[c]);
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_biquad_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_SSE) {
+        pa_log_info("Initialising SSE optimized biquad filters.");
+        biquad_set_process_float32_func(biquad_process_float32_sse);
+        lr4_set_process_mc_float32_func(lr4_process_mc_float32_sse);
+    }
+
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized crossover filters.");
+        lr4_set_process_mc_s16_func(lr4_process_mc_s16_sse2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
@@ -95,3 +95,52 @@ void lr4_process_s16(struct lr4 *lr4, int samples, int channels, short *src, sho
 	lr4->z1 = lz1;
 	lr4->z2 = lz2;
 }
+
+static void lr4_process_mc_float32_c(struct lr4 *lr4, int samples, int channels, float *src, float *dest)
+{
+	int i;
+
+	for (i = 0; i < channels; i++)
+		lr4_process_float32(&lr4[i], samples, channels, &src[i], &dest[i]);
+}
+
+static void lr4_process_mc_s16_c(struct lr4 *lr4, int samples, int channels, short *src, short *dest)
+{
+	int i;
+
+	for (i = 0; i < channels; i++)
+		lr4_process_s16(&lr4[i], samples, channels, &src[i], &dest[i]);
+}
+
+static lr4_process_mc_float32_func_t process_mc_float32_func = lr4_process_mc_float32_c;
+static lr4_process_mc_s16_func_t process_mc_s16_func = lr4_process_mc_s16_c;
+
+void lr4_process_mc_float32(struct lr4 *lr4, int samples, int channels, float *src, float *dest)
+{
+	process_mc_float32_func(lr4, samples, channels, src, dest);
+}
+
+void lr4_process_mc_s16(struct lr4 *lr4, int samples, int channels, short *src, short *dest)
+{
+	process_mc_s16_func(lr4, samples, channels, src, dest);
+}
+
+lr4_process_mc_float32_func_t lr4_get_process_mc_float32_func(void)
+{
+	return process_mc_float32_func;
+}
+
+void lr4_set_process_mc_float32_func(lr4_process_mc_float32_func_t func)
+{
+	process_mc_float32_func = func;
+}
+
+lr4_process_mc_s16_func_t lr4_get_process_mc_s16_func(void)
+{
+	return process_mc_s16_func;
+}
+
+void lr4_set_process_mc_s16_func(lr4_process_mc_s16_func_t func)
+{
+	process_mc_s16_func = func;
+}
@@ -26,4 +26,18 @@ void lr4_set(struct lr4 *lr4, enum biquad_type type, float freq);
 void lr4_process_float32(struct lr4 *lr4, int samples, int channels, float *src, float *dest);
 void lr4_process_s16(struct lr4 *lr4, int samples, int channels, short *src, short *dest);
 
+/* Process all channels of an interleaved buffer at once. lr4 points to an
+ * array of one filter per channel. src and dest may be the same buffer. The
+ * optimized implementations put channels into SIMD lanes. */
+typedef void (*lr4_process_mc_float32_func_t)(struct lr4 *lr4, int samples, int channels, float *src, float *dest);
+typedef void (*lr4_process_mc_s16_func_t)(struct lr4 *lr4, int samples, int channels, short *src, short *dest);
+
+void lr4_process_mc_float32(struct lr4 *lr4, int samples, int channels, float *src, float *dest);
+void lr4_process_mc_s16(struct lr4 *lr4, int samples, int channels, short *src, short *dest);
+
+lr4_process_mc_float32_func_t lr4_get_process_mc_float32_func(void);
+void lr4_set_process_mc_float32_func(lr4_process_mc_float32_func_t func);
+lr4_process_mc_s16_func_t lr4_get_process_mc_s16_func(void);
+void lr4_set_process_mc_s16_func(lr4_process_mc_s16_func_t func);
+
 #endif /* CROSSOVER_H_ */
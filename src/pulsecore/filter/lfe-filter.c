@@ -90,17 +90,13 @@ static void process_block(pa_lfe_filter_t *f, pa_memchunk *buf, bool store_resul
     void *garbage = store_result ? NULL : pa_xmalloc(buf->length);
 
     if (f->ss.format == PA_SAMPLE_FLOAT32NE) {
-        int i;
         float *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_float32(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
+        lr4_process_mc_float32(f->lr4, samples, f->cm.channels, data, garbage ? garbage : data);
         pa_memblock_release(buf->memblock);
     }
     else if (f->ss.format == PA_SAMPLE_S16NE) {
-        int i;
         short *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_s16(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
+        lr4_process_mc_s16(f->lr4, samples, f->cm.channels, data, garbage ? garbage : data);
         pa_memblock_release(buf->memblock);
     }
     else pa_assert_not_reached();
@@ -0,0 +1,147 @@
+#ifndef foog711ssehfoo
+#define foog711ssehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <emmintrin.h>
+
+/* SSE2 versions of the G.711 conversions in g711.c, four samples at a time
+ * in 32 bit lanes. Instead of tables and segment searches, the variable
+ * shifts are done by multiplying with powers of two in floating point,
+ * which is exact for these magnitudes, and the segment number of a value is
+ * taken from the exponent of its floating point representation. The results
+ * are identical to the scalar code. */
+
+/* 2^e for integer lanes 0 <= e < 128 */
+__attribute__ ((target ("sse2")))
+static inline __m128 g711_pow2_sse2(__m128i e) {
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+}
+
+/* floor(log2(x)) for integer lanes 0 < x < 2^24 */
+__attribute__ ((target ("sse2")))
+static inline __m128i g711_log2_sse2(__m128i x) {
+    return _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(x)), 23), _mm_set1_epi32(127));
+}
+
+/* x >> s for integer lanes 0 <= x < 2^24, 0 <= s < 127 */
+__attribute__ ((target ("sse2")))
+static inline __m128i g711_shift_right_sse2(__m128i x, __m128i s) {
+    return _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(x), g711_pow2_sse2(_mm_sub_epi32(_mm_setzero_si128(), s))));
+}
+
+/* Returns a where mask is set, b elsewhere */
+__attribute__ ((target ("sse2")))
+static inline __m128i g711_select_sse2(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* Like st_ulaw2linear16() */
+__attribute__ ((target ("sse2")))
+static inline __m128i g711_ulaw_decode_sse2(__m128i u) {
+    __m128i m, e, t, neg;
+
+    u = _mm_andnot_si128(u, _mm_set1_epi32(0xFF));
+
+    m = _mm_and_si128(u, _mm_set1_epi32(0x0F));
+    e = _mm_and_si128(_mm_srli_epi32(u, 4), _mm_set1_epi32(0x07));
+
+    /* (((m << 3) + BIAS) << e) - BIAS */
+    t = _mm_add_epi32(_mm_slli_epi32(m, 3), _mm_set1_epi32(0x84));
+    t = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(t), g711_pow2_sse2(e)));
+    t = _mm_sub_epi32(t, _mm_set1_epi32(0x84));
+
+    neg = _mm_cmpeq_epi32(_mm_and_si128(u, _mm_set1_epi32(0x80)), _mm_set1_epi32(0x80));
+
+    return _mm_sub_epi32(_mm_xor_si128(t, neg), neg);
+}
+
+/* Like st_14linear2ulaw(), x holds 14 bit values */
+__attribute__ ((target ("sse2")))
+static inline __m128i g711_ulaw_encode_sse2(__m128i x) {
+    __m128i sign, mag, seg, mant, mask;
+
+    sign = _mm_srai_epi32(x, 31);
+    mag = _mm_sub_epi32(_mm_xor_si128(x, sign), sign);
+
+    /* Magnitudes above CLIP end up in the highest code, and so does
+     * CLIP - 1 already, so clipping there keeps us below 2^13 */
+    mag = g711_select_sse2(_mm_cmpgt_epi32(mag, _mm_set1_epi32(8158)), _mm_set1_epi32(8158), mag);
+    mag = _mm_add_epi32(mag, _mm_set1_epi32(0x84 >> 2));
+
+    seg = _mm_sub_epi32(g711_log2_sse2(mag), _mm_set1_epi32(5));
+    mant = g711_shift_right_sse2(mag, _mm_add_epi32(seg, _mm_set1_epi32(1)));
+    mant = _mm_or_si128(_mm_slli_epi32(seg, 4), _mm_and_si128(mant, _mm_set1_epi32(0x0F)));
+
+    mask = _mm_xor_si128(_mm_set1_epi32(0xFF), _mm_and_si128(sign, _mm_set1_epi32(0x80)));
+
+    return _mm_xor_si128(mant, mask);
+}
+
+/* Like st_alaw2linear16() */
+__attribute__ ((target ("sse2")))
+static inline __m128i g711_alaw_decode_sse2(__m128i a) {
+    __m128i m, seg, nz, t, neg;
+
+    a = _mm_xor_si128(a, _mm_set1_epi32(0x55));
+
+    m = _mm_and_si128(a, _mm_set1_epi32(0x0F));
+    seg = _mm_and_si128(_mm_srli_epi32(a, 4), _mm_set1_epi32(0x07));
+    nz = _mm_cmpgt_epi32(seg, _mm_setzero_si128());
+
+    /* ((m << 4) + 8) for segment 0, ((m << 4) + 0x108) << (seg - 1) otherwise */
+    t = _mm_add_epi32(_mm_slli_epi32(m, 4), _mm_set1_epi32(8));
+    t = _mm_add_epi32(t, _mm_and_si128(nz, _mm_set1_epi32(0x100)));
+    seg = _mm_and_si128(_mm_sub_epi32(seg, _mm_set1_epi32(1)), nz);
+    t = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(t), g711_pow2_sse2(seg)));
+
+    neg = _mm_cmpeq_epi32(_mm_and_si128(a, _mm_set1_epi32(0x80)), _mm_setzero_si128());
+
+    return _mm_sub_epi32(_mm_xor_si128(t, neg), neg);
+}
+
+/* Like st_13linear2alaw(), x holds 13 bit values */
+__attribute__ ((target ("sse2")))
+static inline __m128i g711_alaw_encode_sse2(__m128i x) {
+    __m128i sign, mag, seg, shift, mant, mask;
+
+    /* -x - 1 for negative values */
+    sign = _mm_srai_epi32(x, 31);
+    mag = _mm_xor_si128(x, sign);
+    mag = g711_select_sse2(_mm_cmpgt_epi32(mag, _mm_set1_epi32(0xFFF)), _mm_set1_epi32(0xFFF), mag);
+
+    /* Setting the lowest bit keeps 0 in segment 0 without changing the
+     * segment of any other value */
+    seg = _mm_sub_epi32(g711_log2_sse2(_mm_or_si128(mag, _mm_set1_epi32(1))), _mm_set1_epi32(4));
+    seg = _mm_and_si128(seg, _mm_cmpgt_epi32(seg, _mm_setzero_si128()));
+
+    /* Segments 0 and 1 both shift by one */
+    shift = g711_select_sse2(_mm_cmpgt_epi32(seg, _mm_setzero_si128()), seg, _mm_set1_epi32(1));
+    mant = g711_shift_right_sse2(mag, shift);
+    mant = _mm_or_si128(_mm_slli_epi32(seg, 4), _mm_and_si128(mant, _mm_set1_epi32(0x0F)));
+
+    mask = _mm_xor_si128(_mm_set1_epi32(0xD5), _mm_and_si128(sign, _mm_set1_epi32(0x80)));
+
+    return _mm_xor_si128(mant, mask);
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+#endif
@@ -63,6 +63,8 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-error.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/mutex.h>
 #include <pulsecore/once.h>
 #include <pulsecore/ratelimit.h>
 #include <pulsecore/thread.h>
@@ -83,6 +85,15 @@
 #define ENV_LOG_NO_RATELIMIT "PULSE_LOG_NO_RATE_LIMIT"
 #define LOG_MAX_SUFFIX_NUMBER 99
 
+/* In asynchronous mode every thread gets a ring of this many records, which
+ * the drain thread empties every ASYNC_DRAIN_INTERVAL_MSEC. Longer messages
+ * are truncated. The rings are allocated up front, threads beyond
+ * ASYNC_RINGS log synchronously. */
+#define ASYNC_RINGS 16
+#define ASYNC_RING_RECORDS 128
+#define ASYNC_TEXT_MAX 1024
+#define ASYNC_DRAIN_INTERVAL_MSEC 10
+
 static char *ident = NULL; /* in local charset format */
 static pa_log_target target = { PA_LOG_STDERR, NULL };
 static pa_log_target_type_t target_override;
@@ -94,6 +105,47 @@ static bool no_rate_limit = false;
 static int log_fd = -1;
 static int write_type = 0;
 
+struct async_record {
+    pa_usec_t time;
+    pa_log_level_t level;
+    const char *file;
+    int line;
+    const char *func;
+    char text[ASYNC_TEXT_MAX];
+};
+
+/* Written by one thread only, read by the drain thread only. The indices only
+ * ever increase, the ring is full if they are ASYNC_RING_RECORDS apart. A
+ * thread claims a free ring by setting used, the drain thread frees it again
+ * once the thread is dead and the ring is empty. */
+struct async_ring {
+    pa_atomic_t used;
+    pa_atomic_t write_index;
+    pa_atomic_t read_index;
+    pa_atomic_t dropped;
+    pa_atomic_t dead;
+    unsigned reported_dropped;
+    char thread_name[64];
+    struct async_record *records;
+};
+
+static void async_ring_release(void *userdata);
+
+PA_STATIC_TLS_DECLARE(async_ring, async_ring_release);
+PA_STATIC_TLS_DECLARE_NO_FREE(async_drain);
+
+/* The mutex only serializes pa_log_set_async(). The rings are allocated the
+ * first time async mode is turned on and are never freed, since threads
+ * keep pointers to them. Loggers count themselves in async_writers while
+ * they look at async_enabled and fill in a record, so that turning async
+ * mode off can wait for them before the last drain. */
+static pa_static_mutex async_mutex = PA_STATIC_MUTEX_INIT;
+static struct async_ring *async_rings = NULL;
+static pa_thread *async_thread = NULL;
+static pa_atomic_t async_enabled = PA_ATOMIC_INIT(0);
+static pa_atomic_t async_writers = PA_ATOMIC_INIT(0);
+static pa_atomic_t async_quit = PA_ATOMIC_INIT(0);
+
 #ifdef HAVE_SYSLOG_H
 static const int level_to_syslog[] = {
     [PA_LOG_ERROR] = LOG_ERR,
@@ -368,69 +420,56 @@ static void log_syslog(pa_log_level_t level, char *t, char *timestamp, char *loc
 }
 #endif
 
-void pa_log_levelv_meta(
+/* Writes out one message, which may span multiple lines. The thread name is
+ * looked up if NULL is passed, now only matters if timestamps are printed. */
+static void log_text(
         pa_log_level_t level,
-        const char*file,
+        const char *file,
         int line,
         const char *func,
-        const char *format,
-        va_list ap) {
+        const char *thread_name,
+        pa_usec_t now,
+        char *text,
+        char *bt,
+        int *saved_errno) {
 
     char *t, *n;
-    int saved_errno = errno;
-    char *bt = NULL;
     pa_log_target_type_t _target;
-    pa_log_level_t _maximum_level;
-    unsigned _show_backtrace;
     pa_log_flags_t _flags;
-
-    /* We don't use dynamic memory allocation here to minimize the hit
-     * in RT threads */
-    char text[16*1024], location[128], timestamp[32];
-
-    pa_assert(level < PA_LOG_LEVEL_MAX);
-    pa_assert(format);
-
-    init_defaults();
+    char location[128], timestamp[32];
 
     _target = target_override_set ? target_override : target.type;
-    _maximum_level = PA_MAX(maximum_level, maximum_level_override);
-    _show_backtrace = PA_MAX(show_backtrace, show_backtrace_override);
     _flags = flags | flags_override;
 
-    if (PA_LIKELY(level > _maximum_level)) {
-        errno = saved_errno;
-        return;
-    }
-
-    pa_vsnprintf(text, sizeof(text), format, ap);
+    if ((_flags & (PA_LOG_PRINT_META|PA_LOG_PRINT_FILE)) && file && !thread_name)
+        thread_name = pa_thread_get_name(pa_thread_self());
 
     if ((_flags & PA_LOG_PRINT_META) && file && line > 0 && func)
         pa_snprintf(location, sizeof(location), "[%s][%s:%i %s()] ",
-                    pa_strnull(pa_thread_get_name(pa_thread_self())), file, line, func);
+                    pa_strnull(thread_name), file, line, func);
     else if ((_flags & (PA_LOG_PRINT_META|PA_LOG_PRINT_FILE)) && file)
         pa_snprintf(location, sizeof(location), "[%s] %s: ",
-                    pa_strnull(pa_thread_get_name(pa_thread_self())), pa_path_get_filename(file));
+                    pa_strnull(thread_name), pa_path_get_filename(file));
     else
         location[0] = 0;
 
     if (_flags & PA_LOG_PRINT_TIME) {
         static pa_usec_t start, last;
-        pa_usec_t u, a, r;
-
-        u = pa_rtclock_now();
+        pa_usec_t a, r;
 
         PA_ONCE_BEGIN {
-            start = u;
-            last = u;
+            start = now;
+            last = now;
         } PA_ONCE_END;
 
-        r = u - last;
-        a = u - start;
+        /* Messages from the drain thread may be older than the last
+         * synchronously written one */
+        r = now > last ? now - last : 0;
+        a = now > start ? now - start : 0;
 
         /* This is not thread safe, but this is a debugging tool only
          * anyway. */
-        last = u;
+        last = now;
 
         pa_snprintf(timestamp, sizeof(timestamp), "(%4llu.%03llu|%4llu.%03llu) ",
                     (unsigned long long) (a / PA_USEC_PER_SEC),
@@ -441,11 +480,6 @@ void pa_log_levelv_meta(
     } else
         timestamp[0] = 0;
 
-#ifdef HAVE_EXECINFO_H
-    if (_show_backtrace > 0)
-        bt = get_backtrace(_show_backtrace);
-#endif
-
     if (!pa_utf8_valid(text))
         pa_logl(level, "Invalid UTF-8 string following below:");
 
@@ -523,7 +557,7 @@ void pa_log_levelv_meta(
 #else
                     pa_log_target new_target = { .type = PA_LOG_STDERR, .file = NULL };
 
-                    saved_errno = errno;
+                    *saved_errno = errno;
                     fprintf(stderr, "%s\n", "Error writing logs to the journal. Redirect log messages to console.");
                     fprintf(stderr, "%s\n", t);
 #endif
@@ -552,7 +586,7 @@ void pa_log_levelv_meta(
                             || (bt && pa_write(log_fd, bt, strlen(bt), &write_type) < 0)
                             || (pa_write(log_fd, "\n", 1, &write_type) < 0)) {
                         pa_log_target new_target = { .type = PA_LOG_STDERR, .file = NULL };
-                        saved_errno = errno;
+                        *saved_errno = errno;
                         fprintf(stderr, "%s\n", "Error writing logs to a file descriptor. Redirect log messages to console.");
                         fprintf(stderr, "%s %s\n", metadata, t);
                         pa_log_set_target(&new_target);
@@ -569,6 +603,282 @@ void pa_log_levelv_meta(
         }
     }
 
+}
+
+static void async_rings_alloc(void) {
+    unsigned i;
+
+    async_rings = pa_xnew0(struct async_ring, ASYNC_RINGS);
+
+    /* Touch the records here, not on the first message in a realtime
+     * thread */
+    for (i = 0; i < ASYNC_RINGS; i++) {
+        async_rings[i].records = pa_xnew(struct async_record, ASYNC_RING_RECORDS);
+        memset(async_rings[i].records, 0, sizeof(struct async_record) * ASYNC_RING_RECORDS);
+    }
+}
+
+/* Claims a free ring for the calling thread, without locking or allocating
+ * anything */
+static struct async_ring *async_ring_claim(void) {
+    unsigned i;
+
+    for (i = 0; i < ASYNC_RINGS; i++) {
+        struct async_ring *r = &async_rings[i];
+
+        if (!pa_atomic_cmpxchg(&r->used, 0, 1))
+            continue;
+
+        pa_strlcpy(r->thread_name, pa_strnull(pa_thread_get_name(pa_thread_self())), sizeof(r->thread_name));
+        PA_STATIC_TLS_SET(async_ring, r);
+
+        return r;
+    }
+
+    return NULL;
+}
+
+/* Called when a thread that has a ring exits. The drain thread frees the
+ * ring once it's empty. */
+static void async_ring_release(void *userdata) {
+    struct async_ring *r = userdata;
+
+    pa_atomic_store(&r->dead, 1);
+}
+
+/* Formats the message into the ring of the calling thread. Returns false if
+ * the message needs to be written synchronously. */
+static bool log_async(
+        pa_log_level_t level,
+        const char *file,
+        int line,
+        const char *func,
+        const char *format,
+        va_list ap) {
+
+    struct async_ring *r;
+    struct async_record *record;
+    unsigned w;
+    bool ret = false;
+
+    pa_atomic_inc(&async_writers);
+
+    if (!pa_atomic_load(&async_enabled)) {
+        pa_atomic_dec(&async_writers);
+
+        /* Async mode was just turned off. Our earlier messages come
+         * first. */
+        if ((r = PA_STATIC_TLS_GET(async_ring)))
+            while (pa_atomic_load(&r->read_index) != pa_atomic_load(&r->write_index))
+                pa_thread_yield();
+
+        return false;
+    }
+
+    if (!(r = PA_STATIC_TLS_GET(async_ring))) {
+        /* The drain thread writes its own messages right away */
+        if (PA_STATIC_TLS_GET(async_drain))
+            goto finish;
+
+        if (!(r = async_ring_claim()))
+            goto finish;
+    }
+
+    ret = true;
+    w = (unsigned) pa_atomic_load(&r->write_index);
+
+    if (w - (unsigned) pa_atomic_load(&r->read_index) >= ASYNC_RING_RECORDS) {
+        pa_atomic_inc(&r->dropped);
+        goto finish;
+    }
+
+    record = &r->records[w % ASYNC_RING_RECORDS];
+    record->time = pa_rtclock_now();
+    record->level = level;
+    record->file = file;
+    record->line = line;
+    record->func = func;
+    pa_vsnprintf(record->text, sizeof(record->text), format, ap);
+
+    pa_atomic_store(&r->write_index, (int) (w + 1));
+
+finish:
+    pa_atomic_dec(&async_writers);
+
+    return ret;
+}
+
+/* Called from the drain thread, or after it quit. Writes out all pending
+ * messages, oldest first. */
+static void async_drain(void) {
+    int saved_errno = errno;
+    unsigned k;
+
+    for (;;) {
+        struct async_ring *oldest = NULL;
+        struct async_record *record = NULL;
+
+        for (k = 0; k < ASYNC_RINGS; k++) {
+            struct async_ring *r = &async_rings[k];
+            unsigned i = (unsigned) pa_atomic_load(&r->read_index);
+
+            if (i == (unsigned) pa_atomic_load(&r->write_index))
+                continue;
+
+            if (!oldest || r->records[i % ASYNC_RING_RECORDS].time < record->time) {
+                oldest = r;
+                record = &r->records[i % ASYNC_RING_RECORDS];
+            }
+        }
+
+        if (!oldest)
+            break;
+
+        log_text(record->level, record->file, record->line, record->func, oldest->thread_name, record->time,
+                 record->text, NULL, &saved_errno);
+
+        pa_atomic_inc(&oldest->read_index);
+    }
+
+    for (k = 0; k < ASYNC_RINGS; k++) {
+        struct async_ring *r = &async_rings[k];
+        unsigned dropped = (unsigned) pa_atomic_load(&r->dropped);
+
+        if (!pa_atomic_load(&r->used))
+            continue;
+
+        if (dropped != r->reported_dropped) {
+            char text[128];
+
+            pa_snprintf(text, sizeof(text), "Dropped %u log messages of thread %s.",
+                        dropped - r->reported_dropped, r->thread_name);
+            log_text(PA_LOG_WARN, __FILE__, __LINE__, __func__, NULL, pa_rtclock_now(), text, NULL, &saved_errno);
+
+            r->reported_dropped = dropped;
+        }
+
+        if (pa_atomic_load(&r->dead) && pa_atomic_load(&r->read_index) == pa_atomic_load(&r->write_index)) {
+            pa_atomic_store(&r->write_index, 0);
+            pa_atomic_store(&r->read_index, 0);
+            pa_atomic_store(&r->dropped, 0);
+            pa_atomic_store(&r->dead, 0);
+            r->reported_dropped = 0;
+            pa_atomic_store(&r->used, 0);
+        }
+    }
+
+    errno = saved_errno;
+}
+
+static void async_thread_func(void *userdata) {
+    PA_STATIC_TLS_SET(async_drain, PA_UINT_TO_PTR(1));
+
+    for (;;) {
+        bool quit = pa_atomic_load(&async_quit);
+
+        async_drain();
+
+        if (quit)
+            break;
+
+        pa_msleep(ASYNC_DRAIN_INTERVAL_MSEC);
+    }
+}
+
+void pa_log_set_async(bool enable) {
+    pa_mutex *m = pa_static_mutex_get(&async_mutex, false, false);
+
+    pa_mutex_lock(m);
+
+    if (enable == !!async_thread) {
+        pa_mutex_unlock(m);
+        return;
+    }
+
+    if (enable) {
+        if (!async_rings)
+            async_rings_alloc();
+
+        pa_atomic_store(&async_quit, 0);
+
+        if ((async_thread = pa_thread_new("log", async_thread_func, NULL)))
+            pa_atomic_store(&async_enabled, 1);
+
+        pa_mutex_unlock(m);
+
+        if (!async_thread)
+            pa_log_warn("Failed to start log thread, logging synchronously.");
+
+        return;
+    }
+
+    pa_atomic_store(&async_enabled, 0);
+
+    /* Whoever saw async mode still on has to finish its record first */
+    while (pa_atomic_load(&async_writers) > 0)
+        pa_thread_yield();
+
+    /* The thread does a last round before it quits */
+    pa_atomic_store(&async_quit, 1);
+    pa_thread_free(async_thread);
+    async_thread = NULL;
+
+    async_drain();
+
+    pa_mutex_unlock(m);
+}
+
+void pa_log_levelv_meta(
+        pa_log_level_t level,
+        const char*file,
+        int line,
+        const char *func,
+        const char *format,
+        va_list ap) {
+
+    int saved_errno = errno;
+    char *bt = NULL;
+    pa_log_level_t _maximum_level;
+    unsigned _show_backtrace;
+
+    /* We don't use dynamic memory allocation here to minimize the hit
+     * in RT threads */
+    char text[16*1024];
+
+    pa_assert(level < PA_LOG_LEVEL_MAX);
+    pa_assert(format);
+
+    init_defaults();
+
+    _maximum_level = PA_MAX(maximum_level, maximum_level_override);
+    _show_backtrace = PA_MAX(show_backtrace, show_backtrace_override);
+
+    if (PA_LIKELY(level > _maximum_level)) {
+        errno = saved_errno;
+        return;
+    }
+
+    /* Errors are still written out right away, as they are often followed
+     * by an abort(). Backtraces only make sense in the calling thread. A
+     * thread with a ring goes through log_async() even after async mode was
+     * turned off, so that it waits for its messages to be written out. */
+    if ((pa_atomic_load(&async_enabled) || PA_STATIC_TLS_GET(async_ring)) &&
+        level > PA_LOG_ERROR && _show_backtrace == 0 &&
+        log_async(level, file, line, func, format, ap)) {
+        errno = saved_errno;
+        return;
+    }
+
+    pa_vsnprintf(text, sizeof(text), format, ap);
+
+#ifdef HAVE_EXECINFO_H
+    if (_show_backtrace > 0)
+        bt = get_backtrace(_show_backtrace);
+#endif
+
+    log_text(level, file, line, func, NULL, ((flags | flags_override) & PA_LOG_PRINT_TIME) ? pa_rtclock_now() : 0,
+             text, bt, &saved_errno);
+
     pa_xfree(bt);
     errno = saved_errno;
 }
@@ -87,6 +87,12 @@ void pa_log_set_show_backtrace(unsigned nlevels);
 /* Skip the first backtrace frames */
 void pa_log_set_skip_backtrace(unsigned nlevels);
 
+/* Hand messages over to a separate thread that writes them out, so that
+ * logging doesn't block realtime threads. Errors and messages with a
+ * backtrace are still written right away. Disabling writes out everything
+ * that is still pending. */
+void pa_log_set_async(bool enable);
+
 void pa_log_level_meta(
         pa_log_level_t level,
         const char*file,
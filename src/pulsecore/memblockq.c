@@ -31,6 +31,7 @@
 #include <pulsecore/mcalign.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/sample-util.h>
 
 #include "memblockq.h"
 
@@ -44,6 +45,14 @@ struct list_item {
 
 PA_STATIC_FLIST_DECLARE(list_items, 0, pa_xfree);
 
+struct ring_segment {
+    pa_memblock *memblock;
+
+    /* The part of the segment pa_memblockq_peek() handed out, which
+     * might still be referenced elsewhere, as offsets into the segment */
+    size_t exported_start, exported_end;
+};
+
 struct pa_memblockq {
     struct list_item *blocks, *blocks_tail;
     struct list_item *current_read, *current_write;
@@ -56,6 +65,18 @@ struct pa_memblockq {
     int64_t missing, requested;
     char *name;
     pa_sample_spec sample_spec;
+
+    /* Only for queues created with pa_memblockq_new_ring(). The data
+     * from ring_start to ring_end is kept in the ring, at the index
+     * modulo ring_size. The ring is made of segments, each in its own
+     * memblock, so that only the segments still referenced elsewhere
+     * need to be replaced when they're written to. The blocks list isn't
+     * used then. */
+    pa_mempool *pool;
+    struct ring_segment *segments;
+    unsigned n_segments;
+    size_t segment_size, ring_size;
+    int64_t ring_start, ring_end;
 };
 
 pa_memblockq* pa_memblockq_new(
@@ -105,11 +126,49 @@ pa_memblockq* pa_memblockq_new(
     return bq;
 }
 
+pa_memblockq* pa_memblockq_new_ring(
+        const char *name,
+        int64_t idx,
+        size_t maxlength,
+        size_t tlength,
+        const pa_sample_spec *sample_spec,
+        size_t prebuf,
+        size_t minreq,
+        size_t maxrewind,
+        pa_memchunk *silence,
+        pa_mempool *pool) {
+
+    pa_memblockq *bq;
+
+    pa_assert(silence);
+    pa_assert(pool);
+
+    bq = pa_memblockq_new(name, idx, maxlength, tlength, sample_spec, prebuf, minreq, maxrewind, silence);
+    bq->pool = pa_mempool_ref(pool);
+
+    /* The ring is allocated on the first push */
+    bq->ring_start = bq->ring_end = idx;
+
+    return bq;
+}
+
 void pa_memblockq_free(pa_memblockq* bq) {
     pa_assert(bq);
 
     pa_memblockq_silence(bq);
 
+    if (bq->segments) {
+        unsigned k;
+
+        for (k = 0; k < bq->n_segments; k++)
+            pa_memblock_unref(bq->segments[k].memblock);
+
+        pa_xfree(bq->segments);
+    }
+
+    if (bq->pool)
+        pa_mempool_unref(bq->pool);
+
     if (bq->silence.memblock)
         pa_memblock_unref(bq->silence.memblock);
 
@@ -210,12 +269,215 @@ static void drop_block(pa_memblockq *bq, struct list_item *q) {
     bq->n_blocks--;
 }
 
+static bool ring_is_empty(pa_memblockq *bq) {
+    return bq->ring_start >= bq->ring_end;
+}
+
+static size_t ring_offset(pa_memblockq *bq, int64_t i) {
+    int64_t offset;
+
+    offset = i % (int64_t) bq->ring_size;
+
+    return (size_t) (offset < 0 ? offset + (int64_t) bq->ring_size : offset);
+}
+
+/* Returns the data at index i up to the end of the data or of its
+ * segment, without taking a reference. Returns false if there's no data
+ * at i. */
+static bool ring_get(pa_memblockq *bq, int64_t i, pa_memchunk *chunk) {
+    size_t offset;
+
+    if (i < bq->ring_start || i >= bq->ring_end)
+        return false;
+
+    offset = ring_offset(bq, i);
+
+    chunk->memblock = bq->segments[offset / bq->segment_size].memblock;
+    chunk->index = offset % bq->segment_size;
+    chunk->length = PA_MIN((size_t) (bq->ring_end - i), bq->segment_size - chunk->index);
+
+    return true;
+}
+
+/* Makes sure that writing to the segment from offset start to end
+ * doesn't change what others still see. If they see that part, the
+ * segment is replaced by a copy. */
+static void ring_segment_make_writable(pa_memblockq *bq, struct ring_segment *seg, size_t start, size_t end) {
+    pa_memblock *old;
+    uint8_t *dst;
+    const uint8_t *src;
+
+    if (pa_memblock_ref_is_one(seg->memblock)) {
+        seg->exported_start = seg->exported_end = 0;
+        return;
+    }
+
+    if (start >= seg->exported_end || end <= seg->exported_start)
+        return;
+
+    old = seg->memblock;
+    seg->memblock = pa_memblock_new(bq->pool, bq->segment_size);
+    seg->exported_start = seg->exported_end = 0;
+
+    dst = pa_memblock_acquire(seg->memblock);
+    src = pa_memblock_acquire(old);
+    memcpy(dst, src, bq->segment_size);
+    pa_memblock_release(old);
+    pa_memblock_release(seg->memblock);
+
+    pa_memblock_unref(old);
+}
+
+/* Copies length bytes from src into the ring at index i, or silence if
+ * src is NULL */
+static void ring_write_data(pa_memblockq *bq, int64_t i, const uint8_t *src, size_t length) {
+    pa_assert(length <= bq->ring_size);
+
+    while (length > 0) {
+        struct ring_segment *seg;
+        size_t offset, n;
+        uint8_t *dst;
+
+        offset = ring_offset(bq, i);
+        seg = &bq->segments[offset / bq->segment_size];
+        offset %= bq->segment_size;
+        n = PA_MIN(length, bq->segment_size - offset);
+
+        ring_segment_make_writable(bq, seg, offset, offset + n);
+
+        dst = pa_memblock_acquire(seg->memblock);
+
+        if (src) {
+            memcpy(dst + offset, src, n);
+            src += n;
+        } else
+            pa_silence_memory(dst + offset, n, &bq->sample_spec);
+
+        pa_memblock_release(seg->memblock);
+
+        i += (int64_t) n;
+        length -= n;
+    }
+}
+
+/* Copies the chunk into the ring at index i */
+static void ring_write(pa_memblockq *bq, int64_t i, const pa_memchunk *chunk) {
+    ring_write_data(bq, i, pa_memblock_acquire_chunk(chunk), chunk->length);
+    pa_memblock_release(chunk->memblock);
+}
+
+/* Writes silence to the ring from index start to end */
+static void ring_write_silence(pa_memblockq *bq, int64_t start, int64_t end) {
+    pa_memchunk chunk;
+
+    if (!bq->silence.memblock) {
+        ring_write_data(bq, start, NULL, (size_t) (end - start));
+        return;
+    }
+
+    while (start < end) {
+        chunk = bq->silence;
+        chunk.length = PA_MIN(chunk.length, (size_t) (end - start));
+
+        ring_write(bq, start, &chunk);
+        start += (int64_t) chunk.length;
+    }
+}
+
+/* Makes sure the ring can hold the data from start to end, otherwise we
+ * move to a bigger ring */
+static void ring_reserve(pa_memblockq *bq, int64_t start, int64_t end) {
+    struct ring_segment *old_segments;
+    unsigned old_n_segments, k;
+    size_t old_size, old_segment_size, max_segment_size, size, needed;
+    int64_t i;
+
+    needed = (size_t) (end - start);
+    max_segment_size = PA_MAX(pa_frame_align(pa_mempool_block_size_max(bq->pool), &bq->sample_spec), bq->base);
+
+    if (bq->segments && needed <= bq->ring_size)
+        return;
+
+    if (bq->segments)
+        size = PA_MAX(2 * bq->ring_size, needed);
+    else
+        size = PA_MAX(max_segment_size, needed);
+
+    size = PA_MIN(size, PA_MAX(needed, bq->maxlength + bq->maxrewind));
+    size = ((size + bq->base - 1) / bq->base) * bq->base;
+
+    old_segments = bq->segments;
+    old_n_segments = bq->n_segments;
+    old_segment_size = bq->segment_size;
+    old_size = bq->ring_size;
+
+    /* Segments are as big as the pool allows */
+    bq->segment_size = PA_MIN(size, max_segment_size);
+
+    bq->n_segments = (unsigned) ((size + bq->segment_size - 1) / bq->segment_size);
+    bq->ring_size = bq->n_segments * bq->segment_size;
+    bq->segments = pa_xnew0(struct ring_segment, bq->n_segments);
+
+    for (k = 0; k < bq->n_segments; k++)
+        bq->segments[k].memblock = pa_memblock_new(bq->pool, bq->segment_size);
+
+    if (!old_segments)
+        return;
+
+    /* Move the data over */
+    for (i = bq->ring_start; i < bq->ring_end;) {
+        pa_memchunk chunk;
+        int64_t offset;
+
+        if ((offset = i % (int64_t) old_size) < 0)
+            offset += (int64_t) old_size;
+
+        chunk.memblock = old_segments[offset / (int64_t) old_segment_size].memblock;
+        chunk.index = (size_t) offset % old_segment_size;
+        chunk.length = PA_MIN((size_t) (bq->ring_end - i), old_segment_size - chunk.index);
+
+        ring_write(bq, i, &chunk);
+        i += (int64_t) chunk.length;
+    }
+
+    for (k = 0; k < old_n_segments; k++)
+        pa_memblock_unref(old_segments[k].memblock);
+
+    pa_xfree(old_segments);
+}
+
+/* Remembers that the chunk, as returned by ring_get(), was handed out */
+static void ring_export(pa_memblockq *bq, const pa_memchunk *chunk) {
+    struct ring_segment *seg;
+
+    seg = &bq->segments[ring_offset(bq, bq->read_index) / bq->segment_size];
+    pa_assert(seg->memblock == chunk->memblock);
+
+    if (seg->exported_start >= seg->exported_end) {
+        seg->exported_start = chunk->index;
+        seg->exported_end = chunk->index + chunk->length;
+    } else {
+        seg->exported_start = PA_MIN(seg->exported_start, chunk->index);
+        seg->exported_end = PA_MAX(seg->exported_end, chunk->index + chunk->length);
+    }
+}
+
 static void drop_backlog(pa_memblockq *bq) {
     int64_t boundary;
     pa_assert(bq);
 
     boundary = bq->read_index - (int64_t) bq->maxrewind;
 
+    if (bq->pool) {
+        if (bq->ring_start < boundary)
+            bq->ring_start = boundary;
+
+        if (bq->ring_start > bq->ring_end)
+            bq->ring_start = bq->ring_end;
+
+        return;
+    }
+
     while (bq->blocks && (bq->blocks->index + (int64_t) bq->blocks->chunk.length <= boundary))
         drop_block(bq, bq->blocks);
 }
@@ -234,7 +496,10 @@ static bool can_push(pa_memblockq *bq, size_t l) {
             return true;
     }
 
-    end = bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->write_index;
+    if (bq->pool)
+        end = ring_is_empty(bq) ? bq->write_index : bq->ring_end;
+    else
+        end = bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->write_index;
 
     /* Make sure that the list doesn't get too long */
     if (bq->write_index + (int64_t) l > end)
@@ -274,6 +539,55 @@ static void read_index_changed(pa_memblockq *bq, int64_t old_read_index) {
 #endif
 }
 
+/* Unlike the list, the ring takes a copy of the data */
+static void ring_push(pa_memblockq *bq, const pa_memchunk *uchunk) {
+    pa_memchunk chunk = *uchunk;
+    int64_t boundary, start, end, write_start, write_end;
+
+    drop_backlog(bq);
+
+    /* Nothing before the rewind boundary is kept anyway */
+    boundary = bq->read_index - (int64_t) bq->maxrewind;
+
+    if (bq->write_index < boundary) {
+        size_t d = PA_MIN(chunk.length, (size_t) (boundary - bq->write_index));
+
+        chunk.index += d;
+        chunk.length -= d;
+        bq->write_index += (int64_t) d;
+
+        if (chunk.length <= 0)
+            return;
+    }
+
+    start = bq->write_index;
+    end = bq->write_index + (int64_t) chunk.length;
+    write_start = start;
+    write_end = end;
+
+    /* Holes between the old and the new data are filled with silence */
+    if (!ring_is_empty(bq)) {
+        write_start = PA_MIN(start, bq->ring_end);
+        write_end = PA_MAX(end, bq->ring_start);
+        start = PA_MIN(start, bq->ring_start);
+        end = PA_MAX(end, bq->ring_end);
+    }
+
+    ring_reserve(bq, start, end);
+
+    if (write_start < bq->write_index)
+        ring_write_silence(bq, write_start, bq->write_index);
+
+    ring_write(bq, bq->write_index, &chunk);
+    bq->write_index += (int64_t) chunk.length;
+
+    if (write_end > bq->write_index)
+        ring_write_silence(bq, bq->write_index, write_end);
+
+    bq->ring_start = start;
+    bq->ring_end = end;
+}
+
 int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     struct list_item *q, *n;
     pa_memchunk chunk;
@@ -292,6 +606,12 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
         return -1;
 
     old = bq->write_index;
+
+    if (bq->pool) {
+        ring_push(bq, uchunk);
+        goto finish;
+    }
+
     chunk = *uchunk;
 
     fix_current_write(bq);
@@ -354,6 +674,7 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
 
                 /* Drop it from the new entry */
                 p->index = q->index + (int64_t) d;
+                p->chunk.index += d;
                 p->chunk.length -= d;
 
                 /* Add it to the list */
@@ -471,6 +792,51 @@ static bool update_prebuf(pa_memblockq *bq) {
     }
 }
 
+static int peek_silence(pa_memblockq *bq, size_t length, pa_memchunk *chunk) {
+
+    /* We need to return silence, since no data is yet available */
+    if (bq->silence.memblock) {
+        *chunk = bq->silence;
+        pa_memblock_ref(chunk->memblock);
+
+        if (length > 0 && length < chunk->length)
+            chunk->length = length;
+
+    } else {
+
+        /* If the memblockq is empty, return -1, otherwise return
+         * the time to sleep */
+        if (length <= 0)
+            return -1;
+
+        chunk->memblock = NULL;
+        chunk->length = length;
+    }
+
+    chunk->index = 0;
+    return 0;
+}
+
+static int ring_peek(pa_memblockq *bq, pa_memchunk *chunk) {
+    size_t length;
+
+    if (ring_get(bq, bq->read_index, chunk)) {
+        pa_memblock_ref(chunk->memblock);
+        ring_export(bq, chunk);
+        return 0;
+    }
+
+    /* How much silence shall we return? */
+    if (!ring_is_empty(bq) && bq->ring_start > bq->read_index)
+        length = (size_t) (bq->ring_start - bq->read_index);
+    else if (bq->write_index > bq->read_index)
+        length = (size_t) (bq->write_index - bq->read_index);
+    else
+        length = 0;
+
+    return peek_silence(bq, length, chunk);
+}
+
 int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
     int64_t d;
     pa_assert(bq);
@@ -480,6 +846,9 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
     if (update_prebuf(bq))
         return -1;
 
+    if (bq->pool)
+        return ring_peek(bq, chunk);
+
     fix_current_read(bq);
 
     /* Do we need to spit out silence? */
@@ -494,27 +863,7 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
         else
             length = 0;
 
-        /* We need to return silence, since no data is yet available */
-        if (bq->silence.memblock) {
-            *chunk = bq->silence;
-            pa_memblock_ref(chunk->memblock);
-
-            if (length > 0 && length < chunk->length)
-                chunk->length = length;
-
-        } else {
-
-            /* If the memblockq is empty, return -1, otherwise return
-             * the time to sleep */
-            if (length <= 0)
-                return -1;
-
-            chunk->memblock = NULL;
-            chunk->length = length;
-        }
-
-        chunk->index = 0;
-        return 0;
+        return peek_silence(bq, length, chunk);
     }
 
     /* Ok, let's pass real data to the caller */
@@ -567,7 +916,15 @@ int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchun
 
     while (rchunk.index < block_size) {
 
-        if (!item || item->index > ri) {
+        if (bq->pool) {
+            if (!ring_get(bq, ri, &tchunk)) {
+                tchunk = bq->silence;
+
+                if (!ring_is_empty(bq) && bq->ring_start > ri)
+                    tchunk.length = PA_MIN(tchunk.length, (size_t) (bq->ring_start - ri));
+            }
+
+        } else if (!item || item->index > ri) {
             /* Do we need to append silence? */
             tchunk = bq->silence;
 
@@ -602,8 +959,29 @@ int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchun
     return 0;
 }
 
+/* Returns in end where the data at or right of the read index ends, or
+ * false if there's none */
+static bool next_data_end(pa_memblockq *bq, int64_t *end) {
+
+    if (bq->pool) {
+        if (ring_is_empty(bq) || bq->ring_end <= bq->read_index)
+            return false;
+
+        *end = bq->ring_end;
+        return true;
+    }
+
+    fix_current_read(bq);
+
+    if (!bq->current_read)
+        return false;
+
+    *end = bq->current_read->index + (int64_t) bq->current_read->chunk.length;
+    return true;
+}
+
 void pa_memblockq_drop(pa_memblockq *bq, size_t length) {
-    int64_t old;
+    int64_t old, p;
     pa_assert(bq);
     pa_assert(length % bq->base == 0);
 
@@ -615,15 +993,12 @@ void pa_memblockq_drop(pa_memblockq *bq, size_t length) {
         if (update_prebuf(bq))
             break;
 
-        fix_current_read(bq);
-
-        if (bq->current_read) {
-            int64_t p, d;
+        if (next_data_end(bq, &p)) {
+            int64_t d;
 
             /* We go through this piece by piece to make sure we don't
              * drop more than allowed by prebuf */
 
-            p = bq->current_read->index + (int64_t) bq->current_read->chunk.length;
             pa_assert(p >= bq->read_index);
             d = p - bq->read_index;
 
@@ -697,7 +1072,10 @@ void pa_memblockq_seek(pa_memblockq *bq, int64_t offset, pa_seek_mode_t seek, bo
             bq->write_index = bq->read_index + offset;
             break;
         case PA_SEEK_RELATIVE_END:
-            bq->write_index = (bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->read_index) + offset;
+            if (bq->pool)
+                bq->write_index = (ring_is_empty(bq) ? bq->read_index : bq->ring_end) + offset;
+            else
+                bq->write_index = (bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->read_index) + offset;
             break;
         default:
             pa_assert_not_reached();
@@ -972,6 +1350,15 @@ void pa_memblockq_willneed(pa_memblockq *bq) {
 
     pa_assert(bq);
 
+    if (bq->pool) {
+        pa_memchunk chunk;
+
+        if (ring_get(bq, bq->read_index, &chunk))
+            pa_memchunk_will_need(&chunk);
+
+        return;
+    }
+
     fix_current_read(bq);
 
     for (q = bq->current_read; q; q = q->next)
@@ -994,12 +1381,17 @@ void pa_memblockq_set_silence(pa_memblockq *bq, pa_memchunk *silence) {
 bool pa_memblockq_is_empty(pa_memblockq *bq) {
     pa_assert(bq);
 
+    if (bq->pool)
+        return ring_is_empty(bq);
+
     return !bq->blocks;
 }
 
 void pa_memblockq_silence(pa_memblockq *bq) {
     pa_assert(bq);
 
+    bq->ring_start = bq->ring_end;
+
     while (bq->blocks)
         drop_block(bq, bq->blocks);
 
@@ -1009,6 +1401,9 @@ void pa_memblockq_silence(pa_memblockq *bq) {
 unsigned pa_memblockq_get_nblocks(pa_memblockq *bq) {
     pa_assert(bq);
 
+    if (bq->pool)
+        return ring_is_empty(bq) ? 0 : 1;
+
     return bq->n_blocks;
 }
 
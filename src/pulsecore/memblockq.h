@@ -74,6 +74,29 @@ pa_memblockq* pa_memblockq_new(
         size_t maxrewind,
         pa_memchunk *silence);
 
+/* Like pa_memblockq_new(), but the queue copies the data into a ring
+ * buffer allocated from pool, instead of keeping references to the
+ * pushed memblocks. This pays off for streams that come in many small
+ * chunks: pa_memblockq_peek() returns everything up to the end of a ring
+ * segment at once, and pa_memblockq_peek_fixed_size() only has to copy
+ * where a segment ends. Each segment is one memblock from pool; a segment
+ * is only copied when it's written to while a peeked chunk still refers
+ * to the overwritten part. Since every push is copied, this isn't for
+ * streams whose memblocks could be passed on as they are, e.g. from
+ * shared memory. Holes in the queue are filled with silence, which is
+ * required. */
+pa_memblockq* pa_memblockq_new_ring(
+        const char *name,
+        int64_t idx,
+        size_t maxlength,
+        size_t tlength,
+        const pa_sample_spec *sample_spec,
+        size_t prebuf,
+        size_t minreq,
+        size_t maxrewind,
+        pa_memchunk *silence,
+        pa_mempool *pool);
+
 void pa_memblockq_free(pa_memblockq*bq);
 
 /* Push a new memory chunk into the queue.  */
@@ -29,6 +29,8 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/g711.h>
 #include <pulsecore/endianmacros.h>
+#include <pulsecore/memblock.h>
+#include <pulse/xmalloc.h>
 
 #include "cpu.h"
 #include "mix.h"
@@ -612,6 +614,44 @@ void pa_mix_func_init(const pa_cpu_info *cpu_info) {
         do_mix_table[PA_SAMPLE_S16NE] = (pa_do_mix_func_t) pa_mix_s16ne_c;
 }
 
+/* Mixes the first length bytes, during which some of the streams ramp
+ * their volume. These streams get their ramp applied to a copy of their
+ * data, which is then mixed at 0 dB. */
+static void mix_ramps(
+        pa_mix_info streams[],
+        unsigned nstreams,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume) {
+
+    pa_mix_info s[PA_MIX_MAX_STREAMS];
+    unsigned k;
+
+    pa_assert(nstreams <= PA_MIX_MAX_STREAMS);
+
+    for (k = 0; k < nstreams; k++) {
+        s[k] = streams[k];
+        s[k].ramp_length = 0;
+
+        if (streams[k].ramp_length <= 0)
+            continue;
+
+        s[k].chunk.length = length;
+        pa_memblock_ref(s[k].chunk.memblock);
+        pa_memchunk_make_writable(&s[k].chunk, 0);
+
+        pa_volume_memchunk_ramp(&s[k].chunk, spec, &streams[k].ramp_volume, &streams[k].volume, streams[k].ramp_length);
+        pa_cvolume_reset(&s[k].volume, spec->channels);
+    }
+
+    pa_mix(s, nstreams, data, length, spec, volume, false);
+
+    for (k = 0; k < nstreams; k++)
+        if (streams[k].ramp_length > 0)
+            pa_memblock_unref(s[k].chunk.memblock);
+}
+
 size_t pa_mix(
         pa_mix_info streams[],
         unsigned nstreams,
@@ -622,6 +662,7 @@ size_t pa_mix(
         bool mute) {
 
     pa_cvolume full_volume;
+    size_t ramp = 0;
     unsigned k;
 
     pa_assert(streams);
@@ -640,11 +681,23 @@ size_t pa_mix(
 
     for (k = 0; k < nstreams; k++) {
         pa_assert(length <= streams[k].chunk.length);
-        streams[k].ptr = pa_memblock_acquire_chunk(&streams[k].chunk);
+
+        if (streams[k].ramp_length > ramp)
+            ramp = PA_MIN(streams[k].ramp_length, length);
+    }
+
+    if (ramp > 0) {
+        mix_ramps(streams, nstreams, data, ramp, spec, volume);
+
+        if (ramp >= length)
+            return length;
     }
 
+    for (k = 0; k < nstreams; k++)
+        streams[k].ptr = (uint8_t *) pa_memblock_acquire_chunk(&streams[k].chunk) + ramp;
+
     calc_stream_volumes_table[spec->format](streams, nstreams, volume, spec);
-    do_mix_table[spec->format](streams, nstreams, spec->channels, data, length);
+    do_mix_table[spec->format](streams, nstreams, spec->channels, (uint8_t *) data + ramp, length - ramp);
 
     for (k = 0; k < nstreams; k++)
         pa_memblock_release(streams[k].chunk.memblock);
@@ -724,3 +777,152 @@ void pa_volume_memchunk(
 
     pa_memblock_release(c->memblock);
 }
+
+/* The ramp kernels get the linear volume of each channel at the first
+ * frame, and how much it changes from one frame to the next */
+typedef void (*pa_do_volume_ramp_func_t) (void *samples, float *linear, const float *step, unsigned channels, unsigned frames);
+
+static void volume_ramp_s16ne_c(int16_t *samples, float *linear, const float *step, unsigned channels, unsigned frames) {
+    unsigned channel;
+
+    for (; frames > 0; frames--) {
+        for (channel = 0; channel < channels; channel++) {
+            int32_t t = (int32_t) lrintf((float) *samples * linear[channel]);
+
+            *samples++ = (int16_t) PA_CLAMP_UNLIKELY(t, -0x8000, 0x7FFF);
+            linear[channel] += step[channel];
+        }
+    }
+}
+
+static void volume_ramp_s16re_c(int16_t *samples, float *linear, const float *step, unsigned channels, unsigned frames) {
+    unsigned channel;
+
+    for (; frames > 0; frames--) {
+        for (channel = 0; channel < channels; channel++) {
+            int32_t t = (int32_t) lrintf((float) PA_INT16_SWAP(*samples) * linear[channel]);
+
+            t = PA_CLAMP_UNLIKELY(t, -0x8000, 0x7FFF);
+            *samples++ = PA_INT16_SWAP((int16_t) t);
+            linear[channel] += step[channel];
+        }
+    }
+}
+
+static void volume_ramp_float32ne_c(float *samples, float *linear, const float *step, unsigned channels, unsigned frames) {
+    unsigned channel;
+
+    for (; frames > 0; frames--) {
+        for (channel = 0; channel < channels; channel++) {
+            *samples++ *= linear[channel];
+            linear[channel] += step[channel];
+        }
+    }
+}
+
+static void volume_ramp_s32ne_c(int32_t *samples, float *linear, const float *step, unsigned channels, unsigned frames) {
+    unsigned channel;
+
+    for (; frames > 0; frames--) {
+        for (channel = 0; channel < channels; channel++) {
+            int64_t t = llrint((double) *samples * linear[channel]);
+
+            *samples++ = (int32_t) PA_CLAMP_UNLIKELY(t, -0x80000000LL, 0x7FFFFFFFLL);
+            linear[channel] += step[channel];
+        }
+    }
+}
+
+/* Other formats are ramped in steps of this many frames */
+#define VOLUME_RAMP_STEP_FRAMES 32
+
+static void volume_ramp_stepped(void *samples, float *linear, const float *step, unsigned channels, unsigned frames, const pa_sample_spec *spec) {
+    volume_val v[PA_CHANNELS_MAX + VOLUME_PADDING];
+    pa_do_volume_func_t do_volume;
+    size_t fs = pa_frame_size(spec);
+    unsigned channel;
+
+    do_volume = pa_get_volume_func(spec->format);
+
+    while (frames > 0) {
+        unsigned n = PA_MIN(frames, VOLUME_RAMP_STEP_FRAMES);
+        pa_cvolume volume;
+
+        /* Use the volume in the middle of the step */
+        volume.channels = (uint8_t) channels;
+        for (channel = 0; channel < channels; channel++) {
+            volume.values[channel] = pa_sw_volume_from_linear(PA_MAX(linear[channel] + step[channel] * (float) n / 2, 0.0f));
+            linear[channel] += step[channel] * (float) n;
+        }
+
+        calc_volume_table[spec->format] ((void *) v, &volume);
+        do_volume(samples, (void *) v, channels, (unsigned) (n * fs));
+
+        samples = (uint8_t *) samples + n * fs;
+        frames -= n;
+    }
+}
+
+static const pa_do_volume_ramp_func_t do_volume_ramp_table[] = {
+  [PA_SAMPLE_S16NE]     = (pa_do_volume_ramp_func_t) volume_ramp_s16ne_c,
+  [PA_SAMPLE_S16RE]     = (pa_do_volume_ramp_func_t) volume_ramp_s16re_c,
+  [PA_SAMPLE_FLOAT32NE] = (pa_do_volume_ramp_func_t) volume_ramp_float32ne_c,
+  [PA_SAMPLE_S32NE]     = (pa_do_volume_ramp_func_t) volume_ramp_s32ne_c,
+  [PA_SAMPLE_MAX]       = NULL
+};
+
+void pa_volume_memchunk_ramp(
+        pa_memchunk*c,
+        const pa_sample_spec *spec,
+        const pa_cvolume *start_volume,
+        const pa_cvolume *volume,
+        size_t ramp_length) {
+
+    float linear[PA_CHANNELS_MAX], step[PA_CHANNELS_MAX];
+    pa_memchunk rest;
+    unsigned channel, frames;
+    size_t fs, n;
+    void *ptr;
+
+    pa_assert(c);
+    pa_assert(spec);
+    pa_assert(pa_sample_spec_valid(spec));
+    pa_assert(pa_frame_aligned(c->length, spec));
+    pa_assert(pa_frame_aligned(ramp_length, spec));
+    pa_assert(start_volume);
+    pa_assert(start_volume->channels == spec->channels);
+    pa_assert(volume);
+    pa_assert(volume->channels == spec->channels);
+
+    if (pa_memblock_is_silence(c->memblock))
+        return;
+
+    fs = pa_frame_size(spec);
+    n = PA_MIN(c->length, ramp_length);
+
+    if (n > 0) {
+        frames = (unsigned) (ramp_length / fs);
+
+        for (channel = 0; channel < spec->channels; channel++) {
+            linear[channel] = (float) pa_sw_volume_to_linear(start_volume->values[channel]);
+            step[channel] = ((float) pa_sw_volume_to_linear(volume->values[channel]) - linear[channel]) / (float) frames;
+        }
+
+        ptr = pa_memblock_acquire_chunk(c);
+
+        if (do_volume_ramp_table[spec->format])
+            do_volume_ramp_table[spec->format](ptr, linear, step, spec->channels, (unsigned) (n / fs));
+        else
+            volume_ramp_stepped(ptr, linear, step, spec->channels, (unsigned) (n / fs), spec);
+
+        pa_memblock_release(c->memblock);
+    }
+
+    /* The rest gets the final volume */
+    rest = *c;
+    rest.index += n;
+    rest.length -= n;
+
+    if (rest.length > 0)
+        pa_volume_memchunk(&rest, spec, volume);
+}
@@ -26,11 +26,21 @@
 #include <pulse/volume.h>
 #include <pulsecore/memchunk.h>
 
+/* The maximum number of streams pa_mix() accepts when one of them is
+ * ramping, since the ramped copies are kept on the stack. */
+#define PA_MIX_MAX_STREAMS 32
+
 typedef struct pa_mix_info {
     pa_memchunk chunk;
     pa_cvolume volume;
     void *userdata;
 
+    /* If ramp_length is non-zero, the volume of this stream moves
+     * linearly from ramp_volume to volume over the next ramp_length
+     * bytes. The ramp may continue past the end of the chunk. */
+    pa_cvolume ramp_volume;
+    size_t ramp_length;
+
     /* The following fields are used internally by pa_mix(), should
      * not be initialised by the caller of pa_mix(). */
     void *ptr;
@@ -59,4 +69,13 @@ void pa_volume_memchunk(
     const pa_sample_spec *spec,
     const pa_cvolume *volume);
 
+/* Like pa_volume_memchunk(), but the volume moves linearly from
+ * start_volume to volume over the first ramp_length bytes. */
+void pa_volume_memchunk_ramp(
+    pa_memchunk*c,
+    const pa_sample_spec *spec,
+    const pa_cvolume *start_volume,
+    const pa_cvolume *volume,
+    size_t ramp_length);
+
 #endif
@@ -0,0 +1,295 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/endianmacros.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "cpu-x86.h"
+#include "g711.h"
+#include "g711_sse.h"
+#include "mix.h"
+#include "s24_sse.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <smmintrin.h>
+
+/* Samples per block, the sums of a block are kept on the stack */
+#define BLOCK_SIZE 256
+
+/* The volume factors of a stream split into the 16 bit halves that
+ * pa_mult_s16_volume() works with, for 4 samples at a time starting at any
+ * channel. Channels without volume get 0, so they add nothing. */
+struct g711_volume {
+    PA_DECLARE_ALIGNED(16, int32_t, hi[PA_CHANNELS_MAX + 8]);
+    PA_DECLARE_ALIGNED(16, int32_t, lo[PA_CHANNELS_MAX + 8]);
+};
+
+static void g711_volume_init(struct g711_volume *v, const pa_mix_info *m, unsigned channels) {
+    unsigned k;
+
+    for (k = 0; k < channels + 8; k++) {
+        int32_t cv = m->linear[k % channels].i;
+
+        v->hi[k] = cv > 0 ? cv >> 16 : 0;
+        v->lo[k] = cv > 0 ? cv & 0xFFFF : 0;
+    }
+}
+
+/* Like pa_mult_s16_volume() for 4 samples. The halves of the volume factor
+ * are 16 bit numbers in 32 bit lanes, the upper half of the lanes is 0, so
+ * _mm_madd_epi16() gives the plain products. The lower half of the volume
+ * factor is unsigned though, which is corrected for. */
+__attribute__ ((target ("sse2")))
+static inline __m128i g711_mult_volume_sse2(__m128i v, __m128i hi, __m128i lo) {
+    __m128i p, neg;
+
+    p = _mm_srai_epi32(_mm_madd_epi16(v, lo), 16);
+    neg = _mm_cmpgt_epi32(lo, _mm_set1_epi32(0x7FFF));
+    p = _mm_add_epi32(p, _mm_and_si128(neg, v));
+
+    return _mm_add_epi32(p, _mm_madd_epi16(v, hi));
+}
+
+/* Decodes the streams, sums them up in the linear domain and encodes the
+ * result again, a block at a time. 'shift' matches the one of the generic
+ * code in mix.c. */
+#define DEFINE_MIX_G711_SSE2(law, shift, decode, encode)                                        \
+__attribute__ ((target ("sse2")))                                                              \
+static void pa_mix_##law##_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, uint8_t *data, unsigned length) { \
+    PA_DECLARE_ALIGNED(16, int32_t, sum[BLOCK_SIZE]);                                         \
+    struct g711_volume volume;                                                                  \
+    unsigned channel = 0, step = 8 % channels;                                                  \
+                                                                                                \
+    while (length > 0) {                                                                        \
+        unsigned n = PA_MIN(length, BLOCK_SIZE), n8 = n & ~7U, i, j, ch;                        \
+                                                                                                \
+        memset(sum, 0, sizeof(int32_t) * n);                                                    \
+                                                                                                \
+        for (i = 0; i < nstreams; i++) {                                                        \
+            pa_mix_info *m = streams + i;                                                       \
+            const uint8_t *ptr = m->ptr;                                                        \
+                                                                                                \
+            g711_volume_init(&volume, m, channels);                                             \
+                                                                                                \
+            for (j = 0, ch = channel; j < n8; j += 8) {                                         \
+                const __m128i zero = _mm_setzero_si128();                                       \
+                __m128i x, v0, v1;                                                              \
+                                                                                                \
+                x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (ptr + j)), zero);      \
+                v0 = g711_##law##_decode_sse2(_mm_unpacklo_epi16(x, zero));                     \
+                v1 = g711_##law##_decode_sse2(_mm_unpackhi_epi16(x, zero));                     \
+                                                                                                \
+                v0 = g711_mult_volume_sse2(v0, _mm_loadu_si128((const __m128i *) (volume.hi + ch)), \
+                                           _mm_loadu_si128((const __m128i *) (volume.lo + ch))); \
+                v1 = g711_mult_volume_sse2(v1, _mm_loadu_si128((const __m128i *) (volume.hi + ch + 4)), \
+                                           _mm_loadu_si128((const __m128i *) (volume.lo + ch + 4))); \
+                                                                                                \
+                _mm_store_si128((__m128i *) (sum + j), _mm_add_epi32(_mm_load_si128((__m128i *) (sum + j)), v0)); \
+                _mm_store_si128((__m128i *) (sum + j + 4), _mm_add_epi32(_mm_load_si128((__m128i *) (sum + j + 4)), v1)); \
+                                                                                                \
+                if ((ch += step) >= channels)                                                   \
+                    ch -= channels;                                                             \
+            }                                                                                   \
+                                                                                                \
+            for (; j < n; j++) {                                                                \
+                int32_t cv = m->linear[ch].i;                                                   \
+                                                                                                \
+                if (PA_LIKELY(cv > 0))                                                          \
+                    sum[j] += pa_mult_s16_volume(decode(ptr[j]), cv);                           \
+                                                                                                \
+                if (PA_UNLIKELY(++ch >= channels))                                              \
+                    ch = 0;                                                                     \
+            }                                                                                   \
+                                                                                                \
+            m->ptr = (uint8_t*) m->ptr + n;                                                     \
+        }                                                                                       \
+                                                                                                \
+        for (j = 0; j < n8; j += 8) {                                                           \
+            __m128i x, e0, e1;                                                                  \
+                                                                                                \
+            /* Saturates to 16 bit */                                                           \
+            x = _mm_packs_epi32(_mm_load_si128((__m128i *) (sum + j)), _mm_load_si128((__m128i *) (sum + j + 4))); \
+            e0 = g711_##law##_encode_sse2(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16 + (shift))); \
+            e1 = g711_##law##_encode_sse2(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16 + (shift))); \
+                                                                                                \
+            x = _mm_packs_epi32(e0, e1);                                                        \
+            _mm_storel_epi64((__m128i *) (data + j), _mm_packus_epi16(x, x));                   \
+        }                                                                                       \
+                                                                                                \
+        for (; j < n; j++) {                                                                    \
+            int32_t s = PA_CLAMP_UNLIKELY(sum[j], -0x8000, 0x7FFF);                             \
+            data[j] = (uint8_t) encode((int16_t) s >> (shift));                                 \
+        }                                                                                       \
+                                                                                                \
+        channel = (channel + n) % channels;                                                     \
+        data += n;                                                                              \
+        length -= n;                                                                            \
+    }                                                                                           \
+}
+
+DEFINE_MIX_G711_SSE2(ulaw, 2, st_ulaw2linear16, st_14linear2ulaw)
+DEFINE_MIX_G711_SSE2(alaw, 3, st_alaw2linear16, st_13linear2alaw)
+
+/* The volume factors of a stream for 4 samples at a time starting at any
+ * channel, with 0 for channels without volume */
+static void s24_volume_init(int32_t *v, const pa_mix_info *m, unsigned channels) {
+    unsigned k;
+
+    for (k = 0; k < channels + 4; k++) {
+        int32_t cv = m->linear[k % channels].i;
+
+        v[k] = cv > 0 ? cv : 0;
+    }
+}
+
+/* Like the generic code, (v * cv) >> 16 with 64 bit results, for the even
+ * and the odd lanes */
+__attribute__ ((target ("sse4.1")))
+static inline void s24_mult_volume_sse4_1(__m128i v, __m128i cv, __m128i *even, __m128i *odd) {
+    __m128i p;
+
+    /* There is no arithmetic 64 bit shift, so the upper half comes from
+     * a 32 bit one */
+    p = _mm_mul_epi32(v, cv);
+    *even = _mm_blend_epi16(_mm_srli_epi64(p, 16), _mm_srai_epi32(p, 16), 0xCC);
+
+    p = _mm_mul_epi32(_mm_srli_epi64(v, 32), _mm_srli_epi64(cv, 32));
+    *odd = _mm_blend_epi16(_mm_srli_epi64(p, 16), _mm_srai_epi32(p, 16), 0xCC);
+}
+
+/* Saturates 64 bit sums of 4 samples, in even and odd lanes, to 32 bit */
+__attribute__ ((target ("sse4.1")))
+static inline __m128i s24_saturate_sse4_1(__m128i even, __m128i odd) {
+    __m128i a, b, lo, hi, ok, sat;
+
+    a = _mm_unpacklo_epi32(even, odd);
+    b = _mm_unpackhi_epi32(even, odd);
+    lo = _mm_unpacklo_epi64(a, b);
+    hi = _mm_unpackhi_epi64(a, b);
+
+    /* A sum fits if its upper half is the sign extension of the lower */
+    ok = _mm_cmpeq_epi32(hi, _mm_srai_epi32(lo, 31));
+    sat = _mm_xor_si128(_mm_srai_epi32(hi, 31), _mm_set1_epi32(0x7FFFFFFF));
+
+    return _mm_blendv_epi8(sat, lo, ok);
+}
+
+/* Mixes 24 bit streams a block at a time, with 64 bit sums like the
+ * generic code. 'format' selects the load and store functions of
+ * s24_sse.h, the remaining samples are mixed with the scalar 'read' and
+ * 'write'. */
+#define DEFINE_MIX_S24_SSE4_1(name, format, size, read, write)                                  \
+__attribute__ ((target ("sse4.1")))                                                            \
+static void pa_mix_##name##_sse4_1(pa_mix_info streams[], unsigned nstreams, unsigned channels, uint8_t *data, unsigned length) { \
+    __m128i sum[BLOCK_SIZE / 2];                                                                \
+    PA_DECLARE_ALIGNED(16, int32_t, volume[PA_CHANNELS_MAX + 4]);                              \
+    unsigned channel = 0, step = 4 % channels, n = length / (size), done = 0, i;                \
+                                                                                                \
+    while (n >= 16) {                                                                           \
+        unsigned k = PA_MIN(n, BLOCK_SIZE) & ~15U, j, l, ch;                                    \
+                                                                                                \
+        memset(sum, 0, sizeof(__m128i) * k / 2);                                                \
+                                                                                                \
+        for (i = 0; i < nstreams; i++) {                                                        \
+            const uint8_t *ptr = (const uint8_t *) streams[i].ptr + done * (size);             \
+                                                                                                \
+            s24_volume_init(volume, streams + i, channels);                                     \
+                                                                                                \
+            for (j = 0, ch = channel; j < k; j += 16) {                                         \
+                __m128i v[4];                                                                   \
+                                                                                                \
+                format##_load_ssse3(ptr + j * (size), v);                                       \
+                                                                                                \
+                for (l = 0; l < 4; l++) {                                                       \
+                    __m128i even, odd;                                                          \
+                                                                                                \
+                    s24_mult_volume_sse4_1(v[l], _mm_loadu_si128((const __m128i *) (volume + ch)), &even, &odd); \
+                    sum[j / 2 + 2 * l] = _mm_add_epi64(sum[j / 2 + 2 * l], even);               \
+                    sum[j / 2 + 2 * l + 1] = _mm_add_epi64(sum[j / 2 + 2 * l + 1], odd);        \
+                                                                                                \
+                    if ((ch += step) >= channels)                                               \
+                        ch -= channels;                                                         \
+                }                                                                               \
+            }                                                                                   \
+        }                                                                                       \
+                                                                                                \
+        for (j = 0; j < k; j += 16) {                                                           \
+            __m128i v[4];                                                                       \
+                                                                                                \
+            for (l = 0; l < 4; l++)                                                             \
+                v[l] = s24_saturate_sse4_1(sum[j / 2 + 2 * l], sum[j / 2 + 2 * l + 1]);         \
+                                                                                                \
+            format##_store_ssse3(data + j * (size), v);                                         \
+        }                                                                                       \
+                                                                                                \
+        channel = (channel + k) % channels;                                                     \
+        data += k * (size);                                                                     \
+        done += k;                                                                              \
+        n -= k;                                                                                 \
+    }                                                                                           \
+                                                                                                \
+    for (; n > 0; n--, done++, data += (size)) {                                                \
+        int64_t s = 0;                                                                          \
+                                                                                                \
+        for (i = 0; i < nstreams; i++) {                                                        \
+            int32_t cv = streams[i].linear[channel].i;                                          \
+                                                                                                \
+            if (PA_LIKELY(cv > 0))                                                              \
+                s += ((int64_t) read((const uint8_t *) streams[i].ptr + done * (size)) * cv) >> 16; \
+        }                                                                                       \
+                                                                                                \
+        s = PA_CLAMP_UNLIKELY(s, -0x80000000LL, 0x7FFFFFFFLL);                                  \
+        write(data, ((uint32_t) s) >> 8);                                                       \
+                                                                                                \
+        if (PA_UNLIKELY(++channel >= channels))                                                 \
+            channel = 0;                                                                        \
+    }                                                                                           \
+                                                                                                \
+    for (i = 0; i < nstreams; i++)                                                              \
+        streams[i].ptr = (uint8_t*) streams[i].ptr + done * (size);                             \
+}
+
+#define S24NE_READ(p) ((int32_t) (PA_READ24NE(p) << 8))
+#define S24_32NE_READ(p) ((int32_t) (*((const uint32_t *) (p)) << 8))
+#define S24_32NE_WRITE(p, v) (*((uint32_t *) (p)) = (v))
+
+DEFINE_MIX_S24_SSE4_1(s24ne, s24le, 3, S24NE_READ, PA_WRITE24NE)
+DEFINE_MIX_S24_SSE4_1(s24_32ne, s24_32le, 4, S24_32NE_READ, S24_32NE_WRITE)
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_mix_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized G.711 mixing functions.");
+        pa_set_mix_func(PA_SAMPLE_ULAW, (pa_do_mix_func_t) pa_mix_ulaw_sse2);
+        pa_set_mix_func(PA_SAMPLE_ALAW, (pa_do_mix_func_t) pa_mix_alaw_sse2);
+    }
+
+    if (flags & PA_CPU_X86_SSE4_1) {
+        pa_log_info("Initialising SSE4.1 optimized 24 bit mixing functions.");
+        pa_set_mix_func(PA_SAMPLE_S24NE, (pa_do_mix_func_t) pa_mix_s24ne_sse4_1);
+        pa_set_mix_func(PA_SAMPLE_S24_32NE, (pa_do_mix_func_t) pa_mix_s24_32ne_sse4_1);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
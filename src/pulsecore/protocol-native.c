@@ -73,6 +73,9 @@
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
 #define DEFAULT_FRAGSIZE_MSEC DEFAULT_TLENGTH_MSEC
 
+/* How often the timing snapshot in the srbchannel is updated while playing */
+#define TIMING_PUBLISH_INTERVAL_USEC (20*PA_USEC_PER_MSEC)
+
 struct pa_native_protocol;
 
 typedef struct record_stream {
@@ -145,6 +148,14 @@ typedef struct playback_stream {
     size_t render_memblockq_length;
     pa_usec_t current_sink_latency;
     uint64_t playing_for, underrun_for;
+
+    /* Timing slot in the srbchannel, if any. The rest is only accessed
+     * from the IO thread. */
+    uint32_t timing_index;
+    pa_srbchannel_timing *timing;
+    uint64_t timing_received;
+    uint32_t timing_seeks;
+    pa_usec_t timing_published;
 } playback_stream;
 
 #define PLAYBACK_STREAM(o) (playback_stream_cast(o))
@@ -188,6 +199,9 @@ struct pa_native_connection {
     pa_subscription *subscription;
     pa_time_event *auth_timeout_event;
     pa_srbchannel *srbpending;
+    /* Owned by the pstream */
+    pa_srbchannel *srb;
+    uint64_t timing_slots_used;
 };
 
 #define PA_NATIVE_CONNECTION(o) (pa_native_connection_cast(o))
@@ -247,6 +261,9 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_send_event_cb(pa_sink_input *i, const char *event, pa_proplist *pl);
+static void sink_input_state_change_cb(pa_sink_input *i, pa_sink_input_state_t state);
+static void sink_input_suspend_within_thread_cb(pa_sink_input *i, bool b);
+static void sink_input_attach_cb(pa_sink_input *i);
 
 static void native_connection_send_memblock(pa_native_connection *c);
 static void playback_stream_request_bytes(struct playback_stream*s);
@@ -643,6 +660,11 @@ static void playback_stream_unlink(playback_stream *s) {
     if (s->drain_request)
         pa_pstream_send_error(s->connection->pstream, s->drain_tag, PA_ERR_NOENTITY);
 
+    if (s->timing) {
+        s->connection->timing_slots_used &= ~(UINT64_C(1) << s->timing_index);
+        s->timing = NULL;
+    }
+
     pa_assert_se(pa_idxset_remove_by_data(s->connection->output_streams, s, NULL) == s);
     s->connection = NULL;
     playback_stream_unref(s);
@@ -1053,6 +1075,25 @@ static playback_stream* playback_stream_new(
     pa_atomic_store(&s->seek_or_post_in_queue, 0);
     s->seek_windex = -1;
 
+    s->timing_index = PA_INVALID_INDEX;
+    if (c->version >= 35 && c->srb) {
+        uint32_t idx;
+
+        /* Give the stream a free timing slot, if there is one left */
+        for (idx = 0; idx < PA_SRBCHANNEL_TIMING_SLOTS; idx++)
+            if (!(c->timing_slots_used & (UINT64_C(1) << idx)))
+                break;
+
+        if ((s->timing = pa_srbchannel_get_timing(c->srb, idx))) {
+            c->timing_slots_used |= UINT64_C(1) << idx;
+            s->timing_index = idx;
+
+            /* Forget about the previous user of the slot */
+            pa_zero(s->timing->info);
+            pa_atomic_store(&s->timing->seq, 0);
+        }
+    }
+
     s->sink_input->parent.process_msg = sink_input_process_msg;
     s->sink_input->pop = sink_input_pop_cb;
     s->sink_input->process_underrun = sink_input_process_underrun_cb;
@@ -1063,6 +1104,9 @@ static playback_stream* playback_stream_new(
     s->sink_input->moving = sink_input_moving_cb;
     s->sink_input->suspend = sink_input_suspend_cb;
     s->sink_input->send_event = sink_input_send_event_cb;
+    s->sink_input->state_change = sink_input_state_change_cb;
+    s->sink_input->suspend_within_thread = sink_input_suspend_within_thread_cb;
+    s->sink_input->attach = sink_input_attach_cb;
     s->sink_input->userdata = s;
 
     start_index = ssync ? pa_memblockq_get_read_index(ssync->memblockq) : 0;
@@ -1310,6 +1354,44 @@ static void handle_seek(playback_stream *s, int64_t indexw) {
     playback_stream_request_bytes(s);
 }
 
+/* Called from thread context. state is the state the sink input is in,
+ * or is about to enter. */
+static void playback_stream_publish_timing(playback_stream *s, pa_sink_input_state_t state, bool force) {
+    pa_srbchannel_timing_info info;
+    pa_sink_input *i;
+    pa_usec_t now;
+
+    playback_stream_assert_ref(s);
+
+    if (!s->timing)
+        return;
+
+    now = pa_rtclock_now();
+
+    if (!force && now < s->timing_published + TIMING_PUBLISH_INTERVAL_USEC)
+        return;
+
+    i = s->sink_input;
+
+    /* The same as SINK_INPUT_MESSAGE_UPDATE_LATENCY gathers */
+    info.timestamp = now;
+    info.read_index = pa_memblockq_get_read_index(s->memblockq);
+    info.write_index = pa_memblockq_get_write_index(s->memblockq);
+    info.received = s->timing_received;
+    info.sink_usec = pa_sink_get_latency_within_thread(i->sink, false) +
+        pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
+    info.underrun_for = i->thread_info.underrun_for;
+    info.playing_for = i->thread_info.playing_for;
+    info.seeks = s->timing_seeks;
+    info.playing =
+        i->thread_info.playing_for > 0 &&
+        i->sink->thread_info.state == PA_SINK_RUNNING &&
+        state == PA_SINK_INPUT_RUNNING;
+
+    pa_srbchannel_timing_publish(s->timing, &info);
+    s->timing_published = now;
+}
+
 static void flush_write_no_account(pa_memblockq *q) {
     pa_memblockq_flush_write(q, false);
 }
@@ -1345,6 +1427,21 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
                 pa_memblockq_seek(s->memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, true);
             }
 
+            /* Relative seeks are accounted for like data by the client, the
+             * others it can't predict. Let it know right away when they
+             * took effect. */
+            if (chunk)
+                s->timing_received += chunk->length;
+
+            if (code == SINK_INPUT_MESSAGE_SEEK) {
+                if (PA_PTR_TO_UINT(userdata) == PA_SEEK_RELATIVE)
+                    s->timing_received += offset;
+                else {
+                    s->timing_seeks++;
+                    playback_stream_publish_timing(s, i->thread_info.state, true);
+                }
+            }
+
             /* If more data is in queue, we rewind later instead. */
             if (s->seek_windex != -1)
                 windex = PA_MIN(windex, s->seek_windex);
@@ -1388,6 +1485,11 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
             func(s->memblockq);
             handle_seek(s, windex);
 
+            if (code == SINK_INPUT_MESSAGE_FLUSH) {
+                s->timing_seeks++;
+                playback_stream_publish_timing(s, i->thread_info.state, true);
+            }
+
             /* Do the same for all other members in the sync group */
             for (isync = i->sync_prev; isync; isync = isync->sync_prev) {
                 playback_stream *ssync = PLAYBACK_STREAM(isync->userdata);
@@ -1513,6 +1615,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     pa_log("%s, pop(): %lu", pa_proplist_gets(i->proplist, PA_PROP_MEDIA_NAME), (unsigned long) pa_memblockq_get_length(s->memblockq));
 #endif
 
+    playback_stream_publish_timing(s, i->thread_info.state, false);
+
     if (!handle_input_underrun(s, false))
         s->is_underrun = false;
 
@@ -1584,6 +1688,46 @@ static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
     }
 }
 
+/* Called from thread context, or from main context when corked while
+ * being moved */
+static void sink_input_state_change_cb(pa_sink_input *i, pa_sink_input_state_t state) {
+    playback_stream *s;
+
+    pa_sink_input_assert_ref(i);
+    s = PLAYBACK_STREAM(i->userdata);
+    playback_stream_assert_ref(s);
+
+    /* Without a sink we publish when attached to the next one */
+    if (!i->sink)
+        return;
+
+    /* Nothing is rendered while corked, so tell the client right away */
+    playback_stream_publish_timing(s, state, true);
+}
+
+/* Called from thread context */
+static void sink_input_suspend_within_thread_cb(pa_sink_input *i, bool b) {
+    playback_stream *s;
+
+    pa_sink_input_assert_ref(i);
+    s = PLAYBACK_STREAM(i->userdata);
+    playback_stream_assert_ref(s);
+
+    playback_stream_publish_timing(s, i->thread_info.state, true);
+}
+
+/* Called from thread context */
+static void sink_input_attach_cb(pa_sink_input *i) {
+    playback_stream *s;
+
+    pa_sink_input_assert_ref(i);
+    s = PLAYBACK_STREAM(i->userdata);
+    playback_stream_assert_ref(s);
+
+    /* The latency of the new sink */
+    playback_stream_publish_timing(s, i->thread_info.state, true);
+}
+
 /* Called from main context */
 static void sink_input_kill_cb(pa_sink_input *i) {
     playback_stream *s;
@@ -2116,6 +2260,11 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         }
     }
 
+    if (c->version >= 35)
+        /* Since 15.0 the client may read the timing of the stream from
+         * the srbchannel */
+        pa_tagstruct_putu32(reply, s->timing_index);
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 
 finish:
@@ -2552,6 +2701,7 @@ static void command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32
 
     pa_log_debug("Client enabled srbchannel.");
     pa_pstream_set_srbchannel(c->pstream, c->srbpending);
+    c->srb = c->srbpending;
     c->srbpending = NULL;
 }
 
@@ -3163,6 +3313,7 @@ static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sin
     pa_sink_assert_ref(sink);
 
     fixup_sample_spec(c, &fixed_ss, &sink->sample_spec);
+    pa_sink_update_stats(sink);
 
     pa_tagstruct_put(
         t,
@@ -3238,6 +3389,7 @@ static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
     pa_source_assert_ref(source);
 
     fixup_sample_spec(c, &fixed_ss, &source->sample_spec);
+    pa_source_update_stats(source);
 
     pa_tagstruct_put(
         t,
@@ -3404,6 +3556,7 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
     pa_sink_input_assert_ref(s);
 
     fixup_sample_spec(c, &fixed_ss, &s->sample_spec);
+    pa_sink_input_update_stats(s);
 
     has_volume = pa_sink_input_is_volume_readable(s);
     if (has_volume)
@@ -3447,6 +3600,7 @@ static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *
     pa_source_output_assert_ref(s);
 
     fixup_sample_spec(c, &fixed_ss, &s->sample_spec);
+    pa_source_output_update_stats(s);
 
     has_volume = pa_source_output_is_volume_readable(s);
     if (has_volume)
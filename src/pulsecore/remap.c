@@ -495,6 +495,150 @@ static void remap_arrange_ch4_float32ne_c(pa_remap_t *m, float *dst, const float
     }
 }
 
+/* Arrange for any number of output channels, one output channel at a time */
+#define DEFINE_REMAP_ARRANGE(format, type)                                              \
+static void remap_arrange_##format##_c(pa_remap_t *m, type *dst, const type *src, unsigned n) { \
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;                    \
+    const int8_t *arrange = m->state;                                                   \
+    unsigned oc, i;                                                                     \
+                                                                                        \
+    for (oc = 0; oc < n_oc; oc++) {                                                     \
+        const int ic = arrange[oc];                                                     \
+        const type *s = src + ic;                                                       \
+        type *d = dst + oc;                                                             \
+                                                                                        \
+        if (ic >= 0) {                                                                  \
+            for (i = n; i > 0; i--, s += n_ic, d += n_oc)                               \
+                *d = *s;                                                                \
+        } else {                                                                        \
+            for (i = n; i > 0; i--, d += n_oc)                                          \
+                *d = 0;                                                                 \
+        }                                                                               \
+    }                                                                                   \
+}
+
+DEFINE_REMAP_ARRANGE(s16ne, int16_t)
+DEFINE_REMAP_ARRANGE(s32ne, int32_t)
+DEFINE_REMAP_ARRANGE(float32ne, float)
+
+pa_remap_sparse_t *pa_setup_remap_sparse(const pa_remap_t *m) {
+    pa_remap_sparse_t *sparse;
+    unsigned ic, oc, n_ic, n_oc, n;
+
+    pa_assert(m);
+
+    n_ic = m->i_ss.channels;
+    n_oc = m->o_ss.channels;
+
+    /* The generic matrix code ignores negative volumes, the float and the
+     * integer table may differ in which small volumes are zero */
+    n = 0;
+    for (oc = 0; oc < n_oc; oc++)
+        for (ic = 0; ic < n_ic; ic++)
+            if (m->map_table_i[oc][ic] > 0 || m->map_table_f[oc][ic] > 0.0f)
+                n++;
+
+    /* Mixing to mono takes one pass over the data even for dense matrices */
+    if (n * 2 > n_ic * n_oc && n_oc > 1)
+        return NULL;
+
+    sparse = pa_xmalloc0(sizeof(pa_remap_sparse_t) + n * sizeof(sparse->terms[0]));
+
+    n = 0;
+    for (oc = 0; oc < n_oc; oc++) {
+        for (ic = 0; ic < n_ic; ic++) {
+            int32_t vol_i = m->map_table_i[oc][ic];
+            float vol_f = m->map_table_f[oc][ic];
+
+            if (vol_i <= 0 && vol_f <= 0.0f)
+                continue;
+
+            sparse->terms[n].ic = ic;
+            sparse->terms[n].vol_i = PA_CLAMP(vol_i, 0, 0x10000);
+            sparse->terms[n].vol_f = PA_CLAMP(vol_f, 0.0f, 1.0f);
+            sparse->n_terms[oc]++;
+            n++;
+        }
+    }
+
+    return sparse;
+}
+
+/* Computes each output channel in one pass over the data, from the used
+ * input channels only. The loops for up to 8 terms are written out, so that
+ * the compiler can keep the volumes in registers. The results are the same
+ * as those of the generic matrix code, integer sums wrap around the same
+ * way. */
+#define SPARSE_TERMS_1(MUL) MUL(s[ic[0]], v[0])
+#define SPARSE_TERMS_2(MUL) SPARSE_TERMS_1(MUL) + MUL(s[ic[1]], v[1])
+#define SPARSE_TERMS_3(MUL) SPARSE_TERMS_2(MUL) + MUL(s[ic[2]], v[2])
+#define SPARSE_TERMS_4(MUL) SPARSE_TERMS_3(MUL) + MUL(s[ic[3]], v[3])
+#define SPARSE_TERMS_5(MUL) SPARSE_TERMS_4(MUL) + MUL(s[ic[4]], v[4])
+#define SPARSE_TERMS_6(MUL) SPARSE_TERMS_5(MUL) + MUL(s[ic[5]], v[5])
+#define SPARSE_TERMS_7(MUL) SPARSE_TERMS_6(MUL) + MUL(s[ic[6]], v[6])
+#define SPARSE_TERMS_8(MUL) SPARSE_TERMS_7(MUL) + MUL(s[ic[7]], v[7])
+
+#define SPARSE_CASE(k, type, MUL)                                                       \
+            case k:                                                                     \
+                for (i = n; i > 0; i--, s += n_ic, d += n_oc)                           \
+                    *d = (type) (SPARSE_TERMS_##k(MUL));                                \
+                break;
+
+#define DEFINE_REMAP_SPARSE(format, type, sum_type, vol_type, vol, MUL)                 \
+static void remap_sparse_##format##_c(pa_remap_t *m, type *dst, const type *src, unsigned n) { \
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;                    \
+    const pa_remap_sparse_t *sparse = m->state;                                         \
+    unsigned oc, i, k, first = 0;                                                       \
+                                                                                        \
+    for (oc = 0; oc < n_oc; oc++) {                                                     \
+        const unsigned n_terms = sparse->n_terms[oc];                                   \
+        unsigned ic[PA_CHANNELS_MAX];                                                   \
+        vol_type v[PA_CHANNELS_MAX];                                                    \
+        const type *s = src;                                                            \
+        type *d = dst + oc;                                                             \
+                                                                                        \
+        /* Local copies, which the output can't alias */                               \
+        for (k = 0; k < n_terms; k++) {                                                 \
+            ic[k] = sparse->terms[first + k].ic;                                        \
+            v[k] = sparse->terms[first + k].vol;                                        \
+        }                                                                               \
+                                                                                        \
+        switch (n_terms) {                                                              \
+            case 0:                                                                     \
+                for (i = n; i > 0; i--, d += n_oc)                                      \
+                    *d = 0;                                                             \
+                break;                                                                  \
+            SPARSE_CASE(1, type, MUL)                                                   \
+            SPARSE_CASE(2, type, MUL)                                                   \
+            SPARSE_CASE(3, type, MUL)                                                   \
+            SPARSE_CASE(4, type, MUL)                                                   \
+            SPARSE_CASE(5, type, MUL)                                                   \
+            SPARSE_CASE(6, type, MUL)                                                   \
+            SPARSE_CASE(7, type, MUL)                                                   \
+            SPARSE_CASE(8, type, MUL)                                                   \
+            default:                                                                    \
+                for (i = n; i > 0; i--, s += n_ic, d += n_oc) {                         \
+                    sum_type sum = 0;                                                   \
+                                                                                        \
+                    for (k = 0; k < n_terms; k++)                                       \
+                        sum += MUL(s[ic[k]], v[k]);                                     \
+                    *d = (type) sum;                                                    \
+                }                                                                       \
+                break;                                                                  \
+        }                                                                               \
+                                                                                        \
+        first += n_terms;                                                               \
+    }                                                                                   \
+}
+
+#define MUL_S16(x, vol) ((int32_t) (x) * (vol) >> 16)
+#define MUL_S32(x, vol) ((int64_t) (x) * (vol) >> 16)
+#define MUL_FLOAT(x, vol) ((x) * (vol))
+
+DEFINE_REMAP_SPARSE(s16ne, int16_t, int32_t, int32_t, vol_i, MUL_S16)
+DEFINE_REMAP_SPARSE(s32ne, int32_t, int64_t, int32_t, vol_i, MUL_S32)
+DEFINE_REMAP_SPARSE(float32ne, float, float, float, vol_f, MUL_FLOAT)
+
 void pa_set_remap_func(pa_remap_t *m, pa_do_remap_func_t func_s16,
     pa_do_remap_func_t func_s32, pa_do_remap_func_t func_float) {
 
@@ -587,6 +731,24 @@ static void init_remap_c(pa_remap_t *m) {
 
         /* setup state */
         m->state = pa_xnewdup(int8_t, arrange, PA_CHANNELS_MAX);
+    } else if (pa_setup_remap_arrange(m, arrange)) {
+
+        pa_log_info("Using %u-channel arrange remapping", n_oc);
+        pa_set_remap_func(m, (pa_do_remap_func_t) remap_arrange_s16ne_c,
+            (pa_do_remap_func_t) remap_arrange_s32ne_c,
+            (pa_do_remap_func_t) remap_arrange_float32ne_c);
+
+        /* setup state */
+        m->state = pa_xnewdup(int8_t, arrange, PA_CHANNELS_MAX);
+    } else if ((m->state = pa_setup_remap_sparse(m))) {
+
+        if (n_oc == 1)
+            pa_log_info("Using mix to mono remapping");
+        else
+            pa_log_info("Using sparse matrix remapping");
+        pa_set_remap_func(m, (pa_do_remap_func_t) remap_sparse_s16ne_c,
+            (pa_do_remap_func_t) remap_sparse_s32ne_c,
+            (pa_do_remap_func_t) remap_sparse_float32ne_c);
     } else {
 
         pa_log_info("Using generic matrix remapping");
@@ -54,6 +54,23 @@ void pa_set_init_remap_func(pa_init_remap_func_t func);
  */
 bool pa_setup_remap_arrange(const pa_remap_t *m, int8_t arrange[PA_CHANNELS_MAX]);
 
+/* The non-zero entries of a sparse matrix, ordered by output channel.
+ * Output channel oc is the sum of the next n_terms[oc] terms. Volumes are
+ * clamped to 0..1, like the generic matrix code does. */
+typedef struct pa_remap_sparse {
+    uint8_t n_terms[PA_CHANNELS_MAX];
+    struct {
+        uint8_t ic;
+        int32_t vol_i;
+        float vol_f;
+    } terms[];
+} pa_remap_sparse_t;
+
+/* Check if at most half of the matrix entries are used, or if there is only
+ * one output channel. Returns a newly allocated pa_remap_sparse_t, to be
+ * freed with pa_xfree(), or NULL otherwise. */
+pa_remap_sparse_t *pa_setup_remap_sparse(const pa_remap_t *m);
+
 void pa_set_remap_func(pa_remap_t *m, pa_do_remap_func_t func_s16,
     pa_do_remap_func_t func_s32, pa_do_remap_func_t func_float);
 
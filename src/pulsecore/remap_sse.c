@@ -24,12 +24,17 @@
 
 #include <pulse/sample.h>
 #include <pulse/volume.h>
+#include <pulse/xmalloc.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
 #include "cpu-x86.h"
 #include "remap.h"
 
+#if defined (__i386__) || defined (__amd64__)
+#include <emmintrin.h>
+#endif
+
 #define LOAD_SAMPLES                                   \
                 " movdqu (%1), %%xmm0           \n\t"  \
                 " movdqu 16(%1), %%xmm2         \n\t"  \
@@ -122,6 +127,118 @@ static void remap_mono_to_stereo_any32ne_sse2(pa_remap_t *m, float *dst, const f
     );
 }
 
+/* Volumes for up to 8 output channels from mono or stereo, for a whole
+ * frame at a time. For s16, _mm_mulhi_epi16() takes the lower 16 bits of the
+ * volume as a signed number, which is 0x10000 too little for volumes of
+ * 0x8000 and above, so for those the input is added once more. */
+struct upmix_volume {
+    float f[2][8];
+    int32_t i[2][8];
+    int16_t lo[2][8];
+    int16_t add[2][8];
+};
+
+static struct upmix_volume *upmix_volume_new(const pa_remap_t *m) {
+    struct upmix_volume *v;
+    unsigned ic, oc;
+
+    v = pa_xnew0(struct upmix_volume, 1);
+
+    for (ic = 0; ic < m->i_ss.channels; ic++)
+        for (oc = 0; oc < m->o_ss.channels; oc++) {
+            /* Clamped like in the generic matrix code */
+            int32_t vol = PA_CLAMP(m->map_table_i[oc][ic], 0, 0x10000);
+
+            v->f[ic][oc] = PA_CLAMP(m->map_table_f[oc][ic], 0.0f, 1.0f);
+            v->i[ic][oc] = vol;
+            v->lo[ic][oc] = (int16_t) (vol & 0xFFFF);
+            v->add[ic][oc] = vol >= 0x8000 ? -1 : 0;
+        }
+
+    return v;
+}
+
+/* Every frame is stored with a whole vector, the lanes beyond the frame are
+ * overwritten by the next frame. Frames that would store beyond the end of
+ * the output are done in C. */
+__attribute__ ((target ("sse2")))
+static void remap_upmix_float32ne_sse2(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const struct upmix_volume *v = m->state;
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const unsigned width = n_oc > 4 ? 8 : 4;
+    __m128 l0, l1, r0, r1, x, y0, y1;
+    unsigned oc;
+
+    l0 = _mm_loadu_ps(v->f[0]);
+    l1 = _mm_loadu_ps(v->f[0] + 4);
+    r0 = _mm_loadu_ps(v->f[1]);
+    r1 = _mm_loadu_ps(v->f[1] + 4);
+
+    for (; n * n_oc >= width; n--) {
+        x = _mm_set1_ps(src[0]);
+        y0 = _mm_mul_ps(x, l0);
+        y1 = _mm_mul_ps(x, l1);
+
+        if (n_ic == 2) {
+            x = _mm_set1_ps(src[1]);
+            y0 = _mm_add_ps(y0, _mm_mul_ps(x, r0));
+            y1 = _mm_add_ps(y1, _mm_mul_ps(x, r1));
+        }
+
+        _mm_storeu_ps(dst, y0);
+        if (width == 8)
+            _mm_storeu_ps(dst + 4, y1);
+
+        src += n_ic;
+        dst += n_oc;
+    }
+
+    for (; n > 0; n--) {
+        for (oc = 0; oc < n_oc; oc++)
+            *dst++ = src[0] * v->f[0][oc] + (n_ic == 2 ? src[1] * v->f[1][oc] : 0.0f);
+        src += n_ic;
+    }
+}
+
+__attribute__ ((target ("sse2")))
+static void remap_upmix_s16ne_sse2(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n) {
+    const struct upmix_volume *v = m->state;
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    __m128i lo0, lo1, add0, add1, x, y;
+    unsigned oc;
+
+    lo0 = _mm_loadu_si128((const __m128i *) v->lo[0]);
+    lo1 = _mm_loadu_si128((const __m128i *) v->lo[1]);
+    add0 = _mm_loadu_si128((const __m128i *) v->add[0]);
+    add1 = _mm_loadu_si128((const __m128i *) v->add[1]);
+
+    for (; n * n_oc >= 8; n--) {
+        x = _mm_set1_epi16(src[0]);
+        y = _mm_add_epi16(_mm_mulhi_epi16(x, lo0), _mm_and_si128(x, add0));
+
+        if (n_ic == 2) {
+            x = _mm_set1_epi16(src[1]);
+            y = _mm_add_epi16(y, _mm_add_epi16(_mm_mulhi_epi16(x, lo1), _mm_and_si128(x, add1)));
+        }
+
+        _mm_storeu_si128((__m128i *) dst, y);
+
+        src += n_ic;
+        dst += n_oc;
+    }
+
+    for (; n > 0; n--) {
+        for (oc = 0; oc < n_oc; oc++) {
+            int16_t d = (int16_t) (((int32_t) src[0] * v->i[0][oc]) >> 16);
+
+            if (n_ic == 2)
+                d += (int16_t) (((int32_t) src[1] * v->i[1][oc]) >> 16);
+            *dst++ = d;
+        }
+        src += n_ic;
+    }
+}
+
 /* set the function that will execute the remapping based on the matrices */
 static void init_remap_sse2(pa_remap_t *m) {
     unsigned n_oc, n_ic;
@@ -137,6 +254,14 @@ static void init_remap_sse2(pa_remap_t *m) {
         pa_set_remap_func(m, (pa_do_remap_func_t) remap_mono_to_stereo_s16ne_sse2,
             (pa_do_remap_func_t) remap_mono_to_stereo_any32ne_sse2,
             (pa_do_remap_func_t) remap_mono_to_stereo_any32ne_sse2);
+    } else if (n_ic <= 2 && n_oc > 2 && n_oc <= 8 && m->format != PA_SAMPLE_S32NE) {
+
+        pa_log_info("Using SSE2 upmix remapping");
+        pa_set_remap_func(m, (pa_do_remap_func_t) remap_upmix_s16ne_sse2,
+            NULL,
+            (pa_do_remap_func_t) remap_upmix_float32ne_sse2);
+
+        m->state = upmix_volume_new(m);
     }
 }
 #endif /* defined (__i386__) || defined (__amd64__) */
@@ -482,6 +482,7 @@ void pa_resampler_set_input_rate(pa_resampler *r, uint32_t rate) {
     r->i_ss.rate = rate;
 
     r->impl.update_rates(r);
+    r->input_frames = 0;
 }
 
 void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate) {
@@ -495,6 +496,7 @@ void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate) {
     r->o_ss.rate = rate;
 
     r->impl.update_rates(r);
+    r->input_frames = 0;
 
     if (r->lfe_filter)
         pa_lfe_filter_update_rate(r->lfe_filter, rate);
@@ -586,6 +588,7 @@ void pa_resampler_reset(pa_resampler *r) {
         pa_lfe_filter_reset(r->lfe_filter);
 
     *r->have_leftover = false;
+    r->input_frames = 0;
 }
 
 void pa_resampler_rewind(pa_resampler *r, size_t out_frames) {
@@ -600,6 +603,7 @@ void pa_resampler_rewind(pa_resampler *r, size_t out_frames) {
         pa_lfe_filter_rewind(r->lfe_filter, out_frames);
 
     *r->have_leftover = false;
+    r->input_frames = 0;
 }
 
 pa_resample_method_t pa_resampler_get_method(pa_resampler *r) {
@@ -608,6 +612,25 @@ pa_resample_method_t pa_resampler_get_method(pa_resampler *r) {
     return r->method;
 }
 
+uint64_t pa_resampler_get_input_frames(pa_resampler *r) {
+    pa_assert(r);
+
+    return r->input_frames;
+}
+
+bool pa_resampler_same_conversion(pa_resampler *a, pa_resampler *b) {
+    pa_assert(a);
+    pa_assert(b);
+
+    return a->method == b->method &&
+        a->flags == b->flags &&
+        pa_sample_spec_equal(&a->i_ss, &b->i_ss) &&
+        pa_sample_spec_equal(&a->o_ss, &b->o_ss) &&
+        pa_channel_map_equal(&a->i_cm, &b->i_cm) &&
+        pa_channel_map_equal(&a->o_cm, &b->o_cm) &&
+        !a->lfe_filter == !b->lfe_filter;
+}
+
 const pa_channel_map* pa_resampler_input_channel_map(pa_resampler *r) {
     pa_assert(r);
 
@@ -1468,6 +1491,8 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
     pa_assert(in->memblock);
     pa_assert(in->length % r->i_fz == 0);
 
+    r->input_frames += in->length / r->i_fz;
+
     buf = (pa_memchunk*) in;
     buf = convert_to_work_format(r, buf);
 
@@ -111,6 +111,9 @@ struct pa_resampler {
 
     pa_lfe_filter_t *lfe_filter;
 
+    /* Input frames taken since the last reset or rate change */
+    uint64_t input_frames;
+
     pa_resampler_impl impl;
 };
 
@@ -153,6 +156,14 @@ void pa_resampler_rewind(pa_resampler *r, size_t out_frames);
 /* Return the resampling method of the resampler object */
 pa_resample_method_t pa_resampler_get_method(pa_resampler *r);
 
+/* Return the number of input frames the resampler has taken since it was
+ * created, reset or had its rates changed */
+uint64_t pa_resampler_get_input_frames(pa_resampler *r);
+
+/* Return true if both resampler objects do the same conversion, i.e. they
+ * produce the same output when run on the same input */
+bool pa_resampler_same_conversion(pa_resampler *a, pa_resampler *b);
+
 /* Try to parse the resampler method */
 pa_resample_method_t pa_parse_resample_method(const char *string);
 
@@ -97,6 +97,18 @@ static unsigned ffmpeg_resample(pa_resampler *r, const pa_memchunk *input, unsig
     return in_n_frames - previous_consumed_frames;
 }
 
+static void ffmpeg_reset(pa_resampler *r) {
+    struct ffmpeg_data *ffmpeg_data;
+
+    pa_assert(r);
+
+    ffmpeg_data = r->impl.data;
+
+    /* The unused input is dropped with the leftover, so the position
+     * within it has to go too */
+    av_resample_reset(ffmpeg_data->state);
+}
+
 static void ffmpeg_free(pa_resampler *r) {
     struct ffmpeg_data *ffmpeg_data;
 
@@ -125,6 +137,7 @@ int pa_resampler_ffmpeg_init(pa_resampler *r) {
     }
 
     r->impl.free = ffmpeg_free;
+    r->impl.reset = ffmpeg_reset;
     r->impl.resample = ffmpeg_resample;
     r->impl.data = (void *) ffmpeg_data;
 
@@ -0,0 +1,126 @@
+#ifndef foos24ssehfoo
+#define foos24ssehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <tmmintrin.h>
+
+/* SSSE3 loads and stores of 16 S24 or S24_32 samples at a time. In
+ * registers the samples are 32 bit integers with the 24 bits of the sample
+ * in the upper bits, like the generic code in sconv-s16le.c has them, so
+ * that the same kernels work for all four formats. */
+
+/* Splits 48 bytes of packed 24 bit samples into four vectors, using 'mask'
+ * to place the three bytes of each sample into the upper bytes of a lane */
+__attribute__ ((target ("ssse3")))
+static inline void s24_load_ssse3(const uint8_t *a, __m128i mask, __m128i v[4]) {
+    __m128i x0, x1, x2;
+
+    x0 = _mm_loadu_si128((const __m128i *) a);
+    x1 = _mm_loadu_si128((const __m128i *) (a + 16));
+    x2 = _mm_loadu_si128((const __m128i *) (a + 32));
+
+    v[0] = _mm_shuffle_epi8(x0, mask);
+    v[1] = _mm_shuffle_epi8(_mm_alignr_epi8(x1, x0, 12), mask);
+    v[2] = _mm_shuffle_epi8(_mm_alignr_epi8(x2, x1, 8), mask);
+    v[3] = _mm_shuffle_epi8(_mm_srli_si128(x2, 4), mask);
+}
+
+/* The reverse of s24_load_ssse3(), 'mask' places the upper three bytes of
+ * each lane into the lower 12 bytes of the vector */
+__attribute__ ((target ("ssse3")))
+static inline void s24_store_ssse3(uint8_t *b, __m128i mask, const __m128i v[4]) {
+    __m128i c0, c1, c2, c3;
+
+    c0 = _mm_shuffle_epi8(v[0], mask);
+    c1 = _mm_shuffle_epi8(v[1], mask);
+    c2 = _mm_shuffle_epi8(v[2], mask);
+    c3 = _mm_shuffle_epi8(v[3], mask);
+
+    _mm_storeu_si128((__m128i *) b, _mm_or_si128(c0, _mm_slli_si128(c1, 12)));
+    _mm_storeu_si128((__m128i *) (b + 16), _mm_or_si128(_mm_srli_si128(c1, 4), _mm_slli_si128(c2, 8)));
+    _mm_storeu_si128((__m128i *) (b + 32), _mm_or_si128(_mm_srli_si128(c2, 8), _mm_slli_si128(c3, 4)));
+}
+
+#define S24LE_LOAD_MASK _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11)
+#define S24BE_LOAD_MASK _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9)
+#define S24LE_STORE_MASK _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1)
+#define S24BE_STORE_MASK _mm_setr_epi8(3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1)
+
+__attribute__ ((target ("ssse3")))
+static inline void s24le_load_ssse3(const uint8_t *a, __m128i v[4]) {
+    s24_load_ssse3(a, S24LE_LOAD_MASK, v);
+}
+
+__attribute__ ((target ("ssse3")))
+static inline void s24le_store_ssse3(uint8_t *b, const __m128i v[4]) {
+    s24_store_ssse3(b, S24LE_STORE_MASK, v);
+}
+
+__attribute__ ((target ("ssse3")))
+static inline void s24be_load_ssse3(const uint8_t *a, __m128i v[4]) {
+    s24_load_ssse3(a, S24BE_LOAD_MASK, v);
+}
+
+__attribute__ ((target ("ssse3")))
+static inline void s24be_store_ssse3(uint8_t *b, const __m128i v[4]) {
+    s24_store_ssse3(b, S24BE_STORE_MASK, v);
+}
+
+/* S24_32 keeps the sample in the lower 24 bits of 32. Like in the generic
+ * code the upper byte is ignored when reading and written as 0. */
+__attribute__ ((target ("ssse3")))
+static inline void s24_32le_load_ssse3(const uint8_t *a, __m128i v[4]) {
+    unsigned i;
+
+    for (i = 0; i < 4; i++)
+        v[i] = _mm_slli_epi32(_mm_loadu_si128((const __m128i *) (a + 16 * i)), 8);
+}
+
+__attribute__ ((target ("ssse3")))
+static inline void s24_32le_store_ssse3(uint8_t *b, const __m128i v[4]) {
+    unsigned i;
+
+    for (i = 0; i < 4; i++)
+        _mm_storeu_si128((__m128i *) (b + 16 * i), _mm_srli_epi32(v[i], 8));
+}
+
+#define S24_32BE_LOAD_MASK _mm_setr_epi8(-1, 3, 2, 1, -1, 7, 6, 5, -1, 11, 10, 9, -1, 15, 14, 13)
+#define S24_32BE_STORE_MASK _mm_setr_epi8(-1, 3, 2, 1, -1, 7, 6, 5, -1, 11, 10, 9, -1, 15, 14, 13)
+
+__attribute__ ((target ("ssse3")))
+static inline void s24_32be_load_ssse3(const uint8_t *a, __m128i v[4]) {
+    unsigned i;
+
+    for (i = 0; i < 4; i++)
+        v[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (a + 16 * i)), S24_32BE_LOAD_MASK);
+}
+
+__attribute__ ((target ("ssse3")))
+static inline void s24_32be_store_ssse3(uint8_t *b, const __m128i v[4]) {
+    unsigned i;
+
+    for (i = 0; i < 4; i++)
+        _mm_storeu_si128((__m128i *) (b + 16 * i), _mm_shuffle_epi8(v[i], S24_32BE_STORE_MASK));
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+#endif
@@ -22,6 +22,7 @@
 #include <config.h>
 #endif
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -29,7 +30,12 @@
 #include <pulsecore/endianmacros.h>
 
 #include "cpu-x86.h"
+#include "g711.h"
+#include "g711_sse.h"
+#include "s24_sse.h"
 #include "sconv.h"
+#include "sconv-s16be.h"
+#include "sconv-s16le.h"
 
 #if (!defined(__APPLE__) && !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && defined (__i386__)) || defined (__amd64__)
 
@@ -160,6 +166,200 @@ static void pa_sconv_s16le_from_f32ne_sse2(unsigned n, const float *a, int16_t *
 
 #endif /* defined (__i386__) || defined (__amd64__) */
 
+#if defined (__i386__) || defined (__amd64__)
+
+/* Unpacks 16 bytes into four vectors of 32 bit lanes */
+__attribute__ ((target ("sse2")))
+static inline void g711_load_sse2(const uint8_t *a, __m128i v[4]) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i x, lo, hi;
+
+    x = _mm_loadu_si128((const __m128i *) a);
+    lo = _mm_unpacklo_epi8(x, zero);
+    hi = _mm_unpackhi_epi8(x, zero);
+
+    v[0] = _mm_unpacklo_epi16(lo, zero);
+    v[1] = _mm_unpackhi_epi16(lo, zero);
+    v[2] = _mm_unpacklo_epi16(hi, zero);
+    v[3] = _mm_unpackhi_epi16(hi, zero);
+}
+
+/* Packs four vectors of codes into 16 bytes */
+__attribute__ ((target ("sse2")))
+static inline void g711_store_sse2(uint8_t *b, const __m128i v[4]) {
+    _mm_storeu_si128((__m128i *) b, _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3])));
+}
+
+/* Loads 16 s16 samples, shifted right by 'shift' bits, into four vectors */
+#define G711_LOAD_S16_SSE2(a, v, shift)                                                         \
+    do {                                                                                        \
+        __m128i _x0 = _mm_loadu_si128((const __m128i *) (a));                                   \
+        __m128i _x1 = _mm_loadu_si128((const __m128i *) ((a) + 8));                             \
+        (v)[0] = _mm_srai_epi32(_mm_unpacklo_epi16(_x0, _x0), 16 + (shift));                    \
+        (v)[1] = _mm_srai_epi32(_mm_unpackhi_epi16(_x0, _x0), 16 + (shift));                    \
+        (v)[2] = _mm_srai_epi32(_mm_unpacklo_epi16(_x1, _x1), 16 + (shift));                    \
+        (v)[3] = _mm_srai_epi32(_mm_unpackhi_epi16(_x1, _x1), 16 + (shift));                    \
+    } while (0)
+
+/* Defines the four conversions of a companding law. 'shift' and 'scale'
+ * match the ones of the generic code in sconv.c. */
+#define DEFINE_G711_SSE2(law, shift, scale, decode, encode)                                     \
+__attribute__ ((target ("sse2")))                                                              \
+static void law##_to_s16ne_sse2(unsigned n, const uint8_t *a, int16_t *b) {                    \
+    for (; n >= 16; n -= 16, a += 16, b += 16) {                                                \
+        __m128i v[4];                                                                           \
+                                                                                                \
+        g711_load_sse2(a, v);                                                                   \
+        v[0] = g711_##law##_decode_sse2(v[0]);                                                  \
+        v[1] = g711_##law##_decode_sse2(v[1]);                                                  \
+        v[2] = g711_##law##_decode_sse2(v[2]);                                                  \
+        v[3] = g711_##law##_decode_sse2(v[3]);                                                  \
+        _mm_storeu_si128((__m128i *) b, _mm_packs_epi32(v[0], v[1]));                           \
+        _mm_storeu_si128((__m128i *) (b + 8), _mm_packs_epi32(v[2], v[3]));                     \
+    }                                                                                           \
+                                                                                                \
+    for (; n > 0; n--, a++, b++)                                                                \
+        *b = decode(*a);                                                                        \
+}                                                                                               \
+                                                                                                \
+__attribute__ ((target ("sse2")))                                                              \
+static void law##_from_s16ne_sse2(unsigned n, const int16_t *a, uint8_t *b) {                  \
+    for (; n >= 16; n -= 16, a += 16, b += 16) {                                                \
+        __m128i v[4];                                                                           \
+                                                                                                \
+        G711_LOAD_S16_SSE2(a, v, shift);                                                        \
+        v[0] = g711_##law##_encode_sse2(v[0]);                                                  \
+        v[1] = g711_##law##_encode_sse2(v[1]);                                                  \
+        v[2] = g711_##law##_encode_sse2(v[2]);                                                  \
+        v[3] = g711_##law##_encode_sse2(v[3]);                                                  \
+        g711_store_sse2(b, v);                                                                  \
+    }                                                                                           \
+                                                                                                \
+    for (; n > 0; n--, a++, b++)                                                                \
+        *b = encode(*a >> (shift));                                                             \
+}                                                                                               \
+                                                                                                \
+__attribute__ ((target ("sse2")))                                                              \
+static void law##_to_float32ne_sse2(unsigned n, const uint8_t *a, float *b) {                  \
+    const __m128 f = _mm_set1_ps(1.0f / 0x8000);                                               \
+                                                                                                \
+    for (; n >= 16; n -= 16, a += 16, b += 16) {                                                \
+        __m128i v[4];                                                                           \
+        unsigned i;                                                                             \
+                                                                                                \
+        g711_load_sse2(a, v);                                                                   \
+        for (i = 0; i < 4; i++)                                                                 \
+            _mm_storeu_ps(b + 4 * i, _mm_mul_ps(_mm_cvtepi32_ps(g711_##law##_decode_sse2(v[i])), f)); \
+    }                                                                                           \
+                                                                                                \
+    for (; n > 0; n--, a++, b++)                                                                \
+        *b = (float) decode(*a) / 0x8000;                                                       \
+}                                                                                               \
+                                                                                                \
+__attribute__ ((target ("sse2")))                                                              \
+static void law##_from_float32ne_sse2(unsigned n, const float *a, uint8_t *b) {                \
+    const __m128 min = _mm_set1_ps(-1.0f), max = _mm_set1_ps(1.0f), f = _mm_set1_ps(scale);   \
+                                                                                                \
+    for (; n >= 16; n -= 16, a += 16, b += 16) {                                                \
+        __m128i v[4];                                                                           \
+        unsigned i;                                                                             \
+                                                                                                \
+        for (i = 0; i < 4; i++) {                                                               \
+            __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(a + 4 * i), min), max);               \
+            v[i] = g711_##law##_encode_sse2(_mm_cvtps_epi32(_mm_mul_ps(x, f)));                 \
+        }                                                                                       \
+        g711_store_sse2(b, v);                                                                  \
+    }                                                                                           \
+                                                                                                \
+    for (; n > 0; n--, a++, b++) {                                                              \
+        float v = *a;                                                                           \
+        v = PA_CLAMP_UNLIKELY(v, -1.0f, 1.0f);                                                  \
+        v *= (scale);                                                                           \
+        *b = encode((int16_t) lrintf(v));                                                       \
+    }                                                                                           \
+}
+
+DEFINE_G711_SSE2(ulaw, 2, 0x1FFF, st_ulaw2linear16, st_14linear2ulaw)
+DEFINE_G711_SSE2(alaw, 3, 0xFFF, st_alaw2linear16, st_13linear2alaw)
+
+/* Defines the conversions of a 24 bit format, using the load and store
+ * functions of s24_sse.h. The remaining samples are left to the generic
+ * code. */
+#define DEFINE_S24_SSSE3(format, size)                                                          \
+__attribute__ ((target ("ssse3")))                                                             \
+static void format##_to_float32ne_ssse3(unsigned n, const uint8_t *a, float *b) {              \
+    const __m128 f = _mm_set1_ps(1.0f / (1U << 31));                                           \
+                                                                                                \
+    for (; n >= 16; n -= 16, a += 16 * (size), b += 16) {                                       \
+        __m128i v[4];                                                                           \
+        unsigned i;                                                                             \
+                                                                                                \
+        format##_load_ssse3(a, v);                                                              \
+        for (i = 0; i < 4; i++)                                                                 \
+            _mm_storeu_ps(b + 4 * i, _mm_mul_ps(_mm_cvtepi32_ps(v[i]), f));                     \
+    }                                                                                           \
+                                                                                                \
+    pa_sconv_##format##_to_float32ne(n, (const void *) a, b);                                   \
+}                                                                                               \
+                                                                                                \
+__attribute__ ((target ("ssse3")))                                                             \
+static void format##_from_float32ne_ssse3(unsigned n, const float *a, uint8_t *b) {            \
+    /* 'max' is the largest float below 2^31, so the conversion can't overflow */               \
+    const __m128 f = _mm_set1_ps(1U << 31), min = _mm_set1_ps(-2147483648.0f), max = _mm_set1_ps(2147483520.0f); \
+                                                                                                \
+    for (; n >= 16; n -= 16, a += 16, b += 16 * (size)) {                                       \
+        __m128i v[4];                                                                           \
+        unsigned i;                                                                             \
+                                                                                                \
+        for (i = 0; i < 4; i++) {                                                               \
+            __m128 x = _mm_mul_ps(_mm_loadu_ps(a + 4 * i), f);                                  \
+            v[i] = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(x, min), max));                        \
+        }                                                                                       \
+        format##_store_ssse3(b, v);                                                             \
+    }                                                                                           \
+                                                                                                \
+    pa_sconv_##format##_from_float32ne(n, a, (void *) b);                                       \
+}                                                                                               \
+                                                                                                \
+__attribute__ ((target ("ssse3")))                                                             \
+static void format##_to_s16ne_ssse3(unsigned n, const uint8_t *a, int16_t *b) {                \
+    for (; n >= 16; n -= 16, a += 16 * (size), b += 16) {                                      \
+        __m128i v[4];                                                                           \
+                                                                                                \
+        format##_load_ssse3(a, v);                                                              \
+        _mm_storeu_si128((__m128i *) b, _mm_packs_epi32(_mm_srai_epi32(v[0], 16), _mm_srai_epi32(v[1], 16))); \
+        _mm_storeu_si128((__m128i *) (b + 8), _mm_packs_epi32(_mm_srai_epi32(v[2], 16), _mm_srai_epi32(v[3], 16))); \
+    }                                                                                           \
+                                                                                                \
+    pa_sconv_##format##_to_s16ne(n, (const void *) a, b);                                       \
+}                                                                                               \
+                                                                                                \
+__attribute__ ((target ("ssse3")))                                                             \
+static void format##_from_s16ne_ssse3(unsigned n, const int16_t *a, uint8_t *b) {              \
+    const __m128i zero = _mm_setzero_si128();                                                   \
+                                                                                                \
+    for (; n >= 16; n -= 16, a += 16, b += 16 * (size)) {                                       \
+        __m128i v[4], x0, x1;                                                                   \
+                                                                                                \
+        x0 = _mm_loadu_si128((const __m128i *) a);                                              \
+        x1 = _mm_loadu_si128((const __m128i *) (a + 8));                                        \
+        v[0] = _mm_unpacklo_epi16(zero, x0);                                                    \
+        v[1] = _mm_unpackhi_epi16(zero, x0);                                                    \
+        v[2] = _mm_unpacklo_epi16(zero, x1);                                                    \
+        v[3] = _mm_unpackhi_epi16(zero, x1);                                                    \
+        format##_store_ssse3(b, v);                                                             \
+    }                                                                                           \
+                                                                                                \
+    pa_sconv_##format##_from_s16ne(n, a, (void *) b);                                           \
+}
+
+DEFINE_S24_SSSE3(s24le, 3)
+DEFINE_S24_SSSE3(s24be, 3)
+DEFINE_S24_SSSE3(s24_32le, 4)
+DEFINE_S24_SSSE3(s24_32be, 4)
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
 void pa_convert_func_init_sse(pa_cpu_x86_flag_t flags) {
 #if (!defined(__APPLE__) && !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && defined (__i386__)) || defined (__amd64__)
 
@@ -174,4 +374,38 @@ void pa_convert_func_init_sse(pa_cpu_x86_flag_t flags) {
     }
 
 #endif /* defined (__i386__) || defined (__amd64__) */
+
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized G.711 conversions.");
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_to_s16ne_sse2);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_from_s16ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_to_float32ne_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_from_float32ne_sse2);
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_to_s16ne_sse2);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_from_s16ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_to_float32ne_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_from_float32ne_sse2);
+    }
+
+    if (flags & PA_CPU_X86_SSSE3) {
+        pa_log_info("Initialising SSSE3 optimized 24 bit conversions.");
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) s24le_to_float32ne_ssse3);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) s24le_from_float32ne_ssse3);
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) s24le_to_s16ne_ssse3);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) s24le_from_s16ne_ssse3);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24BE, (pa_convert_func_t) s24be_to_float32ne_ssse3);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24BE, (pa_convert_func_t) s24be_from_float32ne_ssse3);
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_S24BE, (pa_convert_func_t) s24be_to_s16ne_ssse3);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_S24BE, (pa_convert_func_t) s24be_from_s16ne_ssse3);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) s24_32le_to_float32ne_ssse3);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) s24_32le_from_float32ne_ssse3);
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) s24_32le_to_s16ne_ssse3);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) s24_32le_from_s16ne_ssse3);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32BE, (pa_convert_func_t) s24_32be_to_float32ne_ssse3);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32BE, (pa_convert_func_t) s24_32be_from_float32ne_ssse3);
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_S24_32BE, (pa_convert_func_t) s24_32be_to_s16ne_ssse3);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_S24_32BE, (pa_convert_func_t) s24_32be_from_s16ne_ssse3);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
 }
@@ -0,0 +1,72 @@
+#ifndef foopulsecoreseqlockhfoo
+#define foopulsecoreseqlockhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <string.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+/* A sequence lock, for publishing a small struct from a realtime thread
+ * to other threads without ever blocking the writer. The sequence number
+ * is odd while the data is being written. Readers copy the data and try
+ * again if the sequence number was odd or changed in the meantime. Only
+ * one thread may write at a time. */
+
+#define PA_SEQLOCK_READ_TRIES 16
+
+typedef struct pa_seqlock {
+    pa_atomic_t seq;
+} pa_seqlock;
+
+/* Copies size bytes from src to data */
+static inline void pa_seqlock_write(pa_seqlock *l, void *data, const void *src, size_t size) {
+    pa_assert(l);
+
+    /* Both are full memory barriers, so the data is written in between */
+    pa_atomic_inc(&l->seq);
+    memcpy(data, src, size);
+    pa_atomic_inc(&l->seq);
+}
+
+/* Copies size bytes from data to dst. Returns false if no consistent copy
+ * could be made, because the writer kept updating the data. */
+static inline bool pa_seqlock_read(pa_seqlock *l, void *dst, const void *data, size_t size) {
+    unsigned n;
+
+    pa_assert(l);
+
+    for (n = 0; n < PA_SEQLOCK_READ_TRIES; n++) {
+        int s = pa_atomic_load(&l->seq);
+
+        if (s & 1)
+            continue;
+
+        memcpy(dst, data, size);
+
+        /* A full memory barrier too, which makes sure the copy is complete
+         * before the sequence number is checked again */
+        if (pa_atomic_cmpxchg(&l->seq, s, s))
+            return true;
+    }
+
+    return false;
+}
+
+#endif
@@ -29,6 +29,8 @@
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
 #include <pulse/internal.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-format.h>
 #include <pulsecore/mix.h>
@@ -45,6 +47,9 @@
 
 #define MEMBLOCKQ_MAXLENGTH (32*1024*1024)
 #define CONVERT_BUFFER_LENGTH (pa_page_size())
+#define VOLUME_RAMP_USEC (10*PA_USEC_PER_MSEC)
+/* How far ahead of the playback position a volume change starts */
+#define VOLUME_REWIND_MARGIN_USEC (5*PA_USEC_PER_MSEC)
 
 PA_DEFINE_PUBLIC_CLASS(pa_sink_input, pa_msgobject);
 
@@ -554,6 +559,7 @@ int pa_sink_input_new(
     i->thread_info.resampler = resampler;
     i->thread_info.soft_volume = i->soft_volume;
     i->thread_info.muted = i->muted;
+    i->thread_info.ramp_length = i->thread_info.ramp_pos = 0;
     i->thread_info.requested_sink_latency = (pa_usec_t) -1;
     i->thread_info.rewrite_nbytes = 0;
     i->thread_info.rewrite_flush = false;
@@ -722,6 +728,8 @@ void pa_sink_input_unlink(pa_sink_input *i) {
         if (pa_sink_flat_volume_enabled(i->sink))
             pa_sink_set_volume(i->sink, NULL, false, false);
 
+        pa_sink_flush_input_volume_batch(i->sink);
+
         if (i->sink->asyncmsgq)
             pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_REMOVE_INPUT, i, 0, NULL) == 0);
     }
@@ -866,6 +874,34 @@ pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency) {
     return r[0];
 }
 
+/* Called from main context */
+void pa_sink_input_update_stats(pa_sink_input *i) {
+    pa_sink_input_stats stats;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+
+    /* Keep the old values if the IO thread is busy publishing */
+    if (!pa_seqlock_read(&i->stats_lock, &stats, &i->stats, sizeof(stats)))
+        return;
+
+    /* Completes the window if the stream wasn't peeked for a while */
+    pa_cpu_usage_roll(&stats.peek_usage, pa_rtclock_now());
+
+    pa_proplist_setf(i->proplist, "rewind.requests", "%llu", (unsigned long long) stats.n_rewind_requests);
+    pa_proplist_setf(i->proplist, "rewind.count", "%llu", (unsigned long long) stats.n_rewinds);
+    pa_proplist_setf(i->proplist, "rewind.bytes", "%llu", (unsigned long long) stats.rewind_bytes);
+    pa_proplist_setf(i->proplist, "rewind.usec", "%llu", (unsigned long long) stats.rewind_usec);
+
+    pa_cpu_usage_to_proplist(&stats.peek_usage, i->proplist, false);
+}
+
+/* Called from thread context. The rewind requests counted in between get
+ * published with the next peek or rewind. */
+static void publish_stats(pa_sink_input *i) {
+    pa_seqlock_write(&i->stats_lock, &i->stats, &i->thread_info.stats, sizeof(i->stats));
+}
+
 /* Called from thread context */
 void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa_memchunk *chunk, pa_cvolume *volume) {
     bool do_volume_adj_here, need_volume_factor_sink;
@@ -873,6 +909,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     size_t block_size_max_sink, block_size_max_sink_input;
     size_t ilength;
     size_t ilength_full;
+    pa_usec_t start;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
@@ -881,6 +918,8 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     pa_assert(chunk);
     pa_assert(volume);
 
+    start = pa_rtclock_now();
+
 #ifdef SINK_INPUT_DEBUG
     pa_log_debug("peek");
 #endif
@@ -1041,6 +1080,9 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
         pa_cvolume_mute(volume, i->sink->sample_spec.channels);
     else
         *volume = i->thread_info.soft_volume;
+
+    pa_cpu_usage_add(&i->thread_info.stats.peek_usage, start, pa_rtclock_now(), 0);
+    publish_stats(i);
 }
 
 /* Called from thread context */
@@ -1057,6 +1099,14 @@ void pa_sink_input_drop(pa_sink_input *i, size_t nbytes /* in sink sample spec *
 #endif
 
     pa_memblockq_drop(i->thread_info.render_memblockq, nbytes);
+
+    /* The ramp is forgotten only once it can't be rewound into anymore */
+    if (i->thread_info.ramp_length > 0) {
+        i->thread_info.ramp_pos += nbytes;
+
+        if (i->thread_info.ramp_pos >= i->thread_info.ramp_length + i->sink->thread_info.max_rewind)
+            i->thread_info.ramp_length = i->thread_info.ramp_pos = 0;
+    }
 }
 
 /* Called from thread context */
@@ -1079,6 +1129,7 @@ bool pa_sink_input_process_underrun(pa_sink_input *i) {
 void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sample spec */) {
     size_t lbq;
     bool called = false;
+    pa_usec_t start = 0;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
@@ -1089,6 +1140,9 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
     pa_log_debug("rewind(%lu, %lu)", (unsigned long) nbytes, (unsigned long) i->thread_info.rewrite_nbytes);
 #endif
 
+    if (nbytes > 0)
+        start = pa_rtclock_now();
+
     lbq = pa_memblockq_get_length(i->thread_info.render_memblockq);
 
     if (nbytes > 0 && !i->thread_info.dont_rewind_render) {
@@ -1096,6 +1150,11 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
         pa_memblockq_rewind(i->thread_info.render_memblockq, nbytes);
     }
 
+    /* The rewound data gets rendered again with the same part of the ramp.
+     * Data from before the ramp started gets the ramp from its start. */
+    if (i->thread_info.ramp_length > 0)
+        i->thread_info.ramp_pos = i->thread_info.ramp_pos > nbytes ? i->thread_info.ramp_pos - nbytes : 0;
+
     if (i->thread_info.rewrite_nbytes == (size_t) -1) {
 
         /* We were asked to drop all buffered data, and rerequest new
@@ -1150,6 +1209,97 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
     i->thread_info.rewrite_nbytes = 0;
     i->thread_info.rewrite_flush = false;
     i->thread_info.dont_rewind_render = false;
+
+    if (nbytes > 0) {
+        i->thread_info.stats.n_rewinds++;
+        i->thread_info.stats.rewind_bytes += nbytes;
+        i->thread_info.stats.rewind_usec += pa_rtclock_now() - start;
+        publish_stats(i);
+    }
+}
+
+/* Called from thread context */
+size_t pa_sink_input_get_volume_ramp(pa_sink_input *i, pa_cvolume *start_volume) {
+    pa_cvolume volume;
+    double pos;
+    unsigned c;
+
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+    pa_assert(start_volume);
+
+    if (i->thread_info.ramp_pos >= i->thread_info.ramp_length)
+        return 0;
+
+    if (i->thread_info.muted)
+        pa_cvolume_mute(&volume, i->thread_info.soft_volume.channels);
+    else
+        volume = i->thread_info.soft_volume;
+
+    /* How far the ramp has progressed, the volume changes linearly in
+     * amplitude */
+    pos = (double) i->thread_info.ramp_pos / (double) i->thread_info.ramp_length;
+
+    start_volume->channels = volume.channels;
+    for (c = 0; c < volume.channels; c++) {
+        double a = pa_sw_volume_to_linear(i->thread_info.ramp_volume.values[c]);
+        double b = pa_sw_volume_to_linear(volume.values[c]);
+
+        start_volume->values[c] = pa_sw_volume_from_linear(a + (b - a) * pos);
+    }
+
+    return i->thread_info.ramp_length - i->thread_info.ramp_pos;
+}
+
+/* Called from thread context */
+void pa_sink_input_update_soft_volume(pa_sink_input *i, const pa_cvolume *soft_volume, bool muted) {
+    pa_cvolume current;
+    int64_t latency;
+
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+    pa_assert(soft_volume);
+
+    if (pa_cvolume_equal(&i->thread_info.soft_volume, soft_volume) && i->thread_info.muted == muted)
+        return;
+
+    /* If the channel maps differ, peek() applies the volume before the data
+     * enters the render queue, so we need to rewrite what is in there. */
+    if (!pa_channel_map_equal(&i->channel_map, &i->sink->channel_map)) {
+        i->thread_info.soft_volume = *soft_volume;
+        i->thread_info.muted = muted;
+        i->thread_info.ramp_length = i->thread_info.ramp_pos = 0;
+        pa_sink_input_request_rewind(i, 0, true, false, false);
+        return;
+    }
+
+    /* Otherwise the sink applies the volume while mixing, so we start a
+     * ramp from where we are now to the new volume. */
+    if (pa_sink_input_get_volume_ramp(i, &current) <= 0) {
+        if (i->thread_info.muted)
+            pa_cvolume_mute(&current, i->thread_info.soft_volume.channels);
+        else
+            current = i->thread_info.soft_volume;
+    }
+
+    i->thread_info.soft_volume = *soft_volume;
+    i->thread_info.muted = muted;
+
+    i->thread_info.ramp_volume = current;
+    i->thread_info.ramp_length = pa_usec_to_bytes(VOLUME_RAMP_USEC, &i->sink->sample_spec);
+    i->thread_info.ramp_pos = 0;
+
+    if (i->thread_info.state == PA_SINK_INPUT_CORKED)
+        return;
+
+    /* Without a rewind the ramp would only be heard once everything the
+     * sink has buffered is played, which takes up to seconds with timer
+     * based scheduling. So we rewind the sink to shortly after its playback
+     * position, which moves the start of the ramp there. The sink itself
+     * stops the rewind short of what it can't rewrite anymore. */
+    latency = pa_sink_get_latency_within_thread(i->sink, false);
+    if (latency > VOLUME_REWIND_MARGIN_USEC)
+        pa_sink_request_rewind(i->sink, pa_usec_to_bytes((pa_usec_t) latency - VOLUME_REWIND_MARGIN_USEC, &i->sink->sample_spec));
 }
 
 /* Called from thread context */
@@ -1258,6 +1408,18 @@ pa_usec_t pa_sink_input_get_requested_latency(pa_sink_input *i) {
     return i->thread_info.requested_sink_latency;
 }
 
+/* Called from main context */
+static void sync_soft_volume(pa_sink_input *i, int code) {
+    pa_assert(i->sink);
+
+    /* Inside a batch the IO thread picks up the newest soft volume and
+     * mute status once, when the batch is sent */
+    if (i->sink->input_volume_batch)
+        pa_asyncmsgq_batch_add_coalesced(i->sink->input_volume_batch, PA_MSGOBJECT(i), code, NULL, 0, NULL, NULL);
+    else
+        pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), code, NULL, 0, NULL) == 0);
+}
+
 /* Called from main context */
 void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool save, bool absolute) {
     pa_cvolume v;
@@ -1306,7 +1468,7 @@ void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool s
         pa_sink_input_set_reference_ratio(i, &i->volume);
 
         /* Copy the new soft_volume to the thread_info struct */
-        pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
+        sync_soft_volume(i, PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME);
     }
 }
 
@@ -1334,7 +1496,7 @@ void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa
     pa_sw_cvolume_multiply(&i->soft_volume, &i->real_ratio, &i->volume_factor);
 
     /* Copy the new soft_volume to the thread_info struct */
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
+    sync_soft_volume(i, PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME);
 }
 
 /* Returns 0 if an entry was removed and -1 if no entry for the given key was
@@ -1365,7 +1527,7 @@ int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key) {
     pa_sw_cvolume_multiply(&i->soft_volume, &i->real_ratio, &i->volume_factor);
 
     /* Copy the new soft_volume to the thread_info struct */
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
+    sync_soft_volume(i, PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME);
 
     return 0;
 }
@@ -1447,7 +1609,7 @@ void pa_sink_input_set_mute(pa_sink_input *i, bool mute, bool save) {
 
     i->save_muted = save;
 
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_MUTE, NULL, 0, NULL) == 0);
+    sync_soft_volume(i, PA_SINK_INPUT_MESSAGE_SET_SOFT_MUTE);
 
     /* The mute status changed, let's tell people so */
     if (i->mute_changed)
@@ -1605,6 +1767,19 @@ int pa_sink_input_set_rate(pa_sink_input *i, uint32_t rate) {
     return 0;
 }
 
+/* Called from thread context */
+void pa_sink_input_set_rate_within_thread(pa_sink_input *i, uint32_t rate) {
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+    pa_assert(i->thread_info.resampler);
+
+    if (i->thread_info.sample_spec.rate == rate)
+        return;
+
+    i->thread_info.sample_spec.rate = rate;
+    pa_resampler_set_input_rate(i->thread_info.resampler, rate);
+}
+
 /* Called from main context */
 pa_resample_method_t pa_sink_input_get_resample_method(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
@@ -1745,6 +1920,8 @@ int pa_sink_input_start_move(pa_sink_input *i) {
          * volume mode. */
         pa_sink_set_volume(i->sink, NULL, false, false);
 
+    pa_sink_flush_input_volume_batch(i->sink);
+
     pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_START_MOVE, i, 0, NULL) == 0);
 
     pa_sink_update_status(i->sink);
@@ -2080,17 +2257,11 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
     switch (code) {
 
         case PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME:
-            if (!pa_cvolume_equal(&i->thread_info.soft_volume, &i->soft_volume)) {
-                i->thread_info.soft_volume = i->soft_volume;
-                pa_sink_input_request_rewind(i, 0, true, false, false);
-            }
+            pa_sink_input_update_soft_volume(i, &i->soft_volume, i->thread_info.muted);
             return 0;
 
         case PA_SINK_INPUT_MESSAGE_SET_SOFT_MUTE:
-            if (i->thread_info.muted != i->muted) {
-                i->thread_info.muted = i->muted;
-                pa_sink_input_request_rewind(i, 0, true, false, false);
-            }
+            pa_sink_input_update_soft_volume(i, &i->thread_info.soft_volume, i->muted);
             return 0;
 
         case PA_SINK_INPUT_MESSAGE_GET_LATENCY: {
@@ -2104,8 +2275,7 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
 
         case PA_SINK_INPUT_MESSAGE_SET_RATE:
 
-            i->thread_info.sample_spec.rate = PA_PTR_TO_UINT(userdata);
-            pa_resampler_set_input_rate(i->thread_info.resampler, PA_PTR_TO_UINT(userdata));
+            pa_sink_input_set_rate_within_thread(i, PA_PTR_TO_UINT(userdata));
 
             return 0;
 
@@ -2185,6 +2355,8 @@ void pa_sink_input_request_rewind(
     if (i->thread_info.state == PA_SINK_INPUT_CORKED)
         return;
 
+    i->thread_info.stats.n_rewind_requests++;
+
     nbytes = PA_MAX(i->thread_info.rewrite_nbytes, nbytes);
 
 #ifdef SINK_INPUT_DEBUG
@@ -2367,6 +2539,9 @@ void pa_sink_input_attach(pa_sink_input *i) {
 
     i->thread_info.attached = true;
 
+    /* The ramp is kept in the sample spec of the old sink */
+    i->thread_info.ramp_length = i->thread_info.ramp_pos = 0;
+
     if (i->attach)
         i->attach(i);
 }
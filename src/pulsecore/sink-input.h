@@ -32,6 +32,8 @@
 #include <pulsecore/client.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/core.h>
+#include <pulsecore/cpu-usage.h>
+#include <pulsecore/seqlock.h>
 
 typedef enum pa_sink_input_state {
     PA_SINK_INPUT_INIT,         /*< The stream is not active yet, because pa_sink_input_put() has not been called yet */
@@ -60,6 +62,16 @@ typedef enum pa_sink_input_flags {
     PA_SINK_INPUT_PASSTHROUGH = 2048
 } pa_sink_input_flags_t;
 
+/* Rewind accounting, and the time spent in pa_sink_input_peek(),
+ * including the pop() callback and the resampler */
+typedef struct pa_sink_input_stats {
+    uint64_t n_rewind_requests, n_rewinds;
+    uint64_t rewind_bytes;
+    pa_usec_t rewind_usec;
+
+    pa_cpu_usage peek_usage;
+} pa_sink_input_stats;
+
 struct pa_sink_input {
     pa_msgobject parent;
 
@@ -231,14 +243,31 @@ struct pa_sink_input {
      * mute status changes. Called from main context */
     void (*mute_changed)(pa_sink_input *i); /* may be NULL */
 
+    /* The IO thread's thread_info.stats as last published, see
+     * pa_sink_input_update_stats() */
+    pa_seqlock stats_lock;
+    pa_sink_input_stats stats;
+
     struct {
         pa_sink_input_state_t state;
 
         pa_cvolume soft_volume;
         bool muted:1;
 
+        /* When the soft volume or mute status changes, the volume moves
+         * from ramp_volume to the new one over ramp_length bytes in the
+         * sink's sample spec. The read index is ramp_pos bytes into the
+         * ramp. This is kept until max_rewind bytes past its end, so that
+         * a rewind into the ramp renders it again. */
+        pa_cvolume ramp_volume;
+        size_t ramp_length, ramp_pos;
+
         bool attached:1; /* True only between ->attach() and ->detach() calls */
 
+        /* Updated as the stream is peeked and rewound, and published
+         * to i->stats afterwards */
+        pa_sink_input_stats stats;
+
         /* rewrite_nbytes: 0: rewrite nothing, (size_t) -1: rewrite everything, otherwise how many bytes to rewrite */
         bool rewrite_flush:1, dont_rewind_render:1;
         size_t rewrite_nbytes;
@@ -374,6 +403,12 @@ void pa_sink_input_kill(pa_sink_input*i);
 
 pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency);
 
+/* Copies the rewind counters and the peek time accounting, as last
+ * published by the IO thread, to the "rewind.*" and "cpu.*" properties,
+ * without sending out change notifications. Doesn't wait for the IO
+ * thread. */
+void pa_sink_input_update_stats(pa_sink_input *i);
+
 bool pa_sink_input_is_passthrough(pa_sink_input *i);
 bool pa_sink_input_is_volume_readable(pa_sink_input *i);
 void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool save, bool absolute);
@@ -412,12 +447,22 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in the sink
 void pa_sink_input_update_max_rewind(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */);
 void pa_sink_input_update_max_request(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */);
 
+/* Returns how many bytes of the next chunk returned by peek() still lie
+ * within a volume ramp, and the volume the ramp starts from at the read
+ * index. The ramp ends at the volume returned by peek(). */
+size_t pa_sink_input_get_volume_ramp(pa_sink_input *i, pa_cvolume *start_volume);
+void pa_sink_input_update_soft_volume(pa_sink_input *i, const pa_cvolume *soft_volume, bool muted);
+
 void pa_sink_input_set_state_within_thread(pa_sink_input *i, pa_sink_input_state_t state);
 
 int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk);
 
 pa_usec_t pa_sink_input_set_requested_latency_within_thread(pa_sink_input *i, pa_usec_t usec);
 
+/* Changes the rate of a variable rate stream without a round trip
+ * through the main thread. i->sample_spec keeps the previous rate. */
+void pa_sink_input_set_rate_within_thread(pa_sink_input *i, uint32_t rate);
+
 bool pa_sink_input_safe_to_remove(pa_sink_input *i);
 bool pa_sink_input_process_underrun(pa_sink_input *i);
 
@@ -49,7 +49,7 @@
 
 #include "sink.h"
 
-#define MAX_MIX_CHANNELS 32
+#define MAX_MIX_CHANNELS PA_MIX_MAX_STREAMS
 #define MIX_BUFFER_LENGTH (pa_page_size())
 #define ABSOLUTE_MIN_LATENCY (500)
 #define ABSOLUTE_MAX_LATENCY (10*PA_USEC_PER_SEC)
@@ -71,6 +71,8 @@ struct set_state_data {
 
 static void sink_free(pa_object *s);
 
+#define REWIND_LIMIT_PROPERTY "rewind.limit_msec"
+
 static void pa_sink_volume_change_push(pa_sink *s);
 static void pa_sink_volume_change_flush(pa_sink *s);
 static void pa_sink_volume_change_rewind(pa_sink *s, size_t nbytes);
@@ -172,6 +174,19 @@ static void reset_callbacks(pa_sink *s) {
     s->reconfigure = NULL;
 }
 
+/* Called from main context */
+static void update_rewind_limit(pa_sink *s) {
+    const char *t;
+    uint32_t msec = 0;
+
+    if ((t = pa_proplist_gets(s->proplist, REWIND_LIMIT_PROPERTY)) && pa_atou(t, &msec) < 0) {
+        pa_log_warn("Failed to parse %s property of sink %s: %s", REWIND_LIMIT_PROPERTY, s->name, t);
+        return;
+    }
+
+    pa_sink_set_rewind_limit(s, (pa_usec_t) msec * PA_USEC_PER_MSEC);
+}
+
 /* Called from main context */
 pa_sink* pa_sink_new(
         pa_core *core,
@@ -323,6 +338,8 @@ pa_sink* pa_sink_new(
 
     s->save_volume = data->save_volume;
     s->save_muted = data->save_muted;
+    s->input_volume_batch = NULL;
+    s->input_volume_batch_depth = 0;
 
     pa_silence_memchunk_get(
             &core->silence_cache,
@@ -339,6 +356,7 @@ pa_sink* pa_sink_new(
     s->thread_info.state = s->state;
     s->thread_info.rewind_nbytes = 0;
     s->thread_info.rewind_requested = false;
+    s->thread_info.rewind_limit = 0;
     s->thread_info.max_rewind = 0;
     s->thread_info.max_request = 0;
     s->thread_info.requested_latency_valid = false;
@@ -354,6 +372,8 @@ pa_sink* pa_sink_new(
     s->thread_info.volume_change_extra_delay = core->deferred_volume_extra_delay_usec;
     s->thread_info.port_latency_offset = s->port_latency_offset;
 
+    update_rewind_limit(s);
+
     /* FIXME: This should probably be moved to pa_sink_put() */
     pa_assert_se(pa_idxset_put(core->sinks, s, &s->index) >= 0);
 
@@ -1047,10 +1067,17 @@ size_t pa_sink_process_input_underruns(pa_sink *s, size_t left_to_play) {
     return left_to_play - result;
 }
 
+/* Called from IO thread context. The rewind requests counted in between
+ * get published with the next render or rewind. */
+static void publish_stats(pa_sink *s) {
+    pa_seqlock_write(&s->stats_lock, &s->stats, &s->thread_info.stats, sizeof(s->stats));
+}
+
 /* Called from IO thread context */
 void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     pa_sink_input *i;
     void *state = NULL;
+    pa_usec_t start = 0;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1068,6 +1095,8 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
 
     if (nbytes > 0) {
         pa_log_debug("Processing rewind...");
+        start = pa_rtclock_now();
+
         if (s->flags & PA_SINK_DEFERRED_VOLUME)
             pa_sink_volume_change_rewind(s, nbytes);
     }
@@ -1080,6 +1109,11 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     if (nbytes > 0) {
         if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state))
             pa_source_process_rewind(s->monitor_source, nbytes);
+
+        s->thread_info.stats.n_rewinds++;
+        s->thread_info.stats.rewind_bytes += nbytes;
+        s->thread_info.stats.rewind_usec += pa_rtclock_now() - start;
+        publish_stats(s);
     }
 }
 
@@ -1098,6 +1132,7 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
         pa_sink_input_assert_ref(i);
 
         pa_sink_input_peek(i, *length, &info->chunk, &info->volume);
+        info->ramp_length = pa_sink_input_get_volume_ramp(i, &info->ramp_volume);
 
         if (mixlength == 0 || info->chunk.length < mixlength)
             mixlength = info->chunk.length;
@@ -1222,7 +1257,7 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
 }
 
 /* Called from IO thread context */
-void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
+static void sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
     size_t block_size_max;
@@ -1275,13 +1310,19 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
         pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
 
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume)) {
+        if (s->thread_info.soft_muted || (pa_cvolume_is_muted(&volume) && info[0].ramp_length <= 0)) {
             pa_memblock_unref(result->memblock);
             pa_silence_memchunk_get(&s->core->silence_cache,
                                     s->core->mempool,
                                     result,
                                     &s->sample_spec,
                                     result->length);
+        } else if (info[0].ramp_length > 0) {
+            pa_cvolume start_volume;
+
+            pa_sw_cvolume_multiply(&start_volume, &s->thread_info.soft_volume, &info[0].ramp_volume);
+            pa_memchunk_make_writable(result, 0);
+            pa_volume_memchunk_ramp(result, &s->sample_spec, &start_volume, &volume, info[0].ramp_length);
         } else if (!pa_cvolume_is_norm(&volume)) {
             pa_memchunk_make_writable(result, 0);
             pa_volume_memchunk(result, &s->sample_spec, &volume);
@@ -1307,7 +1348,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 }
 
 /* Called from IO thread context */
-void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
+static void sink_render_into(pa_sink*s, pa_memchunk *target) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
     size_t length, block_size_max;
@@ -1352,7 +1393,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
         pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
 
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume))
+        if (s->thread_info.soft_muted || (pa_cvolume_is_muted(&volume) && info[0].ramp_length <= 0))
             pa_silence_memchunk(target, &s->sample_spec);
         else {
             pa_memchunk vchunk;
@@ -1363,7 +1404,13 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
             if (vchunk.length > length)
                 vchunk.length = length;
 
-            if (!pa_cvolume_is_norm(&volume)) {
+            if (info[0].ramp_length > 0) {
+                pa_cvolume start_volume;
+
+                pa_sw_cvolume_multiply(&start_volume, &s->thread_info.soft_volume, &info[0].ramp_volume);
+                pa_memchunk_make_writable(&vchunk, 0);
+                pa_volume_memchunk_ramp(&vchunk, &s->sample_spec, &start_volume, &volume, info[0].ramp_length);
+            } else if (!pa_cvolume_is_norm(&volume)) {
                 pa_memchunk_make_writable(&vchunk, 0);
                 pa_volume_memchunk(&vchunk, &s->sample_spec, &volume);
             }
@@ -1392,7 +1439,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 }
 
 /* Called from IO thread context */
-void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
+static void sink_render_into_full(pa_sink *s, pa_memchunk *target) {
     pa_memchunk chunk;
     size_t l, d;
 
@@ -1421,7 +1468,7 @@ void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
         chunk.index += d;
         chunk.length -= d;
 
-        pa_sink_render_into(s, &chunk);
+        sink_render_into(s, &chunk);
 
         d += chunk.length;
         l -= chunk.length;
@@ -1431,7 +1478,7 @@ void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
 }
 
 /* Called from IO thread context */
-void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
+static void sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
     pa_assert(PA_SINK_IS_LINKED(s->thread_info.state));
@@ -1444,7 +1491,7 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
 
     pa_sink_ref(s);
 
-    pa_sink_render(s, length, result);
+    sink_render(s, length, result);
 
     if (result->length < length) {
         pa_memchunk chunk;
@@ -1455,7 +1502,7 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
         chunk.index = result->index + result->length;
         chunk.length = length - result->length;
 
-        pa_sink_render_into_full(s, &chunk);
+        sink_render_into_full(s, &chunk);
 
         result->length = length;
     }
@@ -1463,6 +1510,45 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
     pa_sink_unref(s);
 }
 
+/* Called from IO thread context */
+static void account_render(pa_sink *s, pa_usec_t start, size_t length) {
+    /* Rendering should take less time than playing back what was rendered */
+    pa_cpu_usage_add(&s->thread_info.stats.render_usage, start, pa_rtclock_now(), pa_bytes_to_usec(length, &s->sample_spec));
+    publish_stats(s);
+}
+
+/* Called from IO thread context */
+void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
+    pa_usec_t start = pa_rtclock_now();
+
+    sink_render(s, length, result);
+    account_render(s, start, result->length);
+}
+
+/* Called from IO thread context */
+void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
+    pa_usec_t start = pa_rtclock_now();
+
+    sink_render_into(s, target);
+    account_render(s, start, target->length);
+}
+
+/* Called from IO thread context */
+void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
+    pa_usec_t start = pa_rtclock_now();
+
+    sink_render_into_full(s, target);
+    account_render(s, start, target->length);
+}
+
+/* Called from IO thread context */
+void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
+    pa_usec_t start = pa_rtclock_now();
+
+    sink_render_full(s, length, result);
+    account_render(s, start, result->length);
+}
+
 /* Called from main thread */
 void pa_sink_reconfigure(pa_sink *s, pa_sample_spec *spec, bool passthrough) {
     pa_sample_spec desired_spec;
@@ -2389,6 +2475,8 @@ bool pa_sink_update_proplist(pa_sink *s, pa_update_mode_t mode, pa_proplist *p)
     if (p)
         pa_proplist_update(s->proplist, mode, p);
 
+    update_rewind_limit(s);
+
     if (PA_SINK_IS_LINKED(s->state)) {
         pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SINK_PROPLIST_CHANGED], s);
         pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
@@ -2530,11 +2618,7 @@ static void sync_input_volumes_within_thread(pa_sink *s) {
     pa_sink_assert_io_context(s);
 
     PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
-        if (pa_cvolume_equal(&i->thread_info.soft_volume, &i->soft_volume))
-            continue;
-
-        i->thread_info.soft_volume = i->soft_volume;
-        pa_sink_input_request_rewind(i, 0, true, false, false);
+        pa_sink_input_update_soft_volume(i, &i->soft_volume, i->thread_info.muted);
     }
 }
 
@@ -2604,6 +2688,10 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             if (i->thread_info.requested_sink_latency != (pa_usec_t) -1)
                 pa_sink_input_set_requested_latency_within_thread(i, i->thread_info.requested_sink_latency);
 
+            /* A filter sink brings the rewind limit into effect */
+            if (i->origin_sink && s->thread_info.rewind_limit > 0)
+                pa_sink_invalidate_requested_latency(s, true);
+
             pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
             pa_sink_input_update_max_request(i, s->thread_info.max_request);
 
@@ -2972,6 +3060,11 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             s->thread_info.port_latency_offset = offset;
             return 0;
 
+        case PA_SINK_MESSAGE_SET_REWIND_LIMIT:
+            s->thread_info.rewind_limit = (pa_usec_t) offset;
+            pa_sink_invalidate_requested_latency(s, true);
+            return 0;
+
         case PA_SINK_MESSAGE_GET_LATENCY:
         case PA_SINK_MESSAGE_MAX:
             ;
@@ -3032,17 +3125,40 @@ void pa_sink_attach_within_thread(pa_sink *s) {
         pa_source_attach_within_thread(s->monitor_source);
 }
 
+/* Called from IO thread */
+static bool has_filter_inputs(pa_sink *s) {
+    pa_sink_input *i;
+    void *state = NULL;
+
+    PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state)
+        if (i->origin_sink)
+            return true;
+
+    return false;
+}
+
 /* Called from IO thread */
 void pa_sink_request_rewind(pa_sink*s, size_t nbytes) {
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
     pa_assert(PA_SINK_IS_LINKED(s->thread_info.state));
 
+    s->thread_info.stats.n_rewind_requests++;
+
     if (nbytes == (size_t) -1)
         nbytes = s->thread_info.max_rewind;
 
     nbytes = PA_MIN(nbytes, s->thread_info.max_rewind);
 
+    if (s->thread_info.rewind_limit > 0 && has_filter_inputs(s)) {
+        size_t limit = pa_usec_to_bytes(s->thread_info.rewind_limit, &s->sample_spec);
+
+        if (nbytes > limit) {
+            nbytes = limit;
+            s->thread_info.stats.n_rewinds_limited++;
+        }
+    }
+
     if (s->thread_info.rewind_requested &&
         nbytes <= s->thread_info.rewind_nbytes)
         return;
@@ -3081,6 +3197,12 @@ pa_usec_t pa_sink_get_requested_latency_within_thread(pa_sink *s) {
         (result == (pa_usec_t) -1 || result > monitor_latency))
         result = monitor_latency;
 
+    /* Rewinding through filter sinks is expensive, so if their rewinds
+     * are limited, don't buffer more than what can be rewound */
+    if (s->thread_info.rewind_limit > 0 && has_filter_inputs(s) &&
+        (result == (pa_usec_t) -1 || result > s->thread_info.rewind_limit))
+        result = s->thread_info.rewind_limit;
+
     if (result != (pa_usec_t) -1)
         result = PA_CLAMP(result, s->thread_info.min_latency, s->thread_info.max_latency);
 
@@ -3407,6 +3529,100 @@ size_t pa_sink_get_max_request(pa_sink *s) {
     return r;
 }
 
+/* Called from main context */
+void pa_sink_set_rewind_limit(pa_sink *s, pa_usec_t limit) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+
+    if (s->rewind_limit == limit)
+        return;
+
+    s->rewind_limit = limit;
+
+    if (PA_SINK_IS_LINKED(s->state))
+        pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_SET_REWIND_LIMIT, NULL, (int64_t) limit, NULL) == 0);
+    else
+        s->thread_info.rewind_limit = limit;
+}
+
+/* Called from main context */
+void pa_sink_update_stats(pa_sink *s) {
+    pa_sink_stats stats;
+
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+
+    /* Keep the old values if the IO thread is busy publishing */
+    if (!pa_seqlock_read(&s->stats_lock, &stats, &s->stats, sizeof(stats)))
+        return;
+
+    /* Completes the window if nothing was rendered for a while */
+    pa_cpu_usage_roll(&stats.render_usage, pa_rtclock_now());
+
+    pa_proplist_setf(s->proplist, "rewind.requests", "%llu", (unsigned long long) stats.n_rewind_requests);
+    pa_proplist_setf(s->proplist, "rewind.limited", "%llu", (unsigned long long) stats.n_rewinds_limited);
+    pa_proplist_setf(s->proplist, "rewind.count", "%llu", (unsigned long long) stats.n_rewinds);
+    pa_proplist_setf(s->proplist, "rewind.bytes", "%llu", (unsigned long long) stats.rewind_bytes);
+    pa_proplist_setf(s->proplist, "rewind.usec", "%llu", (unsigned long long) stats.rewind_usec);
+
+    pa_cpu_usage_to_proplist(&stats.render_usage, s->proplist, true);
+}
+
+/* Called from main context */
+void pa_sink_begin_input_volume_batch(pa_sink *s) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+
+    if (s->input_volume_batch_depth++ <= 0)
+        s->input_volume_batch = pa_asyncmsgq_batch_new();
+}
+
+static void send_input_volume_batch(pa_sink *s) {
+    pa_asyncmsgq_batch *b;
+
+    b = s->input_volume_batch;
+    s->input_volume_batch = NULL;
+
+    if (pa_asyncmsgq_batch_size(b) <= 0) {
+        pa_asyncmsgq_batch_free(b);
+        return;
+    }
+
+    /* This has to be a send, the IO thread reads the new volumes from
+     * the main thread fields of the inputs */
+    pa_assert_se(pa_asyncmsgq_batch_send(s->asyncmsgq, b) == 0);
+}
+
+/* Called from main context */
+void pa_sink_end_input_volume_batch(pa_sink *s) {
+    pa_asyncmsgq_batch *b;
+
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(s->input_volume_batch);
+
+    b = s->input_volume_batch;
+    s->input_volume_batch = NULL;
+    s->input_volume_batch_depth = 0;
+
+    /* This has to be a send, the IO thread reads the new volumes from
+     * the main thread fields of the inputs */
+    pa_assert_se(pa_asyncmsgq_batch_send(s->asyncmsgq, b) == 0);
+}
+
+/* Called from main context. Passes on what has been collected so far,
+ * before an input leaves the sink. */
+void pa_sink_flush_input_volume_batch(pa_sink *s) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+
+    if (!s->input_volume_batch || pa_asyncmsgq_batch_size(s->input_volume_batch) <= 0)
+        return;
+
+    send_input_volume_batch(s);
+    s->input_volume_batch = pa_asyncmsgq_batch_new();
+}
+
 /* Called from main context */
 int pa_sink_set_port(pa_sink *s, const char *name, bool save) {
     pa_device_port *port;
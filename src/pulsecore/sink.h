@@ -31,6 +31,7 @@
 #include <pulse/volume.h>
 
 #include <pulsecore/core.h>
+#include <pulsecore/cpu-usage.h>
 #include <pulsecore/idxset.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/source.h>
@@ -38,6 +39,7 @@
 #include <pulsecore/asyncmsgq.h>
 #include <pulsecore/msgobject.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/seqlock.h>
 #include <pulsecore/device-port.h>
 #include <pulsecore/card.h>
 #include <pulsecore/queue.h>
@@ -56,6 +58,18 @@ typedef void(*pa_sink_cb_t)(pa_sink *s);
 
 typedef int (*pa_sink_get_mute_cb_t)(pa_sink *s, bool *mute);
 
+/* Rewind accounting: how often a rewind was requested, how many
+ * requests the limit shortened, and how many rewinds were processed,
+ * over how many bytes and taking how long. And the time spent
+ * rendering, against the playback time of what was rendered. */
+typedef struct pa_sink_stats {
+    uint64_t n_rewind_requests, n_rewinds_limited, n_rewinds;
+    uint64_t rewind_bytes;
+    pa_usec_t rewind_usec;
+
+    pa_cpu_usage render_usage;
+} pa_sink_stats;
+
 struct pa_sink {
     pa_msgobject parent;
 
@@ -120,6 +134,19 @@ struct pa_sink {
     /* The latency offset is inherited from the currently active port */
     int64_t port_latency_offset;
 
+    /* Limits rewinds while filter sinks are connected, 0 if unlimited */
+    pa_usec_t rewind_limit;
+
+    /* The IO thread's thread_info.stats as last published, see
+     * pa_sink_update_stats() */
+    pa_seqlock stats_lock;
+    pa_sink_stats stats;
+
+    /* Collects the soft volume and mute syncs of our inputs between
+     * pa_sink_begin_input_volume_batch() and _end_, NULL otherwise */
+    pa_asyncmsgq_batch *input_volume_batch;
+    unsigned input_volume_batch_depth;
+
     unsigned priority;
 
     bool set_mute_in_progress;
@@ -298,6 +325,13 @@ struct pa_sink {
         size_t rewind_nbytes;
         bool rewind_requested;
 
+        /* This is a direct copy from s->rewind_limit */
+        pa_usec_t rewind_limit;
+
+        /* Updated as the sink renders and rewinds, and published to
+         * s->stats afterwards */
+        pa_sink_stats stats;
+
         /* Both dynamic and fixed latencies will be clamped to this
          * range. */
         pa_usec_t min_latency; /* we won't go below this latency */
@@ -358,6 +392,7 @@ typedef enum pa_sink_message {
     PA_SINK_MESSAGE_SET_MAX_REQUEST,
     PA_SINK_MESSAGE_UPDATE_VOLUME_AND_MUTE,
     PA_SINK_MESSAGE_SET_PORT_LATENCY_OFFSET,
+    PA_SINK_MESSAGE_SET_REWIND_LIMIT,
     PA_SINK_MESSAGE_MAX
 } pa_sink_message_t;
 
@@ -457,6 +492,17 @@ pa_usec_t pa_sink_get_fixed_latency(pa_sink *s);
 size_t pa_sink_get_max_rewind(pa_sink *s);
 size_t pa_sink_get_max_request(pa_sink *s);
 
+/* While filter sinks are connected to the sink, rewinds are limited to
+ * this much, and the sink doesn't buffer more than that either. 0 means
+ * no limit. Set through the "rewind.limit_msec" property too. */
+void pa_sink_set_rewind_limit(pa_sink *s, pa_usec_t limit);
+
+/* Copies the rewind counters and the render time accounting, as last
+ * published by the IO thread, to the "rewind.*" and "cpu.*" properties,
+ * without sending out change notifications. Doesn't wait for the IO
+ * thread. */
+void pa_sink_update_stats(pa_sink *s);
+
 int pa_sink_update_status(pa_sink*s);
 int pa_sink_suspend(pa_sink *s, bool suspend, pa_suspend_cause_t cause);
 int pa_sink_suspend_all(pa_core *c, bool suspend, pa_suspend_cause_t cause);
@@ -482,6 +528,15 @@ const pa_cvolume *pa_sink_get_volume(pa_sink *sink, bool force_refresh);
 void pa_sink_set_mute(pa_sink *sink, bool mute, bool save);
 bool pa_sink_get_mute(pa_sink *sink, bool force_refresh);
 
+/* Between these two calls the soft volume and mute changes of the
+ * sink's inputs are passed to the IO thread together, in a single
+ * round trip when the batch ends, instead of one round trip for each
+ * change. For changing many inputs at once. The calls may be nested,
+ * the batch is sent when the outermost one ends. */
+void pa_sink_begin_input_volume_batch(pa_sink *s);
+void pa_sink_end_input_volume_batch(pa_sink *s);
+void pa_sink_flush_input_volume_batch(pa_sink *s);
+
 bool pa_sink_update_proplist(pa_sink *s, pa_update_mode_t mode, pa_proplist *p);
 
 int pa_sink_set_port(pa_sink *s, const char *name, bool save);
@@ -29,6 +29,7 @@
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
 #include <pulse/internal.h>
+#include <pulse/rtclock.h>
 
 #include <pulsecore/core-format.h>
 #include <pulsecore/mix.h>
@@ -483,6 +484,7 @@ int pa_source_output_new(
     o->thread_info.attached = false;
     o->thread_info.sample_spec = o->sample_spec;
     o->thread_info.resampler = resampler;
+    o->thread_info.resampler_stale = false;
     o->thread_info.soft_volume = o->soft_volume;
     o->thread_info.muted = o->muted;
     o->thread_info.requested_source_latency = (pa_usec_t) -1;
@@ -740,12 +742,30 @@ pa_usec_t pa_source_output_get_latency(pa_source_output *o, pa_usec_t *source_la
     return r[0];
 }
 
+/* Called from main context */
+void pa_source_output_update_stats(pa_source_output *o) {
+    pa_cpu_usage u;
+
+    pa_source_output_assert_ref(o);
+    pa_assert_ctl_context();
+
+    /* Keep the old values if the IO thread is busy publishing */
+    if (!pa_seqlock_read(&o->push_usage_lock, &u, &o->push_usage, sizeof(u)))
+        return;
+
+    /* Completes the window if nothing was pushed for a while */
+    pa_cpu_usage_roll(&u, pa_rtclock_now());
+
+    pa_cpu_usage_to_proplist(&u, o->proplist, false);
+}
+
 /* Called from thread context */
 void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
     bool need_volume_factor_source;
     bool volume_is_norm;
     size_t length;
     size_t limit, mbs = 0;
+    pa_usec_t start;
 
     pa_source_output_assert_ref(o);
     pa_source_output_assert_io_context(o);
@@ -758,6 +778,8 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
 
     pa_assert(o->thread_info.state == PA_SOURCE_OUTPUT_RUNNING);
 
+    start = pa_rtclock_now();
+
     if (pa_memblockq_push(o->thread_info.delay_memblockq, chunk) < 0) {
         pa_log_debug("Delay queue overflow!");
         pa_memblockq_seek(o->thread_info.delay_memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, true);
@@ -839,6 +861,11 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
             if (qchunk.length > mbs)
                 qchunk.length = mbs;
 
+            if (o->thread_info.resampler_stale) {
+                pa_source_reset_resampler(o->source, o->thread_info.resampler, o->thread_info.shared_input_frames);
+                o->thread_info.resampler_stale = false;
+            }
+
             pa_resampler_run(o->thread_info.resampler, &qchunk, &rchunk);
 
             if (rchunk.length > 0)
@@ -851,6 +878,36 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
         pa_memblock_unref(qchunk.memblock);
         pa_memblockq_drop(o->thread_info.delay_memblockq, qchunk.length);
     }
+
+    pa_cpu_usage_add(&o->thread_info.push_usage, start, pa_rtclock_now(), 0);
+    pa_seqlock_write(&o->push_usage_lock, &o->push_usage, &o->thread_info.push_usage, sizeof(o->push_usage));
+}
+
+/* Called from thread context. Returns true if all that pa_source_output_push()
+ * would do is running the resampler and pushing the result. The converted
+ * data may then be shared with other source outputs that do the same
+ * conversion. */
+bool pa_source_output_is_conversion_only(pa_source_output *o) {
+    pa_source_output_assert_ref(o);
+    pa_source_output_assert_io_context(o);
+
+    if (!o->push || o->thread_info.state != PA_SOURCE_OUTPUT_RUNNING)
+        return false;
+
+    if (!o->thread_info.resampler || o->thread_info.direct_on_input)
+        return false;
+
+    if (o->thread_info.muted || !pa_cvolume_is_norm(&o->thread_info.soft_volume) ||
+        !pa_cvolume_is_norm(&o->volume_factor_source))
+        return false;
+
+    /* The delay queue has to pass everything through right away, see
+     * pa_source_output_push() */
+    if (!o->process_rewind && o->source->thread_info.max_rewind > 0)
+        return false;
+
+    return pa_memblockq_get_read_index(o->thread_info.delay_memblockq) ==
+        pa_memblockq_get_write_index(o->thread_info.delay_memblockq);
 }
 
 /* Called from thread context */
@@ -1800,6 +1857,7 @@ int pa_source_output_update_resampler(pa_source_output *o) {
         pa_resampler_free(o->thread_info.resampler);
 
     o->thread_info.resampler = new_resampler;
+    o->thread_info.resampler_stale = false;
 
     pa_memblockq_free(o->thread_info.delay_memblockq);
 
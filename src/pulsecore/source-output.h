@@ -31,6 +31,8 @@
 #include <pulsecore/client.h>
 #include <pulsecore/source.h>
 #include <pulsecore/core.h>
+#include <pulsecore/cpu-usage.h>
+#include <pulsecore/seqlock.h>
 #include <pulsecore/sink-input.h>
 
 typedef enum pa_source_output_state {
@@ -201,6 +203,11 @@ struct pa_source_output {
      * mute status changes. Called from main context */
     void (*mute_changed)(pa_source_output *o); /* may be NULL */
 
+    /* The IO thread's thread_info.push_usage as last published, see
+     * pa_source_output_update_stats() */
+    pa_seqlock push_usage_lock;
+    pa_cpu_usage push_usage;
+
     struct {
         pa_source_output_state_t state;
 
@@ -209,10 +216,25 @@ struct pa_source_output {
 
         bool attached:1; /* True only between ->attach() and ->detach() calls */
 
+        /* Time spent in pa_source_output_push(), including the push()
+         * callback and the resampler. Published to o->push_usage after
+         * every push. */
+        pa_cpu_usage push_usage;
+
         pa_sample_spec sample_spec;
 
         pa_resampler* resampler;              /* may be NULL */
 
+        /* Set while the resampler was left out because another source
+         * output did the same conversion, see pa_source_post(). Its
+         * history is outdated then, and pa_source_reset_resampler() has
+         * to bring it up to date. */
+        bool resampler_stale;
+
+        /* pa_resampler_get_input_frames() of the resampler that ran in
+         * place of the stale one */
+        uint64_t shared_input_frames;
+
         /* We maintain a delay memblockq here for source outputs that
          * don't implement rewind() */
         pa_memblockq *delay_memblockq;
@@ -324,6 +346,11 @@ void pa_source_output_kill(pa_source_output*o);
 
 pa_usec_t pa_source_output_get_latency(pa_source_output *o, pa_usec_t *source_latency);
 
+/* Copies the push time accounting, as last published by the IO thread,
+ * to the "cpu.*" properties, without sending out change notifications.
+ * Doesn't wait for the IO thread. */
+void pa_source_output_update_stats(pa_source_output *o);
+
 bool pa_source_output_is_volume_readable(pa_source_output *o);
 bool pa_source_output_is_passthrough(pa_source_output *o);
 void pa_source_output_set_volume(pa_source_output *o, const pa_cvolume *volume, bool save, bool absolute);
@@ -355,6 +382,7 @@ pa_usec_t pa_source_output_get_requested_latency(pa_source_output *o);
 /* To be used exclusively by the source driver thread */
 
 void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk);
+bool pa_source_output_is_conversion_only(pa_source_output *o);
 void pa_source_output_process_rewind(pa_source_output *o, size_t nbytes);
 void pa_source_output_update_max_rewind(pa_source_output *o, size_t nbytes);
 
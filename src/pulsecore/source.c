@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <pulse/format.h>
 #include <pulse/utf8.h>
@@ -40,6 +41,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/mix.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/resampler.h>
 
 #include "source.h"
 
@@ -47,6 +49,12 @@
 #define ABSOLUTE_MAX_LATENCY (10*PA_USEC_PER_SEC)
 #define DEFAULT_FIXED_LATENCY (250*PA_USEC_PER_MSEC)
 
+/* How much of its recent input the source keeps for bringing a skipped
+ * resampler up to date, see pa_source_reset_resampler(). This is longer
+ * than the filters of the speex resamplers even at their highest quality
+ * and when downsampling 48 kHz to 8 kHz. */
+#define INPUT_HISTORY_USEC (40*PA_USEC_PER_MSEC)
+
 PA_DEFINE_PUBLIC_CLASS(pa_source, pa_msgobject);
 
 struct pa_source_volume_change {
@@ -61,8 +69,41 @@ struct set_state_data {
     pa_suspend_cause_t suspend_cause;
 };
 
+/* The result of one resampler run in pa_source_post(), see
+ * post_to_outputs() */
+struct source_conversion {
+    pa_source_output *leader;
+    pa_memchunk *chunks;
+    unsigned n_chunks, n_allocated;
+};
+
+/* The last INPUT_HISTORY_USEC of what pa_source_post() handed to the
+ * source outputs */
+struct source_input_history {
+    pa_memchunk *chunks;
+    unsigned n_chunks, n_allocated;
+    size_t length;
+};
+
 static void source_free(pa_object *o);
 
+static void source_conversion_free(struct source_conversion *c) {
+    pa_assert(c->n_chunks == 0);
+
+    pa_xfree(c->chunks);
+    pa_xfree(c);
+}
+
+static void source_input_history_free(struct source_input_history *h) {
+    unsigned i;
+
+    for (i = 0; i < h->n_chunks; i++)
+        pa_memblock_unref(h->chunks[i].memblock);
+
+    pa_xfree(h->chunks);
+    pa_xfree(h);
+}
+
 static void pa_source_volume_change_push(pa_source *s);
 static void pa_source_volume_change_flush(pa_source *s);
 
@@ -159,6 +200,7 @@ static void reset_callbacks(pa_source *s) {
     s->set_port = NULL;
     s->get_formats = NULL;
     s->reconfigure = NULL;
+    s->update_stats = NULL;
 }
 
 /* Called from main context */
@@ -322,6 +364,8 @@ pa_source* pa_source_new(
     s->thread_info.rtpoll = NULL;
     s->thread_info.outputs = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL,
                                                  (pa_free_cb_t) pa_source_output_unref);
+    s->thread_info.conversions = pa_dynarray_new((pa_free_cb_t) source_conversion_free);
+    s->thread_info.input_history = pa_xnew0(struct source_input_history, 1);
     s->thread_info.soft_volume = s->soft_volume;
     s->thread_info.soft_muted = s->muted;
     s->thread_info.state = s->state;
@@ -756,6 +800,8 @@ static void source_free(pa_object *o) {
 
     pa_idxset_free(s->outputs, NULL);
     pa_hashmap_free(s->thread_info.outputs);
+    pa_dynarray_free(s->thread_info.conversions);
+    source_input_history_free(s->thread_info.input_history);
 
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
@@ -948,6 +994,70 @@ void pa_source_move_all_fail(pa_queue *q) {
     pa_queue_free(q, NULL);
 }
 
+/* Called from IO thread context */
+static void source_input_history_clear(struct source_input_history *h) {
+    unsigned i;
+
+    for (i = 0; i < h->n_chunks; i++)
+        pa_memblock_unref(h->chunks[i].memblock);
+
+    h->n_chunks = 0;
+    h->length = 0;
+}
+
+/* Called from IO thread context */
+static void source_input_history_append(struct source_input_history *h, const pa_memchunk *chunk, size_t max_length) {
+    unsigned n = 0;
+
+    if (h->n_chunks >= h->n_allocated) {
+        h->n_allocated = PA_MAX(2 * h->n_allocated, 4U);
+        h->chunks = pa_xrenew(pa_memchunk, h->chunks, h->n_allocated);
+    }
+
+    h->chunks[h->n_chunks] = *chunk;
+    pa_memblock_ref(chunk->memblock);
+    h->n_chunks++;
+    h->length += chunk->length;
+
+    /* Forget the chunks that are no longer needed, and cut the oldest
+     * remaining one down to what is */
+    while (h->length - h->chunks[n].length >= max_length) {
+        h->length -= h->chunks[n].length;
+        pa_memblock_unref(h->chunks[n].memblock);
+        n++;
+    }
+
+    if (n > 0) {
+        h->n_chunks -= n;
+        memmove(h->chunks, h->chunks + n, h->n_chunks * sizeof(pa_memchunk));
+    }
+
+    if (h->length > max_length) {
+        h->chunks[0].index += h->length - max_length;
+        h->chunks[0].length -= h->length - max_length;
+        h->length = max_length;
+    }
+}
+
+/* Called from IO thread context. The source will post the rewound data
+ * again. */
+static void source_input_history_rewind(struct source_input_history *h, size_t nbytes) {
+    while (nbytes > 0 && h->n_chunks > 0) {
+        pa_memchunk *last = &h->chunks[h->n_chunks - 1];
+
+        if (last->length > nbytes) {
+            last->length -= nbytes;
+            h->length -= nbytes;
+            break;
+        }
+
+        nbytes -= last->length;
+        h->length -= last->length;
+        pa_memblock_unref(last->memblock);
+        h->n_chunks--;
+    }
+}
+
 /* Called from IO thread context */
 void pa_source_process_rewind(pa_source *s, size_t nbytes) {
     pa_source_output *o;
@@ -969,13 +1079,203 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
         pa_source_output_assert_ref(o);
         pa_source_output_process_rewind(o, nbytes);
     }
+
+    source_input_history_rewind(s->thread_info.input_history, nbytes);
 }
 
 /* Called from IO thread context */
-void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
+static void source_conversion_append(struct source_conversion *c, const pa_memchunk *chunk) {
+    if (c->n_chunks >= c->n_allocated) {
+        c->n_allocated = PA_MAX(2 * c->n_allocated, 4U);
+        c->chunks = pa_xrenew(pa_memchunk, c->chunks, c->n_allocated);
+    }
+
+    c->chunks[c->n_chunks] = *chunk;
+    pa_memblock_ref(chunk->memblock);
+    c->n_chunks++;
+}
+
+/* Called from IO thread context */
+static void source_conversion_clear(struct source_conversion *c) {
+    unsigned i;
+
+    for (i = 0; i < c->n_chunks; i++)
+        pa_memblock_unref(c->chunks[i].memblock);
+
+    c->n_chunks = 0;
+    c->leader = NULL;
+}
+
+/* Called from IO thread context */
+void pa_source_reset_resampler(pa_source *s, pa_resampler *r, uint64_t input_frames) {
+    struct source_input_history *h;
+    size_t fs, available, skip, mbs;
+    uint32_t i_rate, o_rate, period;
+    unsigned i;
+
+    pa_source_assert_ref(s);
+    pa_source_assert_io_context(s);
+    pa_assert(r);
+
+    pa_resampler_reset(r);
+
+    h = s->thread_info.input_history;
+    fs = pa_frame_size(&s->sample_spec);
+    available = h->length / fs;
+
+    /* The resampler lands on the same sub-sample position as the other one
+     * only if it takes as many frames modulo the period of the two rates.
+     * If the other one was reset recently, all of its input is still
+     * there. If the period is longer than the history, which takes rates
+     * without much in common, it only gets close. */
+    if (input_frames <= available)
+        skip = available - (size_t) input_frames;
+    else {
+        i_rate = pa_resampler_input_sample_spec(r)->rate;
+        o_rate = pa_resampler_output_sample_spec(r)->rate;
+        period = i_rate / pa_gcd(i_rate, o_rate);
+
+        skip = (size_t) ((period - (input_frames - available) % period) % period);
+
+        if (skip >= available)
+            skip = 0;
+    }
+
+    skip *= fs;
+
+    /* Whatever comes out of it now has been delivered already, by the
+     * resampler that ran in its place */
+    mbs = pa_resampler_max_block_size(r);
+
+    for (i = 0; i < h->n_chunks; i++) {
+        pa_memchunk qchunk = h->chunks[i];
+
+        if (skip >= qchunk.length) {
+            skip -= qchunk.length;
+            continue;
+        }
+
+        qchunk.index += skip;
+        qchunk.length -= skip;
+        skip = 0;
+
+        while (qchunk.length > 0) {
+            pa_memchunk piece = qchunk, rchunk;
+
+            if (piece.length > mbs)
+                piece.length = mbs;
+
+            pa_resampler_run(r, &piece, &rchunk);
+
+            if (rchunk.memblock)
+                pa_memblock_unref(rchunk.memblock);
+
+            qchunk.index += piece.length;
+            qchunk.length -= piece.length;
+        }
+    }
+}
+
+/* Called from IO thread context. Resamples the chunk for the source output
+ * and keeps the result for the outputs that do the same conversion. */
+static void source_conversion_run(struct source_conversion *c, pa_source_output *o, const pa_memchunk *chunk) {
+    pa_resampler *r = o->thread_info.resampler;
+    pa_memchunk qchunk = *chunk;
+    size_t mbs;
+
+    if (o->thread_info.resampler_stale) {
+        pa_source_reset_resampler(o->source, r, o->thread_info.shared_input_frames);
+        o->thread_info.resampler_stale = false;
+    }
+
+    c->leader = o;
+    mbs = pa_resampler_max_block_size(r);
+
+    while (qchunk.length > 0) {
+        pa_memchunk piece = qchunk, rchunk;
+
+        if (piece.length > mbs)
+            piece.length = mbs;
+
+        pa_resampler_run(r, &piece, &rchunk);
+
+        if (rchunk.length > 0) {
+            o->push(o, &rchunk);
+            source_conversion_append(c, &rchunk);
+        }
+
+        if (rchunk.memblock)
+            pa_memblock_unref(rchunk.memblock);
+
+        qchunk.index += piece.length;
+        qchunk.length -= piece.length;
+    }
+}
+
+/* Called from IO thread context */
+static void post_to_outputs(pa_source *s, const pa_memchunk *chunk) {
+    struct source_conversion *c;
     pa_source_output *o;
     void *state = NULL;
+    unsigned n_conversions = 0, i;
+
+    PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state) {
+        pa_source_output_assert_ref(o);
+
+        if (o->thread_info.direct_on_input)
+            continue;
+
+        /* Outputs with their own volume, delay queue and so on take the
+         * usual path */
+        if (!pa_source_output_is_conversion_only(o)) {
+            pa_source_output_push(o, chunk);
+            continue;
+        }
+
+        /* If another output already did the same conversion, hand out its
+         * result instead of running the resampler again. The skipped
+         * resampler has to be brought up to date before it is used the
+         * next time. */
+        for (i = 0; i < n_conversions; i++) {
+            c = pa_dynarray_get(s->thread_info.conversions, i);
+
+            if (pa_resampler_same_conversion(c->leader->thread_info.resampler, o->thread_info.resampler))
+                break;
+        }
+
+        if (i < n_conversions) {
+            unsigned j;
+
+            for (j = 0; j < c->n_chunks; j++)
+                o->push(o, &c->chunks[j]);
+
+            o->thread_info.resampler_stale = true;
+            o->thread_info.shared_input_frames = pa_resampler_get_input_frames(c->leader->thread_info.resampler);
+            continue;
+        }
+
+        if (!(c = pa_dynarray_get(s->thread_info.conversions, n_conversions))) {
+            c = pa_xnew0(struct source_conversion, 1);
+            pa_dynarray_append(s->thread_info.conversions, c);
+        }
+
+        n_conversions++;
+        source_conversion_run(c, o, chunk);
+    }
+
+    for (i = 0; i < n_conversions; i++)
+        source_conversion_clear(pa_dynarray_get(s->thread_info.conversions, i));
 
+    /* Only needed as long as outputs may share a conversion */
+    if (n_conversions > 0)
+        source_input_history_append(s->thread_info.input_history, chunk,
+                                    pa_usec_to_bytes(INPUT_HISTORY_USEC, &s->sample_spec));
+    else
+        source_input_history_clear(s->thread_info.input_history);
+}
+
+/* Called from IO thread context */
+void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     pa_source_assert_ref(s);
     pa_source_assert_io_context(s);
     pa_assert(PA_SOURCE_IS_LINKED(s->thread_info.state));
@@ -995,23 +1295,11 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
         else
             pa_volume_memchunk(&vchunk, &s->sample_spec, &s->thread_info.soft_volume);
 
-        while ((o = pa_hashmap_iterate(s->thread_info.outputs, &state, NULL))) {
-            pa_source_output_assert_ref(o);
-
-            if (!o->thread_info.direct_on_input)
-                pa_source_output_push(o, &vchunk);
-        }
+        post_to_outputs(s, &vchunk);
 
         pa_memblock_unref(vchunk.memblock);
-    } else {
-
-        while ((o = pa_hashmap_iterate(s->thread_info.outputs, &state, NULL))) {
-            pa_source_output_assert_ref(o);
-
-            if (!o->thread_info.direct_on_input)
-                pa_source_output_push(o, chunk);
-        }
-    }
+    } else
+        post_to_outputs(s, chunk);
 }
 
 /* Called from IO thread context */
@@ -1969,6 +2257,15 @@ bool pa_source_update_proplist(pa_source *s, pa_update_mode_t mode, pa_proplist
     return true;
 }
 
+/* Called from main thread */
+void pa_source_update_stats(pa_source *s) {
+    pa_source_assert_ref(s);
+    pa_assert_ctl_context();
+
+    if (PA_SOURCE_IS_LINKED(s->state) && s->update_stats)
+        s->update_stats(s);
+}
+
 /* Called from main thread */
 /* FIXME -- this should be dropped and be merged into pa_source_update_proplist() */
 void pa_source_set_description(pa_source *s, const char *description) {
@@ -2239,6 +2536,9 @@ int pa_source_process_msg(pa_msgobject *object, int code, void *userdata, int64_
                 pa_source_output *o;
                 void *state = NULL;
 
+                /* The sample spec may change while suspended */
+                source_input_history_clear(s->thread_info.input_history);
+
                 while ((o = pa_hashmap_iterate(s->thread_info.outputs, &state, NULL)))
                     if (o->suspend_within_thread)
                         o->suspend_within_thread(o, s->thread_info.state == PA_SOURCE_SUSPENDED);
@@ -32,6 +32,7 @@
 #include <pulse/volume.h>
 
 #include <pulsecore/core.h>
+#include <pulsecore/dynarray.h>
 #include <pulsecore/idxset.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/sink.h>
@@ -227,12 +228,24 @@ struct pa_source {
      * main thread. */
     void (*reconfigure)(pa_source *s, pa_sample_spec *spec, bool passthrough);
 
+    /* Called before the properties are shown, so that statistics can be
+     * put into them without announcing a change every time they change.
+     * Called from main thread. */
+    pa_source_cb_t update_stats; /* may be NULL */
+
     /* Contains copies of the above data so that the real-time worker
      * thread can work without access locking */
     struct {
         pa_source_state_t state;
         pa_hashmap *outputs;
 
+        /* Converted data that source outputs doing the same conversion
+         * share, reused by every pa_source_post() call */
+        pa_dynarray *conversions;
+
+        /* The recent input, see pa_source_reset_resampler() */
+        struct source_input_history *input_history;
+
         pa_rtpoll *rtpoll;
 
         pa_cvolume soft_volume;
@@ -415,6 +428,7 @@ void pa_source_set_mute(pa_source *source, bool mute, bool save);
 bool pa_source_get_mute(pa_source *source, bool force_refresh);
 
 bool pa_source_update_proplist(pa_source *s, pa_update_mode_t mode, pa_proplist *p);
+void pa_source_update_stats(pa_source *s);
 
 int pa_source_set_port(pa_source *s, const char *name, bool save);
 
@@ -474,6 +488,13 @@ bool pa_source_volume_change_apply(pa_source *s, pa_usec_t *usec_to_next);
 void pa_source_invalidate_requested_latency(pa_source *s, bool dynamic);
 int64_t pa_source_get_latency_within_thread(pa_source *s, bool allow_negative);
 
+/* Called from IO context, also from source-output.c. Resets the resampler of
+ * a source output that was left out because another one did the same
+ * conversion, and runs the recent input of the source through it, so that
+ * it continues where the other resampler is. input_frames is what
+ * pa_resampler_get_input_frames() returned for the other resampler. */
+void pa_source_reset_resampler(pa_source *s, pa_resampler *r, uint64_t input_frames);
+
 /* Called from the main thread, from source-output.c only. The normal way to
  * set the source reference volume is to call pa_source_set_volume(), but the
  * flat volume logic in source-output.c needs also a function that doesn't do
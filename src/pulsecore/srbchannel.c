@@ -28,6 +28,9 @@
 
 /* #define DEBUG_SRBCHANNEL */
 
+/* A reader gives up if the writer keeps updating the slot */
+#define TIMING_READ_TRIES 16
+
 /* This ringbuffer might be useful in other contexts too, but
  * right now it's only used inside the srbchannel, so let's keep it here
  * for the time being. */
@@ -80,6 +83,9 @@ struct pa_srbchannel {
     pa_fdsem *sem_read, *sem_write;
     pa_memblock *memblock;
 
+    pa_srbchannel_timing *timing;
+    uint32_t n_timing;
+
     void *cb_userdata;
     pa_srbchannel_cb_t callback;
 
@@ -175,6 +181,10 @@ struct srbheader {
     int readbuf_offset;
     int writebuf_offset;
 
+    /* Since protocol version 35, older servers don't set these */
+    int timing_offset;
+    int n_timing;
+
     /* TODO: Maybe a marker here to make sure we talk to a server with equally sized struct */
 };
 
@@ -235,7 +245,13 @@ pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p) {
     srh = pa_memblock_acquire(sr->memblock);
     pa_zero(*srh);
 
-    sr->rb_read.memory = (uint8_t*) srh + PA_ALIGN(sizeof(*srh));
+    sr->timing = (pa_srbchannel_timing*) ((uint8_t*) srh + PA_ALIGN(sizeof(*srh)));
+    sr->n_timing = PA_SRBCHANNEL_TIMING_SLOTS;
+    memset(sr->timing, 0, sr->n_timing * sizeof(pa_srbchannel_timing));
+    srh->timing_offset = (uint8_t*) sr->timing - (uint8_t*) srh;
+    srh->n_timing = sr->n_timing;
+
+    sr->rb_read.memory = (uint8_t*) sr->timing + PA_ALIGN(sr->n_timing * sizeof(pa_srbchannel_timing));
     srh->readbuf_offset = sr->rb_read.memory - (uint8_t*) srh;
 
     capacity = (pa_memblock_get_length(sr->memblock) - srh->readbuf_offset) / 2;
@@ -305,6 +321,13 @@ pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel
     sr->rb_read.memory = (uint8_t*) srh + srh->readbuf_offset;
     sr->rb_write.memory = (uint8_t*) srh + srh->writebuf_offset;
 
+    /* Don't trust the other side to get the layout right */
+    if (srh->n_timing > 0 && srh->timing_offset >= (int) sizeof(*srh) &&
+        srh->timing_offset + srh->n_timing * sizeof(pa_srbchannel_timing) <= (size_t) srh->readbuf_offset) {
+        sr->timing = (pa_srbchannel_timing*) ((uint8_t*) srh + srh->timing_offset);
+        sr->n_timing = srh->n_timing;
+    }
+
     sr->sem_read = pa_fdsem_open_shm(&srh->read_semdata, t->readfd);
     if (!sr->sem_read)
         goto fail;
@@ -337,6 +360,52 @@ void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t) {
     t->writefd = pa_fdsem_get(sr->sem_write);
 }
 
+pa_srbchannel_timing *pa_srbchannel_get_timing(pa_srbchannel *sr, uint32_t idx) {
+    pa_assert(sr);
+
+    if (idx >= sr->n_timing)
+        return NULL;
+
+    return sr->timing + idx;
+}
+
+void pa_srbchannel_timing_publish(pa_srbchannel_timing *t, const pa_srbchannel_timing_info *i) {
+    pa_assert(t);
+    pa_assert(i);
+
+    /* Both are full memory barriers, so the snapshot is written in
+     * between */
+    pa_atomic_inc(&t->seq);
+    t->info = *i;
+    pa_atomic_inc(&t->seq);
+}
+
+bool pa_srbchannel_timing_read(pa_srbchannel_timing *t, pa_srbchannel_timing_info *i, unsigned *seq) {
+    unsigned n;
+
+    pa_assert(t);
+    pa_assert(i);
+    pa_assert(seq);
+
+    for (n = 0; n < TIMING_READ_TRIES; n++) {
+        int s = pa_atomic_load(&t->seq);
+
+        if (s & 1)
+            continue;
+
+        *i = t->info;
+
+        /* A full memory barrier too, which makes sure the copy is complete
+         * before the sequence number is checked again */
+        if (pa_atomic_cmpxchg(&t->seq, s, s)) {
+            *seq = (unsigned) s;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata) {
     if (sr->callback)
         pa_fdsem_after_poll(sr->sem_read);
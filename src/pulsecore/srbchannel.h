@@ -21,6 +21,7 @@
 ***/
 
 #include <pulse/mainloop-api.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/fdsem.h>
 #include <pulsecore/memblock.h>
 
@@ -29,6 +30,31 @@
 
 typedef struct pa_srbchannel pa_srbchannel;
 
+/* The shm area also holds a number of slots for timing snapshots of
+ * playback streams. The server's IO thread publishes a snapshot to the
+ * slot of the stream, and the client reads it without sending a request.
+ * The layout is the same for 32 and 64 bit processes. */
+#define PA_SRBCHANNEL_TIMING_SLOTS 64
+
+typedef struct pa_srbchannel_timing_info {
+    uint64_t timestamp;         /* pa_rtclock_now() when this was taken */
+    int64_t read_index;
+    int64_t write_index;
+    uint64_t received;          /* Bytes of audio received from the client */
+    uint64_t sink_usec;
+    uint64_t underrun_for;
+    uint64_t playing_for;
+    uint32_t seeks;             /* Seeks and flushes processed */
+    uint32_t playing;
+} pa_srbchannel_timing_info;
+
+typedef struct pa_srbchannel_timing {
+    /* Odd while the snapshot is being updated, 0 if it never was */
+    pa_atomic_t seq;
+    uint32_t padding;
+    pa_srbchannel_timing_info info;
+} pa_srbchannel_timing;
+
 typedef struct pa_srbchannel_template {
     int readfd, writefd;
     pa_memblock *memblock;
@@ -42,6 +68,17 @@ void pa_srbchannel_free(pa_srbchannel *sr);
 
 void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t);
 
+/* Returns NULL if idx is out of range */
+pa_srbchannel_timing *pa_srbchannel_get_timing(pa_srbchannel *sr, uint32_t idx);
+
+/* Only one thread may publish to a slot at a time */
+void pa_srbchannel_timing_publish(pa_srbchannel_timing *t, const pa_srbchannel_timing_info *i);
+
+/* Returns false if no consistent snapshot could be read. On success *seq
+ * is set to the sequence number of the snapshot, which is 0 if nothing was
+ * published yet. */
+bool pa_srbchannel_timing_read(pa_srbchannel_timing *t, pa_srbchannel_timing_info *i, unsigned *seq);
+
 size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l);
 size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
 
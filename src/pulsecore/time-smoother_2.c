@@ -0,0 +1,227 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulse/sample.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "time-smoother_2.h"
+
+/*
+ * A second order phase locked loop that follows the device clock. The
+ * state is the device time at the last measurement and the ratio of the
+ * device clock to the system clock. For each new measurement the state is
+ * extrapolated to the time of the measurement and then corrected by the
+ * prediction error, with gains derived from the loop bandwidth:
+ *
+ *     position += ratio * dt + 2 * damping * w * dt * error
+ *     ratio    += (w * dt)^2 / dt * error
+ *
+ * Unlike the linear regression of pa_smoother this needs no history, and a
+ * single bad measurement moves the estimate by a bounded amount only. The
+ * loop starts with a wide bandwidth to lock quickly and then narrows it to
+ * suppress jitter. A single error too large to be jitter is taken as a
+ * bad measurement and ignored. Only when several of them come in a row
+ * they are taken as a discontinuity of the device clock, and the loop is
+ * resynchronized.
+ */
+
+#define START_BANDWIDTH 1.0             /* Hz */
+#define MIN_BANDWIDTH 0.05              /* Hz */
+#define BANDWIDTH_DECAY 0.9             /* per measurement */
+#define DAMPING M_SQRT1_2
+
+/* Keeps the discrete loop stable with infrequent measurements */
+#define MAX_OMEGA_DT 0.5
+
+#define MAX_ERROR_USEC (50*PA_USEC_PER_MSEC)
+/* Consecutive errors above MAX_ERROR_USEC before we resynchronize */
+#define MAX_OUTLIERS 3
+#define MAX_RATIO_DEVIATION 0.05
+
+struct pa_smoother_2 {
+    size_t frame_size;
+    uint32_t rate;
+
+    /* Estimated device time at system time last_time, in usec */
+    double position;
+    /* Device time per system time */
+    double ratio;
+    pa_usec_t last_time;
+
+    double bandwidth;
+    double error;
+    unsigned n_outliers;
+
+    /* To keep the results monotonic */
+    pa_usec_t last_result;
+
+    pa_usec_t pause_time;
+    bool paused:1;
+};
+
+pa_smoother_2 *pa_smoother_2_new(const pa_sample_spec *ss, pa_usec_t time_stamp, bool paused) {
+    pa_smoother_2 *s;
+
+    s = pa_xnew0(pa_smoother_2, 1);
+    pa_smoother_2_reset(s, ss, time_stamp, paused);
+
+    return s;
+}
+
+void pa_smoother_2_free(pa_smoother_2 *s) {
+    pa_assert(s);
+
+    pa_xfree(s);
+}
+
+void pa_smoother_2_reset(pa_smoother_2 *s, const pa_sample_spec *ss, pa_usec_t time_stamp, bool paused) {
+    pa_assert(s);
+    pa_assert(ss);
+    pa_assert(pa_sample_spec_valid(ss));
+
+    s->frame_size = pa_frame_size(ss);
+    s->rate = ss->rate;
+
+    s->position = 0;
+    s->ratio = 1.0;
+    s->last_time = time_stamp;
+
+    s->bandwidth = START_BANDWIDTH;
+    s->error = 0;
+    s->n_outliers = 0;
+
+    s->last_result = 0;
+
+    s->pause_time = time_stamp;
+    s->paused = paused;
+}
+
+void pa_smoother_2_put(pa_smoother_2 *s, pa_usec_t time_stamp, int64_t byte_count) {
+    double y, dt, error, omega_dt;
+
+    pa_assert(s);
+
+    /* The device clock doesn't advance while we are paused */
+    if (s->paused || time_stamp <= s->last_time)
+        return;
+
+    y = (double) (byte_count / (int64_t) s->frame_size) * PA_USEC_PER_SEC / s->rate;
+    dt = (double) (time_stamp - s->last_time);
+
+    s->position += s->ratio * dt;
+    s->last_time = time_stamp;
+
+    error = y - s->position;
+
+    if (fabs(error) > MAX_ERROR_USEC) {
+        if (++s->n_outliers < MAX_OUTLIERS) {
+            pa_log_debug("Device clock is off by %0.2f ms, ignoring the measurement.", error / PA_USEC_PER_MSEC);
+            return;
+        }
+
+        pa_log_debug("Device clock is off by %0.2f ms, resynchronizing.", error / PA_USEC_PER_MSEC);
+
+        s->position = y;
+        s->bandwidth = START_BANDWIDTH;
+        s->n_outliers = 0;
+        return;
+    }
+
+    s->n_outliers = 0;
+
+    omega_dt = PA_MIN(2 * M_PI * s->bandwidth * dt / PA_USEC_PER_SEC, MAX_OMEGA_DT);
+
+    s->position += 2 * DAMPING * omega_dt * error;
+    s->ratio += omega_dt * omega_dt / dt * error;
+    s->ratio = PA_CLAMP(s->ratio, 1.0 - MAX_RATIO_DEVIATION, 1.0 + MAX_RATIO_DEVIATION);
+
+    s->bandwidth = PA_MAX(s->bandwidth * BANDWIDTH_DECAY, MIN_BANDWIDTH);
+    s->error += (fabs(error) - s->error) * 0.1;
+}
+
+pa_usec_t pa_smoother_2_get(pa_smoother_2 *s, pa_usec_t time_stamp) {
+    double y;
+    pa_usec_t r;
+
+    pa_assert(s);
+
+    if (s->paused)
+        time_stamp = s->pause_time;
+
+    y = s->position + s->ratio * ((double) time_stamp - (double) s->last_time);
+
+    r = y > 0 ? (pa_usec_t) y : 0;
+
+    if (r < s->last_result)
+        r = s->last_result;
+    else
+        s->last_result = r;
+
+    return r;
+}
+
+pa_usec_t pa_smoother_2_translate(pa_smoother_2 *s, pa_usec_t time_difference) {
+    pa_assert(s);
+
+    return (pa_usec_t) ((double) time_difference / s->ratio);
+}
+
+double pa_smoother_2_get_ratio(pa_smoother_2 *s) {
+    pa_assert(s);
+
+    return s->ratio;
+}
+
+pa_usec_t pa_smoother_2_get_error(pa_smoother_2 *s) {
+    pa_assert(s);
+
+    return (pa_usec_t) s->error;
+}
+
+void pa_smoother_2_pause(pa_smoother_2 *s, pa_usec_t time_stamp) {
+    pa_assert(s);
+
+    if (s->paused)
+        return;
+
+    s->pause_time = time_stamp;
+    s->paused = true;
+}
+
+void pa_smoother_2_resume(pa_smoother_2 *s, pa_usec_t time_stamp) {
+    pa_assert(s);
+
+    if (!s->paused)
+        return;
+
+    /* Continue from where the device clock stopped */
+    if (s->pause_time > s->last_time)
+        s->position += s->ratio * (double) (s->pause_time - s->last_time);
+
+    s->last_time = PA_MAX(time_stamp, s->pause_time);
+    s->paused = false;
+}
@@ -0,0 +1,57 @@
+#ifndef foopulsetimesmoother2hfoo
+#define foopulsetimesmoother2hfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulsecore/macro.h>
+#include <pulse/sample.h>
+
+typedef struct pa_smoother_2 pa_smoother_2;
+
+/* Tracks the clock of a device against the system clock. The device clock
+ * starts at 0 when the smoother is resumed for the first time after
+ * creation or reset. */
+pa_smoother_2 *pa_smoother_2_new(const pa_sample_spec *ss, pa_usec_t time_stamp, bool paused);
+
+void pa_smoother_2_free(pa_smoother_2 *s);
+
+/* Adds a new measurement: byte_count bytes have passed the device at system
+ * time time_stamp */
+void pa_smoother_2_put(pa_smoother_2 *s, pa_usec_t time_stamp, int64_t byte_count);
+
+/* Returns the estimated device time at system time time_stamp. The result
+ * never decreases. */
+pa_usec_t pa_smoother_2_get(pa_smoother_2 *s, pa_usec_t time_stamp);
+
+/* Translates a time span from the device time domain to the system one */
+pa_usec_t pa_smoother_2_translate(pa_smoother_2 *s, pa_usec_t time_difference);
+
+/* Returns the estimated ratio of the device clock to the system clock */
+double pa_smoother_2_get_ratio(pa_smoother_2 *s);
+
+/* Returns the average deviation of the measurements from the estimate */
+pa_usec_t pa_smoother_2_get_error(pa_smoother_2 *s);
+
+void pa_smoother_2_pause(pa_smoother_2 *s, pa_usec_t time_stamp);
+void pa_smoother_2_resume(pa_smoother_2 *s, pa_usec_t time_stamp);
+
+/* Forgets everything, e.g. after the device has been restarted, possibly
+ * with a different sample spec */
+void pa_smoother_2_reset(pa_smoother_2 *s, const pa_sample_spec *ss, pa_usec_t time_stamp, bool paused);
+
+#endif
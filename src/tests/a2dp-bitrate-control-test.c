@@ -0,0 +1,210 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "../modules/bluetooth/a2dp-bitrate-control.h"
+
+/* A socketpair stands in for the L2CAP link. Every tick the sender writes
+ * one packet, whose size grows with the bitrate level, and the receiver
+ * reads as much as the link can carry during the tick. The time is
+ * simulated, so the test runs as fast as the socket calls. */
+
+#define TICK_USEC (10 * PA_USEC_PER_MSEC)
+#define SEND_BUFFER_SIZE 8192
+
+#define MAX_LEVEL 10
+#define PACKET_SIZE(level) (200 + 50 * (level))
+
+struct phase {
+    pa_usec_t end;
+    size_t link_capacity;                       /* Bytes per tick */
+};
+
+/* The link gets congested for a while and recovers */
+static const struct phase phases[] = {
+    { 10 * PA_USEC_PER_SEC, 1000 },
+    { 40 * PA_USEC_PER_SEC, PACKET_SIZE(5) },
+    { 100 * PA_USEC_PER_SEC, 1000 },
+};
+
+struct stats {
+    unsigned level;
+    unsigned n_changes;
+    unsigned n_congested;
+};
+
+static void run_phase(pa_a2dp_bitrate_control *c, int fds[2], pa_usec_t *now, const struct phase *phase, struct stats *stats) {
+    uint8_t packet[PACKET_SIZE(MAX_LEVEL)];
+    int capacity;
+    socklen_t len = sizeof(capacity);
+    ssize_t credit = 0;
+
+    fail_unless(getsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &capacity, &len) == 0);
+
+    memset(packet, 0, sizeof(packet));
+
+    for (; *now < phase->end; *now += TICK_USEC) {
+        pa_a2dp_bitrate_step_t step;
+        bool congested = false;
+        int queued;
+
+        if (send(fds[0], packet, PACKET_SIZE(stats->level), MSG_DONTWAIT) < 0) {
+            fail_unless(errno == EAGAIN);
+            congested = true;
+            stats->n_congested++;
+        }
+
+        /* Unlike on Bluetooth sockets, SIOCOUTQ reports the bytes queued
+         * on Unix sockets */
+        fail_unless(ioctl(fds[0], SIOCOUTQ, &queued) == 0);
+
+        step = pa_a2dp_bitrate_control_update(c, *now, (size_t) queued, (size_t) capacity, congested);
+
+        if (step == PA_A2DP_BITRATE_DECREASE && stats->level > 0) {
+            stats->level--;
+            stats->n_changes++;
+        } else if (step == PA_A2DP_BITRATE_INCREASE && stats->level < MAX_LEVEL) {
+            stats->level++;
+            stats->n_changes++;
+        } else if (step != PA_A2DP_BITRATE_KEEP)
+            pa_a2dp_bitrate_control_reject(c);
+
+        /* The link carries what it can, unused capacity is lost */
+        credit = PA_MIN(credit, 0) + (ssize_t) phase->link_capacity;
+
+        while (credit > 0) {
+            ssize_t l;
+
+            if ((l = recv(fds[1], packet, sizeof(packet), MSG_DONTWAIT)) < 0) {
+                fail_unless(errno == EAGAIN);
+                break;
+            }
+
+            credit -= l;
+        }
+    }
+
+    pa_log_debug("Until %0.1f s: level %u, %u changes, %u times congested",
+                 (double) phase->end / PA_USEC_PER_SEC, stats->level, stats->n_changes, stats->n_congested);
+}
+
+START_TEST (bitrate_control_test) {
+    pa_a2dp_bitrate_control *c;
+    struct stats stats = { MAX_LEVEL, 0, 0 };
+    pa_usec_t now = 0;
+    int fds[2];
+    int size = SEND_BUFFER_SIZE;
+
+    fail_unless(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+    fail_unless(setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == 0);
+
+    c = pa_a2dp_bitrate_control_new();
+
+    /* Plenty of capacity, the bitrate stays at its maximum */
+    run_phase(c, fds, &now, &phases[0], &stats);
+    fail_unless(stats.level == MAX_LEVEL);
+    fail_unless(stats.n_changes == 0);
+    fail_unless(stats.n_congested == 0);
+
+    /* The bitrate goes down to what the link carries. Attempts to go up
+     * again get rarer, so it doesn't keep changing: after the way down,
+     * three attempts with 2, 4 and 8 s in between fit into the phase. */
+    run_phase(c, fds, &now, &phases[1], &stats);
+    fail_unless(stats.level <= 5);
+    fail_unless(stats.n_changes <= 16);
+
+    /* When the link has recovered, so does the bitrate */
+    run_phase(c, fds, &now, &phases[2], &stats);
+    fail_unless(stats.level == MAX_LEVEL);
+
+    pa_a2dp_bitrate_control_free(c);
+    pa_close(fds[0]);
+    pa_close(fds[1]);
+}
+END_TEST
+
+/* An encoder at its highest bitrate rejects the increases. A congestion
+ * right after one must not count as a failed increase, or the bitrate would
+ * take longer to come back. */
+START_TEST (bitrate_control_reject_test) {
+    pa_a2dp_bitrate_control *c;
+    pa_usec_t now, rejected_at = 0;
+
+    c = pa_a2dp_bitrate_control_new();
+
+    for (now = 0; now < 10 * PA_USEC_PER_SEC; now += TICK_USEC) {
+        if (pa_a2dp_bitrate_control_update(c, now, 0, SEND_BUFFER_SIZE, false) == PA_A2DP_BITRATE_INCREASE) {
+            pa_a2dp_bitrate_control_reject(c);
+            rejected_at = now;
+        }
+    }
+
+    fail_unless(rejected_at > 0);
+
+    now = rejected_at + TICK_USEC;
+    fail_unless(pa_a2dp_bitrate_control_update(c, now, 0, SEND_BUFFER_SIZE, true) == PA_A2DP_BITRATE_DECREASE);
+
+    do
+        now += TICK_USEC;
+    while (pa_a2dp_bitrate_control_update(c, now, 0, SEND_BUFFER_SIZE, false) != PA_A2DP_BITRATE_INCREASE);
+
+    fail_unless(now - rejected_at < 3 * PA_USEC_PER_SEC);
+
+    pa_a2dp_bitrate_control_free(c);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("A2DP bitrate control");
+    tc = tcase_create("a2dp-bitrate-control");
+    tcase_add_test(tc, bitrate_control_test);
+    tcase_add_test(tc, bitrate_control_reject_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
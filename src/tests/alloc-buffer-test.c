@@ -0,0 +1,305 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+#include <pulse/internal.h>
+
+#include <pulsecore/memblock.h>
+
+/* Tests pa_context_alloc_buffer() and pa_context_free_buffer(), and
+ * writing such buffers with pa_stream_write(). Needs a running daemon. */
+
+#define BUFFER_SIZE 4096
+
+static pa_threaded_mainloop *mainloop = NULL;
+static pa_context *context = NULL;
+static pa_mainloop_api *mainloop_api = NULL;
+static const char *bname = NULL;
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = 44100,
+    .channels = 2
+};
+
+/* This is called whenever the context status changes */
+static void context_state_callback(pa_context *c, void *userdata) {
+    fail_unless(c != NULL);
+
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+            break;
+
+        case PA_CONTEXT_READY:
+            fprintf(stderr, "Connection established.\n");
+            pa_threaded_mainloop_signal(mainloop, false);
+            break;
+
+        case PA_CONTEXT_TERMINATED:
+            mainloop_api->quit(mainloop_api, 0);
+            pa_threaded_mainloop_signal(mainloop, false);
+            break;
+
+        case PA_CONTEXT_FAILED:
+            mainloop_api->quit(mainloop_api, 0);
+            pa_threaded_mainloop_signal(mainloop, false);
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            fail();
+            break;
+
+        default:
+            fail();
+    }
+}
+
+static void alloc_buffer_setup() {
+    int r;
+
+    mainloop = pa_threaded_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    mainloop_api = pa_threaded_mainloop_get_api(mainloop);
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    pa_threaded_mainloop_start(mainloop);
+
+    context = pa_context_new(mainloop_api, bname);
+    fail_unless(context != NULL);
+
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+
+    r = pa_context_connect(context, NULL, 0, NULL);
+    fail_unless(r == 0);
+
+    pa_threaded_mainloop_wait(mainloop);
+
+    fail_unless(pa_context_get_state(context) == PA_CONTEXT_READY);
+
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+static void alloc_buffer_teardown() {
+    pa_threaded_mainloop_lock(mainloop);
+
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+
+    pa_threaded_mainloop_unlock(mainloop);
+
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+}
+
+/* This routine is called whenever the stream state changes */
+static void stream_state_callback(pa_stream *s, void *userdata) {
+    fail_unless(s != NULL);
+
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_UNCONNECTED:
+        case PA_STREAM_CREATING:
+            break;
+
+        case PA_STREAM_READY:
+        case PA_STREAM_TERMINATED:
+            pa_threaded_mainloop_signal(mainloop, false);
+            break;
+
+        case PA_STREAM_FAILED:
+            fprintf(stderr, "Stream error: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            pa_threaded_mainloop_signal(mainloop, false);
+            break;
+
+        default:
+            fail();
+    }
+}
+
+static pa_stream* connect_stream() {
+    pa_stream *s;
+    int r;
+
+    s = pa_stream_new(context, "alloc buffer test", &sample_spec, NULL);
+    fail_unless(s != NULL);
+
+    pa_stream_set_state_callback(s, stream_state_callback, NULL);
+
+    /* Corked, so that the buffers are not played back */
+    r = pa_stream_connect_playback(s, NULL, NULL, PA_STREAM_START_CORKED, NULL, NULL);
+    fail_unless(r == 0);
+
+    pa_threaded_mainloop_wait(mainloop);
+
+    fail_unless(pa_stream_get_state(s) == PA_STREAM_READY);
+
+    return s;
+}
+
+static void disconnect_stream(pa_stream *s) {
+    int r;
+
+    r = pa_stream_disconnect(s);
+    fail_unless(r == 0);
+
+    pa_threaded_mainloop_wait(mainloop);
+    fail_unless(pa_stream_get_state(s) == PA_STREAM_TERMINATED);
+
+    pa_stream_unref(s);
+}
+
+/* Number of blocks allocated from the memory pool of the context so
+ * far, which changes if a write copies the data into the pool */
+static int n_accumulated(void) {
+    return pa_atomic_load(&pa_mempool_get_stat(context->mempool)->n_accumulated);
+}
+
+START_TEST (alloc_buffer_free_test) {
+    void *data, *data2;
+    size_t nbytes;
+    char foreign[16];
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    /* The library chooses the size */
+    nbytes = (size_t) -1;
+    fail_unless(pa_context_alloc_buffer(context, &data, &nbytes) == 0);
+    fail_unless(data != NULL);
+    fail_unless(nbytes == pa_context_get_tile_size(context, NULL));
+    memset(data, 0, nbytes);
+
+    fail_unless(pa_context_free_buffer(context, data) == 0);
+
+    /* Freeing twice */
+    fail_unless(pa_context_free_buffer(context, data) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+
+    nbytes = BUFFER_SIZE;
+    fail_unless(pa_context_alloc_buffer(context, &data, &nbytes) == 0);
+    fail_unless(nbytes == BUFFER_SIZE);
+
+    nbytes = 0;
+    fail_unless(pa_context_alloc_buffer(context, &data2, &nbytes) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+
+    /* Pointers that were not returned by pa_context_alloc_buffer() */
+    fail_unless(pa_context_free_buffer(context, foreign) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+    fail_unless(pa_context_free_buffer(context, (uint8_t *) data + 4) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+    fail_unless(pa_context_free_buffer(context, NULL) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+
+    /* data is left allocated, the context frees it */
+
+    pa_threaded_mainloop_unlock(mainloop);
+}
+END_TEST
+
+static void free_cb(void *p) {
+    *(bool *) p = true;
+
+    pa_threaded_mainloop_signal(mainloop, false);
+}
+
+START_TEST (alloc_buffer_write_test) {
+    pa_stream *s;
+    void *data;
+    size_t nbytes;
+    int n;
+    int16_t user_data[BUFFER_SIZE / sizeof(int16_t)];
+    bool freed = false;
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    s = connect_stream();
+
+    nbytes = BUFFER_SIZE;
+    fail_unless(pa_context_alloc_buffer(context, &data, &nbytes) == 0);
+    memset(data, 0, nbytes);
+
+    /* A free callback makes no sense for these buffers */
+    fail_unless(pa_stream_write_ext_free(s, data, nbytes, free_cb, &freed, 0, PA_SEEK_RELATIVE) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+
+    /* The buffer is too small */
+    fail_unless(pa_stream_write(s, data, nbytes + pa_frame_size(&sample_spec), NULL, 0, PA_SEEK_RELATIVE) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+
+    /* Written without copying it into another block, and may be shorter
+     * than the buffer */
+    n = n_accumulated();
+    fail_unless(pa_stream_write(s, data, nbytes / 2, NULL, 0, PA_SEEK_RELATIVE) == 0);
+    fail_unless(n_accumulated() == n);
+
+    /* The write took the buffer over */
+    fail_unless(pa_context_free_buffer(context, data) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+
+    /* Other memory without a free callback still gets copied */
+    memset(user_data, 0, sizeof(user_data));
+    n = n_accumulated();
+    fail_unless(pa_stream_write(s, user_data, sizeof(user_data), NULL, 0, PA_SEEK_RELATIVE) == 0);
+    fail_unless(n_accumulated() > n);
+
+    /* And with a free callback it is either referenced until it has been
+     * sent or copied, and then freed */
+    fail_unless(!freed);
+    fail_unless(pa_stream_write_ext_free(s, user_data, sizeof(user_data), free_cb, &freed, 0, PA_SEEK_RELATIVE) == 0);
+    while (!freed)
+        pa_threaded_mainloop_wait(mainloop);
+
+    disconnect_stream(s);
+
+    pa_threaded_mainloop_unlock(mainloop);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv[0];
+
+    s = suite_create("Alloc buffer");
+    tc = tcase_create("alloc-buffer");
+    tcase_add_checked_fixture(tc, alloc_buffer_setup, alloc_buffer_teardown);
+    tcase_add_test(tc, alloc_buffer_free_test);
+    tcase_add_test(tc, alloc_buffer_write_test);
+    tcase_set_timeout(tc, 5);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
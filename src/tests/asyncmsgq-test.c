@@ -34,9 +34,32 @@ enum {
     OPERATION_A,
     OPERATION_B,
     OPERATION_C,
+    OPERATION_FAIL,
     QUIT
 };
 
+typedef struct test_msg {
+    pa_msgobject parent;
+    int codes[16];
+    int64_t offsets[16];
+    unsigned n;
+} test_msg;
+
+PA_DEFINE_PRIVATE_CLASS(test_msg, pa_msgobject);
+#define TEST_MSG(o) (test_msg_cast(o))
+
+static int test_msg_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    test_msg *m = TEST_MSG(o);
+
+    pa_assert(m->n < PA_ELEMENTSOF(m->codes));
+
+    m->codes[m->n] = code;
+    m->offsets[m->n] = offset;
+    m->n++;
+
+    return code == OPERATION_FAIL ? -1 : 0;
+}
+
 static void the_thread(void *_q) {
     pa_asyncmsgq *q = _q;
     int quit = 0;
@@ -44,7 +67,19 @@ static void the_thread(void *_q) {
     do {
         int code = 0;
 
-        pa_assert_se(pa_asyncmsgq_get(q, NULL, &code, NULL, NULL, NULL, 1) == 0);
+        pa_msgobject *object = NULL;
+        void *data;
+        int64_t offset;
+        pa_memchunk chunk;
+        int ret = 0;
+
+        pa_assert_se(pa_asyncmsgq_get(q, &object, &code, &data, &offset, &chunk, 1) == 0);
+
+        if (object) {
+            ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
+            pa_asyncmsgq_done(q, ret);
+            continue;
+        }
 
         switch (code) {
 
@@ -105,6 +140,80 @@ START_TEST (asyncmsgq_test) {
 }
 END_TEST
 
+START_TEST (asyncmsgq_batch_test) {
+    pa_asyncmsgq *q;
+    pa_asyncmsgq_batch *b;
+    pa_thread *t;
+    test_msg *m;
+
+    q = pa_asyncmsgq_new(0);
+    fail_unless(q != NULL);
+
+    m = pa_msgobject_new(test_msg);
+    m->parent.process_msg = test_msg_process_msg;
+    m->n = 0;
+
+    t = pa_thread_new("test", the_thread, q);
+    fail_unless(t != NULL);
+
+    /* Coalesced messages keep only the last one, in the last place */
+    b = pa_asyncmsgq_batch_new();
+    pa_asyncmsgq_batch_add_coalesced(b, PA_MSGOBJECT(m), OPERATION_A, NULL, 1, NULL, NULL);
+    pa_asyncmsgq_batch_add(b, PA_MSGOBJECT(m), OPERATION_B, NULL, 2, NULL, NULL);
+    pa_asyncmsgq_batch_add_coalesced(b, PA_MSGOBJECT(m), OPERATION_A, NULL, 3, NULL, NULL);
+    pa_asyncmsgq_batch_add(b, PA_MSGOBJECT(m), OPERATION_C, NULL, 4, NULL, NULL);
+    pa_asyncmsgq_batch_add_coalesced(b, PA_MSGOBJECT(m), OPERATION_A, NULL, 5, NULL, NULL);
+    fail_unless(pa_asyncmsgq_batch_size(b) == 3);
+
+    fail_unless(pa_asyncmsgq_batch_send(q, b) == 0);
+
+    fail_unless(m->n == 3);
+    fail_unless(m->codes[0] == OPERATION_B && m->offsets[0] == 2);
+    fail_unless(m->codes[1] == OPERATION_C && m->offsets[1] == 4);
+    fail_unless(m->codes[2] == OPERATION_A && m->offsets[2] == 5);
+
+    /* All messages are dispatched, even after one of them failed */
+    b = pa_asyncmsgq_batch_new();
+    pa_asyncmsgq_batch_add(b, PA_MSGOBJECT(m), OPERATION_FAIL, NULL, 6, NULL, NULL);
+    pa_asyncmsgq_batch_add(b, PA_MSGOBJECT(m), OPERATION_A, NULL, 7, NULL, NULL);
+
+    fail_unless(pa_asyncmsgq_batch_send(q, b) < 0);
+    fail_unless(m->n == 5);
+    fail_unless(m->codes[4] == OPERATION_A && m->offsets[4] == 7);
+
+    /* Posted batches are ordered with the other messages */
+    b = pa_asyncmsgq_batch_new();
+    pa_asyncmsgq_batch_add(b, PA_MSGOBJECT(m), OPERATION_B, NULL, 8, NULL, NULL);
+    pa_asyncmsgq_batch_add(b, PA_MSGOBJECT(m), OPERATION_C, NULL, 9, NULL, NULL);
+    pa_asyncmsgq_batch_post(q, b);
+
+    fail_unless(pa_asyncmsgq_batch_send(q, pa_asyncmsgq_batch_new()) == 0);
+
+    fail_unless(pa_asyncmsgq_send(q, PA_MSGOBJECT(m), OPERATION_A, NULL, 10, NULL) == 0);
+    fail_unless(m->n == 8);
+    fail_unless(m->offsets[5] == 8 && m->offsets[6] == 9 && m->offsets[7] == 10);
+
+    /* The reading thread puts a finished posted batch back for reuse
+     * instead of freeing it */
+    b = pa_asyncmsgq_batch_new();
+    pa_asyncmsgq_batch_add(b, PA_MSGOBJECT(m), OPERATION_B, NULL, 11, NULL, NULL);
+    pa_asyncmsgq_batch_post(q, b);
+
+    fail_unless(pa_asyncmsgq_send(q, PA_MSGOBJECT(m), OPERATION_A, NULL, 12, NULL) == 0);
+    fail_unless(m->n == 10);
+    fail_unless(pa_asyncmsgq_batch_new() == b);
+    fail_unless(pa_asyncmsgq_batch_size(b) == 0);
+    pa_asyncmsgq_batch_free(b);
+
+    pa_asyncmsgq_post(q, NULL, QUIT, NULL, 0, NULL, NULL);
+
+    pa_thread_free(t);
+
+    pa_asyncmsgq_unref(q);
+    pa_msgobject_unref(PA_MSGOBJECT(m));
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -114,6 +223,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Message Queue");
     tc = tcase_create("asyncmsgq");
     tcase_add_test(tc, asyncmsgq_test);
+    tcase_add_test(tc, asyncmsgq_batch_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
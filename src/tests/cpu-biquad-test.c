@@ -0,0 +1,207 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/cpu.h>
+#include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/random.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/filter/biquad.h>
+
+#include "runtime-test-util.h"
+
+#define SAMPLES 1021
+#define TIMES 100
+#define TIMES2 50
+
+/* The optimized kernels compute in the same order as the C code, but
+ * fused multiply-adds or flushed denormals can make them differ in the
+ * last bits */
+#define MAX_ERROR 1e-5f
+
+/* Every channel gets a different filter type, so that a lane picking up
+ * the coefficients of another channel shows */
+static void setup_filters(struct biquad *bq, struct biquad_state *state, int channels) {
+    static const enum biquad_type types[] = {
+        BQ_LOWPASS, BQ_HIGHPASS, BQ_BANDPASS, BQ_LOWSHELF,
+        BQ_HIGHSHELF, BQ_PEAKING, BQ_NOTCH, BQ_ALLPASS, BQ_NONE
+    };
+    int c;
+
+    for (c = 0; c < channels; c++) {
+        biquad_set_params(&bq[c], types[c % PA_ELEMENTSOF(types)], 0.02 + 0.05 * c, 0.7 + 0.1 * c, 6.0 - c);
+        biquad_state_reset(&state[c]);
+    }
+}
+
+static void run_biquad_test(
+        biquad_process_float32_func_t func,
+        biquad_process_float32_func_t orig_func,
+        int channels,
+        bool correct,
+        bool perf) {
+
+    struct biquad bq[PA_CHANNELS_MAX];
+    struct biquad_state state[PA_CHANNELS_MAX], state_ref[PA_CHANNELS_MAX];
+    int16_t *noise;
+    float *src, *dst, *dst_ref;
+    int i, half = SAMPLES / 2;
+
+    noise = pa_xnew(int16_t, SAMPLES * channels);
+    src = pa_xnew(float, SAMPLES * channels);
+    dst = pa_xnew(float, SAMPLES * channels);
+    dst_ref = pa_xnew(float, SAMPLES * channels);
+
+    pa_random(noise, SAMPLES * channels * sizeof(int16_t));
+    for (i = 0; i < SAMPLES * channels; i++)
+        src[i] = noise[i] / 32768.0f;
+
+    setup_filters(bq, state, channels);
+    setup_filters(bq, state_ref, channels);
+
+    if (correct) {
+        /* The first half is filtered in place and the second half into
+         * another buffer, which also checks that the filter state is
+         * carried over between calls */
+        memcpy(dst, src, half * channels * sizeof(float));
+        func(bq, state, half, channels, dst, dst);
+        func(bq, state, SAMPLES - half, channels, src + half * channels, dst + half * channels);
+        orig_func(bq, state_ref, SAMPLES, channels, src, dst_ref);
+
+        for (i = 0; i < SAMPLES * channels; i++) {
+            if (fabsf(dst[i] - dst_ref[i]) > MAX_ERROR) {
+                pa_log_debug("Correctness test failed: channels=%d", channels);
+                pa_log_debug("%d: %.9f != %.9f", i, dst[i], dst_ref[i]);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %d-channel biquad performance", channels);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(bq, state, SAMPLES, channels, src, dst);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(bq, state_ref, SAMPLES, channels, src, dst_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_xfree(noise);
+    pa_xfree(src);
+    pa_xfree(dst);
+    pa_xfree(dst_ref);
+}
+
+static void run_biquad_tests(biquad_process_float32_func_t func, biquad_process_float32_func_t orig_func) {
+    run_biquad_test(func, orig_func, 1, true, false);
+    run_biquad_test(func, orig_func, 2, true, true);
+    run_biquad_test(func, orig_func, 4, true, false);
+    run_biquad_test(func, orig_func, 6, true, true);
+    run_biquad_test(func, orig_func, 7, true, false);
+    run_biquad_test(func, orig_func, 8, true, true);
+    run_biquad_test(func, orig_func, 9, true, false);
+}
+
+#if defined (__i386__) || defined (__amd64__)
+START_TEST (biquad_sse_test) {
+    biquad_process_float32_func_t orig_func, sse_func;
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE)) {
+        pa_log_info("SSE not supported. Skipping");
+        return;
+    }
+
+    orig_func = biquad_get_process_float32_func();
+    pa_biquad_func_init_sse(flags);
+    sse_func = biquad_get_process_float32_func();
+
+    pa_log_debug("Checking SSE biquad");
+    run_biquad_tests(sse_func, orig_func);
+
+    biquad_set_process_float32_func(orig_func);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+START_TEST (biquad_neon_test) {
+    biquad_process_float32_func_t orig_func, neon_func;
+    pa_cpu_arm_flag_t flags = 0;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    orig_func = biquad_get_process_float32_func();
+    pa_biquad_func_init_neon(flags);
+    neon_func = biquad_get_process_float32_func();
+
+    pa_log_debug("Checking NEON biquad");
+    run_biquad_tests(neon_func, orig_func);
+
+    biquad_set_process_float32_func(orig_func);
+}
+END_TEST
+#endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("CPU");
+
+    tc = tcase_create("biquad");
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, biquad_sse_test);
+#endif
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+    tcase_add_test(tc, biquad_neon_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -23,6 +23,7 @@
 
 #include <pulsecore/cpu.h>
 #include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
 #include <pulsecore/random.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/mix.h>
@@ -168,6 +169,148 @@ START_TEST (mix_special_test) {
 }
 END_TEST
 
+#if defined (__i386__) || defined (__amd64__)
+#define MIX_STREAMS 3
+
+/* Mixes three streams with differing volumes per channel, including a
+ * muted channel and one above PA_VOLUME_NORM. The length is not a multiple
+ * of the vector size, nor of the number of channels. */
+static void run_mix_format_test(
+        pa_do_mix_func_t func,
+        pa_do_mix_func_t orig_func,
+        pa_sample_format_t format,
+        int channels,
+        bool perf) {
+
+    uint8_t in[MIX_STREAMS][SAMPLES * 4], out[SAMPLES * 4], out_ref[SAMPLES * 4];
+    size_t size = pa_sample_size_of_format(format);
+    pa_mempool *pool;
+    pa_mix_info m[MIX_STREAMS];
+    int i, j;
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL, NULL);
+
+    for (i = 0; i < MIX_STREAMS; i++) {
+        pa_random(in[i], sizeof(in[i]));
+
+        m[i].chunk.memblock = pa_memblock_new_fixed(pool, in[i], sizeof(in[i]), false);
+        m[i].chunk.length = pa_memblock_get_length(m[i].chunk.memblock);
+        m[i].chunk.index = 0;
+
+        m[i].volume.channels = channels;
+        for (j = 0; j < channels; j++) {
+            m[i].volume.values[j] = PA_VOLUME_NORM;
+            m[i].linear[j].i = 0x4000 + 0x5555 * i + 0x1234 * j;
+        }
+    }
+
+    m[0].linear[channels - 1].i = 0;
+    m[1].linear[0].i = 0x18000;
+
+    acquire_mix_streams(m, MIX_STREAMS);
+    orig_func(m, MIX_STREAMS, channels, out_ref, (SAMPLES - 3) * size);
+    release_mix_streams(m, MIX_STREAMS);
+
+    acquire_mix_streams(m, MIX_STREAMS);
+    func(m, MIX_STREAMS, channels, out, (SAMPLES - 3) * size);
+    release_mix_streams(m, MIX_STREAMS);
+
+    for (i = 0; i < (int) ((SAMPLES - 3) * size); i++) {
+        if (out[i] != out_ref[i]) {
+            pa_log_debug("Correctness test failed: channels=%d", channels);
+            pa_log_debug("%d: %02x != %02x", i, out[i], out_ref[i]);
+            ck_abort();
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %d-channel mixing performance", channels);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            acquire_mix_streams(m, MIX_STREAMS);
+            func(m, MIX_STREAMS, channels, out, SAMPLES * size);
+            release_mix_streams(m, MIX_STREAMS);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            acquire_mix_streams(m, MIX_STREAMS);
+            orig_func(m, MIX_STREAMS, channels, out_ref, SAMPLES * size);
+            release_mix_streams(m, MIX_STREAMS);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    for (i = 0; i < MIX_STREAMS; i++)
+        pa_memblock_unref(m[i].chunk.memblock);
+
+    pa_mempool_unref(pool);
+}
+
+START_TEST (mix_g711_sse2_test) {
+    pa_do_mix_func_t orig_ulaw, orig_alaw, sse2_ulaw, sse2_alaw;
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    orig_ulaw = pa_get_mix_func(PA_SAMPLE_ULAW);
+    orig_alaw = pa_get_mix_func(PA_SAMPLE_ALAW);
+    pa_mix_func_init_sse(PA_CPU_X86_SSE2);
+    sse2_ulaw = pa_get_mix_func(PA_SAMPLE_ULAW);
+    sse2_alaw = pa_get_mix_func(PA_SAMPLE_ALAW);
+
+    pa_log_debug("Checking SSE2 mix (ulaw, mono)");
+    run_mix_format_test(sse2_ulaw, orig_ulaw, PA_SAMPLE_ULAW, 1, true);
+
+    pa_log_debug("Checking SSE2 mix (ulaw, stereo)");
+    run_mix_format_test(sse2_ulaw, orig_ulaw, PA_SAMPLE_ULAW, 2, false);
+
+    pa_log_debug("Checking SSE2 mix (ulaw, 6-channel)");
+    run_mix_format_test(sse2_ulaw, orig_ulaw, PA_SAMPLE_ULAW, 6, false);
+
+    pa_log_debug("Checking SSE2 mix (alaw, mono)");
+    run_mix_format_test(sse2_alaw, orig_alaw, PA_SAMPLE_ALAW, 1, true);
+
+    pa_log_debug("Checking SSE2 mix (alaw, 3-channel)");
+    run_mix_format_test(sse2_alaw, orig_alaw, PA_SAMPLE_ALAW, 3, false);
+}
+END_TEST
+
+START_TEST (mix_s24_sse4_1_test) {
+    pa_do_mix_func_t orig_s24, orig_s24_32, sse4_1_s24, sse4_1_s24_32;
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE4_1)) {
+        pa_log_info("SSE4.1 not supported. Skipping");
+        return;
+    }
+
+    orig_s24 = pa_get_mix_func(PA_SAMPLE_S24NE);
+    orig_s24_32 = pa_get_mix_func(PA_SAMPLE_S24_32NE);
+    pa_mix_func_init_sse(PA_CPU_X86_SSE4_1);
+    sse4_1_s24 = pa_get_mix_func(PA_SAMPLE_S24NE);
+    sse4_1_s24_32 = pa_get_mix_func(PA_SAMPLE_S24_32NE);
+
+    pa_log_debug("Checking SSE4.1 mix (s24, stereo)");
+    run_mix_format_test(sse4_1_s24, orig_s24, PA_SAMPLE_S24NE, 2, true);
+
+    pa_log_debug("Checking SSE4.1 mix (s24, 6-channel)");
+    run_mix_format_test(sse4_1_s24, orig_s24, PA_SAMPLE_S24NE, 6, false);
+
+    pa_log_debug("Checking SSE4.1 mix (s24-32, stereo)");
+    run_mix_format_test(sse4_1_s24_32, orig_s24_32, PA_SAMPLE_S24_32NE, 2, true);
+
+    pa_log_debug("Checking SSE4.1 mix (s24-32, 3-channel)");
+    run_mix_format_test(sse4_1_s24_32, orig_s24_32, PA_SAMPLE_S24_32NE, 3, false);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (mix_neon_test) {
     pa_do_mix_func_t orig_func, neon_func;
@@ -209,6 +352,10 @@ int main(int argc, char *argv[]) {
 
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_special_test);
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, mix_g711_sse2_test);
+    tcase_add_test(tc, mix_s24_sse4_1_test);
+#endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, mix_neon_test);
 #endif
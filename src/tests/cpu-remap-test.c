@@ -308,6 +308,123 @@ static void remap_init2_test_channels(
     pa_xfree(remap_func.state);
 }
 
+/* Some real world matrices, as set up by the resampler, rows are output
+ * channels */
+static const float downmix_7_1_to_stereo[2 * 8] = {
+    0.621f, 0.000f, 0.034f, 0.000f, 0.310f, 0.000f, 0.034f, 0.000f,
+    0.000f, 0.621f, 0.000f, 0.034f, 0.310f, 0.000f, 0.000f, 0.034f,
+};
+
+static const float downmix_5_1_to_stereo[2 * 6] = {
+    0.621f, 0.000f, 0.069f, 0.000f, 0.310f, 0.000f,
+    0.000f, 0.621f, 0.000f, 0.069f, 0.310f, 0.000f,
+};
+
+static const float downmix_5_1_to_mono[1 * 6] = {
+    0.167f, 0.167f, 0.167f, 0.167f, 0.167f, 0.167f,
+};
+
+static const float upmix_stereo_to_5_1[6 * 2] = {
+    1.0f, 0.0f,
+    0.0f, 1.0f,
+    1.0f, 0.0f,
+    0.0f, 1.0f,
+    0.5f, 0.5f,
+    0.5f, 0.5f,
+};
+
+static const float upmix_stereo_to_7_1[8 * 2] = {
+    1.0f, 0.0f,
+    0.0f, 1.0f,
+    1.0f, 0.0f,
+    0.0f, 1.0f,
+    0.5f, 0.5f,
+    0.0f, 0.0f,
+    1.0f, 0.0f,
+    0.0f, 1.0f,
+};
+
+static const float upmix_mono_to_5_1[6 * 1] = {
+    1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f,
+};
+
+/* 5.1 from FL FR RL RR FC LFE to FL FR FC LFE RL RR */
+static const float reorder_5_1[6 * 6] = {
+    1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+    0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+};
+
+static void setup_remap_matrix(
+    pa_remap_t *m,
+    pa_sample_format_t f,
+    unsigned in_channels,
+    unsigned out_channels,
+    const float *matrix) {
+
+    unsigned i, o;
+
+    m->format = f;
+    m->i_ss.channels = in_channels;
+    m->o_ss.channels = out_channels;
+
+    for (o = 0; o < out_channels; o++) {
+        for (i = 0; i < in_channels; i++) {
+            m->map_table_f[o][i] = matrix[o * in_channels + i];
+            m->map_table_i[o][i] = (int32_t) (matrix[o * in_channels + i] * 0x10000);
+        }
+    }
+}
+
+static void remap_init_test_matrix(
+        pa_init_remap_func_t init_func,
+        pa_init_remap_func_t orig_init_func,
+        pa_sample_format_t f,
+        unsigned in_channels,
+        unsigned out_channels,
+        const float *matrix) {
+
+    pa_remap_t remap_orig = {0}, remap_func = {0};
+
+    setup_remap_matrix(&remap_orig, f, in_channels, out_channels, matrix);
+    orig_init_func(&remap_orig);
+
+    setup_remap_matrix(&remap_func, f, in_channels, out_channels, matrix);
+    init_func(&remap_func);
+
+    remap_test_channels(&remap_func, &remap_orig);
+
+    pa_xfree(remap_orig.state);
+    pa_xfree(remap_func.state);
+}
+
+static void remap_init2_test_matrix(
+        pa_sample_format_t f,
+        unsigned in_channels,
+        unsigned out_channels,
+        const float *matrix) {
+
+    pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, false };
+    pa_remap_t remap_orig = {0}, remap_func = {0};
+
+    cpu_info.force_generic_code = true;
+    pa_remap_func_init(&cpu_info);
+    setup_remap_matrix(&remap_orig, f, in_channels, out_channels, matrix);
+    pa_init_remap_func(&remap_orig);
+
+    cpu_info.force_generic_code = false;
+    pa_remap_func_init(&cpu_info);
+    setup_remap_matrix(&remap_func, f, in_channels, out_channels, matrix);
+    pa_init_remap_func(&remap_func);
+
+    remap_test_channels(&remap_func, &remap_orig);
+
+    pa_xfree(remap_func.state);
+}
+
 START_TEST (remap_special_test) {
     pa_log_debug("Checking special remap (float, mono->stereo)");
     remap_init2_test_channels(PA_SAMPLE_FLOAT32NE, 1, 2, false);
@@ -355,6 +472,32 @@ START_TEST (rearrange_special_test) {
     remap_init2_test_channels(PA_SAMPLE_S32NE, 4, 4, true);
     pa_log_debug("Checking special remap (float, 4-channel rearrange)");
     remap_init2_test_channels(PA_SAMPLE_FLOAT32NE, 4, 4, true);
+
+    pa_log_debug("Checking 6-channel rearrange (s16, 5.1 reorder)");
+    remap_init2_test_matrix(PA_SAMPLE_S16NE, 6, 6, reorder_5_1);
+    pa_log_debug("Checking 6-channel rearrange (s32, 5.1 reorder)");
+    remap_init2_test_matrix(PA_SAMPLE_S32NE, 6, 6, reorder_5_1);
+    pa_log_debug("Checking 6-channel rearrange (float, 5.1 reorder)");
+    remap_init2_test_matrix(PA_SAMPLE_FLOAT32NE, 6, 6, reorder_5_1);
+}
+END_TEST
+
+START_TEST (remap_sparse_test) {
+    const pa_sample_format_t formats[] = { PA_SAMPLE_FLOAT32NE, PA_SAMPLE_S32NE, PA_SAMPLE_S16NE };
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++) {
+        pa_sample_format_t f = formats[i];
+
+        pa_log_debug("Checking sparse remap (%s, 7.1->stereo)", pa_sample_format_to_string(f));
+        remap_init2_test_matrix(f, 8, 2, downmix_7_1_to_stereo);
+        pa_log_debug("Checking sparse remap (%s, 5.1->stereo)", pa_sample_format_to_string(f));
+        remap_init2_test_matrix(f, 6, 2, downmix_5_1_to_stereo);
+        pa_log_debug("Checking mix to mono remap (%s, 5.1->mono)", pa_sample_format_to_string(f));
+        remap_init2_test_matrix(f, 6, 1, downmix_5_1_to_mono);
+        pa_log_debug("Checking sparse remap (%s, stereo->7.1)", pa_sample_format_to_string(f));
+        remap_init2_test_matrix(f, 2, 8, upmix_stereo_to_7_1);
+    }
 }
 END_TEST
 
@@ -404,6 +547,24 @@ START_TEST (remap_sse2_test) {
 
     pa_log_debug("Checking SSE2 remap (s16, mono->stereo)");
     remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 1, 2, false);
+
+    pa_log_debug("Checking SSE2 upmix remap (float, mono->5.1)");
+    remap_init_test_matrix(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 1, 6, upmix_mono_to_5_1);
+    pa_log_debug("Checking SSE2 upmix remap (float, stereo->5.1)");
+    remap_init_test_matrix(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 2, 6, upmix_stereo_to_5_1);
+    pa_log_debug("Checking SSE2 upmix remap (float, stereo->7.1)");
+    remap_init_test_matrix(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 2, 8, upmix_stereo_to_7_1);
+    pa_log_debug("Checking SSE2 upmix remap (float, mono->4-channel)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 1, 4, false);
+
+    pa_log_debug("Checking SSE2 upmix remap (s16, mono->5.1)");
+    remap_init_test_matrix(init_func, orig_init_func, PA_SAMPLE_S16NE, 1, 6, upmix_mono_to_5_1);
+    pa_log_debug("Checking SSE2 upmix remap (s16, stereo->5.1)");
+    remap_init_test_matrix(init_func, orig_init_func, PA_SAMPLE_S16NE, 2, 6, upmix_stereo_to_5_1);
+    pa_log_debug("Checking SSE2 upmix remap (s16, stereo->7.1)");
+    remap_init_test_matrix(init_func, orig_init_func, PA_SAMPLE_S16NE, 2, 8, upmix_stereo_to_7_1);
+    pa_log_debug("Checking SSE2 upmix remap (s16, mono->4-channel)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 1, 4, false);
 }
 END_TEST
 #endif /* defined (__i386__) || defined (__amd64__) */
@@ -513,6 +674,7 @@ int main(int argc, char *argv[]) {
 
     tc = tcase_create("remap");
     tcase_add_test(tc, remap_special_test);
+    tcase_add_test(tc, remap_sparse_test);
 #if defined (__i386__) || defined (__amd64__)
     tcase_add_test(tc, remap_mmx_test);
     tcase_add_test(tc, remap_sse2_test);
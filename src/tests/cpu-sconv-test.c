@@ -21,6 +21,8 @@
 
 #include <check.h>
 
+#include <pulse/xmalloc.h>
+
 #include <pulsecore/cpu-arm.h>
 #include <pulsecore/cpu-x86.h>
 #include <pulsecore/random.h>
@@ -188,6 +190,241 @@ START_TEST (sconv_sse_test) {
     run_conv_test_float_to_s16(sse_func, orig_func, 7, true, true);
 }
 END_TEST
+
+#define G711_SAMPLES 0x10000
+
+/* Checks the conversions of a companded format against the generic ones.
+ * All codes and all s16 values are converted, the results must be
+ * identical. */
+static void run_conv_test_g711(pa_sample_format_t format, pa_convert_func_t orig_func[4], pa_convert_func_t func[4], bool perf) {
+    int16_t *s, *s_ref;
+    float *f, *f_ref;
+    uint8_t *u, *u_ref;
+    unsigned i, n;
+
+    s = pa_xnew(int16_t, G711_SAMPLES);
+    s_ref = pa_xnew(int16_t, G711_SAMPLES);
+    f = pa_xnew(float, G711_SAMPLES);
+    f_ref = pa_xnew(float, G711_SAMPLES);
+    u = pa_xnew(uint8_t, G711_SAMPLES);
+    u_ref = pa_xnew(uint8_t, G711_SAMPLES);
+
+    /* Not a multiple of the vector size, to cover the tails as well */
+    n = G711_SAMPLES - 3;
+
+    /* Decoding */
+    for (i = 0; i < n; i++)
+        u[i] = (uint8_t) i;
+
+    orig_func[0](n, u, s_ref);
+    func[0](n, u, s);
+    orig_func[1](n, u, f_ref);
+    func[1](n, u, f);
+
+    for (i = 0; i < n; i++) {
+        if (s[i] != s_ref[i] || f[i] != f_ref[i]) {
+            pa_log_debug("%s decoding failed: %d: %d != %d, %f != %f", pa_sample_format_to_string(format),
+                         u[i], s[i], s_ref[i], f[i], f_ref[i]);
+            ck_abort();
+        }
+    }
+
+    /* Encoding */
+    for (i = 0; i < n; i++)
+        s[i] = (int16_t) (i - 0x8000);
+
+    orig_func[2](n, s, u_ref);
+    func[2](n, s, u);
+
+    for (i = 0; i < n; i++) {
+        if (u[i] != u_ref[i]) {
+            pa_log_debug("%s encoding failed: %d: %02x != %02x", pa_sample_format_to_string(format), s[i], u[i], u_ref[i]);
+            ck_abort();
+        }
+    }
+
+    for (i = 0; i < n; i++)
+        f[i] = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+
+    orig_func[3](n, f, u_ref);
+    func[3](n, f, u);
+
+    for (i = 0; i < n; i++) {
+        if (u[i] != u_ref[i]) {
+            pa_log_debug("%s encoding failed: %.24f: %02x != %02x", pa_sample_format_to_string(format), f[i], u[i], u_ref[i]);
+            ck_abort();
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %s sconv performance", pa_sample_format_to_string(format));
+
+        n = SAMPLES;
+
+        PA_RUNTIME_TEST_RUN_START("func (decode s16)", TIMES, TIMES2) {
+            func[0](n, u, s);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig (decode s16)", TIMES, TIMES2) {
+            orig_func[0](n, u, s_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("func (encode s16)", TIMES, TIMES2) {
+            func[2](n, s, u);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig (encode s16)", TIMES, TIMES2) {
+            orig_func[2](n, s, u_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("func (encode float)", TIMES, TIMES2) {
+            func[3](n, f, u);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig (encode float)", TIMES, TIMES2) {
+            orig_func[3](n, f, u_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_xfree(s);
+    pa_xfree(s_ref);
+    pa_xfree(f);
+    pa_xfree(f_ref);
+    pa_xfree(u);
+    pa_xfree(u_ref);
+}
+
+/* Checks the conversions of a 24 bit format against the generic ones,
+ * with random samples, the results must be identical */
+static void run_conv_test_s24(pa_sample_format_t format, pa_convert_func_t orig_func[4], pa_convert_func_t func[4], bool perf) {
+    PA_DECLARE_ALIGNED(8, uint8_t, x[SAMPLES * 4]);
+    PA_DECLARE_ALIGNED(8, uint8_t, x_ref[SAMPLES * 4]);
+    PA_DECLARE_ALIGNED(8, int16_t, s[SAMPLES]);
+    PA_DECLARE_ALIGNED(8, int16_t, s_ref[SAMPLES]);
+    PA_DECLARE_ALIGNED(8, float, f[SAMPLES]);
+    PA_DECLARE_ALIGNED(8, float, f_ref[SAMPLES]);
+    unsigned i, n = SAMPLES - 3;
+    size_t size = pa_sample_size_of_format(format);
+
+    pa_random(x, sizeof(x));
+
+    orig_func[0](n, x, s_ref);
+    func[0](n, x, s);
+    orig_func[1](n, x, f_ref);
+    func[1](n, x, f);
+
+    for (i = 0; i < n; i++) {
+        if (s[i] != s_ref[i] || f[i] != f_ref[i]) {
+            pa_log_debug("%s decoding failed: %d: %d != %d, %.24f != %.24f", pa_sample_format_to_string(format),
+                         i, s[i], s_ref[i], f[i], f_ref[i]);
+            ck_abort();
+        }
+    }
+
+    pa_random(s, sizeof(s));
+    memset(x, 0, sizeof(x));
+    memset(x_ref, 0, sizeof(x_ref));
+
+    orig_func[2](n, s, x_ref);
+    func[2](n, s, x);
+
+    if (memcmp(x, x_ref, n * size) != 0) {
+        pa_log_debug("%s encoding failed (s16)", pa_sample_format_to_string(format));
+        ck_abort();
+    }
+
+    /* Including values that need clipping */
+    for (i = 0; i < n; i++)
+        f[i] = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+    f[0] = 1.0f;
+    f[1] = -1.0f;
+
+    orig_func[3](n, f, x_ref);
+    func[3](n, f, x);
+
+    if (memcmp(x, x_ref, n * size) != 0) {
+        pa_log_debug("%s encoding failed (float)", pa_sample_format_to_string(format));
+        ck_abort();
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %s sconv performance", pa_sample_format_to_string(format));
+
+        PA_RUNTIME_TEST_RUN_START("func (to float)", TIMES, TIMES2) {
+            func[1](n, x, f);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig (to float)", TIMES, TIMES2) {
+            orig_func[1](n, x, f_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("func (from float)", TIMES, TIMES2) {
+            func[3](n, f, x);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig (from float)", TIMES, TIMES2) {
+            orig_func[3](n, f, x_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+static void get_conv_funcs(pa_sample_format_t format, pa_convert_func_t funcs[4]) {
+    funcs[0] = pa_get_convert_to_s16ne_function(format);
+    funcs[1] = pa_get_convert_to_float32ne_function(format);
+    funcs[2] = pa_get_convert_from_s16ne_function(format);
+    funcs[3] = pa_get_convert_from_float32ne_function(format);
+}
+
+START_TEST (sconv_g711_sse2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_convert_func_t orig_ulaw[4], orig_alaw[4], sse2_ulaw[4], sse2_alaw[4];
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    get_conv_funcs(PA_SAMPLE_ULAW, orig_ulaw);
+    get_conv_funcs(PA_SAMPLE_ALAW, orig_alaw);
+    pa_convert_func_init_sse(PA_CPU_X86_SSE2);
+    get_conv_funcs(PA_SAMPLE_ULAW, sse2_ulaw);
+    get_conv_funcs(PA_SAMPLE_ALAW, sse2_alaw);
+
+    pa_log_debug("Checking SSE2 sconv (ulaw)");
+    run_conv_test_g711(PA_SAMPLE_ULAW, orig_ulaw, sse2_ulaw, true);
+
+    pa_log_debug("Checking SSE2 sconv (alaw)");
+    run_conv_test_g711(PA_SAMPLE_ALAW, orig_alaw, sse2_alaw, true);
+}
+END_TEST
+
+START_TEST (sconv_s24_ssse3_test) {
+    pa_sample_format_t formats[] = { PA_SAMPLE_S24LE, PA_SAMPLE_S24BE, PA_SAMPLE_S24_32LE, PA_SAMPLE_S24_32BE };
+    pa_convert_func_t orig_funcs[4][4], ssse3_funcs[4][4];
+    pa_cpu_x86_flag_t flags = 0;
+    unsigned i;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSSE3)) {
+        pa_log_info("SSSE3 not supported. Skipping");
+        return;
+    }
+
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++)
+        get_conv_funcs(formats[i], orig_funcs[i]);
+    pa_convert_func_init_sse(PA_CPU_X86_SSSE3);
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++)
+        get_conv_funcs(formats[i], ssse3_funcs[i]);
+
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++) {
+        pa_log_debug("Checking SSSE3 sconv (%s)", pa_sample_format_to_string(formats[i]));
+        run_conv_test_s24(formats[i], orig_funcs[i], ssse3_funcs[i], i == 0 || i == 2);
+    }
+}
+END_TEST
 #endif /* defined (__i386__) || defined (__amd64__) */
 
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
@@ -247,6 +484,8 @@ int main(int argc, char *argv[]) {
 #if defined (__i386__) || defined (__amd64__)
     tcase_add_test(tc, sconv_sse2_test);
     tcase_add_test(tc, sconv_sse_test);
+    tcase_add_test(tc, sconv_g711_sse2_test);
+    tcase_add_test(tc, sconv_s24_ssse3_test);
 #endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, sconv_neon_test);
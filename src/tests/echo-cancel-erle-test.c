@@ -0,0 +1,183 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/cpu-x86.h>
+
+#include "../modules/echo-cancel/echo-cancel.h"
+
+/* Runs the pbfdaf canceller on a synthetic echo: white noise played back
+ * through a decaying random room response. After converging, the echo has
+ * to be reduced by at least MIN_ERLE_DB. Then a near end tone is added,
+ * which has to come through with less of the echo than was recorded. */
+
+#define RATE 16000
+#define ECHO_DELAY 80           /* 5 ms */
+#define ECHO_LENGTH 400         /* 25 ms */
+#define CONVERGE_SECONDS 4
+#define MIN_ERLE_DB 20.0
+#define MIN_DOUBLE_TALK_ERLE_DB 6.0
+
+static float noise(void) {
+    return (float) rand() / RAND_MAX - 0.5f;
+}
+
+static void run_erle_test(pa_cpu_info *cpu_info) {
+    pa_core core;
+    pa_echo_canceller ec;
+    pa_sample_spec rec_ss, play_ss, out_ss;
+    pa_channel_map rec_map, play_map, out_map;
+    float *room, *history, *play, *rec, *near, *out;
+    double echo_energy = 0, residual_energy = 0, dt_echo_energy = 0, near_error = 0;
+    uint32_t nframes;
+    unsigned i, j, block, n_blocks;
+
+    memset(&core, 0, sizeof(core));
+    core.cpu_info = *cpu_info;
+
+    memset(&ec, 0, sizeof(ec));
+    rec_ss.rate = play_ss.rate = out_ss.rate = RATE;
+
+    fail_unless(pa_pbfdaf_ec_init(&core, &ec, &rec_ss, &rec_map, &play_ss, &play_map, &out_ss, &out_map,
+                                  &nframes, "filter_size_ms=64"));
+    fail_unless(out_ss.format == PA_SAMPLE_FLOAT32NE && out_ss.channels == 1);
+
+    srand(0);
+
+    room = pa_xnew0(float, ECHO_DELAY + ECHO_LENGTH);
+    for (i = 0; i < ECHO_LENGTH; i++)
+        room[ECHO_DELAY + i] = 0.5f * noise() * expf(-(float) i / (ECHO_LENGTH / 5));
+
+    history = pa_xnew0(float, ECHO_DELAY + ECHO_LENGTH + nframes);
+    play = history + ECHO_DELAY + ECHO_LENGTH;
+    rec = pa_xnew(float, nframes);
+    near = pa_xnew(float, nframes);
+    out = pa_xnew(float, nframes);
+
+    /* One second more for measuring the ERLE, and one for double-talk */
+    n_blocks = (CONVERGE_SECONDS + 2) * RATE / nframes;
+
+    for (block = 0; block < n_blocks; block++) {
+        bool measure = block >= CONVERGE_SECONDS * RATE / nframes;
+        bool double_talk = block >= (CONVERGE_SECONDS + 1) * RATE / nframes;
+
+        memmove(history, history + nframes, (ECHO_DELAY + ECHO_LENGTH) * sizeof(float));
+
+        for (i = 0; i < nframes; i++) {
+            float echo = 0;
+
+            play[i] = noise();
+
+            for (j = 0; j < ECHO_DELAY + ECHO_LENGTH; j++)
+                echo += room[j] * play[(int) i - (int) j];
+
+            near[i] = double_talk ? 0.2f * sinf(2 * M_PI * 440 * (block * nframes + i) / RATE) : 0;
+            rec[i] = echo + near[i];
+        }
+
+        pa_pbfdaf_ec_run(&ec, (uint8_t *) rec, (uint8_t *) play, (uint8_t *) out);
+
+        if (!measure)
+            continue;
+
+        for (i = 0; i < nframes; i++) {
+            if (double_talk) {
+                dt_echo_energy += (rec[i] - near[i]) * (rec[i] - near[i]);
+                near_error += (out[i] - near[i]) * (out[i] - near[i]);
+            } else {
+                echo_energy += rec[i] * rec[i];
+                residual_energy += out[i] * out[i];
+            }
+        }
+    }
+
+    pa_log_debug("ERLE %0.1f dB, during double-talk %0.1f dB",
+                 10 * log10(echo_energy / residual_energy), 10 * log10(dt_echo_energy / near_error));
+
+    fail_unless(10 * log10(echo_energy / residual_energy) >= MIN_ERLE_DB);
+    /* Double-talk disturbs the adaptation, but the output must still be
+     * closer to the near end than the recording is */
+    fail_unless(10 * log10(dt_echo_energy / near_error) >= MIN_DOUBLE_TALK_ERLE_DB);
+
+    pa_pbfdaf_ec_done(&ec);
+
+    pa_xfree(room);
+    pa_xfree(history);
+    pa_xfree(rec);
+    pa_xfree(near);
+    pa_xfree(out);
+}
+
+START_TEST (pbfdaf_erle_test) {
+    pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, { 0 } };
+
+    run_erle_test(&cpu_info);
+}
+END_TEST
+
+#if defined (__i386__) || defined (__amd64__)
+START_TEST (pbfdaf_erle_sse_test) {
+    pa_cpu_info cpu_info = { PA_CPU_X86, { 0 } };
+
+    pa_cpu_get_x86_flags(&cpu_info.flags.x86);
+
+    if (!(cpu_info.flags.x86 & PA_CPU_X86_SSE)) {
+        pa_log_info("SSE not supported. Skipping");
+        return;
+    }
+
+    run_erle_test(&cpu_info);
+}
+END_TEST
+#endif
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Echo Cancel ERLE");
+    tc = tcase_create("pbfdaf");
+    tcase_add_test(tc, pbfdaf_erle_test);
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, pbfdaf_erle_sse_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -24,8 +24,14 @@
 #include <pulse/pulseaudio.h>
 #include <pulse/sample.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/random.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/cpu-arm.h>
 
 #include <pulsecore/filter/lfe-filter.h>
+#include <pulsecore/filter/crossover.h>
+
+#include "runtime-test-util.h"
 
 struct lfe_filter_test {
     pa_lfe_filter_t *lf;
@@ -172,6 +178,184 @@ START_TEST (lfe_filter_test) {
 }
 END_TEST
 
+#define MC_SAMPLES 1024
+#define MC_TIMES 100
+#define MC_TIMES2 50
+
+/* Set up one LR4 filter per channel, lowpass on the last channel (as if it
+ * were the LFE channel), highpass on the others. */
+static void setup_mc_filters(struct lr4 *lr4, int channels) {
+    int c;
+
+    for (c = 0; c < channels; c++)
+        lr4_set(&lr4[c], c == channels - 1 ? BQ_LOWPASS : BQ_HIGHPASS, 120.0 / 22050);
+}
+
+static void run_mc_float32_test(lr4_process_mc_float32_func_t func, lr4_process_mc_float32_func_t orig_func,
+                                int channels, bool correct, bool perf) {
+    struct lr4 lr4[PA_CHANNELS_MAX], lr4_ref[PA_CHANNELS_MAX];
+    float *src, *dst, *dst_ref;
+    int i;
+
+    src = pa_xnew(float, MC_SAMPLES * channels);
+    dst = pa_xnew(float, MC_SAMPLES * channels);
+    dst_ref = pa_xnew(float, MC_SAMPLES * channels);
+
+    for (i = 0; i < MC_SAMPLES * channels; i++)
+        src[i] = (float) (random() % 65536 - 32768) / 32768.0f;
+
+    setup_mc_filters(lr4, channels);
+    setup_mc_filters(lr4_ref, channels);
+
+    if (correct) {
+        /* Run twice so that the filter state carried over between blocks is
+         * checked too */
+        func(lr4, MC_SAMPLES / 2, channels, src, dst);
+        func(lr4, MC_SAMPLES / 2, channels, src + MC_SAMPLES / 2 * channels, dst + MC_SAMPLES / 2 * channels);
+        orig_func(lr4_ref, MC_SAMPLES, channels, src, dst_ref);
+
+        for (i = 0; i < MC_SAMPLES * channels; i++) {
+            if (fabsf(dst[i] - dst_ref[i]) > 1e-6f) {
+                pa_log_debug("Correctness test failed: channels=%d", channels);
+                pa_log_debug("%d: %.9f != %.9f", i, dst[i], dst_ref[i]);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %d-channel float32 crossover performance", channels);
+
+        PA_RUNTIME_TEST_RUN_START("func", MC_TIMES, MC_TIMES2) {
+            func(lr4, MC_SAMPLES, channels, src, dst);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", MC_TIMES, MC_TIMES2) {
+            orig_func(lr4_ref, MC_SAMPLES, channels, src, dst_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_xfree(src);
+    pa_xfree(dst);
+    pa_xfree(dst_ref);
+}
+
+static void run_mc_s16_test(lr4_process_mc_s16_func_t func, lr4_process_mc_s16_func_t orig_func,
+                            int channels, bool correct, bool perf) {
+    struct lr4 lr4[PA_CHANNELS_MAX], lr4_ref[PA_CHANNELS_MAX];
+    short *src, *dst, *dst_ref;
+    int i;
+
+    src = pa_xnew(short, MC_SAMPLES * channels);
+    dst = pa_xnew(short, MC_SAMPLES * channels);
+    dst_ref = pa_xnew(short, MC_SAMPLES * channels);
+
+    pa_random(src, MC_SAMPLES * channels * sizeof(short));
+
+    setup_mc_filters(lr4, channels);
+    setup_mc_filters(lr4_ref, channels);
+
+    if (correct) {
+        func(lr4, MC_SAMPLES / 2, channels, src, dst);
+        func(lr4, MC_SAMPLES / 2, channels, src + MC_SAMPLES / 2 * channels, dst + MC_SAMPLES / 2 * channels);
+        orig_func(lr4_ref, MC_SAMPLES, channels, src, dst_ref);
+
+        for (i = 0; i < MC_SAMPLES * channels; i++) {
+            if (abs(dst[i] - dst_ref[i]) > TOLERANT_VARIATION) {
+                pa_log_debug("Correctness test failed: channels=%d", channels);
+                pa_log_debug("%d: %hd != %hd", i, dst[i], dst_ref[i]);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %d-channel s16 crossover performance", channels);
+
+        PA_RUNTIME_TEST_RUN_START("func", MC_TIMES, MC_TIMES2) {
+            func(lr4, MC_SAMPLES, channels, src, dst);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", MC_TIMES, MC_TIMES2) {
+            orig_func(lr4_ref, MC_SAMPLES, channels, src, dst_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_xfree(src);
+    pa_xfree(dst);
+    pa_xfree(dst_ref);
+}
+
+static void run_mc_tests(lr4_process_mc_float32_func_t f32_func, lr4_process_mc_float32_func_t orig_f32_func,
+                         lr4_process_mc_s16_func_t s16_func, lr4_process_mc_s16_func_t orig_s16_func) {
+    /* 3 and 7 channels exercise the leftover lanes */
+    run_mc_float32_test(f32_func, orig_f32_func, 3, true, false);
+    run_mc_float32_test(f32_func, orig_f32_func, 6, true, true);
+    run_mc_float32_test(f32_func, orig_f32_func, 7, true, false);
+    run_mc_float32_test(f32_func, orig_f32_func, 8, true, true);
+
+    run_mc_s16_test(s16_func, orig_s16_func, 3, true, false);
+    run_mc_s16_test(s16_func, orig_s16_func, 6, true, true);
+    run_mc_s16_test(s16_func, orig_s16_func, 7, true, false);
+    run_mc_s16_test(s16_func, orig_s16_func, 8, true, true);
+}
+
+#if defined (__i386__) || defined (__amd64__)
+START_TEST (lfe_filter_sse_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    lr4_process_mc_float32_func_t orig_f32_func, sse_f32_func;
+    lr4_process_mc_s16_func_t orig_s16_func, sse_s16_func;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    orig_f32_func = lr4_get_process_mc_float32_func();
+    orig_s16_func = lr4_get_process_mc_s16_func();
+    pa_biquad_func_init_sse(flags);
+    sse_f32_func = lr4_get_process_mc_float32_func();
+    sse_s16_func = lr4_get_process_mc_s16_func();
+
+    pa_log_debug("Checking SSE crossover");
+    run_mc_tests(sse_f32_func, orig_f32_func, sse_s16_func, orig_s16_func);
+
+    lr4_set_process_mc_float32_func(orig_f32_func);
+    lr4_set_process_mc_s16_func(orig_s16_func);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+START_TEST (lfe_filter_neon_test) {
+    pa_cpu_arm_flag_t flags = 0;
+    lr4_process_mc_float32_func_t orig_f32_func, neon_f32_func;
+    lr4_process_mc_s16_func_t orig_s16_func, neon_s16_func;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    orig_f32_func = lr4_get_process_mc_float32_func();
+    orig_s16_func = lr4_get_process_mc_s16_func();
+    pa_biquad_func_init_neon(flags);
+    neon_f32_func = lr4_get_process_mc_float32_func();
+    neon_s16_func = lr4_get_process_mc_s16_func();
+
+    pa_log_debug("Checking NEON crossover");
+    run_mc_tests(neon_f32_func, orig_f32_func, neon_s16_func, orig_s16_func);
+
+    lr4_set_process_mc_float32_func(orig_f32_func);
+    lr4_set_process_mc_s16_func(orig_s16_func);
+}
+END_TEST
+#endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -184,7 +368,13 @@ int main(int argc, char *argv[]) {
     s = suite_create("lfe-filter");
     tc = tcase_create("lfe-filter");
     tcase_add_test(tc, lfe_filter_test);
-    tcase_set_timeout(tc, 10);
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, lfe_filter_sse_test);
+#endif
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+    tcase_add_test(tc, lfe_filter_neon_test);
+#endif
+    tcase_set_timeout(tc, 120);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
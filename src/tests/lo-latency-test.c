@@ -27,6 +27,7 @@
 #include <fcntl.h>
 
 #include <errno.h>
+#include <math.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,6 +40,11 @@
 #define CHANNELS 2
 #define N_OUT (SAMPLE_HZ * 1)
 
+/* One pulse is sent per second. The first ones are skipped while the
+ * latency settles, the rest make up the steady state statistics. */
+#define N_WARMUP_PULSES 10
+#define N_PULSES 60
+
 static float out[N_OUT][CHANNELS];
 
 pa_lo_test_context test_ctx;
@@ -46,6 +52,31 @@ static const char *context_name = NULL;
 
 static struct timeval tv_out, tv_in;
 
+static struct {
+    unsigned n, skipped;
+    double sum, sum_sq;
+    pa_usec_t min, max;
+} stats;
+
+static void add_measurement(pa_lo_test_context *ctx, pa_usec_t latency) {
+    if (stats.skipped < N_WARMUP_PULSES) {
+        stats.skipped++;
+        return;
+    }
+
+    if (stats.n == 0 || latency < stats.min)
+        stats.min = latency;
+    if (stats.n == 0 || latency > stats.max)
+        stats.max = latency;
+
+    stats.sum += (double) latency;
+    stats.sum_sq += (double) latency * latency;
+    stats.n++;
+
+    if (stats.n >= N_PULSES)
+        pa_mainloop_quit(ctx->mainloop, 0);
+}
+
 static void nop_free_cb(void *p) {
 }
 
@@ -126,6 +157,7 @@ static void read_cb(pa_stream *s, size_t nbytes, void *userdata) {
         if (cur - last > 0.4f) {
             pa_gettimeofday(&tv_in);
             fprintf(stderr, "Latency %llu\n", (unsigned long long) pa_timeval_diff(&tv_in, &tv_out));
+            add_measurement(ctx, pa_timeval_diff(&tv_in, &tv_out));
         }
 
         last = cur;
@@ -138,6 +170,7 @@ static void read_cb(pa_stream *s, size_t nbytes, void *userdata) {
 
 START_TEST (loopback_test) {
     int i, pulse_hz = SAMPLE_HZ / 1000;
+    double mean, variance, jitter;
 
     test_ctx.context_name = context_name;
 
@@ -161,6 +194,16 @@ START_TEST (loopback_test) {
     fail_unless(pa_lo_test_init(&test_ctx) == 0);
     fail_unless(pa_lo_test_run(&test_ctx) == 0);
     pa_lo_test_deinit(&test_ctx);
+
+    fail_unless(stats.n > 0);
+
+    mean = stats.sum / stats.n;
+    variance = stats.sum_sq / stats.n - mean * mean;
+    jitter = variance > 0 ? sqrt(variance) : 0;
+
+    fprintf(stderr, "Steady state latency over %u pulses: mean %0.2f ms, jitter %0.2f ms, min %0.2f ms, max %0.2f ms\n",
+            stats.n, mean / PA_USEC_PER_MSEC, jitter / PA_USEC_PER_MSEC,
+            (double) stats.min / PA_USEC_PER_MSEC, (double) stats.max / PA_USEC_PER_MSEC);
 }
 END_TEST
 
@@ -0,0 +1,227 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/util.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+
+#define N_THREADS 4
+#define N_MESSAGES 100
+
+/* Less than a ring holds, so nothing is dropped */
+#define BENCHMARK_CALLS 100
+#define BENCHMARK_ROUNDS 50
+
+static void log_target_file(const char *file) {
+    pa_log_target t = { .type = PA_LOG_FILE, .file = (char *) file };
+
+    fail_unless(pa_log_set_target(&t) == 0);
+}
+
+static void log_target_stderr(void) {
+    pa_log_target t = { .type = PA_LOG_STDERR, .file = NULL };
+
+    pa_log_set_target(&t);
+}
+
+static void thread_func(void *data) {
+    unsigned id = PA_PTR_TO_UINT(data), i;
+
+    for (i = 0; i < N_MESSAGES; i++)
+        pa_log_info("thread %u message %u", id, i);
+}
+
+START_TEST (log_async_test) {
+    pa_thread *threads[N_THREADS];
+    unsigned next[N_THREADS] = { 0, };
+    char fn[] = "/tmp/pulse-log-test-XXXXXX";
+    char line[256];
+    FILE *f;
+    unsigned i;
+    int fd;
+
+    fail_unless((fd = mkstemp(fn)) >= 0);
+    pa_close(fd);
+
+    log_target_file(fn);
+    pa_log_set_level(PA_LOG_INFO);
+    pa_log_set_async(true);
+
+    for (i = 0; i < N_THREADS; i++)
+        fail_unless((threads[i] = pa_thread_new("log-test", thread_func, PA_UINT_TO_PTR(i))) != NULL);
+
+    for (i = 0; i < N_THREADS; i++)
+        pa_thread_free(threads[i]);
+
+    /* Writes out whatever is left */
+    pa_log_set_async(false);
+    log_target_stderr();
+
+    fail_unless((f = fopen(fn, "r")) != NULL);
+
+    /* Nothing may be lost, and every thread's messages must be in order */
+    while (fgets(line, sizeof(line), f)) {
+        unsigned id, n;
+
+        fail_unless(sscanf(line, "thread %u message %u", &id, &n) == 2);
+        fail_unless(id < N_THREADS);
+        fail_unless(n == next[id]);
+        next[id]++;
+    }
+
+    fclose(f);
+    unlink(fn);
+
+    for (i = 0; i < N_THREADS; i++)
+        fail_unless(next[i] == N_MESSAGES);
+}
+END_TEST
+
+static void slow_thread_func(void *data) {
+    unsigned i;
+
+    for (i = 0; i < N_MESSAGES; i++) {
+        pa_log_info("message %u", i);
+        pa_msleep(1);
+    }
+}
+
+/* Turns async mode off while a thread is logging. Whatever it logged
+ * before has to be written out, the rest is logged synchronously. */
+START_TEST (log_async_off_test) {
+    pa_thread *thread;
+    char fn[] = "/tmp/pulse-log-test-XXXXXX";
+    char line[256];
+    FILE *f;
+    unsigned next = 0;
+    int fd;
+
+    fail_unless((fd = mkstemp(fn)) >= 0);
+    pa_close(fd);
+
+    log_target_file(fn);
+    pa_log_set_level(PA_LOG_INFO);
+    pa_log_set_async(true);
+
+    fail_unless((thread = pa_thread_new("log-test", slow_thread_func, NULL)) != NULL);
+
+    pa_msleep(N_MESSAGES / 2);
+    pa_log_set_async(false);
+
+    pa_thread_free(thread);
+    log_target_stderr();
+
+    fail_unless((f = fopen(fn, "r")) != NULL);
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned n;
+
+        fail_unless(sscanf(line, "message %u", &n) == 1);
+        fail_unless(n == next);
+        next++;
+    }
+
+    fclose(f);
+    unlink(fn);
+
+    fail_unless(next == N_MESSAGES);
+}
+END_TEST
+
+static pa_usec_t benchmark_calls(void) {
+    pa_usec_t total = 0, start;
+    unsigned i, j;
+
+    for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+        start = pa_rtclock_now();
+
+        for (j = 0; j < BENCHMARK_CALLS; j++)
+            pa_log_info("Benchmark message %u of round %u, with some numbers: %i %f.", j, i, -42, 3.14);
+
+        total += pa_rtclock_now() - start;
+
+        /* Give the drain thread time to empty the ring */
+        pa_msleep(20);
+    }
+
+    return total;
+}
+
+START_TEST (log_benchmark_test) {
+    pa_usec_t sync_time, async_time;
+    char fn[] = "/tmp/pulse-log-test-XXXXXX";
+    int fd;
+
+    fail_unless((fd = mkstemp(fn)) >= 0);
+    pa_close(fd);
+
+    log_target_file(fn);
+    pa_log_set_level(PA_LOG_INFO);
+
+    sync_time = benchmark_calls();
+
+    pa_log_set_async(true);
+    async_time = benchmark_calls();
+    pa_log_set_async(false);
+
+    log_target_stderr();
+    unlink(fn);
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_log_debug("Per call: synchronous %0.2f usec, asynchronous %0.2f usec.",
+                 (double) sync_time / (BENCHMARK_ROUNDS * BENCHMARK_CALLS),
+                 (double) async_time / (BENCHMARK_ROUNDS * BENCHMARK_CALLS));
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Log");
+    tc = tcase_create("log");
+    tcase_add_test(tc, log_async_test);
+    tcase_add_test(tc, log_async_off_test);
+    tcase_add_test(tc, log_benchmark_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
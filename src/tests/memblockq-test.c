@@ -26,11 +26,13 @@
 #include <check.h>
 
 #include <pulsecore/memblockq.h>
+#include <pulsecore/sample-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
 static const char *fixed[] = {
@@ -232,7 +234,7 @@ START_TEST (memblockq_test_initial_properties) {
 }
 END_TEST
 
-START_TEST (memblockq_test) {
+static void run_memblockq_test(bool ring) {
     int ret;
 
     pa_mempool *p;
@@ -250,7 +252,10 @@ START_TEST (memblockq_test) {
 
     silence = memchunk_from_str(p, "__");
 
-    bq = pa_memblockq_new("test memblockq", 0, 200, 10, &ss, 4, 4, 40, &silence);
+    if (ring)
+        bq = pa_memblockq_new_ring("test memblockq", 0, 200, 10, &ss, 4, 4, 40, &silence, p);
+    else
+        bq = pa_memblockq_new("test memblockq", 0, 200, 10, &ss, 4, 4, 40, &silence);
     fail_unless(bq != NULL);
     check_queue_invariants(bq);
 
@@ -332,6 +337,15 @@ START_TEST (memblockq_test) {
 
     pa_mempool_unref(p);
 }
+
+START_TEST (memblockq_test) {
+    run_memblockq_test(false);
+}
+END_TEST
+
+START_TEST (memblockq_test_ring) {
+    run_memblockq_test(true);
+}
 END_TEST
 
 START_TEST (memblockq_test_length_changes) {
@@ -632,6 +646,295 @@ START_TEST (memblockq_test_tlength_change) {
 }
 END_TEST
 
+static pa_memchunk memchunk_random(pa_mempool *p, size_t length) {
+    pa_memchunk chunk;
+    uint8_t *d;
+    size_t i;
+
+    chunk.memblock = pa_memblock_new(p, length);
+    chunk.index = 0;
+    chunk.length = length;
+
+    d = pa_memblock_acquire(chunk.memblock);
+    for (i = 0; i < length; i++)
+        d[i] = (uint8_t) (rand() % 255 + 1);
+    pa_memblock_release(chunk.memblock);
+
+    return chunk;
+}
+
+static bool memchunk_equal(const pa_memchunk *a, const pa_memchunk *b) {
+    bool equal;
+
+    if (a->length != b->length)
+        return false;
+
+    equal = memcmp(pa_memblock_acquire_chunk(a), pa_memblock_acquire_chunk(b), a->length) == 0;
+    pa_memblock_release(a->memblock);
+    pa_memblock_release(b->memblock);
+
+    return equal;
+}
+
+static pa_memchunk memchunk_copy(pa_mempool *p, pa_memchunk *chunk) {
+    pa_memchunk copy;
+
+    copy.memblock = pa_memblock_new(p, chunk->length);
+    copy.index = 0;
+    copy.length = chunk->length;
+    pa_memchunk_memcpy(&copy, chunk);
+
+    return copy;
+}
+
+#define N_KEPT 8
+
+static unsigned check_kept(pa_memchunk *kept, pa_memchunk *copies, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        fail_unless(memchunk_equal(&kept[i], &copies[i]));
+        pa_memblock_unref(kept[i].memblock);
+        pa_memblock_unref(copies[i].memblock);
+    }
+
+    return 0;
+}
+
+/* Runs random operations on a list and a ring queue, and expects the same
+ * results from both. Peeked data is kept for a while, since the ring may
+ * not overwrite it before it is released. */
+START_TEST (memblockq_test_ring_random) {
+    pa_mempool *p;
+    pa_memblockq *list, *ring;
+    pa_memchunk silence, kept[N_KEPT], copies[N_KEPT];
+    unsigned i, n_kept = 0;
+    size_t history = 0;
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 2
+    };
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    silence = memchunk_from_str(p, "____");
+
+    list = pa_memblockq_new("list memblockq", 0, 8192, 4096, &ss, 0, 256, 1024, &silence);
+    ring = pa_memblockq_new_ring("ring memblockq", 0, 8192, 4096, &ss, 0, 256, 1024, &silence, p);
+
+    srand(0);
+
+    for (i = 0; i < 20000; i++) {
+        pa_memchunk a, b;
+        size_t l = (size_t) (rand() % 128 + 1) * 4;
+
+        switch (rand() % 8) {
+            case 0:
+            case 1:
+            case 2: {
+                pa_memchunk chunk = memchunk_random(p, l);
+
+                fail_unless(pa_memblockq_push(list, &chunk) == pa_memblockq_push(ring, &chunk));
+                pa_memblock_unref(chunk.memblock);
+                break;
+            }
+
+            case 3:
+                pa_memblockq_seek(list, (int64_t) l - 256, PA_SEEK_RELATIVE, true);
+                pa_memblockq_seek(ring, (int64_t) l - 256, PA_SEEK_RELATIVE, true);
+                break;
+
+            case 4:
+                /* Only rewind what is kept as history */
+                l = PA_MIN(l, history);
+                history -= l;
+                pa_memblockq_rewind(list, l);
+                pa_memblockq_rewind(ring, l);
+                break;
+
+            case 5:
+                fail_unless(pa_memblockq_peek(list, &a) == 0);
+                fail_unless(pa_memblockq_peek(ring, &b) == 0);
+                fail_unless(memcmp(pa_memblock_acquire_chunk(&a), pa_memblock_acquire_chunk(&b), PA_MIN(a.length, b.length)) == 0);
+                pa_memblock_release(a.memblock);
+                pa_memblock_release(b.memblock);
+
+                /* Keep the ring's view together with a copy of it */
+                if (n_kept >= N_KEPT)
+                    n_kept = check_kept(kept, copies, n_kept);
+
+                kept[n_kept] = b;
+                copies[n_kept] = memchunk_copy(p, &b);
+                n_kept++;
+
+                pa_memblock_unref(a.memblock);
+                break;
+
+            default:
+                fail_unless(pa_memblockq_peek_fixed_size(list, l, &a) == 0);
+                fail_unless(pa_memblockq_peek_fixed_size(ring, l, &b) == 0);
+                fail_unless(memchunk_equal(&a, &b));
+                pa_memblock_unref(a.memblock);
+                pa_memblock_unref(b.memblock);
+
+                pa_memblockq_drop(list, l);
+                pa_memblockq_drop(ring, l);
+                history = PA_MIN(history + l, 1024);
+                break;
+        }
+
+        fail_unless(pa_memblockq_get_read_index(list) == pa_memblockq_get_read_index(ring));
+        fail_unless(pa_memblockq_get_write_index(list) == pa_memblockq_get_write_index(ring));
+    }
+
+    check_kept(kept, copies, n_kept);
+
+    pa_memblockq_free(list);
+    pa_memblockq_free(ring);
+    pa_memblock_unref(silence.memblock);
+    pa_mempool_unref(p);
+}
+END_TEST
+
+/* Holds on to the first chunk peeked from a ring queue while the ring
+ * wraps around. The ring has to copy the segment the chunk refers to,
+ * once, and must not copy anything while no chunk is held. */
+START_TEST (memblockq_test_ring_held_ref) {
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk silence, held, copy;
+    pa_memblock *segment = NULL;
+    unsigned i, n_changes = 0;
+    size_t segment_size;
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 2
+    };
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    silence = memchunk_from_str(p, "____");
+    segment_size = pa_frame_align(pa_mempool_block_size_max(p), &ss);
+
+    bq = pa_memblockq_new_ring("ring memblockq", 0, segment_size, segment_size, &ss, 0, 0, 0, &silence, p);
+
+    srand(0);
+
+    /* Go around the ring a few times */
+    for (i = 0; i < 4 * segment_size / 1024; i++) {
+        pa_memchunk chunk = memchunk_random(p, 1024);
+
+        fail_unless(pa_memblockq_push(bq, &chunk) == 0);
+
+        while (pa_memblockq_get_length(bq) > 0) {
+            pa_memchunk out;
+
+            fail_unless(pa_memblockq_peek(bq, &out) == 0);
+            fail_unless(out.length <= chunk.length);
+            fail_unless(memcmp(pa_memblock_acquire_chunk(&out), pa_memblock_acquire_chunk(&chunk), out.length) == 0);
+            pa_memblock_release(chunk.memblock);
+            pa_memblock_release(out.memblock);
+
+            if (out.memblock != segment) {
+                segment = out.memblock;
+                n_changes++;
+            }
+
+            if (i == 0) {
+                held = out;
+                copy = memchunk_copy(p, &out);
+            } else
+                pa_memblock_unref(out.memblock);
+
+            pa_memblockq_drop(bq, out.length);
+            chunk.index += out.length;
+            chunk.length -= out.length;
+        }
+
+        pa_memblock_unref(chunk.memblock);
+    }
+
+    /* The first segment, and the copy made when wrapping over the held
+     * chunk */
+    fail_unless(n_changes == 2);
+    fail_unless(held.memblock != segment);
+    fail_unless(memchunk_equal(&held, &copy));
+
+    pa_memblock_unref(held.memblock);
+    pa_memblock_unref(copy.memblock);
+
+    pa_memblockq_free(bq);
+    pa_memblock_unref(silence.memblock);
+    pa_mempool_unref(p);
+}
+END_TEST
+
+#define BENCHMARK_CHUNK 192             /* 1 ms of 48 kHz stereo S16 */
+#define BENCHMARK_BLOCK 1920            /* 10 ms */
+#define BENCHMARK_ROUNDS 20000
+
+/* Small writes and fixed size reads with some rewinding, like a sink
+ * input fed by a client that writes 1 ms at a time */
+static pa_usec_t benchmark_queue(pa_memblockq *bq, pa_mempool *p) {
+    pa_memchunk chunk, out;
+    pa_usec_t start;
+    unsigned i, j;
+
+    chunk = memchunk_random(p, BENCHMARK_CHUNK);
+
+    start = pa_rtclock_now();
+
+    for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+        for (j = 0; j < BENCHMARK_BLOCK / BENCHMARK_CHUNK; j++)
+            fail_unless(pa_memblockq_push(bq, &chunk) == 0);
+
+        fail_unless(pa_memblockq_peek_fixed_size(bq, BENCHMARK_BLOCK, &out) == 0);
+        pa_memblock_unref(out.memblock);
+        pa_memblockq_drop(bq, BENCHMARK_BLOCK);
+
+        if (i % 10 == 0) {
+            pa_memblockq_rewind(bq, BENCHMARK_BLOCK);
+            pa_memblockq_drop(bq, BENCHMARK_BLOCK);
+        }
+    }
+
+    start = pa_rtclock_now() - start;
+
+    pa_memblock_unref(chunk.memblock);
+
+    return start;
+}
+
+START_TEST (memblockq_test_benchmark) {
+    pa_mempool *p;
+    pa_memblockq *list, *ring;
+    pa_memchunk silence;
+    pa_usec_t list_time, ring_time;
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 2
+    };
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    silence = memchunk_from_str(p, "____");
+
+    /* Keep a few blocks queued, so that the list has some length */
+    list = pa_memblockq_new("list memblockq", 0, 65536, 16384, &ss, 0, 0, 16384, &silence);
+    ring = pa_memblockq_new_ring("ring memblockq", 0, 65536, 16384, &ss, 0, 0, 16384, &silence, p);
+
+    list_time = benchmark_queue(list, p);
+    ring_time = benchmark_queue(ring, p);
+
+    pa_log_debug("Per 10 ms block: list %0.2f usec, ring %0.2f usec.",
+                 (double) list_time / BENCHMARK_ROUNDS, (double) ring_time / BENCHMARK_ROUNDS);
+
+    pa_memblockq_free(list);
+    pa_memblockq_free(ring);
+    pa_memblock_unref(silence.memblock);
+    pa_mempool_unref(p);
+}
+END_TEST
 
 int main(int argc, char *argv[]) {
     int failed = 0;
@@ -647,9 +950,13 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, memchunk_from_str_test);
     tcase_add_test(tc, memblockq_test_initial_properties);
     tcase_add_test(tc, memblockq_test);
+    tcase_add_test(tc, memblockq_test_ring);
+    tcase_add_test(tc, memblockq_test_ring_random);
+    tcase_add_test(tc, memblockq_test_ring_held_ref);
     tcase_add_test(tc, memblockq_test_length_changes);
     tcase_add_test(tc, memblockq_test_pop_missing);
     tcase_add_test(tc, memblockq_test_tlength_change);
+    tcase_add_test(tc, memblockq_test_benchmark);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -319,9 +319,11 @@ START_TEST (mix_test) {
         m[0].chunk = i;
         m[0].volume.values[0] = PA_VOLUME_NORM;
         m[0].volume.channels = a.channels;
+        m[0].ramp_length = 0;
         m[1].chunk = j;
         m[1].volume.values[0] = PA_VOLUME_NORM;
         m[1].volume.channels = a.channels;
+        m[1].ramp_length = 0;
 
         k.memblock = pa_memblock_new(pool, i.length);
         k.length = i.length;
@@ -342,6 +344,140 @@ START_TEST (mix_test) {
 }
 END_TEST
 
+#define RAMP_FRAMES 1000
+
+static pa_memblock *generate_constant_block(pa_mempool *pool, const pa_sample_spec *ss) {
+    pa_memblock *r;
+    void *d;
+    unsigned i;
+
+    pa_assert_se(r = pa_memblock_new(pool, RAMP_FRAMES * pa_frame_size(ss)));
+    d = pa_memblock_acquire(r);
+
+    for (i = 0; i < RAMP_FRAMES * ss->channels; i++) {
+        if (ss->format == PA_SAMPLE_S16NE)
+            ((int16_t *) d)[i] = 0x4000;
+        else
+            ((float *) d)[i] = 0.5f;
+    }
+
+    pa_memblock_release(r);
+
+    return r;
+}
+
+static double get_sample(const pa_sample_spec *ss, const void *d, unsigned i) {
+    if (ss->format == PA_SAMPLE_S16NE)
+        return ((const int16_t *) d)[i] / (double) 0x8000;
+    else
+        return ((const float *) d)[i];
+}
+
+START_TEST (mix_ramp_test) {
+    static const pa_sample_format_t formats[] = { PA_SAMPLE_S16NE, PA_SAMPLE_FLOAT32NE };
+    pa_mempool *pool;
+    pa_sample_spec a;
+    pa_cvolume start, end;
+    unsigned f, n;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL, NULL);
+
+    a.channels = 2;
+    a.rate = 48000;
+
+    /* The left channel fades in, the right one fades out */
+    start.channels = end.channels = a.channels;
+    start.values[0] = PA_VOLUME_MUTED;
+    end.values[0] = PA_VOLUME_NORM;
+    start.values[1] = PA_VOLUME_NORM;
+    end.values[1] = PA_VOLUME_MUTED;
+
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++) {
+        pa_memchunk i, j, k;
+        pa_mix_info m[2];
+        size_t fs, ramp_length;
+        const void *d;
+        void *ptr;
+
+        a.format = formats[f];
+        fs = pa_frame_size(&a);
+
+        pa_log_debug("=== ramping: %s", pa_sample_format_to_string(a.format));
+
+        i.memblock = generate_constant_block(pool, &a);
+        i.length = pa_memblock_get_length(i.memblock);
+        i.index = 0;
+
+        /* The ramp continues past the end of the block */
+        ramp_length = 2 * i.length;
+
+        j = i;
+        pa_memblock_ref(j.memblock);
+        pa_memchunk_make_writable(&j, 0);
+        pa_volume_memchunk_ramp(&j, &a, &start, &end, ramp_length);
+
+        d = pa_memblock_acquire_chunk(&j);
+        for (n = 0; n < RAMP_FRAMES; n++) {
+            double pos = (double) n / (ramp_length / fs);
+
+            fail_unless(fabs(get_sample(&a, d, n * 2) - 0.5 * pos) < 0.001);
+            fail_unless(fabs(get_sample(&a, d, n * 2 + 1) - 0.5 * (1.0 - pos)) < 0.001);
+        }
+        pa_memblock_release(j.memblock);
+
+        /* Mixing a ramping stream with silence must give the same result,
+         * also when the ramp ends within the block */
+        for (n = 0; n < 2; n++) {
+            pa_memchunk l;
+
+            if (n == 1) {
+                ramp_length = i.length / 2;
+
+                pa_memblock_unref(j.memblock);
+                j = i;
+                pa_memblock_ref(j.memblock);
+                pa_memchunk_make_writable(&j, 0);
+                pa_volume_memchunk_ramp(&j, &a, &start, &end, ramp_length);
+            }
+
+            l.memblock = pa_memblock_new(pool, i.length);
+            l.length = i.length;
+            l.index = 0;
+            pa_silence_memchunk(&l, &a);
+
+            m[0].chunk = i;
+            m[0].volume = end;
+            m[0].ramp_volume = start;
+            m[0].ramp_length = ramp_length;
+            m[1].chunk = l;
+            pa_cvolume_reset(&m[1].volume, a.channels);
+            m[1].ramp_length = 0;
+
+            k.memblock = pa_memblock_new(pool, i.length);
+            k.length = i.length;
+            k.index = 0;
+
+            ptr = pa_memblock_acquire_chunk(&k);
+            pa_mix(m, 2, ptr, k.length, &a, NULL, false);
+            fail_unless(memcmp(ptr, pa_memblock_acquire_chunk(&j), k.length) == 0);
+            pa_memblock_release(j.memblock);
+            pa_memblock_release(k.memblock);
+
+            pa_memblock_unref(k.memblock);
+            pa_memblock_unref(l.memblock);
+        }
+
+        pa_memblock_unref(i.memblock);
+        pa_memblock_unref(j.memblock);
+    }
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -351,6 +487,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Mix");
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_test);
+    tcase_add_test(tc, mix_ramp_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -19,6 +19,7 @@
 #include <config.h>
 #endif
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -28,6 +29,18 @@
 
 #include <pulsecore/log.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/time-smoother_2.h>
+
+/* Simulated device for the drift estimator: its clock runs this much faster
+ * than the system clock, and the time stamps of the measurements are off by
+ * up to JITTER_USEC. Updates come in at increasing intervals, like in the
+ * ALSA modules. */
+#define DEVICE_RATIO 1.0005
+#define JITTER_USEC 500
+#define MIN_INTERVAL_USEC (2*PA_USEC_PER_MSEC)
+#define MAX_INTERVAL_USEC (200*PA_USEC_PER_MSEC)
+#define SIMULATION_USEC (60*PA_USEC_PER_SEC)
+#define SETTLE_USEC (10*PA_USEC_PER_SEC)
 
 START_TEST (smoother_test) {
     pa_usec_t x;
@@ -84,6 +97,114 @@ START_TEST (smoother_test) {
 }
 END_TEST
 
+START_TEST (smoother_2_test) {
+    pa_sample_spec ss = { .format = PA_SAMPLE_S16LE, .rate = 48000, .channels = 2 };
+    pa_usec_t t, interval = MIN_INTERVAL_USEC, next = 0;
+    pa_usec_t r, error, max_error = 0, old_max_error = 0, last = 0;
+    pa_smoother_2 *s;
+    pa_smoother *old;
+
+    srand(0);
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = pa_smoother_2_new(&ss, 0, true);
+    old = pa_smoother_new(PA_USEC_PER_SEC, 10*PA_USEC_PER_SEC, true, true, 5, 0, true);
+
+    pa_smoother_2_resume(s, 0);
+    pa_smoother_resume(old, 0, true);
+
+    for (t = PA_USEC_PER_MSEC; t < SIMULATION_USEC; t += PA_USEC_PER_MSEC) {
+        pa_usec_t device;
+
+        device = (pa_usec_t) (t * DEVICE_RATIO);
+
+        if (t >= next) {
+            pa_usec_t stamp = t + (pa_usec_t) (rand() % (2 * JITTER_USEC)) - JITTER_USEC;
+            uint64_t frames = device * ss.rate / PA_USEC_PER_SEC;
+
+            pa_smoother_2_put(s, stamp, (int64_t) (frames * pa_frame_size(&ss)));
+            pa_smoother_put(old, stamp, pa_bytes_to_usec(frames * pa_frame_size(&ss), &ss));
+
+            interval = PA_MIN(interval * 2, MAX_INTERVAL_USEC);
+            next = t + interval;
+        }
+
+        r = pa_smoother_2_get(s, t);
+        fail_unless(r >= last);
+        last = r;
+
+        if (t < SETTLE_USEC)
+            continue;
+
+        error = r > device ? r - device : device - r;
+        max_error = PA_MAX(max_error, error);
+
+        r = pa_smoother_get(old, t);
+        error = r > device ? r - device : device - r;
+        old_max_error = PA_MAX(old_max_error, error);
+    }
+
+    pa_log_debug("Maximum error: %llu usec (pa_smoother: %llu usec), ratio %0.6f, average error %llu usec",
+                 (unsigned long long) max_error, (unsigned long long) old_max_error,
+                 pa_smoother_2_get_ratio(s), (unsigned long long) pa_smoother_2_get_error(s));
+
+    /* Once locked, the estimate must stay well within the jitter */
+    fail_unless(max_error < JITTER_USEC);
+    fail_unless(fabs(pa_smoother_2_get_ratio(s) - DEVICE_RATIO) < 1e-4);
+
+    /* The device clock stands still while paused */
+    pa_smoother_2_pause(s, t);
+    r = pa_smoother_2_get(s, t + PA_USEC_PER_SEC);
+    fail_unless(r == pa_smoother_2_get(s, t));
+
+    pa_smoother_2_resume(s, t + PA_USEC_PER_SEC);
+    fail_unless(pa_smoother_2_get(s, t + PA_USEC_PER_SEC) >= r);
+
+    pa_smoother_free(old);
+    pa_smoother_2_free(s);
+}
+END_TEST
+
+/* A single bad measurement must not throw the estimate off, a jump of the
+ * device clock that persists must be followed */
+START_TEST (smoother_2_outlier_test) {
+    pa_sample_spec ss = { .format = PA_SAMPLE_S16LE, .rate = 48000, .channels = 2 };
+    pa_usec_t t, jump = 0;
+    pa_smoother_2 *s;
+    unsigned n;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = pa_smoother_2_new(&ss, 0, false);
+
+    for (n = 0, t = 10*PA_USEC_PER_MSEC; n < 40; n++, t += 10*PA_USEC_PER_MSEC) {
+        pa_usec_t device = t + jump;
+
+        /* One measurement that is off by 200 ms */
+        if (n == 20)
+            device += 200*PA_USEC_PER_MSEC;
+
+        /* From here on the device is 100 ms ahead for good */
+        if (n == 30)
+            jump = 100*PA_USEC_PER_MSEC;
+
+        pa_smoother_2_put(s, t, (int64_t) pa_usec_to_bytes(device, &ss));
+
+        if (n == 20)
+            fail_unless(pa_smoother_2_get(s, t) < t + PA_USEC_PER_MSEC);
+    }
+
+    t -= 10*PA_USEC_PER_MSEC;
+    fail_unless(pa_smoother_2_get(s, t) > t + jump - PA_USEC_PER_MSEC);
+    fail_unless(pa_smoother_2_get(s, t) < t + jump + PA_USEC_PER_MSEC);
+
+    pa_smoother_2_free(s);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -93,6 +214,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("Smoother");
     tc = tcase_create("smoother");
     tcase_add_test(tc, smoother_test);
+    tcase_add_test(tc, smoother_2_test);
+    tcase_add_test(tc, smoother_2_outlier_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -29,6 +29,9 @@
 #include <pulsecore/pstream.h>
 #include <pulsecore/iochannel.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/thread.h>
+
+#define N_SNAPSHOTS 1000000
 
 static unsigned packets_received;
 static unsigned packets_checksum;
@@ -121,6 +124,84 @@ START_TEST (srbchannel_test) {
 }
 END_TEST
 
+static void publish_func(void *data) {
+    pa_srbchannel_timing *t = data;
+    pa_srbchannel_timing_info info;
+    uint64_t n;
+
+    for (n = 1; n <= N_SNAPSHOTS; n++) {
+        info.timestamp = n;
+        info.read_index = (int64_t) n;
+        info.write_index = (int64_t) n;
+        info.received = n;
+        info.sink_usec = n;
+        info.underrun_for = n;
+        info.playing_for = n;
+        info.seeks = (uint32_t) n;
+        info.playing = (uint32_t) n;
+
+        pa_srbchannel_timing_publish(t, &info);
+    }
+}
+
+START_TEST (srbchannel_timing_test) {
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    pa_srbchannel *sr1, *sr2;
+    pa_srbchannel_template srt;
+    pa_srbchannel_timing_info info;
+    pa_thread *thread;
+    unsigned seq, last_seq = 0, n_read = 0;
+    uint64_t last = 0;
+
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp);
+    pa_srbchannel_export(sr1, &srt);
+    sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
+
+    fail_unless(pa_srbchannel_get_timing(sr1, PA_SRBCHANNEL_TIMING_SLOTS) == NULL);
+    fail_unless(pa_srbchannel_get_timing(sr2, PA_SRBCHANNEL_TIMING_SLOTS - 1) != NULL);
+
+    /* Nothing published yet */
+    fail_unless(pa_srbchannel_timing_read(pa_srbchannel_get_timing(sr2, 1), &info, &seq));
+    fail_unless(seq == 0);
+
+    fail_unless((thread = pa_thread_new("publish", publish_func, pa_srbchannel_get_timing(sr1, 1))) != NULL);
+
+    /* Every snapshot read must be complete, and never go back in time */
+    while (last < N_SNAPSHOTS) {
+        if (!pa_srbchannel_timing_read(pa_srbchannel_get_timing(sr2, 1), &info, &seq) || seq == 0)
+            continue;
+
+        fail_unless(seq >= last_seq);
+        fail_unless(info.timestamp >= last);
+        fail_unless(info.read_index == (int64_t) info.timestamp);
+        fail_unless(info.write_index == (int64_t) info.timestamp);
+        fail_unless(info.received == info.timestamp);
+        fail_unless(info.sink_usec == info.timestamp);
+        fail_unless(info.underrun_for == info.timestamp);
+        fail_unless(info.playing_for == info.timestamp);
+        fail_unless(info.seeks == (uint32_t) info.timestamp);
+        fail_unless(info.playing == (uint32_t) info.timestamp);
+
+        last_seq = seq;
+        last = info.timestamp;
+        n_read++;
+    }
+
+    pa_thread_free(thread);
+
+    pa_log_debug("Read %u consistent snapshots", n_read);
+
+    /* The other slots are untouched */
+    fail_unless(pa_srbchannel_timing_read(pa_srbchannel_get_timing(sr2, 0), &info, &seq));
+    fail_unless(seq == 0);
+
+    pa_srbchannel_free(sr2);
+    pa_srbchannel_free(sr1);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
 
 int main(int argc, char *argv[]) {
     int failed = 0;
@@ -134,6 +215,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("srbchannel");
     tc = tcase_create("srbchannel");
     tcase_add_test(tc, srbchannel_test);
+    tcase_add_test(tc, srbchannel_timing_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);